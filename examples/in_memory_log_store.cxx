@@ -30,6 +30,7 @@ inmem_log_store::inmem_log_store()
     , disk_emul_thread_(nullptr)
     , disk_emul_thread_stop_signal_(false)
     , disk_emul_last_durable_index_(0)
+    , num_append_batches_(0)
 {
     // Dummy entry for index 0.
     ptr<buffer> buf = buffer::alloc(sz_ulong);
@@ -126,6 +127,10 @@ void inmem_log_store::write_at(ulong index, ptr<log_entry>& entry) {
     }
 }
 
+void inmem_log_store::end_of_append_batch(ulong start, ulong cnt) {
+    num_append_batches_++;
+}
+
 ptr< std::vector< ptr<log_entry> > >
     inmem_log_store::log_entries(ulong start, ulong end)
 {
@@ -48,6 +48,8 @@ public:
 
     void write_at(ulong index, ptr<log_entry>& entry);
 
+    void end_of_append_batch(ulong start, ulong cnt);
+
     ptr<std::vector<ptr<log_entry>>> log_entries(ulong start, ulong end);
 
     ptr<std::vector<ptr<log_entry>>> log_entries_ext(
@@ -74,6 +76,8 @@ public:
 
     void set_disk_delay(raft_server* raft, size_t delay_ms);
 
+    size_t get_num_append_batches() const { return num_append_batches_; }
+
 private:
     static ptr<log_entry> make_clone(const ptr<log_entry>& entry);
 
@@ -133,6 +137,11 @@ private:
      */
     std::atomic<uint64_t> disk_emul_last_durable_index_;
 
+    /**
+     * Number of `end_of_append_batch` calls.
+     */
+    std::atomic<size_t> num_append_batches_;
+
     // Testing purpose --------------- END
 };
 
@@ -137,6 +137,14 @@ struct asio_service_options {
         , corrupted_msg_handler_(nullptr)
         , streaming_mode_(false)
         , custom_io_context_(nullptr)
+        , encoded_batch_cache_size_(4)
+        , use_crc32c_(false)
+        , recv_buffer_pool_size_(0)
+        , log_entry_slices_(false)
+        , log_compression_threshold_(0)
+        , log_compression_level_(1)
+        , compact_header_(false)
+        , multiplexing_(false)
         {}
 
     /**
@@ -310,6 +318,100 @@ struct asio_service_options {
 #else
     asio::io_context* custom_io_context_;
 #endif
+
+    /**
+     * Number of recently encoded log entry batches to keep. If the leader
+     * sends the same log entries to multiple peers, their wire encoding
+     * will be produced once and shared. Only the per-peer header will be
+     * written for each request.
+     *
+     * If zero, log entries will be encoded for each request.
+     */
+    size_t encoded_batch_cache_size_;
+
+    /**
+     * If `true`, CRC-32C (Castagnoli) will be used for the header and the
+     * entire message CRC, instead of CRC-32. CRC-32C is computed by hardware
+     * instructions (SSE4.2 or ARMv8 CRC) if the CPU supports them.
+     *
+     * Peers negotiate it: CRC-32C will be used for a connection only after
+     * the other side advertises that it supports CRC-32C, so that it is safe
+     * to enable this option on a cluster running old versions.
+     *
+     * Per-entry CRCs (`crc_on_payload_`) are not affected, since they are
+     * stored in log store.
+     */
+    bool use_crc32c_;
+
+    /**
+     * Maximum number of buffers that each session keeps per size class,
+     * for receiving messages. Size classes are powers of two from 1KB
+     * to 16MB. A buffer is reused only after the previous message
+     * (and all the log entries sliced from it) has been released.
+     *
+     * If zero, a new buffer will be allocated for each message.
+     */
+    size_t recv_buffer_pool_size_;
+
+    /**
+     * If `true`, the payload of each received log entry will be a slice
+     * of the message buffer (see `buffer::slice()`), instead of a copy.
+     *
+     * Note that the entire message buffer will remain in memory as long as
+     * any of its log entries is alive. If your log store keeps log entries
+     * in memory for a long time, it may increase memory consumption.
+     */
+    bool log_entry_slices_;
+
+    /**
+     * If non-zero, log entries in an append_entries request will be
+     * compressed (zlib) if their encoded size is equal to or greater than
+     * this value. A batch that does not get smaller is sent as it is.
+     *
+     * Compression is used for a connection only after the peer
+     * advertises that it is able to decompress, so that it is safe
+     * to enable this option on a cluster running old versions.
+     *
+     * If zero, log entries will not be compressed.
+     */
+    size_t log_compression_threshold_;
+
+    /**
+     * Compression level, from 1 (fastest) to 9 (smallest).
+     */
+    int log_compression_level_;
+
+    /**
+     * Preset dictionary for log compression, e.g., trained on typical
+     * payloads. It MUST be the same on all members, otherwise followers
+     * will fail to decompress the requests.
+     */
+    std::string log_compression_dict_;
+
+    /**
+     * If `true`, use compact headers (with variable-length integers and
+     * without source and destination IDs) on connections to peers that
+     * also enable this option. Heartbeats and batches of small log
+     * entries will be much smaller.
+     *
+     * Each connection starts with the legacy format, and switches to
+     * the compact one after both sides advertise that they support it,
+     * so that it is safe to enable this option on a cluster running
+     * old versions.
+     */
+    bool compact_header_;
+
+    /**
+     * If `true` and `streaming_mode_` is disabled, multiple requests
+     * can be in flight on a single connection, and their responses
+     * can arrive in any order. Each request carries an ID that is
+     * echoed back in its response (see `rpc_client::supports_multiplexing()`).
+     *
+     * Each connection sends one request at a time until the peer
+     * advertises that it supports this option, so that it is safe
+     * to enable this option on a cluster running old versions.
+     */
+    bool multiplexing_;
 };
 
 }
@@ -78,6 +78,31 @@ public:
      */
     static ptr<buffer> expand(const buffer& buf, uint32_t new_size);
 
+    /**
+     * Create a buffer that refers to the given range of `parent`,
+     * without copying the data. The returned buffer shares the ownership
+     * of the parent allocation, so that the memory remains valid until
+     * both the parent and all its slices are released.
+     *
+     * Position of the slice is independent of that of the parent,
+     * but the data is shared: writing to one will be visible to the other.
+     *
+     * @param parent Buffer to refer to.
+     * @param offset Offset of the range, from the beginning of `parent`.
+     * @param len Length of the range.
+     * @return buffer instance.
+     */
+    static ptr<buffer> slice(const ptr<buffer>& parent,
+                             size_t offset,
+                             size_t len);
+
+    /**
+     * Check if this buffer is a slice of another buffer.
+     *
+     * @return `true` if this buffer is created by `slice()`.
+     */
+    bool is_slice() const;
+
     /**
      * Get total size of entire buffer container, including meta section.
      *
@@ -262,6 +262,19 @@ public:
      */
     void get_buffer(ptr<buffer>& dst);
 
+    /**
+     * Read byte array of given size, and return it as a buffer.
+     *
+     * If this serializer is created with `ptr<buffer>`, the returned
+     * buffer will be a slice of it (see `buffer::slice()`), which does
+     * not copy the data. Otherwise, the data will be copied into
+     * a new buffer.
+     *
+     * @param len Size to read.
+     * @return buffer instance.
+     */
+    ptr<buffer> get_buffer_slice(size_t len);
+
     /**
      * Read 4-byte length followed by byte array, and then return them.
      * It will NOT allocate a new memory, but return the
@@ -298,6 +311,10 @@ private:
     // Reference to buffer to read or write.
     buffer& buf_;
 
+    // Pointer to the same buffer, to create slices.
+    // `nullptr` if this serializer is created with `buffer&`.
+    ptr<buffer> buf_ptr_;
+
     // Current position.
     size_t pos_;
 };
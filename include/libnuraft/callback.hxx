@@ -164,6 +164,10 @@ public:
         /**
          * Just sent an append entries request.
          * ctx: pointer to `req_msg` instance.
+         *
+         * If `raft_params::append_dispatch_threads_` is set, this
+         * callback is invoked by the dispatcher threads, without
+         * holding the Raft lock.
          */
         SentAppendEntriesReq = 20,
 
@@ -233,6 +237,8 @@ public:
 
         /**
          * Called before log is appended to the entries on follower node.
+         * For the logs in a log pack (`raft_params::use_bulk_catch_up_`),
+         * called after the pack is applied to the log store.
          * ctx: pointer to the ptr<log_entry>
          */
         PreAppendLogFollower = 31,
@@ -32,8 +32,8 @@ class rpc_client;
  * Obtain via `raft_server::open_client_req_stream`.
  *
  * `append` is not thread-safe. Callers must serialize concurrent
- * calls externally. On a non-pipelining transport
- * (`rpc_client::supports_pipelining() == false`) the caller must
+ * calls externally. On a transport supporting neither pipelining nor
+ * multiplexing (see `rpc_client`) the caller must
  * additionally wait for is_ready() to become true, indicating that
  * the previous RPC has returned.
  *
@@ -79,8 +79,8 @@ public:
     bool is_abandoned() const;
 
     /**
-     * If transport supports pipelining
-     * (asio_service_options::streaming_mode_ == true),
+     * If transport supports pipelining or multiplexing
+     * (asio_service_options::streaming_mode_ or `multiplexing_`),
      * this is always true.
      * Otherwise this returns false if there's a request in progress.
      * `append` calls are not allowed when is_ready() == false.
@@ -50,6 +50,31 @@ public:
                           const raft_params& params,
                           const raft_server::init_options& opt = raft_server::init_options());
 
+    /**
+     * Initialize Raft server whose RPC goes through io_uring.
+     * ASIO service is still created, but only for timers.
+     *
+     * @param sm State machine.
+     * @param smgr State manager.
+     * @param lg Logger.
+     * @param port_number Port number.
+     * @param asio_options ASIO options.
+     * @param uring_options io_uring service options.
+     * @param params Raft parameters.
+     * @param opt Raft server init options.
+     * @return Raft server instance.
+     *         `nullptr` on any errors, including the case that
+     *         io_uring is not supported.
+     */
+    ptr<raft_server> init(ptr<state_machine> sm,
+                          ptr<state_mgr> smgr,
+                          ptr<logger> lg,
+                          int port_number,
+                          const asio_service::options& asio_options,
+                          const uring_service::options& uring_options,
+                          const raft_params& params,
+                          const raft_server::init_options& opt = raft_server::init_options());
+
     /**
      * Shutdown Raft server and ASIO service.
      * If this function is hanging even after the given timeout,
@@ -67,6 +92,13 @@ public:
      */
     ptr<asio_service> get_asio_service() const { return asio_svc_; }
 
+    /**
+     * Get io_uring service instance.
+     *
+     * @return io_uring service instance, `nullptr` if not used.
+     */
+    ptr<uring_service> get_uring_service() const { return uring_svc_; }
+
     /**
      * Get ASIO listener.
      *
@@ -83,6 +115,7 @@ public:
 
 private:
     ptr<asio_service> asio_svc_;
+    ptr<uring_service> uring_svc_;
     std::vector<ptr<rpc_listener>> asio_listeners_;
     ptr<raft_server> raft_instance_;
 };
@@ -124,6 +124,22 @@ public:
         return cs_new<log_entry>(term, data, t);
     }
 
+    /**
+     * Same as `deserialize(buffer&)`, but the data of returned log entry
+     * will be a slice of the given buffer, instead of a copy.
+     * Hence, the given buffer will remain in memory as long as
+     * the returned log entry is alive.
+     *
+     * WARNING: It will move the position of the given `buf`.
+     */
+    static ptr<log_entry> deserialize(const ptr<buffer>& buf) {
+        ulong term = buf->get_ulong();
+        log_val_type t = static_cast<log_val_type>(buf->get_byte());
+        ptr<buffer> data = buffer::slice(buf, buf->pos(), buf->size() - buf->pos());
+        buf->pos(buf->size());
+        return cs_new<log_entry>(term, data, t);
+    }
+
     static ulong term_in_buffer(buffer& buf) {
         ulong term = buf.get_ulong();
         buf.pos(0); // reset the position
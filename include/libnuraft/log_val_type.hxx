@@ -30,6 +30,9 @@ enum log_val_type : uint8_t {
     cluster_server  = 3,
     log_pack        = 4,
     snp_sync_req    = 5,
+    // Metadata of an `app_log` sent to a witness instead of the log itself.
+    // It is not passed to the state machine.
+    app_log_meta    = 6,
     custom          = 231,
 };
 
@@ -63,11 +63,13 @@ enum msg_type {
     leader_status_request           = 30,
     leader_status_response          = 31,
     priority_change_request_v2      = 32,
+    read_index_request              = 33,
+    read_index_response             = 34,
 };
 
 inline bool ATTR_UNUSED is_valid_msg(msg_type type) {
     if ( type >= request_vote_request &&
-         type <= priority_change_request_v2 ) {
+         type <= read_index_response ) {
         return true;
     }
     return false;
@@ -108,6 +110,8 @@ inline std::string ATTR_UNUSED msg_type_to_string(msg_type type) {
     case leader_status_request:   return "leader_status_request";
     case leader_status_response:  return "leader_status_response";
     case priority_change_request_v2:    return "priority_change_request_v2";
+    case read_index_request:            return "read_index_request";
+    case read_index_response:           return "read_index_response";
     default:
         return "unknown (" + std::to_string(static_cast<int>(type)) + ")";
     }
@@ -42,12 +42,14 @@ limitations under the License.
 #include "rpc_cli_factory.hxx"
 #include "rpc_cli.hxx"
 #include "rpc_listener.hxx"
+#include "shm_service.hxx"
 #include "snapshot.hxx"
 #include "srv_config.hxx"
 #include "srv_state.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
 #include "timer_task.hxx"
+#include "uring_service.hxx"
 
 #include "launcher.hxx"
 
@@ -31,6 +31,7 @@ limitations under the License.
 
 #include <atomic>
 #include <cassert>
+#include <deque>
 
 namespace nuraft {
 
@@ -55,6 +56,7 @@ public:
         , matched_idx_(0)
         , next_log_idx_floor_(0)
         , busy_flag_(false)
+        , snapshot_busy_flag_(false)
         , deferred_free_(false)
         , pending_commit_flag_(false)
         , hb_enabled_(false)
@@ -70,6 +72,9 @@ public:
         , manual_free_(false)
         , rpc_errs_(0)
         , stale_rpc_responses_(0)
+        , last_req_seq_(0)
+        , acked_req_seq_(0)
+        , lease_ack_ts_us_(0)
         , last_sent_idx_(0)
         , cnt_not_applied_(0)
         , cnt_backward_log_probe_(0)
@@ -85,6 +90,15 @@ public:
         , rsv_msg_handler_(nullptr)
         , last_streamed_log_idx_(0)
         , bytes_in_flight_(0)
+        , append_batch_size_(0)
+        , append_batch_bytes_(0)
+        , avg_append_rtt_us_(0)
+        , append_rtt_sample_us_(0)
+        , append_rtt_sample_entries_(0)
+        , append_rtt_sample_bytes_(0)
+        , relayed_timestamp_us_(0)
+        , log_pack_declined_(false)
+        , log_pack_supported_(false)
         , snapshot_sync_is_needed_(false)
         , self_mark_down_(false)
         , l_(logger)
@@ -151,6 +165,26 @@ public:
         busy_flag_.store(false);
     }
 
+    /**
+     * Move the busy flag held for a snapshot chunk to its own flag
+     * (`snapshot_busy_flag_`), so that other requests such as
+     * heartbeats can be sent while the chunk is in flight.
+     * Only possible if the connection supports multiplexing.
+     *
+     * @return `true` if moved.
+     */
+    bool move_busy_to_snapshot() {
+        if (!supports_multiplexing()) return false;
+        bool f = false;
+        if (!snapshot_busy_flag_.compare_exchange_strong(f, true)) return false;
+        set_free();
+        return true;
+    }
+
+    bool is_snapshot_busy() {
+        return snapshot_busy_flag_;
+    }
+
     bool is_hb_enabled() const {
         return hb_enabled_;
     }
@@ -301,6 +335,10 @@ public:
     int32_t inc_stale_rpc_responses()   { return stale_rpc_responses_.fetch_add(1); }
     int32_t get_stale_rpc_responses()   { return stale_rpc_responses_; }
 
+    uint64_t get_last_req_seq() const   { return last_req_seq_; }
+    uint64_t get_acked_req_seq() const  { return acked_req_seq_; }
+    uint64_t get_lease_ack_ts_us() const { return lease_ack_ts_us_; }
+
     void set_last_sent_idx(ulong to)    { last_sent_idx_ = to; }
     ulong get_last_sent_idx() const     { return last_sent_idx_.load(); }
 
@@ -368,6 +406,61 @@ public:
         last_streamed_log_idx_.store(0);
     }
 
+    bool supports_pipelining() {
+        std::lock_guard<std::mutex> l(rpc_protector_);
+        return rpc_ &&
+               ( rpc_->supports_pipelining() ||
+                 rpc_->supports_multiplexing() );
+    }
+
+    bool supports_multiplexing() {
+        std::lock_guard<std::mutex> l(rpc_protector_);
+        return rpc_ && rpc_->supports_multiplexing();
+    }
+
+    size_t get_window_size() {
+        std::lock_guard<std::mutex> l(window_lock_);
+        return window_.size();
+    }
+
+    ulong get_window_next_idx() {
+        std::lock_guard<std::mutex> l(window_lock_);
+        return window_.empty() ? 0 : window_.back();
+    }
+
+    void push_window(ulong next_idx) {
+        std::lock_guard<std::mutex> l(window_lock_);
+        window_.push_back(next_idx);
+    }
+
+    /**
+     * Acknowledge in-flight requests in the replication window,
+     * in the order they were sent. A response acknowledges its own
+     * request, and also all earlier requests whose responses have
+     * not arrived yet, as the peer's log is contiguous.
+     *
+     * @param next_idx Next log index that the peer has confirmed.
+     * @return Number of requests acknowledged.
+     */
+    size_t ack_window(ulong next_idx) {
+        std::lock_guard<std::mutex> l(window_lock_);
+        size_t num_acked = 0;
+        while (!window_.empty() && window_.front() < next_idx) {
+            window_.pop_front();
+            num_acked++;
+        }
+        if (!window_.empty() && window_.front() == next_idx) {
+            window_.pop_front();
+            num_acked++;
+        }
+        return num_acked;
+    }
+
+    void reset_window() {
+        std::lock_guard<std::mutex> l(window_lock_);
+        window_.clear();
+    }
+
     int64_t get_bytes_in_flight() {
         return bytes_in_flight_.load();
     }
@@ -385,6 +478,51 @@ public:
         bytes_in_flight_.store(0);
     }
 
+    int32 get_append_batch_size() const {
+        return append_batch_size_;
+    }
+
+    void set_append_batch_size(int32 to) {
+        append_batch_size_ = to;
+    }
+
+    int64 get_append_batch_bytes() const {
+        return append_batch_bytes_;
+    }
+
+    void set_append_batch_bytes(int64 to) {
+        append_batch_bytes_ = to;
+    }
+
+    uint64_t get_avg_append_rtt_us() const {
+        return avg_append_rtt_us_;
+    }
+
+    void set_avg_append_rtt_us(uint64_t to) {
+        avg_append_rtt_us_ = to;
+    }
+
+    void set_append_rtt_sample(uint64_t rtt_us,
+                               size_t num_entries,
+                               size_t bytes) {
+        std::lock_guard<std::mutex> l(append_rtt_sample_lock_);
+        append_rtt_sample_us_ = rtt_us;
+        append_rtt_sample_entries_ = num_entries;
+        append_rtt_sample_bytes_ = bytes;
+    }
+
+    bool pop_append_rtt_sample(uint64_t& rtt_us_out,
+                               size_t& num_entries_out,
+                               size_t& bytes_out) {
+        std::lock_guard<std::mutex> l(append_rtt_sample_lock_);
+        if (!append_rtt_sample_entries_) return false;
+        rtt_us_out = append_rtt_sample_us_;
+        num_entries_out = append_rtt_sample_entries_;
+        bytes_out = append_rtt_sample_bytes_;
+        append_rtt_sample_entries_ = 0;
+        return true;
+    }
+
     void try_set_free(msg_type type, bool streaming);
 
     /**
@@ -446,6 +584,40 @@ public:
         return snapshot_sync_is_needed_;
     }
 
+    void set_relayed_timestamp() {
+        relayed_timestamp_us_ = timer_helper::get_timeofday_us();
+    }
+    void reset_relayed_timestamp() {
+        relayed_timestamp_us_ = 0;
+    }
+    /**
+     * Return `true` if the progress of this peer through a relay
+     * has been confirmed within the given time.
+     */
+    bool is_relayed_within(uint64_t duration_ms) const {
+        uint64_t ts_us = relayed_timestamp_us_;
+        if (!ts_us) return false;
+        uint64_t now_us = timer_helper::get_timeofday_us();
+        return now_us < ts_us + duration_ms * 1000;
+    }
+
+    void set_log_pack_declined() {
+        log_pack_declined_ = true;
+    }
+
+    bool clear_log_pack_declined() {
+        bool t = true;
+        return log_pack_declined_.compare_exchange_strong(t, false);
+    }
+
+    void set_log_pack_supported(bool to) {
+        log_pack_supported_ = to;
+    }
+
+    bool is_log_pack_supported() const {
+        return log_pack_supported_;
+    }
+
     bool is_self_mark_down() const {
         return self_mark_down_;
     }
@@ -464,6 +636,8 @@ private:
                            ptr<rpc_result>& pending_result,
                            bool streaming,
                            size_t req_size_bytes,
+                           uint64_t send_ts_us,
+                           uint64_t req_seq,
                            ptr<resp_msg>& resp,
                            ptr<rpc_exception>& err);
 
@@ -547,6 +721,12 @@ private:
      */
     std::atomic<bool> busy_flag_;
 
+    /**
+     * `true` if a snapshot chunk is in flight without holding
+     * `busy_flag_`. See `move_busy_to_snapshot()`.
+     */
+    std::atomic<bool> snapshot_busy_flag_;
+
     /**
      * `true` if the release of `busy_flag_` for the in-flight
      * non-streamed `append_entries_request` has been deferred from
@@ -629,6 +809,24 @@ private:
      */
     std::atomic<int32> stale_rpc_responses_;
 
+    /**
+     * Sequence number of the last request sent to this peer.
+     */
+    std::atomic<uint64_t> last_req_seq_;
+
+    /**
+     * The greatest sequence number of the requests that
+     * this peer has responded to.
+     */
+    std::atomic<uint64_t> acked_req_seq_;
+
+    /**
+     * The greatest send timestamp (`timer_helper::get_timeofday_us()`)
+     * of the `append_entries` requests that this peer has accepted
+     * in the same term. Used for leader lease.
+     */
+    std::atomic<uint64_t> lease_ack_ts_us_;
+
     /**
      * Start log index of the last sent append entries request.
      */
@@ -715,6 +913,80 @@ private:
      */
     std::atomic<int64_t> bytes_in_flight_;
 
+    /**
+     * Replication window: the next log index (i.e., last log index + 1)
+     * of each in-flight `append_entries` request, in the order sent.
+     * Used only when `raft_params::replication_window_batches_` is set.
+     */
+    std::deque<ulong> window_;
+
+    /**
+     * Lock for `window_`.
+     */
+    std::mutex window_lock_;
+
+    /**
+     * Maximum number of log entries in an append_entries request,
+     * chosen by the leader based on the observed latency.
+     * 0 if not decided yet.
+     */
+    std::atomic<int32> append_batch_size_;
+
+    /**
+     * Maximum total size of log entries in an append_entries request,
+     * chosen by the leader based on the observed latency.
+     * 0 if not decided yet.
+     */
+    std::atomic<int64> append_batch_bytes_;
+
+    /**
+     * Moving average of append_entries round-trip time in microseconds.
+     */
+    std::atomic<uint64_t> avg_append_rtt_us_;
+
+    /**
+     * The latest round-trip time sample of an append_entries request
+     * carrying log entries, not consumed by the leader yet.
+     */
+    uint64_t append_rtt_sample_us_;
+
+    /**
+     * The number of log entries in the request of the latest sample.
+     * 0 if there is no sample to consume.
+     */
+    size_t append_rtt_sample_entries_;
+
+    /**
+     * The total size of log entries in the request of the latest sample.
+     */
+    size_t append_rtt_sample_bytes_;
+
+    /**
+     * Lock for the latest round-trip time sample.
+     */
+    std::mutex append_rtt_sample_lock_;
+
+    /**
+     * Timestamp when the progress of this peer through a relay was
+     * confirmed last time: on the relay, when this peer accepted a
+     * relayed request; on the leader, when the relay reported it.
+     * 0 if there is no such progress.
+     */
+    std::atomic<uint64_t> relayed_timestamp_us_;
+
+    /**
+     * `true` if this peer declined the last log pack, then the next
+     * request should be a usual `append_entries`.
+     */
+    std::atomic<bool> log_pack_declined_;
+
+    /**
+     * `true` if this peer has told that it can apply log packs
+     * in `append_entries`. Cleared on reconnection, as the peer
+     * may have been restarted with a different version.
+     */
+    std::atomic<bool> log_pack_supported_;
+
     /**
      * Set to `true` if this peer was in the middle of receiving snapshot,
      * but received a normal request. In such a case, even though
@@ -104,7 +104,22 @@ struct raft_params {
         , parallel_log_appending_(false)
         , max_log_gap_in_stream_(0)
         , max_bytes_in_flight_in_stream_(0)
+        , replication_window_batches_(0)
+        , replication_window_bytes_(0)
+        , append_batch_target_latency_ms_(0)
+        , follower_group_flush_delay_ms_(0)
+        , append_dispatch_threads_(0)
+        , use_learner_relay_(false)
+        , suppress_busy_heartbeat_(false)
+        , commit_propagation_delay_ms_(0)
+        , use_bulk_catch_up_(false)
+        , leader_lease_ms_(0)
+        , lease_clock_drift_ms_(0)
+        , use_group_commit_(false)
         , max_uncommitted_log_entries_(0)
+        , share_log_entries_among_peers_(false)
+        , replication_cache_size_bytes_(0)
+        , commit_ret_ring_size_(0)
         {}
 
     raft_params& with_max_uncommitted_log_entries(uint64_t max_entries) {
@@ -717,6 +732,185 @@ public:
      */
     int64_t max_bytes_in_flight_in_stream_;
 
+    /**
+     * If greater than 1, the leader keeps up to this number of
+     * `append_entries` requests in flight for each peer, without
+     * waiting for the response of the previous one.
+     *
+     * Unlike streaming mode (`max_log_gap_in_stream_`), it works with
+     * any RPC client that can have multiple requests in flight, i.e.,
+     * `rpc_client::supports_pipelining()` or
+     * `rpc_client::supports_multiplexing()` returns `true`. Otherwise,
+     * requests are sent one by one as usual.
+     *
+     * Responses are acknowledged in the order the requests were sent.
+     * Once a request is rejected or fails, all in-flight requests are
+     * discarded and replication restarts from the last acknowledged log.
+     *
+     * If streaming mode is enabled, this parameter is ignored.
+     */
+    int32 replication_window_batches_;
+
+    /**
+     * If non-zero, the total size of log entries in flight in the
+     * replication window is limited to this value.
+     */
+    int64_t replication_window_bytes_;
+
+    /**
+     * If non-zero, the leader adjusts the batch size (the number of log
+     * entries and their total bytes) of `append_entries` requests to each
+     * peer, based on the observed round-trip time of previous requests,
+     * so as to make it close to this value (in milliseconds).
+     *
+     * The round-trip time includes the time the follower spends on
+     * appending (and flushing) the log entries, as the response is sent
+     * after that. The adjusted sizes never exceed `max_append_size_` and
+     * `max_append_size_bytes_`, and can be seen in `peer_info`.
+     *
+     * If zero, `max_append_size_` and `max_append_size_bytes_` are used
+     * as they are.
+     */
+    int32 append_batch_target_latency_ms_;
+
+    /**
+     * (Follower side)
+     * If non-zero, and the leader allows the follower to defer the response
+     * of `append_entries` requests (i.e., streaming mode or replication
+     * window), `log_store::end_of_append_batch` is not called for each
+     * request. Instead, log entries from consecutive requests are grouped
+     * and `end_of_append_batch` is called once for the whole group, at most
+     * this many milliseconds after the first request of the group.
+     * Responses of all requests in the group are sent after that.
+     *
+     * If `parallel_log_appending_` is not set, the log store should make
+     * the log entries durable in `end_of_append_batch`.
+     */
+    int32 follower_group_flush_delay_ms_;
+
+    /**
+     * (Leader side)
+     * If non-zero, `append_entries` requests are built and sent to
+     * peers by this many background threads. The Raft lock is held
+     * only to decide what to send to each peer (next log index, term,
+     * commit index), while reading log entries, building and encoding
+     * the request are done by the thread of the peer. Requests to the
+     * same peer are always handled by the same thread, in order.
+     *
+     * Useful for large clusters with big batches, so that the request
+     * to the last peer is not delayed by the log reads and
+     * serialization cost of the others. The threads are created on the
+     * first use, and a change of this value doesn't resize the existing
+     * pool. Setting it back to zero makes requests sent inline again.
+     *
+     * Note that the `SentAppendEntriesReq` callback is invoked by
+     * these threads, once the request is actually sent.
+     */
+    int32 append_dispatch_threads_;
+
+    /**
+     * If `true`, a learner whose `dc_id` is non-zero receives logs from
+     * a member in the same DC (relay), instead of from the leader.
+     * The relay is the smallest-ID voting member of that DC other than
+     * the leader, or the smallest-ID learner of that DC if there is no
+     * such voting member. The relay forwards the logs it received from
+     * the leader once they are committed, and reports the learners'
+     * progress in its responses.
+     *
+     * The leader stops sending `append_entries` to a learner while its
+     * relay keeps reporting the progress, and falls back to direct
+     * replication (including snapshot) if the reports stop for longer
+     * than the election timeout.
+     *
+     * All members should have the same value.
+     */
+    bool use_learner_relay_;
+
+    /**
+     * (Leader side)
+     * If `true`, the heartbeat to a peer is skipped if any other
+     * `append_entries` request was sent to that peer within the last
+     * heartbeat interval. The heartbeat timer is re-armed so that the
+     * gap between two requests to the same peer still does not exceed
+     * the interval.
+     */
+    bool suppress_busy_heartbeat_;
+
+    /**
+     * (Leader side)
+     * If non-zero, a newly advanced commit index is not sent to peers
+     * by a dedicated `append_entries` request right away. Instead, it is
+     * carried by the next request with new log entries, or sent after
+     * this delay (in milliseconds) to the peers that did not receive
+     * any request in the meantime, whichever comes first.
+     *
+     * Followers will see the commit index later than before by up to
+     * this delay, when there is no further client traffic.
+     */
+    int32 commit_propagation_delay_ms_;
+
+    /**
+     * (Leader side)
+     * If `true`, a voting member whose log is behind the commit index
+     * by `log_sync_stop_gap_` or more receives committed logs as a log
+     * pack (`log_store::pack`) of up to `log_sync_batch_size_` logs per
+     * request, which is applied by `log_store::apply_pack` at once.
+     * Once the gap becomes smaller than `log_sync_stop_gap_`, the usual
+     * `append_entries` is used again.
+     *
+     * The follower invokes `state_machine::pre_commit` and
+     * `cb_func::PreAppendLogFollower` for each log in a pack once
+     * the pack is applied, in the same order as the usual path.
+     *
+     * A follower tells the leader that it can apply log packs only if
+     * this flag is set, so an old or disabled follower keeps receiving
+     * the usual `append_entries`.
+     */
+    bool use_bulk_catch_up_;
+
+    /**
+     * If non-zero, enables leader lease (in milliseconds).
+     *
+     * (Follower side)
+     * A member that received a valid `append_entries` request from the
+     * current leader within this period ignores vote requests from
+     * other members, without updating its term. The leader also ignores
+     * them while its lease is valid. Vote requests for leadership
+     * transfer are not ignored.
+     *
+     * (Leader side)
+     * The leader holds the lease until this period (minus
+     * `lease_clock_drift_ms_`) elapses from the time it sent the
+     * requests that a quorum of members acknowledged. While the lease
+     * is valid, `raft_server::read_index()` returns immediately without
+     * any network round trip.
+     *
+     * All members should have the same value, and it should be smaller
+     * than `election_timeout_lower_bound_`. Otherwise, leader election
+     * after the leader's failure will be delayed until the lease expires.
+     */
+    int32 leader_lease_ms_;
+
+    /**
+     * (Leader side)
+     * The maximum difference (in milliseconds) between the elapsed times
+     * measured by the leader's clock and followers' clocks during
+     * `leader_lease_ms_`. The leader considers its lease expired
+     * earlier by this amount.
+     */
+    int32 lease_clock_drift_ms_;
+
+    /**
+     * (Leader side)
+     * If `true`, client requests submitted concurrently by multiple
+     * threads are appended as a group. Each caller puts its request
+     * into a lock-free queue, and one of them appends all the queued
+     * requests at once, under a single acquisition of the lock and a
+     * single `log_store::end_of_append_batch` call. The result of
+     * each request is still returned to its own caller.
+     */
+    bool use_group_commit_;
+
     /**
      * If non-zero, leader-side admission of new client requests will reject
      * batches that would make the local uncommitted Raft log tail exceed this
@@ -725,6 +919,45 @@ public:
      * limited by this setting.
      */
     uint64_t max_uncommitted_log_entries_;
+
+    /**
+     * If `true`, log entries read for an append_entries request will be
+     * shared with other peers requesting the same range in the same term,
+     * instead of reading them from the log store again for each peer.
+     * Then the transport layer can also reuse the wire encoding of them.
+     *
+     * With this option, `log_store::log_entries_ext` is not invoked for
+     * every peer, so `peer_id` given to that API may not be accurate.
+     */
+    bool share_log_entries_among_peers_;
+
+    /**
+     * If non-zero, the leader keeps the most recently appended log entries
+     * in memory, up to this total payload size, and reads them from there
+     * when building append_entries requests. Only the entries that are
+     * not in the cache (e.g., for a lagging follower) are read from
+     * `log_store`.
+     *
+     * The cache holds the same `log_entry` instances that are given to
+     * `log_store::append`, so that the buffers passed to `append_entries`
+     * should not be modified afterwards.
+     *
+     * If zero, log entries are always read from `log_store`.
+     */
+    size_t replication_cache_size_bytes_;
+
+    /**
+     * (Leader side)
+     * Number of slots for client requests waiting for commit. Each request
+     * takes the slot of its last log index, so that it should be larger
+     * than the number of logs that can be uncommitted at the same time.
+     * Otherwise, the requests whose slots are still occupied go to
+     * a slower map (overflow).
+     *
+     * If zero, 4096 slots are used. Applied only when the server is
+     * created, changing it at runtime doesn't resize the slots.
+     */
+    size_t commit_ret_ring_size_;
 };
 
 }
@@ -33,6 +33,7 @@ limitations under the License.
 #include "timer_task.hxx"
 #include "thread.hxx"
 
+#include <condition_variable>
 #include <list>
 #include <deque>
 #include <map>
@@ -51,6 +52,8 @@ class custom_notification_msg;
 class delayed_task_scheduler;
 class global_mgr;
 class EventAwaiter;
+class append_dispatcher;
+class log_entry_cache;
 class logger;
 class peer;
 class rpc_client;
@@ -554,6 +557,15 @@ public:
     ulong get_target_committed_log_idx() const
     { return quick_commit_index_.load(); }
 
+    /**
+     * Get the number of client requests waiting for commit, which could
+     * not take their slots as the slots were occupied by older requests.
+     * See `raft_params::commit_ret_ring_size_`.
+     *
+     * @return Number of requests.
+     */
+    size_t get_num_commit_ret_overflows() const;
+
     /**
      * Get the leader's last committed log index number.
      *
@@ -690,6 +702,9 @@ public:
             : id_(-1)
             , last_log_idx_(0)
             , last_succ_resp_us_(0)
+            , append_batch_size_(0)
+            , append_batch_bytes_(0)
+            , avg_append_rtt_us_(0)
             {}
 
         /**
@@ -707,6 +722,27 @@ public:
          * in microsecond.
          */
         ulong last_succ_resp_us_;
+
+        /**
+         * The maximum number of log entries in an append_entries request
+         * to this peer. If `append_batch_target_latency_ms_` is set, this
+         * is the value chosen by the leader. Otherwise, it is the same as
+         * `max_append_size_`.
+         */
+        int32 append_batch_size_;
+
+        /**
+         * The maximum total size of log entries in an append_entries request
+         * to this peer, in bytes. 0 means no limit.
+         */
+        int64 append_batch_bytes_;
+
+        /**
+         * Moving average of the round-trip time of append_entries requests
+         * to this peer, in microsecond. Measured only if
+         * `append_batch_target_latency_ms_` is set.
+         */
+        ulong avg_append_rtt_us_;
     };
 
     /**
@@ -987,11 +1023,59 @@ public:
      */
     ptr<cmd_result<bool>> wait_for_state_machine_commit(uint64_t target_idx);
 
+    /**
+     * Get the read index for a linearizable read, without appending
+     * a log. Only the leader can serve it.
+     *
+     * The leader confirms that it is still the leader by a round of
+     * `append_entries` acknowledged by a quorum, which is shared by all
+     * the callers arrived before the round starts. Then the result is set
+     * to the committed log index at that moment.
+     *
+     * Once the state machine commits the returned index (see
+     * `wait_for_state_machine_commit`), reading the local state machine
+     * reflects all the writes completed before this function was called.
+     *
+     * This function will return immediately, and the read index will be
+     * set to the returned `cmd_result` instance later. It fails with
+     * `NOT_LEADER` if this server is not the leader, or loses the
+     * leadership before the read index is confirmed.
+     *
+     * If leader lease is enabled (`raft_params::leader_lease_ms_`) and
+     * the lease is valid, the result is set before this function returns,
+     * without any round.
+     *
+     * @return `cmd_result` instance containing the read index.
+     */
+    ptr<cmd_result<uint64_t>> read_index();
+
+    /**
+     * Get a read index from the current leader, and wait until the local
+     * state machine commits it. Once the result is set, reading the local
+     * state machine reflects all the writes completed before this function
+     * was called, even if this server is a follower.
+     *
+     * The leader handles a single `read_index_request` on behalf of all the
+     * callers on this server that arrived before the request is sent.
+     * If this server is the leader, it is the same as `read_index` followed
+     * by `wait_for_state_machine_commit`.
+     *
+     * This function will return immediately, and the read index will be
+     * set to the returned `cmd_result` instance later. It fails with
+     * `NOT_LEADER` if the leader cannot confirm its leadership, or `FAILED`
+     * if the leader is unknown or not reachable.
+     *
+     * @return `cmd_result` instance containing the read index.
+     */
+    ptr<cmd_result<uint64_t>> read_index_from_leader();
+
 protected:
     typedef std::unordered_map<int32, ptr<peer>>::const_iterator peer_itor;
 
     struct commit_ret_elem;
+    struct commit_ret_ring;
     struct sm_watcher_elem;
+    struct cli_req_pkg;
 
     struct pre_vote_status_t {
         pre_vote_status_t()
@@ -1032,6 +1116,12 @@ protected:
      */
     struct auto_fwd_pkg;
 
+    /**
+     * Per-peer state taken under `lock_` to build an
+     * `append_entries` request.
+     */
+    struct append_entries_plan;
+
 protected:
     /**
      * Process Raft request.
@@ -1074,6 +1164,13 @@ protected:
     ptr<resp_msg> handle_cli_req(req_msg& req,
                                  const req_ext_params& ext_params,
                                  uint64_t timestamp_us);
+    ptr<resp_msg> handle_cli_req_grouped(req_msg& req,
+                                         const req_ext_params& ext_params);
+    void drain_cli_req_queue();
+    void handle_cli_reqs(std::vector<cli_req_pkg*>& pkgs);
+    ptr<resp_msg> append_cli_req(cli_req_pkg& pkg,
+                                 ulong cur_term,
+                                 ulong& last_idx);
     ptr<resp_msg> handle_cli_req_callback(ptr<commit_ret_elem> elem,
                                           ptr<resp_msg> resp);
     ptr< cmd_result< ptr<buffer> > >
@@ -1081,6 +1178,19 @@ protected:
 
     void drop_all_pending_commit_elems();
     void drop_all_sm_watcher_elems();
+    void drop_all_read_index_waiters(cmd_result_code code);
+    void start_read_index_round();
+    void check_read_index_round();
+    void notify_read_index_results();
+    uint64_t get_lease_expiry_us();
+    bool is_within_leader_lease(req_msg& req);
+    ptr<resp_msg> handle_read_index_req(req_msg& req);
+    bool request_read_index_from_leader();
+    void handle_leader_read_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err);
+    void wait_for_read_index(ptr<cmd_result<uint64_t>> ret,
+                             cmd_result<uint64_t>& read_idx_ret,
+                             ptr<std::exception>& err);
+    void drop_all_leader_read_waiters(cmd_result_code code);
 
     ptr<resp_msg> handle_ext_msg(req_msg& req,
                                  std::unique_lock<std::recursive_mutex>& guard);
@@ -1111,12 +1221,44 @@ protected:
     void request_vote(bool force_vote);
     void request_append_entries();
     bool request_append_entries(ptr<peer> p);
+    bool is_replication_window_usable(ptr<peer>& p);
+    bool send_append_entries_in_window(ptr<peer>& p);
     bool send_request(ptr<peer>& p,
                       ptr<req_msg>& msg,
                       rpc_handler& m_handler,
                       bool streaming = false);
+    void send_request_on_dispatcher(ptr<peer>& p,
+                                    ptr<req_msg>& msg,
+                                    rpc_handler& m_handler,
+                                    bool streaming);
+    bool send_heartbeat_during_snapshot(ptr<peer>& p);
+    bool dispatch_append_entries_req(ptr<peer>& p,
+                                     ptr<append_entries_plan>& plan);
+    void build_and_send_append_entries_req(ptr<peer>& p,
+                                           const append_entries_plan& plan);
+    void check_peer_recovery_on_send(ptr<peer>& p);
+    void check_srv_to_leave_on_send(ptr<peer>& p,
+                                    ulong last_log_idx,
+                                    ulong commit_idx);
     void handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err);
     void handle_append_entries_resp(resp_msg& resp);
+    void add_to_follower_append_group(ulong start_idx, ulong last_idx);
+    void flush_follower_append_group();
+    void handle_group_flush_timeout();
+    void defer_commit_propagation();
+    void handle_commit_propagation_timeout();
+    uint64_t get_follower_durable_index();
+    void complete_pending_follower_resps();
+    void adjust_append_batch_size(peer& p);
+    void fill_append_batch_info(peer& p, peer_info& info) const;
+    int32 get_relay_id(const srv_config& s_conf);
+    bool is_relayed_peer(peer& p);
+    void relay_append_entries();
+    void relay_append_entries_to(ptr<peer>& p);
+    ptr<req_msg> create_relay_append_entries_req(peer& p);
+    void handle_relay_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err);
+    void collect_relay_progress(std::vector<std::pair<int32, uint64_t>>& out);
+    void handle_relay_progress(const std::vector<std::pair<int32, uint64_t>>& progress);
     void handle_install_snapshot_resp(resp_msg& resp);
     void handle_install_snapshot_resp_new_member(resp_msg& resp);
     void handle_prevote_resp(resp_msg& resp);
@@ -1133,6 +1275,31 @@ protected:
     void reset_srv_to_join();
     void reset_srv_to_leave();
     ptr<req_msg> create_append_entries_req(ptr<peer>& pp, ulong custom_last_log_idx = 0);
+    bool prepare_append_entries_req(ptr<peer>& pp,
+                                    ulong custom_last_log_idx,
+                                    append_entries_plan& plan,
+                                    ptr<req_msg>& req_out);
+    ptr<req_msg> build_append_entries_req(ptr<peer>& pp,
+                                          const append_entries_plan& plan);
+    ptr<req_msg> create_missing_logs_req(ptr<peer>& pp,
+                                         const append_entries_plan& plan);
+    ptr<std::vector<ptr<log_entry>>> get_shared_log_entries(ulong start_idx,
+                                                             ulong end_idx,
+                                                             ulong term,
+                                                             int64 batch_size_hint,
+                                                             int32 peer_id);
+    ptr<std::vector<ptr<log_entry>>> read_log_entries(ulong start_idx,
+                                                       ulong end_idx,
+                                                       int64 batch_size_hint,
+                                                       int32 peer_id);
+    ptr<req_msg> create_log_pack_req(peer& p,
+                                     ulong last_log_idx,
+                                     ulong term,
+                                     ulong commit_idx);
+    ptr<req_msg> create_witness_snapshot_req(ptr<peer>& pp,
+                                             ulong last_log_idx,
+                                             ulong term,
+                                             ulong commit_idx);
     ptr<req_msg> create_sync_snapshot_req(ptr<peer>& pp,
                                           ulong last_log_idx,
                                           ulong term,
@@ -1169,6 +1336,7 @@ protected:
                           ptr<std::exception>& err);
     void on_retryable_req_err(ptr<peer>& p, ptr<req_msg>& req);
     ulong term_for_log(ulong log_idx);
+    ulong first_log_idx_after_term(ulong term, ulong start_idx, ulong end_idx);
 
     virtual void commit_in_bg();
     bool commit_in_bg_exec(size_t timeout_ms = 0, bool initial_commit_exec = false);
@@ -1247,6 +1415,11 @@ protected:
 
 protected:
     static const int default_snapshot_sync_block_size;
+    /**
+     * Default number of slots for `commit_ret_elems_`,
+     * if `raft_params::commit_ret_ring_size_` is not given.
+     */
+    static const size_t commit_ret_ring_size;
 
     /**
      * Current limit values.
@@ -1454,6 +1627,12 @@ protected:
      */
     bool im_learner_;
 
+    /**
+     * `true` if this server is a witness. Will participate
+     * leader election, but will not initiate it.
+     */
+    bool im_witness_;
+
     /**
      * `true` if this server is in the middle of
      * `append_entries` handler.
@@ -1504,6 +1683,58 @@ protected:
      */
     ptr<delayed_task> election_task_;
 
+    /**
+     * Follower group flush timeout handler.
+     */
+    timer_task<void>::executor group_flush_exec_;
+
+    /**
+     * Follower group flush timer.
+     */
+    ptr<delayed_task> group_flush_task_;
+
+    /**
+     * Used when `raft_params::follower_group_flush_delay_ms_` is set.
+     * The first log index of log entries appended by the follower but
+     * `end_of_append_batch` has not been called for yet.
+     * Protected by `lock_`.
+     */
+    ulong group_flush_start_idx_;
+
+    /**
+     * The last log index of the pending group above.
+     * If 0, there is no pending group.
+     */
+    ulong group_flush_last_idx_;
+
+    /**
+     * The time when the pending group was started.
+     */
+    timer_helper group_flush_timer_;
+
+    /**
+     * Deferred commit propagation timeout handler.
+     */
+    timer_task<void>::executor commit_propagation_exec_;
+
+    /**
+     * Deferred commit propagation timer.
+     */
+    ptr<delayed_task> commit_propagation_task_;
+
+    /**
+     * Used when `raft_params::commit_propagation_delay_ms_` is set.
+     * `true` if the commit index has advanced but not every peer has
+     * been sent a request since then.
+     * Protected by `lock_`.
+     */
+    bool commit_propagation_pending_;
+
+    /**
+     * The time when the latest deferred commit index advancement happened.
+     */
+    timer_helper commit_propagation_timer_;
+
     /**
      * The time when the election timer was reset last time.
      */
@@ -1682,15 +1913,32 @@ protected:
     std::mutex rpc_clients_lock_;
 
     /**
-     * Client requests waiting for replication.
-     * Only used in blocking mode.
+     * Client requests waiting for replication,
+     * addressed by their log index.
+     */
+    ptr<commit_ret_ring> commit_ret_elems_;
+
+    /**
+     * Head of the lock-free submission queue of client requests,
+     * used when `use_group_commit_` is set.
+     * Elements are pushed in reverse order.
+     */
+    std::atomic<cli_req_pkg*> cli_req_queue_head_;
+
+    /**
+     * `true` if one of the callers is draining the submission queue.
+     */
+    bool cli_req_group_draining_;
+
+    /**
+     * Lock for `cli_req_group_draining_`.
      */
-    std::map<uint64_t, ptr<commit_ret_elem>> commit_ret_elems_;
+    std::mutex cli_req_group_lock_;
 
     /**
-     * Lock for `commit_ret_elems_`.
+     * Callers waiting for the drainer.
      */
-    std::mutex commit_ret_elems_lock_;
+    std::condition_variable cli_req_group_cv_;
 
     /**
      * Map of state machine watchers.
@@ -1702,6 +1950,61 @@ protected:
      */
     std::mutex sm_watchers_lock_;
 
+    /**
+     * `read_index` callers waiting for the next round.
+     * Protected by `lock_`.
+     */
+    std::list<ptr<cmd_result<uint64_t>>> read_index_waiters_;
+
+    /**
+     * `read_index` callers waiting for the current round.
+     * Protected by `lock_`.
+     */
+    std::list<ptr<cmd_result<uint64_t>>> read_index_batch_;
+
+    /**
+     * `read_index` callers whose round is done, with the read index.
+     * Their results are set by `notify_read_index_results()`,
+     * outside `lock_`. Protected by `lock_`.
+     */
+    std::list< std::pair<ptr<cmd_result<uint64_t>>, uint64_t> >
+        read_index_results_;
+
+    /**
+     * `true` if a round for `read_index` is in progress.
+     */
+    bool read_index_round_active_;
+
+    /**
+     * Peer ID -> the sequence number of the last request sent to the peer
+     * when the current round started. A response to any later request
+     * is the acknowledgement of the round.
+     */
+    std::unordered_map<int32, uint64_t> read_index_round_seqs_;
+
+    /**
+     * Timestamp (`timer_helper::get_timeofday_us()`) when this server
+     * became the leader. Lease acknowledgements before it are ignored.
+     */
+    std::atomic<uint64_t> leader_since_us_;
+
+    /**
+     * `read_index_from_leader` callers waiting for the next request.
+     * Protected by `lock_`.
+     */
+    std::list<ptr<cmd_result<uint64_t>>> leader_read_waiters_;
+
+    /**
+     * `read_index_from_leader` callers waiting for the response
+     * of the request in flight.
+     */
+    std::list<ptr<cmd_result<uint64_t>>> leader_read_batch_;
+
+    /**
+     * `true` if a `read_index_request` is in flight.
+     */
+    bool leader_read_in_flight_;
+
     /**
      * Condition variable to invoke Raft server for
      * notifying the termination of BG commit thread.
@@ -1725,6 +2028,13 @@ protected:
      */
     rpc_handler ex_resp_handler_;
 
+    /**
+     * (Read-only)
+     * Response handler for `append_entries` requests relayed to
+     * learners, see `raft_params::use_learner_relay_`.
+     */
+    rpc_handler relay_resp_handler_;
+
     /**
      * Last snapshot instance.
      */
@@ -1735,6 +2045,12 @@ protected:
      */
     mutable std::mutex last_snapshot_lock_;
 
+    /**
+     * Lock for saving a received snapshot object, which is done
+     * without holding `lock_`.
+     */
+    std::mutex snp_obj_save_lock_;
+
     /**
      * Timer that will be reset on becoming a leader.
      */
@@ -1791,6 +2107,38 @@ protected:
     std::mutex pending_follower_resps_lock_; // may be locked while holding lock_
     std::deque<pending_follower_resp> pending_follower_resps_;
 
+    /**
+     * Used when `raft_params::share_log_entries_among_peers_` is set.
+     * The most recent log entries read for an append_entries request,
+     * which will be reused for other peers requesting the same range
+     * with the same batch size hint in the same term.
+     */
+    struct shared_log_batch
+    {
+        shared_log_batch()
+            : start_idx_(0), end_idx_(0), term_(0), size_hint_(0) {}
+        ulong start_idx_;
+        ulong end_idx_;
+        ulong term_;
+        int64 size_hint_;
+        ptr<std::vector<ptr<log_entry>>> entries_;
+    };
+    std::mutex last_log_batch_lock_;
+    shared_log_batch last_log_batch_;
+
+    /**
+     * Recently appended log entries on the leader, used when
+     * `raft_params::replication_cache_size_bytes_` is set.
+     */
+    ptr<log_entry_cache> log_cache_;
+
+    /**
+     * Worker threads that send `append_entries` requests, used when
+     * `raft_params::append_dispatch_threads_` is set.
+     * Created under `lock_` and never replaced once created.
+     */
+    ptr<append_dispatcher> append_dispatcher_;
+
     /**
      * If `true`, test mode is enabled.
      */
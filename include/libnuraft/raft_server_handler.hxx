@@ -103,6 +103,11 @@ protected:
     static ptr<peer> get_srv_to_join(raft_server* srv) {
         return srv->srv_to_join_;
     }
+
+    /// Runs the append batch size controller of a peer (for testing).
+    static void adjust_append_batch_size(raft_server* srv, peer& pp) {
+        srv->adjust_append_batch_size(pp);
+    }
 };
 
 }
@@ -46,6 +46,8 @@ public:
     // When streaming mode is enabled, no such requirement exists, and
     // requests can be pipelined, and their `when_done` callbacks are
     // called in the same order as the corresponding send() calls.
+    // If `supports_multiplexing()` is true, requests can be in flight
+    // concurrently as well, but their callbacks can be called in any order.
     //
     // On error, when_done may be called inline and/or in parallel with other when_done calls.
     virtual void send(ptr<req_msg>& req,
@@ -60,6 +62,12 @@ public:
     // handler has fired. In the main asio implementation, this
     // corresponds to asio_service_options::streaming_mode_.
     virtual bool supports_pipelining() const { return false; }
+
+    // If true, `send` may be called again before the previous send's
+    // handler has fired, but the handlers may be called in any order.
+    // In the main asio implementation, this corresponds to
+    // asio_service_options::multiplexing_ without streaming mode.
+    virtual bool supports_multiplexing() const { return false; }
 };
 
 }
@@ -0,0 +1,153 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#ifndef _SHM_SERVICE_HXX_
+#define _SHM_SERVICE_HXX_
+
+#include "pp_util.hxx"
+#include "ptr.hxx"
+#include "rpc_cli_factory.hxx"
+
+#include <string>
+
+namespace nuraft {
+
+struct shm_service_options {
+    shm_service_options()
+        : ring_size_(1024 * 1024)
+        , busy_poll_us_(0)
+        , recv_buffer_pool_size_(0)
+        , replicate_log_timestamp_(false)
+        , crc_on_entire_message_(false)
+        , crc_on_payload_(false)
+        , use_crc32c_(false)
+        , log_entry_slices_(false)
+        {}
+
+    /**
+     * Size of each ring buffer (one for each direction) of a connection.
+     * Will be rounded up to a power of 2. A message bigger than
+     * the ring is streamed through it.
+     */
+    size_t ring_size_;
+
+    /**
+     * If non-zero, an idle connection keeps polling its ring for
+     * the given time (in microseconds) before going to sleep.
+     * It reduces latency at the cost of CPU.
+     */
+    size_t busy_poll_us_;
+
+    /**
+     * Same as `asio_service_options::recv_buffer_pool_size_`.
+     */
+    size_t recv_buffer_pool_size_;
+
+    /**
+     * Same as `asio_service_options::replicate_log_timestamp_`.
+     */
+    bool replicate_log_timestamp_;
+
+    /**
+     * Same as `asio_service_options::crc_on_entire_message_`.
+     */
+    bool crc_on_entire_message_;
+
+    /**
+     * Same as `asio_service_options::crc_on_payload_`.
+     */
+    bool crc_on_payload_;
+
+    /**
+     * Same as `asio_service_options::use_crc32c_`.
+     */
+    bool use_crc32c_;
+
+    /**
+     * Same as `asio_service_options::log_entry_slices_`.
+     */
+    bool log_entry_slices_;
+};
+
+/**
+ * RPC client factory and listener for Raft servers running on
+ * the same host, based on shared memory.
+ *
+ * Each connection has a pair of single-producer single-consumer
+ * ring buffers in a memory file (`memfd`), one for each direction,
+ * and an `eventfd` for each side to wake up the other side only
+ * when it is sleeping. Both file descriptors are handed over through
+ * a Unix domain socket, which also tells each side when
+ * the other side goes away.
+ *
+ * Messages are framed in the same way as `asio_service`
+ * (without SSL and custom meta).
+ *
+ * Listeners are identified by port number, as with TCP: a client
+ * created with endpoint `[shm://]host:port` connects to the listener
+ * of `port` on this host; the host part is ignored.
+ *
+ * It does not provide a timer: `asio_service` (or any other
+ * `delayed_task_scheduler`) is still needed for Raft server.
+ */
+class shm_service_impl;
+class logger;
+class rpc_listener;
+class shm_service
+    : public rpc_client_factory {
+public:
+    using options = shm_service_options;
+
+    /**
+     * Throws `std::runtime_error` if shared memory transport
+     * is not available.
+     */
+    shm_service(const options& _opt = options(),
+                ptr<logger> _l = nullptr);
+
+    ~shm_service();
+
+    __nocopy__(shm_service);
+
+public:
+    /**
+     * Check if the OS supports `memfd` and `eventfd` (Linux only).
+     *
+     * @return `true` if supported.
+     */
+    static bool is_supported();
+
+    virtual ptr<rpc_client> create_client(const std::string& endpoint)
+                            __override__;
+
+    ptr<rpc_listener> create_rpc_listener(ushort listening_port,
+                                          ptr<logger>& l);
+
+    /**
+     * Close all connections and wait for their threads to finish.
+     */
+    void stop();
+
+private:
+    shm_service_impl* impl_;
+
+    ptr<logger> l_;
+};
+
+}
+
+#endif //_SHM_SERVICE_HXX_
@@ -42,6 +42,7 @@ public:
         , endpoint_(endpoint)
         , learner_(false)
         , new_joiner_(false)
+        , witness_(false)
         , priority_(INIT_PRIORITY)
         {}
 
@@ -57,6 +58,7 @@ public:
         , aux_(aux)
         , learner_(learner)
         , new_joiner_(false)
+        , witness_(false)
         , priority_(priority)
         {}
 
@@ -83,6 +85,10 @@ public:
 
     void set_new_joiner(bool to) { new_joiner_ = to; }
 
+    bool is_witness() const { return witness_; }
+
+    void set_witness(bool to) { witness_ = to; }
+
     int32 get_priority() const { return priority_; }
 
     void set_priority(const int32 new_val) { priority_ = new_val; }
@@ -125,6 +131,22 @@ private:
      */
     bool new_joiner_;
 
+    /**
+     * `true` if this node is a witness.
+     * Witness participates in leader election and commit quorum,
+     * but never becomes a leader. It receives only the metadata of
+     * application logs instead of their payloads: each `app_log` entry
+     * is replaced with an `app_log_meta` entry that has its CRC32
+     * (4 bytes) and original size (8 bytes), and the snapshot it
+     * receives doesn't contain any state machine data. `app_log_meta`
+     * entries are not passed to the state machine.
+     *
+     * Witness votes for a candidate regardless of its logs. Instead,
+     * a log is committed only when enough non-witness members have it,
+     * so that every election quorum contains one of them.
+     */
+    bool witness_;
+
     /**
      * Priority of this node.
      * 0 will never be a leader.
@@ -28,6 +28,8 @@ namespace nuraft {
 enum timer_task_type {
     election_timer = 0x1,
     heartbeat_timer = 0x2,
+    follower_group_flush_timer = 0x3,
+    commit_propagation_timer = 0x4,
 };
 
 template<typename T>
@@ -0,0 +1,168 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#ifndef _URING_SERVICE_HXX_
+#define _URING_SERVICE_HXX_
+
+#include "pp_util.hxx"
+#include "ptr.hxx"
+#include "rpc_cli_factory.hxx"
+
+#include <string>
+#include <vector>
+
+namespace nuraft {
+
+struct uring_service_options {
+    uring_service_options()
+        : thread_pool_size_(2)
+        , queue_depth_(256)
+        , recv_buffer_size_(64 * 1024)
+        , recv_buffer_ring_size_(64)
+        , recv_buffer_pool_size_(0)
+        , replicate_log_timestamp_(false)
+        , crc_on_entire_message_(false)
+        , crc_on_payload_(false)
+        , use_crc32c_(false)
+        , log_entry_slices_(false)
+        {}
+
+    /**
+     * Number of I/O threads. Each thread has its own ring,
+     * and each connection is served by one of them.
+     */
+    size_t thread_pool_size_;
+
+    /**
+     * Number of submission queue entries of each ring.
+     */
+    size_t queue_depth_;
+
+    /**
+     * Size of each receive buffer. Small messages arriving together
+     * are received by a single operation, and the body of a bigger
+     * message is received in place.
+     */
+    size_t recv_buffer_size_;
+
+    /**
+     * Number of receive buffers shared by all connections of each
+     * I/O thread, rounded up to a power of 2. They are registered to
+     * the ring, and each connection keeps a single multishot receive
+     * armed on them (Linux 6.0 or later).
+     *
+     * If 0, or the kernel does not support it, each connection has
+     * its own receive buffer and re-arms a receive for every completion.
+     */
+    size_t recv_buffer_ring_size_;
+
+    /**
+     * Same as `asio_service_options::recv_buffer_pool_size_`.
+     */
+    size_t recv_buffer_pool_size_;
+
+    /**
+     * Same as `asio_service_options::replicate_log_timestamp_`.
+     */
+    bool replicate_log_timestamp_;
+
+    /**
+     * Same as `asio_service_options::crc_on_entire_message_`.
+     */
+    bool crc_on_entire_message_;
+
+    /**
+     * Same as `asio_service_options::crc_on_payload_`.
+     */
+    bool crc_on_payload_;
+
+    /**
+     * Same as `asio_service_options::use_crc32c_`.
+     */
+    bool use_crc32c_;
+
+    /**
+     * Same as `asio_service_options::log_entry_slices_`.
+     */
+    bool log_entry_slices_;
+};
+
+/**
+ * RPC client factory and listener based on Linux io_uring.
+ *
+ * Each I/O thread owns a ring shared by all its connections. Each
+ * connection keeps a multishot receive armed on buffers provided to
+ * the ring (see `recv_buffer_ring_size_`), and requests and responses
+ * are sent as linked chains, so that a batch of messages costs
+ * a single system call.
+ *
+ * Sends do not use registered (fixed) buffers: messages are encoded
+ * into buffers whose lifetime is owned by the caller, so registering
+ * them would need an extra copy into the registered region, which
+ * costs more than the page pinning it saves.
+ *
+ * The wire format is the same as that of `asio_service` (without SSL and
+ * custom meta), so that a server using this class can talk to
+ * a server using `asio_service`.
+ *
+ * It does not provide a timer: `asio_service` (or any other
+ * `delayed_task_scheduler`) is still needed for Raft server.
+ */
+class uring_service_impl;
+class logger;
+class rpc_listener;
+class uring_service
+    : public rpc_client_factory {
+public:
+    using options = uring_service_options;
+
+    /**
+     * Throws `std::runtime_error` if io_uring is not available.
+     */
+    uring_service(const options& _opt = options(),
+                  ptr<logger> _l = nullptr);
+
+    ~uring_service();
+
+    __nocopy__(uring_service);
+
+public:
+    /**
+     * Check if the OS supports the io_uring features
+     * that this class needs (Linux 5.19 or later).
+     *
+     * @return `true` if supported.
+     */
+    static bool is_supported();
+
+    virtual ptr<rpc_client> create_client(const std::string& endpoint)
+                            __override__;
+
+    ptr<rpc_listener> create_rpc_listener(ushort listening_port,
+                                          ptr<logger>& l);
+
+    void stop();
+
+private:
+    uring_service_impl* impl_;
+
+    ptr<logger> l_;
+};
+
+}
+
+#endif //_URING_SERVICE_HXX_
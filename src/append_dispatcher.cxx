@@ -0,0 +1,107 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "append_dispatcher.hxx"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+namespace nuraft {
+
+append_dispatcher::append_dispatcher(size_t num_threads,
+                                     const std::string& name_prefix)
+    : name_prefix_(name_prefix)
+    , stopping_(false)
+{
+    for (size_t ii = 0; ii < num_threads; ++ii) {
+        ptr<worker> w = cs_new<worker>();
+        workers_.push_back(w);
+        w->thread_ = cs_new<nuraft_thread>( &append_dispatcher::worker_loop,
+                                            this,
+                                            ii,
+                                            w );
+    }
+}
+
+append_dispatcher::~append_dispatcher() {
+    stop();
+}
+
+bool append_dispatcher::dispatch(int32 key, const task& t, const task& on_drop) {
+    if (workers_.empty()) return false;
+
+    size_t idx = (size_t)(uint32_t)key % workers_.size();
+    ptr<worker>& w = workers_[idx];
+    {   std::lock_guard<std::mutex> l(w->lock_);
+        // Checked under the lock, so that `stop()` doesn't miss
+        // a task queued while it drains the queue.
+        if (stopping_) return false;
+        w->queue_.push_back( std::make_pair(t, on_drop) );
+    }
+    w->ea_.invoke();
+    return true;
+}
+
+void append_dispatcher::stop() {
+    stopping_ = true;
+    for (ptr<worker>& w: workers_) {
+        if (w->thread_ && w->thread_->joinable()) {
+            w->ea_.invoke();
+            w->thread_->join();
+        }
+        w->thread_.reset();
+
+        std::deque< std::pair<task, task> > dropped;
+        {   std::lock_guard<std::mutex> l(w->lock_);
+            dropped.swap(w->queue_);
+        }
+        for (auto& entry: dropped) {
+            if (entry.second) entry.second();
+        }
+    }
+}
+
+void append_dispatcher::worker_loop(size_t id, ptr<worker> w) {
+    std::string thread_name = name_prefix_ + std::to_string(id);
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+#elif __APPLE__
+    pthread_setname_np(thread_name.c_str());
+#endif
+
+    while (!stopping_) {
+        task cur_task;
+        {   std::lock_guard<std::mutex> l(w->lock_);
+            if (!w->queue_.empty()) {
+                cur_task = w->queue_.front().first;
+                w->queue_.pop_front();
+            }
+        }
+
+        if (!cur_task) {
+            // Just in case of missed wake-up.
+            w->ea_.wait_ms(1000);
+            w->ea_.reset();
+            continue;
+        }
+        cur_task();
+    }
+}
+
+}
+
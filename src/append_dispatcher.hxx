@@ -0,0 +1,103 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+#include "event_awaiter.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+#include "thread.hxx"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Fixed-size pool of threads that run tasks on behalf of the leader,
+ * e.g., encoding and sending `append_entries` requests to peers.
+ *
+ * Tasks with the same key always go to the same thread, so that they
+ * are executed in the order of `dispatch()` calls.
+ *
+ * This class is thread-safe.
+ */
+class append_dispatcher {
+public:
+    using task = std::function<void()>;
+
+    /**
+     * @param num_threads Number of worker threads.
+     * @param name_prefix Prefix of the worker thread names.
+     */
+    append_dispatcher(size_t num_threads, const std::string& name_prefix);
+
+    ~append_dispatcher();
+
+    __nocopy__(append_dispatcher);
+
+public:
+    /**
+     * Queue a task.
+     *
+     * @param key Key to choose the worker thread (e.g., peer ID).
+     * @param t Task to run.
+     * @param on_drop Optional function to be invoked instead of `t`,
+     *                if `t` is dropped by `stop()` without running.
+     * @return `false` if the dispatcher has been stopped.
+     */
+    bool dispatch(int32 key, const task& t, const task& on_drop = nullptr);
+
+    /**
+     * Stop and join all worker threads. Queued tasks are dropped,
+     * and their `on_drop` functions are invoked.
+     */
+    void stop();
+
+    /**
+     * @return Number of worker threads.
+     */
+    size_t num_threads() const { return workers_.size(); }
+
+private:
+    struct worker {
+        worker() : thread_(nullptr) {}
+
+        std::mutex lock_;
+        // Pairs of {task, on_drop}.
+        std::deque< std::pair<task, task> > queue_;
+        EventAwaiter ea_;
+        ptr<nuraft_thread> thread_;
+    };
+
+    void worker_loop(size_t id, ptr<worker> w);
+
+    std::string name_prefix_;
+
+    std::vector< ptr<worker> > workers_;
+
+    std::atomic<bool> stopping_;
+};
+
+}
+
@@ -28,6 +28,7 @@ limitations under the License.
 
 #include "asio_service.hxx"
 
+#include "buffer_pool.hxx"
 #include "buffer_serializer.hxx"
 #include "callback.hxx"
 #include "crc32.hxx"
@@ -36,6 +37,8 @@ limitations under the License.
 #include "rpc_listener.hxx"
 #include "raft_server.hxx"
 #include "raft_server_handler.hxx"
+#include "rpc_wire.hxx"
+#include "stat_mgr.hxx"
 #include "strfmt.hxx"
 #include "tracer.hxx"
 
@@ -85,77 +88,6 @@ limitations under the License.
 #define ASIO_VERSION BOOST_ASIO_VERSION
 #endif
 
-// Note: both req & resp header structures have been modified by Jung-Sang Ahn.
-//       They MUST NOT be combined with the original code.
-
-// request header:
-//     byte         marker (req = 0x0)  (1),
-//     msg_type     type                (1),
-//     int32        src                 (4),
-//     int32        dst                 (4),
-//     ulong        term                (8),
-//     ulong        last_log_term       (8),
-//     ulong        last_log_idx        (8),
-//     ulong        commit_idx          (8),
-//     int32        log data size       (4),
-//     ulong        flags + CRC32       (8),
-//     -------------------------------------
-//                  total               (54)
-#define RPC_REQ_HEADER_SIZE (4*3 + 8*5 + 1*2)
-
-// response header:
-//     byte         marker (resp = 0x1) (1),
-//     msg_type     type                (1),
-//     int32        src                 (4),
-//     int32        dst                 (4),
-//     ulong        term                (8),
-//     ulong        next_idx            (8),
-//     bool         accepted            (1),
-//     int32        ctx data dize       (4),
-//     ulong        flags + CRC32       (8),
-//     -------------------------------------
-//                  total               (39)
-#define RPC_RESP_HEADER_SIZE (4*3 + 8*3 + 1*3)
-
-#define DATA_SIZE_LEN (4)
-#define CRC_FLAGS_LEN (8)
-
-// === RPC Flags =========
-
-// If set, RPC message includes custom meta given by user.
-#define INCLUDE_META (0x1)
-
-// If set, RPC message (response) includes additional hints.
-#define INCLUDE_HINT (0x2)
-
-// If set, each log entry will contain timestamp.
-#define INCLUDE_LOG_TIMESTAMP (0x4)
-
-// If set, CRC number represents the entire message.
-#define CRC_ON_ENTIRE_MESSAGE (0x8)
-
-// If set, each log entry will contain a CRC on the payload.
-#define CRC_ON_PAYLOAD (0x10)
-
-// If set, RPC message (response) includes result code
-#define INCLUDE_RESULT_CODE (0x20)
-
-// If set, and
-//   - If it is used in a request (leader -> follower),
-//     the follower has been excluded from the quorum,
-//     determined by the leader (i.e., sender).
-//   - If it is used in a response (follower -> leader),
-//     the follower is marked down by itself.
-#define MARK_DOWN (0x40)
-
-// See `req_msg::ALLOW_ASYNC_LOG_APPENDING`.
-#define ALLOW_ASYNC_LOG_APPENDING_WIRE (0x80)
-
-// See `req_msg::CLOSE_ON_ERROR`.
-#define CLOSE_ON_ERROR_WIRE (0x100)
-
-// =======================
-
 namespace nuraft {
 
 static const size_t SSL_GRACE_PERIOD_MS = 500;
@@ -179,14 +111,41 @@ asio_service::meta_cb_params req_to_params(req_msg* req, resp_msg* resp) {
 struct pending_req_pkg {
     pending_req_pkg(ptr<req_msg>& req,
                     rpc_handler& when_done,
-                    uint64_t timeout_ms)
+                    uint64_t timeout_ms,
+                    uint64_t req_id = 0)
         : req_(req)
         , when_done_(when_done)
         , timeout_ms_(timeout_ms)
+        , req_id_(req_id)
         {}
     ptr<req_msg> req_;
     rpc_handler when_done_;
     uint64_t timeout_ms_;
+    // ID sent along with the request (multiplexing), 0 if none.
+    uint64_t req_id_;
+};
+
+// Wire encoding of log entries in an append_entries request
+// (i.e., per-entry headers and payloads), which can be shared by
+// multiple requests containing the same log entries.
+struct encoded_log_entries {
+    encoded_log_entries() : compact_(false), size_(0), compression_tried_(false) {}
+    // Log entries that `spans_` are pointing to.
+    std::vector< ptr<log_entry> > entries_;
+    // `true` if entries have compact headers.
+    bool compact_;
+    // Per-entry headers and inlined payloads.
+    ptr<buffer> buf_;
+    // Buffer sequence to send, pointing to `buf_` and payloads of `entries_`.
+    std::vector<asio::const_buffer> spans_;
+    // Total size of encoded log entries.
+    int32 size_;
+    // Protects `compression_tried_` and `compressed_`.
+    std::mutex compression_lock_;
+    // `true` if compression has been tried on this batch.
+    bool compression_tried_;
+    // Compressed log entries, `nullptr` if not compressible.
+    ptr<buffer> compressed_;
 };
 
 // NOTE:
@@ -260,6 +219,35 @@ public:
     }
     uint64_t assign_client_id() { return client_id_counter_.fetch_add(1); }
 
+    ptr<encoded_log_entries>
+        find_encoded_log_entries(const std::vector< ptr<log_entry> >& entries,
+                                 bool compact)
+    {
+        static stat_elem& cache_hits = *stat_mgr::get_instance()->create_stat
+            (stat_elem::COUNTER, "asio_encoded_batch_cache_hits");
+
+        if (!my_opt_.encoded_batch_cache_size_ || entries.empty()) return nullptr;
+        std::lock_guard<std::mutex> l(encoded_batches_lock_);
+        for (auto& entry: encoded_batches_) {
+            // Compare pointers: the same log entry objects
+            // will have the same encoding.
+            if (entry->compact_ == compact && entry->entries_ == entries) {
+                cache_hits++;
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void add_encoded_log_entries(const ptr<encoded_log_entries>& enc) {
+        if (!my_opt_.encoded_batch_cache_size_ || enc->entries_.empty()) return;
+        std::lock_guard<std::mutex> l(encoded_batches_lock_);
+        encoded_batches_.push_front(enc);
+        while (encoded_batches_.size() > my_opt_.encoded_batch_cache_size_) {
+            encoded_batches_.pop_back();
+        }
+    }
+
 private:
 #ifndef SSL_LIBRARY_NOT_FOUND
     std::string get_password(std::size_t size,
@@ -283,6 +271,8 @@ private:
     asio_service::options my_opt_;
     asio::steady_timer asio_timer_;
     std::atomic<uint64_t> client_id_counter_;
+    std::mutex encoded_batches_lock_;
+    std::list< ptr<encoded_log_entries> > encoded_batches_;
     ptr<logger> l_;
     friend asio_service;
 };
@@ -311,17 +301,23 @@ public:
         , ssl_socket_(socket_, ssl_ctx)
         , ssl_enabled_(_enable_ssl)
         , ssl_strand_(io.get_executor())
-        , use_strand_(ssl_enabled_ && impl_->get_options().streaming_mode_)
-        , flags_(0x0)
+        , use_strand_( ssl_enabled_ &&
+                       ( impl_->get_options().streaming_mode_ ||
+                         impl_->get_options().multiplexing_ ) )
         , log_data_()
         , header_(buffer::alloc(RPC_REQ_HEADER_SIZE))
+        , recv_buf_pool_(impl_->get_options().recv_buffer_pool_size_)
         , l_(logger)
         , callback_(callback)
         , src_id_(-1)
         , is_leader_(false)
         , cached_port_(0)
-        , crc_header_(0)
-        , crc_from_msg_(0)
+        , peer_supports_crc32c_(false)
+        , compact_req_(false)
+        , compact_src_(-1)
+        , compact_dst_(-1)
+        , peer_supports_compact_(false)
+        , compact_resp_(false)
     {
         p_tr( "asio rpc session created: %p. %s",
               this,
@@ -403,6 +399,11 @@ public:
     }
 
     void start(ptr<rpc_session> self) {
+        if (compact_req_) {
+            start_compact(self);
+            return;
+        }
+
         header_->pos(0);
         aa::read( ssl_enabled_, ssl_socket_, socket_,
                   asio::buffer( header_->data(), RPC_REQ_HEADER_SIZE ),
@@ -431,20 +432,25 @@ public:
             // header_->pos(0);
             buffer_serializer h_bs(header_);
             byte* header_data = header_->data_begin();
-            crc_header_ = crc32_8( header_data,
-                                   RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
-                                   0 );
 
             // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
             h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
             // uint64_t flags_and_crc = header_->get_ulong();
             uint64_t flags_and_crc = h_bs.get_u64();
-            crc_from_msg_ = flags_and_crc & (uint32_t)0xffffffff;
-            flags_ = (flags_and_crc >> 32);
+            req_hdr_.crc_from_msg_ = flags_and_crc & (uint32_t)0xffffffff;
+            req_hdr_.flags_ = (flags_and_crc >> 32);
+            if (req_hdr_.flags_ & CRC32C_SUPPORTED) {
+                peer_supports_crc32c_ = true;
+            }
+
+            req_hdr_.crc_header_ = msg_crc( req_hdr_.flags_,
+                                   header_data,
+                                   RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
+                                   0 );
 
             // Verify CRC (if entire message validation is disbaled).
-            if ( !(flags_ & CRC_ON_ENTIRE_MESSAGE) &&
-                 crc_header_ != crc_from_msg_ ) {
+            if ( !(req_hdr_.flags_ & CRC_ON_ENTIRE_MESSAGE) &&
+                 req_hdr_.crc_header_ != req_hdr_.crc_from_msg_ ) {
                 auto received_data = std::string(reinterpret_cast<char *>(header_data), RPC_REQ_HEADER_SIZE);
                 std::stringstream ss;
                 for (auto ch : received_data) {
@@ -452,7 +458,7 @@ public:
                 }
                 auto received_data_bytes = ss.str();
                 p_er("CRC mismatch: local calculation %x, from header %x, message: %s, message in bytes: %s: received from socket %s:%u",
-                     crc_header_, crc_from_msg_, received_data.c_str(), received_data_bytes.c_str(), cached_address_.c_str(), cached_port_);
+                     req_hdr_.crc_header_, req_hdr_.crc_from_msg_, received_data.c_str(), received_data_bytes.c_str(), cached_address_.c_str(), cached_port_);
 
                 if (impl_->get_options().corrupted_msg_handler_) {
                     impl_->get_options().corrupted_msg_handler_(header_, nullptr);
@@ -490,10 +496,17 @@ public:
                 return;
             }
 
-            // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
-            // int32 data_size = header_->get_int();
-            h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
+            req_hdr_.type_ = m_type;
+            req_hdr_.src_ = h_bs.get_i32();
+            req_hdr_.dst_ = h_bs.get_i32();
+            req_hdr_.term_ = h_bs.get_u64();
+            req_hdr_.last_log_term_ = h_bs.get_u64();
+            req_hdr_.last_log_idx_ = h_bs.get_u64();
+            req_hdr_.commit_idx_ = h_bs.get_u64();
+            req_hdr_.compact_ = false;
+
             int32 data_size = h_bs.get_i32();
+            req_hdr_.data_size_ = data_size;
             // Up to 1GB.
             if (data_size < 0) {
                 p_er("bad log data size in the header %d, stop "
@@ -512,13 +525,24 @@ public:
                 p_wn("large data size in the header %d", data_size);
             }
 
+            if ( (req_hdr_.flags_ & COMPACT_HEADER_SUPPORTED) &&
+                 impl_->get_options().compact_header_ ) {
+                peer_supports_compact_ = true;
+            }
+            if (req_hdr_.flags_ & COMPACT_HEADER_FOLLOWS) {
+                // Next requests will omit src and dst.
+                compact_req_ = true;
+                compact_src_ = req_hdr_.src_;
+                compact_dst_ = req_hdr_.dst_;
+            }
+
             if (data_size == 0) {
                 // Don't carry data, immediately process request.
                 this->read_complete(header_, nullptr);
 
             } else {
                 // Carry some data, need to read further.
-                ptr<buffer> log_ctx = buffer::alloc((size_t)data_size);
+                ptr<buffer> log_ctx = recv_buf_pool_.acquire((size_t)data_size);
                 aa::read( ssl_enabled_, ssl_socket_, socket_,
                           asio::buffer( log_ctx->data(),
                                         (size_t)data_size ),
@@ -533,6 +557,55 @@ public:
                    use_strand_ ? &ssl_strand_ : nullptr );
     }
 
+    void start_compact(ptr<rpc_session> self) {
+        header_->pos(0);
+        aa::read( ssl_enabled_, ssl_socket_, socket_,
+                  asio::buffer( header_->data(), RPC_COMPACT_PREFIX_SIZE ),
+                  [this, self]
+                  (const ERROR_CODE& err, size_t) -> void
+        {
+            if (err) {
+                p_er( "session %" PRIu64 " failed to read compact rpc header "
+                      "from socket %s:%u due to error %d, %s, ref count %" PRIu64 "",
+                      session_id_,
+                      cached_address_.c_str(),
+                      cached_port_,
+                      err.value(),
+                      err.message().c_str(),
+                      self.use_count() );
+                this->request_stop();
+                return;
+            }
+
+            size_t rest_size = 0;
+            std::string err_msg;
+            if ( !rpc_wire::decode_compact_prefix
+                  ( *header_, 0x2, rest_size, err_msg ) ) {
+                p_er("%s, received from socket %s:%u",
+                     err_msg.c_str(), cached_address_.c_str(), cached_port_);
+
+                if (impl_->get_options().corrupted_msg_handler_) {
+                    impl_->get_options().corrupted_msg_handler_(header_, nullptr);
+                }
+
+                this->request_stop();
+                return;
+            }
+
+            // Read the rest of the header and the data at once.
+            ptr<buffer> msg_buf = recv_buf_pool_.acquire(rest_size);
+            aa::read( ssl_enabled_, ssl_socket_, socket_,
+                      asio::buffer( msg_buf->data(), rest_size ),
+                      std::bind( &rpc_session::read_compact_msg,
+                                 self,
+                                 msg_buf,
+                                 std::placeholders::_1,
+                                 std::placeholders::_2 ),
+                      use_strand_ ? &ssl_strand_ : nullptr );
+        },
+                  use_strand_ ? &ssl_strand_ : nullptr );
+    }
+
     ssl_socket::lowest_layer_type& socket() {
         return ssl_socket_.lowest_layer();
     }
@@ -631,6 +704,45 @@ private:
         }
     }
 
+    void read_compact_msg(ptr<buffer> msg_buf,
+                          const ERROR_CODE& err,
+                          size_t bytes_read) {
+        if (err) {
+            p_er( "session %" PRIu64 " failed to read compact rpc message "
+                  "from socket due to error %d, %s",
+                  session_id_,
+                  err.value(),
+                  err.message().c_str() );
+            this->request_stop();
+            return;
+        }
+
+        size_t data_pos = 0;
+        std::string err_msg;
+        if ( !rpc_wire::decode_compact_req_header
+              ( *header_, *msg_buf, compact_src_, compact_dst_,
+                req_hdr_, data_pos, err_msg ) ) {
+            p_er("%s, received from socket %s:%u",
+                 err_msg.c_str(), cached_address_.c_str(), cached_port_);
+
+            if (impl_->get_options().corrupted_msg_handler_) {
+                impl_->get_options().corrupted_msg_handler_(header_, msg_buf);
+            }
+
+            this->request_stop();
+            return;
+        }
+        if (req_hdr_.flags_ & CRC32C_SUPPORTED) {
+            peer_supports_crc32c_ = true;
+        }
+
+        ptr<buffer> log_ctx;
+        if (req_hdr_.data_size_) {
+            log_ctx = buffer::slice(msg_buf, data_pos, req_hdr_.data_size_);
+        }
+        this->read_complete(header_, log_ctx);
+    }
+
     static void update_resp_with_async_result(resp_msg* resp,
                                               cmd_result<ptr<buffer>, ptr<std::exception>>& res,
                                               ptr<std::exception>& ) {
@@ -646,38 +758,27 @@ private:
         ptr<rpc_session> self = this->shared_from_this();
 
        try {
-        // Deprecate `buffer::get` and use `buffer_serializer`.
-        // hdr->pos(1);
-        // msg_type t = (msg_type)hdr->get_byte();
-        // int32 src = hdr->get_int();
-        // int32 dst = hdr->get_int();
-        // ulong term = hdr->get_ulong();
-        // ulong last_term = hdr->get_ulong();
-        // ulong last_idx = hdr->get_ulong();
-        // ulong commit_idx = hdr->get_ulong();
-
-        buffer_serializer h_bs(header_);
-        h_bs.pos(1);
-        msg_type t = (msg_type)h_bs.get_u8();
-        int32 src = h_bs.get_i32();
-        int32 dst = h_bs.get_i32();
-        ulong term = h_bs.get_u64();
-        ulong last_term = h_bs.get_u64();
-        ulong last_idx = h_bs.get_u64();
-        ulong commit_idx = h_bs.get_u64();
-        int32 log_data_size = h_bs.get_i32();
-
-        if (flags_ & CRC_ON_ENTIRE_MESSAGE) {
+        msg_type t = req_hdr_.type_;
+        int32 src = req_hdr_.src_;
+        int32 dst = req_hdr_.dst_;
+        ulong term = req_hdr_.term_;
+        ulong last_term = req_hdr_.last_log_term_;
+        ulong last_idx = req_hdr_.last_log_idx_;
+        ulong commit_idx = req_hdr_.commit_idx_;
+        int32 log_data_size = req_hdr_.data_size_;
+
+        if (req_hdr_.flags_ & CRC_ON_ENTIRE_MESSAGE) {
             // Calculate the CRC of `log_ctx`.
             uint32_t crc_payload =
                 log_ctx
-                ? crc32_8( log_ctx->data_begin(),
+                ? msg_crc( req_hdr_.flags_,
+                           log_ctx->data_begin(),
                            log_ctx->size(),
-                           crc_header_ )
-                : crc_header_;
-            if (crc_payload != crc_from_msg_) {
+                           req_hdr_.crc_header_ )
+                : req_hdr_.crc_header_;
+            if (crc_payload != req_hdr_.crc_from_msg_) {
                 p_er("request CRC mismatch: local calculation %x, from message %x",
-                     crc_payload, crc_from_msg_);
+                     crc_payload, req_hdr_.crc_from_msg_);
 
                 if (impl_->get_options().corrupted_msg_handler_) {
                     impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
@@ -737,76 +838,162 @@ private:
         std::string meta_str;
         ptr<req_msg> req = cs_new<req_msg>
                            ( term, t, src, dst, last_term, last_idx, commit_idx );
-        if (flags_ & MARK_DOWN) {
+        if (req_hdr_.flags_ & MARK_DOWN) {
             req->set_extra_flags(
                 req->get_extra_flags() | req_msg::EXCLUDED_FROM_THE_QUORUM);
         }
-        if (flags_ & ALLOW_ASYNC_LOG_APPENDING_WIRE) {
+        if (req_hdr_.flags_ & ALLOW_ASYNC_LOG_APPENDING_WIRE) {
             req->set_extra_flags(
                 req->get_extra_flags() | req_msg::ALLOW_ASYNC_LOG_APPENDING);
         }
 
+        // ID of the request to echo back in the response, 0 if none.
+        uint64_t req_id = 0;
+        if (req_hdr_.flags_ & REQUEST_ID_INCLUDED) {
+            if (log_data_size < REQUEST_ID_LEN || !log_ctx) {
+                p_wn("wrong log ctx size %d for request ID, stop this session",
+                     log_data_size);
+
+                if (impl_->get_options().corrupted_msg_handler_) {
+                    impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                }
+
+                this->request_stop();
+                return;
+            }
+            buffer_serializer id_bs(log_ctx);
+            req_id = id_bs.get_u64();
+        }
+
         if (log_data_size > 0 && log_ctx) {
-            buffer_serializer ss(log_ctx);
-            size_t log_ctx_size = log_ctx->size();
+            size_t log_pos = req_id ? REQUEST_ID_LEN : 0;
 
             // If flag is set, read meta first.
-            if (flags_ & INCLUDE_META) {
+            if (req_hdr_.flags_ & INCLUDE_META) {
+                buffer_serializer meta_bs(log_ctx);
+                meta_bs.pos(log_pos);
                 size_t meta_len = 0;
-                const byte* meta_raw = (const byte*)ss.get_bytes(meta_len);
+                const byte* meta_raw = (const byte*)meta_bs.get_bytes(meta_len);
                 if (meta_len) {
                     meta_str = std::string((const char*)meta_raw, meta_len);
                 }
+                log_pos = meta_bs.pos();
+            }
+
+            // Decompress log entries into a new receive buffer,
+            // the rest is the same as uncompressed ones.
+            ptr<buffer> log_entries_buf = log_ctx;
+            if (req_hdr_.flags_ & COMPRESSED_LOG_DATA) {
+                std::string err_msg;
+                log_entries_buf = rpc_wire::decompress_log_data
+                                  ( *log_ctx,
+                                    log_pos,
+                                    impl_->get_options().log_compression_dict_,
+                                    &recv_buf_pool_,
+                                    err_msg );
+                if (!log_entries_buf) {
+                    p_er("%s, stop this session", err_msg.c_str());
+
+                    if (impl_->get_options().corrupted_msg_handler_) {
+                        impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                    }
+
+                    this->request_stop();
+                    return;
+                }
+                log_pos = 0;
             }
 
+            buffer_serializer ss(log_entries_buf);
+            ss.pos(log_pos);
+            size_t log_ctx_size = log_entries_buf->size();
+
             size_t LOG_ENTRY_SIZE = 8 + 1 + 4;
-            if (flags_ & INCLUDE_LOG_TIMESTAMP) {
+            if (req_hdr_.flags_ & INCLUDE_LOG_TIMESTAMP) {
                 LOG_ENTRY_SIZE += 8;
             }
-            if (flags_ & CRC_ON_PAYLOAD) {
+            if (req_hdr_.flags_ & CRC_ON_PAYLOAD) {
                 LOG_ENTRY_SIZE += 5;
             }
 
+            // Header of the previous entry, for compact headers.
+            compact_entry_header c_hdr(last_term);
+
             while (log_ctx_size > ss.pos()) {
-                if (log_ctx_size - ss.pos() < LOG_ENTRY_SIZE) {
-                    // Possibly corrupted packet. Stop here.
-                    p_wn("wrong log ctx size %zu pos %zu, stop this session",
-                         log_ctx_size, ss.pos());
+                ulong term = 0;
+                log_val_type val_type = app_log;
+                uint64_t timestamp = 0;
+                bool has_crc32 = false;
+                uint32_t crc32 = 0;
+                size_t val_size = 0;
+
+                if (req_hdr_.compact_) {
+                    std::string err_msg;
+                    if ( !rpc_wire::get_compact_entry_header
+                          ( ss, req_hdr_.flags_, c_hdr, err_msg ) ) {
+                        // Possibly corrupted packet. Stop here.
+                        p_wn("%s, stop this session", err_msg.c_str());
 
-                    if (impl_->get_options().corrupted_msg_handler_) {
-                        impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                        if (impl_->get_options().corrupted_msg_handler_) {
+                            impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                        }
+
+                        this->request_stop();
+                        return;
                     }
+                    term = c_hdr.term_;
+                    val_type = c_hdr.type_;
+                    timestamp = c_hdr.timestamp_;
+                    has_crc32 = c_hdr.has_crc32_;
+                    crc32 = c_hdr.crc32_;
+                    val_size = c_hdr.size_;
 
-                    this->request_stop();
-                    return;
-                }
-                ulong term = ss.get_u64();
-                log_val_type val_type = (log_val_type)ss.get_u8();
-                uint64_t timestamp = (flags_ & INCLUDE_LOG_TIMESTAMP) ? ss.get_u64() : 0;
-                bool has_crc32 = (flags_ & CRC_ON_PAYLOAD) ? (ss.get_u8() != 0) : false;
-                uint32_t crc32 = (flags_ & CRC_ON_PAYLOAD) ? ss.get_u32() : 0;
-
-                size_t val_size = ss.get_i32();
-                if (log_ctx_size - ss.pos() < val_size) {
-                    // Out-of-bound size.
-                    p_wn("wrong value size %zu log ctx %zu %zu, "
-                         "stop this session",
-                         val_size, log_ctx_size, ss.pos());
+                } else {
+                    if (log_ctx_size - ss.pos() < LOG_ENTRY_SIZE) {
+                        // Possibly corrupted packet. Stop here.
+                        p_wn("wrong log ctx size %zu pos %zu, stop this session",
+                             log_ctx_size, ss.pos());
 
-                    if (impl_->get_options().corrupted_msg_handler_) {
-                        impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                        if (impl_->get_options().corrupted_msg_handler_) {
+                            impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                        }
+
+                        this->request_stop();
+                        return;
                     }
+                    term = ss.get_u64();
+                    val_type = (log_val_type)ss.get_u8();
+                    timestamp = (req_hdr_.flags_ & INCLUDE_LOG_TIMESTAMP) ? ss.get_u64() : 0;
+                    has_crc32 = (req_hdr_.flags_ & CRC_ON_PAYLOAD) ? (ss.get_u8() != 0) : false;
+                    crc32 = (req_hdr_.flags_ & CRC_ON_PAYLOAD) ? ss.get_u32() : 0;
+
+                    val_size = ss.get_i32();
+                    if (log_ctx_size - ss.pos() < val_size) {
+                        // Out-of-bound size.
+                        p_wn("wrong value size %zu log ctx %zu %zu, "
+                             "stop this session",
+                             val_size, log_ctx_size, ss.pos());
 
-                    this->request_stop();
-                    return;
+                        if (impl_->get_options().corrupted_msg_handler_) {
+                            impl_->get_options().corrupted_msg_handler_(header_, log_ctx);
+                        }
+
+                        this->request_stop();
+                        return;
+                    }
                 }
 
-                ptr<buffer> buf( buffer::alloc(val_size) );
-                ss.get_buffer(buf);
+                ptr<buffer> buf;
+                if (impl_->get_options().log_entry_slices_) {
+                    buf = ss.get_buffer_slice(val_size);
+                } else {
+                    buf = buffer::alloc(val_size);
+                    ss.get_buffer(buf);
+                }
                 ptr<log_entry> entry(
                     cs_new<log_entry>(term, buf, val_type, timestamp, has_crc32, crc32, false) );
 
-                if ((flags_ & CRC_ON_PAYLOAD) && has_crc32) {
+                if ((req_hdr_.flags_ & CRC_ON_PAYLOAD) && has_crc32) {
                     // Verify CRC.
                     uint32_t crc_payload = crc32_8( buf->data_begin(),
                                                     buf->size(),
@@ -840,7 +1027,18 @@ private:
             }
         }
 
-        const bool close_on_error_req = (flags_ & CLOSE_ON_ERROR_WIRE) != 0;
+        const bool close_on_error_req = (req_hdr_.flags_ & CLOSE_ON_ERROR_WIRE) != 0;
+
+        if (req_id && t == msg_type::install_snapshot_request) {
+            // Applying a snapshot chunk may take long. Handle it on
+            // another thread so that the requests behind it on this
+            // connection (e.g., heartbeats) don't wait for it. The peer
+            // matches the response by the request ID.
+            pipelined_ = true;
+            dispatch_detached_req(self, handler, req, req_id, close_on_error_req);
+            this->start(self);
+            return;
+        }
 
         // === RAFT server processes the request here. ===
         ptr<resp_msg> resp = raft_server_handler::process_req(handler.get(), *req);
@@ -853,67 +1051,19 @@ private:
         if (!pipelined_ && (resp->has_async_cb() && impl_->get_options().streaming_mode_)) {
             pipelined_ = true;
         }
+        if (!pipelined_ && req_id) {
+            // The peer doesn't wait for the response before sending
+            // the next request.
+            pipelined_ = true;
+        }
 
         if (pipelined_) {
             // Pipelined mode: queue the deferred response and immediately
             // read the next request. The response will be sent when the
             // async result is ready (e.g. for append_entries request we
             // send response after log store fsync, which may take a while).
-
-            if (resp->has_cb())
-                resp = resp->call_cb(resp);
-
-            const bool close_after_drain =
-                close_on_error_req
-                && !resp->has_async_cb()
-                && ( !resp->get_accepted()
-                     || resp->get_result_code() != cmd_result_code::OK );
-
-            auto entry = cs_new<pending_resp_entry>();
-            entry->req = req;
-            entry->resp = resp;
-
-            {
-                std::lock_guard<std::mutex> guard(pending_resps_lock_);
-                pending_resps_.push_back(entry);
-                if (close_after_drain) {
-                    stop_after_sending_resps_ = true;
-                }
-            }
-
-            if (resp->has_async_cb()) {
-                // Note: in this case close_on_error_req can't work as
-                // we may have already started processing the next request by
-                // the time an error is reported.
-                // This is currently ok because CLOSE_ON_ERROR is used only by
-                // client_req_stream to handle leader rejections, in particular
-                // max_uncommitted_log_entries_, which happen synchronously.
-                ptr< cmd_result< ptr<buffer> > > ret = resp->call_async_cb();
-                ret->when_ready(
-                    [this, self, entry]
-                    ( cmd_result<ptr<buffer>, ptr<std::exception>>& res,
-                      ptr<std::exception>& exp ) {
-                        // Note: the async part of request processing currently has the power
-                        // to fail the request (by setting non-ok result code in `res`),
-                        // but can't change other fields of resp_msg, e.g. `next_idx`.
-                        // This is an unnecessary limitation, but it's ok for
-                        // the current user of this feature (parallel log appending
-                        // on follower).
-                        update_resp_with_async_result(entry->resp.get(), res, exp);
-                        entry->ready.store(true, std::memory_order_release);
-                        try_send_pending_resps(self);
-                        res.reset();
-                    }
-                );
-            } else {
-                entry->ready.store(true, std::memory_order_release);
-                try_send_pending_resps(self);
-            }
-
-            if (close_after_drain) {
-                p_in("session %" PRIu64 " CLOSE_ON_ERROR: close after drain", session_id_);
-                // try_send_pending_resps will stop() once the queue drains.
-            } else {
+            // Responses with request ID can be sent ahead of older ones.
+            if (!queue_pipelined_resp(self, req, resp, req_id, close_on_error_req)) {
                 // Receive next message.
                 this->start(self);
             }
@@ -962,7 +1112,140 @@ private:
        }
     }
 
-    ptr<buffer> serialize_resp(ptr<req_msg>& req, ptr<resp_msg>& resp) {
+    /**
+     * Queue the response of a request in pipelined mode, and send it
+     * once it is ready.
+     *
+     * @return `true` if the session will be closed after the queued
+     *         responses are sent.
+     */
+    bool queue_pipelined_resp(ptr<rpc_session> self,
+                              ptr<req_msg>& req,
+                              ptr<resp_msg>& resp,
+                              uint64_t req_id,
+                              bool close_on_error_req)
+    {
+        if (resp->has_cb())
+            resp = resp->call_cb(resp);
+
+        const bool close_after_drain =
+            close_on_error_req
+            && !resp->has_async_cb()
+            && ( !resp->get_accepted()
+                 || resp->get_result_code() != cmd_result_code::OK );
+
+        auto entry = cs_new<pending_resp_entry>();
+        entry->req = req;
+        entry->resp = resp;
+        entry->req_id = req_id;
+
+        {
+            std::lock_guard<std::mutex> guard(pending_resps_lock_);
+            pending_resps_.push_back(entry);
+            if (close_after_drain) {
+                stop_after_sending_resps_ = true;
+            }
+        }
+
+        if (resp->has_async_cb()) {
+            // Note: in this case close_on_error_req can't work as
+            // we may have already started processing the next request by
+            // the time an error is reported.
+            // This is currently ok because CLOSE_ON_ERROR is used only by
+            // client_req_stream to handle leader rejections, in particular
+            // max_uncommitted_log_entries_, which happen synchronously.
+            ptr< cmd_result< ptr<buffer> > > ret = resp->call_async_cb();
+            ret->when_ready(
+                [this, self, entry]
+                ( cmd_result<ptr<buffer>, ptr<std::exception>>& res,
+                  ptr<std::exception>& exp ) {
+                    // Note: the async part of request processing currently has the power
+                    // to fail the request (by setting non-ok result code in `res`),
+                    // but can't change other fields of resp_msg, e.g. `next_idx`.
+                    // This is an unnecessary limitation, but it's ok for
+                    // the current user of this feature (parallel log appending
+                    // on follower).
+                    update_resp_with_async_result(entry->resp.get(), res, exp);
+                    entry->ready.store(true, std::memory_order_release);
+                    try_send_pending_resps(self);
+                    res.reset();
+                }
+            );
+        } else {
+            entry->ready.store(true, std::memory_order_release);
+            try_send_pending_resps(self);
+        }
+
+        if (close_after_drain) {
+            p_in("session %" PRIu64 " CLOSE_ON_ERROR: close after drain", session_id_);
+            // try_send_pending_resps will stop() once the queue drains.
+        }
+        return close_after_drain;
+    }
+
+    /**
+     * Handle a request with ID on another thread, without blocking the
+     * requests read after it. Such requests are handled in the order
+     * they are received.
+     */
+    void dispatch_detached_req(ptr<rpc_session> self,
+                               ptr<msg_handler>& handler,
+                               ptr<req_msg>& req,
+                               uint64_t req_id,
+                               bool close_on_error_req)
+    {
+        ptr<detached_req> elem = cs_new<detached_req>();
+        elem->handler_ = handler;
+        elem->req_ = req;
+        elem->req_id_ = req_id;
+        elem->close_on_error_req_ = close_on_error_req;
+        {
+            std::lock_guard<std::mutex> guard(detached_reqs_lock_);
+            detached_reqs_.push_back(elem);
+            if (detached_reqs_running_) return;
+            detached_reqs_running_ = true;
+        }
+        asio::post( impl_->get_io_svc(),
+                    [this, self]() { handle_detached_reqs(self); } );
+    }
+
+    void handle_detached_reqs(ptr<rpc_session> self) {
+        while (true) {
+            ptr<detached_req> elem;
+            {
+                std::lock_guard<std::mutex> guard(detached_reqs_lock_);
+                if (detached_reqs_.empty()) {
+                    detached_reqs_running_ = false;
+                    return;
+                }
+                elem = detached_reqs_.front();
+                detached_reqs_.pop_front();
+            }
+
+           try {
+            ptr<resp_msg> resp =
+                raft_server_handler::process_req(elem->handler_.get(), *elem->req_);
+            if (!resp) {
+                p_wn("no response is returned from raft message handler");
+                this->request_stop();
+                continue;
+            }
+            queue_pipelined_resp( self, elem->req_, resp, elem->req_id_,
+                                  elem->close_on_error_req_ );
+
+           } catch (std::exception& ex) {
+            p_er( "session %" PRIu64 " failed to process request message "
+                  "due to error: %s",
+                  this->session_id_,
+                  ex.what() );
+            this->request_stop();
+           }
+        }
+    }
+
+    ptr<buffer> serialize_resp(ptr<req_msg>& req,
+                               ptr<resp_msg>& resp,
+                               uint64_t req_id = 0) {
         ptr<buffer> resp_ctx = resp->get_ctx();
         int32 resp_ctx_size = (resp_ctx) ? resp_ctx->size() : 0;
         int32 result_code_size = sizeof(int32_t);
@@ -993,7 +1276,37 @@ private:
             flags |= MARK_DOWN;
         }
 
+        if (impl_->get_options().use_crc32c_) {
+            flags |= CRC32C_SUPPORTED;
+            if (peer_supports_crc32c_) {
+                flags |= CRC32C_IN_USE;
+            }
+        }
+
+        if (rpc_wire::compression_available()) {
+            flags |= LOG_COMPRESSION_SUPPORTED;
+        }
+
+        if (impl_->get_options().compact_header_) {
+            flags |= COMPACT_HEADER_SUPPORTED;
+        }
+
+        if (impl_->get_options().multiplexing_) {
+            flags |= MULTIPLEXING_SUPPORTED;
+        }
+        // Responses are serialized in the order they are sent,
+        // so that the switch to compact headers is seen in the same order.
+        bool compact = compact_resp_;
+        if (!compact_resp_ && peer_supports_compact_) {
+            flags |= COMPACT_HEADER_FOLLOWS;
+            compact_resp_ = true;
+        }
+
         size_t carried_data_size = resp_meta_size + resp_hint_size + resp_ctx_size;
+        if (req_id) {
+            flags |= REQUEST_ID_INCLUDED;
+            carried_data_size += REQUEST_ID_LEN;
+        }
 
         if (req->get_type() == msg_type::client_request ||
             req->get_type() == msg_type::add_server_request ||
@@ -1002,28 +1315,41 @@ private:
             carried_data_size += result_code_size;
         }
 
-        int buf_size = RPC_RESP_HEADER_SIZE + carried_data_size;
+        size_t header_size = compact
+                             ? rpc_wire::compact_resp_header_size(*resp, flags)
+                             : RPC_RESP_HEADER_SIZE;
+        int buf_size = header_size + carried_data_size;
         ptr<buffer> resp_buf = buffer::alloc(buf_size);
         buffer_serializer bs(resp_buf);
 
-        const byte RESP_MARKER = 0x1;
-        bs.put_u8(RESP_MARKER);
-        bs.put_u8(resp->get_type());
-        bs.put_i32(resp->get_src());
-        bs.put_i32(resp->get_dst());
-        bs.put_u64(resp->get_term());
-        bs.put_u64(resp->get_next_idx());
-        bs.put_u8(resp->get_accepted());
-        bs.put_i32(carried_data_size);
-
-        // Calculate CRC32 on header only.
-        uint32_t crc_val = crc32_8( resp_buf->data_begin(),
-                                    RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN,
-                                    0 );
-
-        uint64_t flags_crc = ((uint64_t)flags << 32) | crc_val;
-        bs.put_u64(flags_crc);
+        if (compact) {
+            rpc_wire::put_compact_resp_header(bs, *resp, flags, carried_data_size);
 
+        } else {
+            const byte RESP_MARKER = 0x1;
+            bs.put_u8(RESP_MARKER);
+            bs.put_u8(resp->get_type());
+            bs.put_i32(resp->get_src());
+            bs.put_i32(resp->get_dst());
+            bs.put_u64(resp->get_term());
+            bs.put_u64(resp->get_next_idx());
+            bs.put_u8(resp->get_accepted());
+            bs.put_i32(carried_data_size);
+
+            // Calculate CRC32 on header only.
+            uint32_t crc_val = msg_crc( flags,
+                                        resp_buf->data_begin(),
+                                        RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN,
+                                        0 );
+
+            uint64_t flags_crc = ((uint64_t)flags << 32) | crc_val;
+            bs.put_u64(flags_crc);
+        }
+
+        // Request ID comes first.
+        if (flags & REQUEST_ID_INCLUDED) {
+            bs.put_u64(req_id);
+        }
         // Handling meta if the flag is set.
         if (flags & INCLUDE_META) {
             bs.put_str(resp_meta_str);
@@ -1089,11 +1415,20 @@ private:
        }
     }
 
-    // --- Pipelined response support (streaming mode) ---
+    // --- Pipelined response support (streaming mode and multiplexing) ---
+
+    struct detached_req {
+        ptr<msg_handler> handler_;
+        ptr<req_msg> req_;
+        uint64_t req_id_{0};
+        bool close_on_error_req_{false};
+    };
 
     struct pending_resp_entry {
         ptr<req_msg> req;
         ptr<resp_msg> resp;
+        // ID of the request to echo back, 0 if the request has no ID.
+        uint64_t req_id{0};
         std::atomic<bool> ready{false};
     };
 
@@ -1102,10 +1437,19 @@ private:
         {
             std::unique_lock<std::mutex> guard(pending_resps_lock_);
             if (writing_resp_) return;
-            if (pending_resps_.empty() ||
-                !pending_resps_.front()->ready.load(
-                    std::memory_order_acquire))
-            {
+
+            // Responses without request ID should be sent in FIFO order,
+            // the others can overtake them as soon as they are ready.
+            auto it = pending_resps_.begin();
+            while (it != pending_resps_.end()) {
+                if ((*it)->ready.load(std::memory_order_acquire)) break;
+                if (!(*it)->req_id) {
+                    it = pending_resps_.end();
+                    break;
+                }
+                ++it;
+            }
+            if (it == pending_resps_.end()) {
                 if (stop_after_sending_resps_ && pending_resps_.empty()) {
                     guard.unlock();
                     this->stop();
@@ -1113,12 +1457,12 @@ private:
                 return;
             }
             writing_resp_ = true;
-            entry = std::move(pending_resps_.front());
-            pending_resps_.pop_front();
+            entry = std::move(*it);
+            pending_resps_.erase(it);
         }
 
        try {
-        ptr<buffer> resp_buf = serialize_resp(entry->req, entry->resp);
+        ptr<buffer> resp_buf = serialize_resp(entry->req, entry->resp, entry->req_id);
 
         aa::write( ssl_enabled_, ssl_socket_, socket_,
                    asio::buffer(resp_buf->data_begin(), resp_buf->size()),
@@ -1161,9 +1505,20 @@ private:
     bool ssl_enabled_;
     asio::strand<asio::io_context::executor_type> ssl_strand_;
     bool use_strand_;
-    uint32_t flags_;
     ptr<buffer> log_data_;
     ptr<buffer> header_;
+
+    /**
+     * Fields of the request header currently being processed.
+     */
+    rpc_req_header req_hdr_;
+
+    /**
+     * Pool of buffers for receiving log data.
+     * Only the read path of this session acquires buffers from it.
+     */
+    buffer_pool recv_buf_pool_;
+
     ptr<logger> l_;
     session_closed_callback callback_;
 
@@ -1185,14 +1540,33 @@ private:
     uint32_t cached_port_;
 
     /**
-     * Locally calculated CRC number of the request header.
+     * `true` if the endpoint is able to verify CRC-32C.
+     */
+    std::atomic<bool> peer_supports_crc32c_;
+
+    /**
+     * `true` if the following requests will have compact headers.
+     * Only the receive side accesses it.
+     */
+    bool compact_req_;
+
+    /**
+     * Source and destination IDs of the requests with compact headers,
+     * given by the request that carried `COMPACT_HEADER_FOLLOWS`.
+     */
+    int32 compact_src_;
+    int32 compact_dst_;
+
+    /**
+     * `true` if the endpoint is able to read compact headers.
      */
-    uint32_t crc_header_;
+    std::atomic<bool> peer_supports_compact_;
 
     /**
-     * CRC number from the request header.
+     * `true` if compact headers are used for responses.
+     * Only the side serializing responses accesses it.
      */
-    uint32_t crc_from_msg_;
+    bool compact_resp_;
 
     // --- Pipelined response state (streaming mode) ---
 
@@ -1200,6 +1574,7 @@ private:
      * Queue of pending responses waiting to be sent.
      * In pipelined mode, responses are sent in FIFO order;
      * async responses wait until their result is ready.
+     * Responses to requests with ID are sent as soon as they are ready.
      */
     std::deque<ptr<pending_resp_entry>> pending_resps_;
 
@@ -1218,7 +1593,8 @@ private:
 
     /**
      * True once we have entered pipelined mode on this session
-     * (first async_cb response seen in streaming mode).
+     * (first async_cb response seen in streaming mode, or
+     *  first request with ID).
      * In this state, there are two "threads" operating on this rpc_session:
      *  * receive side: start <-> read_complete async loop,
      *  * send side: try_send_pending_resps async loop.
@@ -1233,6 +1609,22 @@ private:
      * True if we should close the connection after pending_resps_ is drained.
      */
     bool stop_after_sending_resps_{false};
+
+    /**
+     * Requests with ID handled by a thread other than the receive side,
+     * see `dispatch_detached_req()`.
+     */
+    std::deque<ptr<detached_req>> detached_reqs_;
+
+    /**
+     * Lock protecting `detached_reqs_` and `detached_reqs_running_`.
+     */
+    std::mutex detached_reqs_lock_;
+
+    /**
+     * True while a thread is handling `detached_reqs_`.
+     */
+    bool detached_reqs_running_{false};
 };
 
 // rpc listener implementation
@@ -1415,7 +1807,9 @@ public:
         , port_(port)
         , ssl_enabled_(ssl_enabled)
         , ssl_strand_(io_svc.get_executor())
-        , use_strand_(ssl_enabled_ && impl_->get_options().streaming_mode_)
+        , use_strand_( ssl_enabled_ &&
+                       ( impl_->get_options().streaming_mode_ ||
+                         impl_->get_options().multiplexing_ ) )
         , l_(l)
         , send_timer_(io_svc)
         , receive_timer_(io_svc)
@@ -1460,6 +1854,15 @@ public:
         return impl_->get_options().streaming_mode_;
     }
 
+    bool supports_multiplexing() const override {
+        return multiplexing();
+    }
+
+    bool multiplexing() const {
+        return impl_->get_options().multiplexing_ &&
+               !impl_->get_options().streaming_mode_;
+    }
+
 #ifndef SSL_LIBRARY_NOT_FOUND
     bool verify_certificate(bool preverified,
                             asio::ssl::verify_context& ctx)
@@ -1485,7 +1888,7 @@ public:
                       rpc_handler& when_done,
                       uint64_t send_timeout_ms = 0) __override__
     {
-        if (impl_->get_options().streaming_mode_) {
+        if (impl_->get_options().streaming_mode_ || multiplexing()) {
             pre_send(req, when_done, send_timeout_ms);
         } else {
             register_req_send(req, when_done, send_timeout_ms);
@@ -1519,19 +1922,144 @@ public:
         }
     }
 
-    ptr<buffer> serialize_req(ptr<req_msg>& req) {
-        // serialize req, send and read response
-        std::vector<ptr<buffer>> log_entry_bufs;
-        int32 log_data_size(0);
+    /**
+     * Encode log entries of the given request. Payloads are not copied:
+     * spans of the returned object will point directly at each
+     * `log_entry::get_buf()`, except for the ones smaller than
+     * `INLINE_PAYLOAD_LIMIT`, which are copied inline to keep the number
+     * of spans (i.e., iovecs) small.
+     *
+     * @param req Request to encode.
+     * @param compact If `true`, use compact log entry headers.
+     * @return Encoded log entries.
+     */
+    ptr<encoded_log_entries> encode_log_entries(ptr<req_msg>& req, bool compact) {
+        static const size_t INLINE_PAYLOAD_LIMIT = 256;
 
         uint32_t flags = 0x0;
         size_t LOG_ENTRY_SIZE = 8 + 1 + 4;
         if (impl_->get_options().replicate_log_timestamp_) {
-            LOG_ENTRY_SIZE += 8;
             flags |= INCLUDE_LOG_TIMESTAMP;
+            LOG_ENTRY_SIZE += 8;
         }
         if (impl_->get_options().crc_on_payload_) {
+            flags |= CRC_ON_PAYLOAD;
             LOG_ENTRY_SIZE += 5;
+        }
+        // Compact headers have variable length, reserve the maximum.
+        size_t max_header_size =
+            compact ? MAX_COMPACT_ENTRY_HEADER_SIZE : LOG_ENTRY_SIZE;
+
+        ptr<encoded_log_entries> enc = cs_new<encoded_log_entries>();
+        enc->entries_ = req->log_entries();
+        enc->compact_ = compact;
+
+        // Size of the part that will be placed in the local buffer.
+        size_t inline_size(0);
+        for (auto& entry: enc->entries_) {
+            size_t payload_size = entry->get_buf().size();
+            inline_size += max_header_size;
+            if (payload_size < INLINE_PAYLOAD_LIMIT) {
+                inline_size += payload_size;
+            }
+        }
+        if (!inline_size) return enc;
+
+        enc->buf_ = buffer::alloc(inline_size);
+        buffer_serializer bs(enc->buf_);
+
+        // Each span is either a range of `buf_`, or a payload of
+        // a log entry. Consecutive ranges of `buf_` are merged.
+        enc->spans_.reserve(enc->entries_.size() * 2);
+        size_t span_start = 0;
+        auto flush_local_span = [&]() {
+            if (bs.pos() > span_start) {
+                enc->spans_.push_back( asio::buffer( enc->buf_->data_begin() + span_start,
+                                                     bs.pos() - span_start ) );
+                enc->size_ += (int32)(bs.pos() - span_start);
+            }
+            span_start = bs.pos();
+        };
+
+        compact_entry_header prev_hdr(req->get_last_log_term());
+        for (auto& entry: enc->entries_) {
+            ptr<log_entry>& le = entry;
+            buffer& le_buf = le->get_buf();
+            if (compact) {
+                rpc_wire::put_compact_entry_header(bs, *le, flags, prev_hdr);
+            } else {
+                bs.put_u64( le->get_term() );
+                bs.put_u8( le->get_val_type() );
+                if (flags & INCLUDE_LOG_TIMESTAMP) {
+                    bs.put_u64( le->get_timestamp() );
+                }
+                if (flags & CRC_ON_PAYLOAD) {
+                    bs.put_u8(le->has_crc32() ? 1 : 0);
+                    bs.put_u32(le->get_crc32());
+                }
+                bs.put_i32( le_buf.size() );
+            }
+            if (le_buf.size() < INLINE_PAYLOAD_LIMIT) {
+                bs.put_raw( le_buf.data_begin(), le_buf.size() );
+            } else {
+                flush_local_span();
+                enc->spans_.push_back( asio::buffer( le_buf.data_begin(),
+                                                     le_buf.size() ) );
+                enc->size_ += (int32)le_buf.size();
+            }
+        }
+        flush_local_span();
+        return enc;
+    }
+
+    /**
+     * Compress the given encoded log entries, only once per batch.
+     *
+     * @param enc Encoded log entries.
+     * @return Log data with `COMPRESSED_LOG_DATA` format, or `nullptr`
+     *         if the batch is not compressible.
+     */
+    ptr<buffer> compress_log_entries(encoded_log_entries& enc) {
+        std::lock_guard<std::mutex> l(enc.compression_lock_);
+        if (enc.compression_tried_) return enc.compressed_;
+
+        std::vector<wire_span> spans;
+        spans.reserve(enc.spans_.size());
+        for (const asio::const_buffer& span: enc.spans_) {
+            spans.push_back( wire_span(span.data(), span.size()) );
+        }
+        enc.compressed_ = rpc_wire::compress_log_data
+                          ( spans,
+                            impl_->get_options().log_compression_level_,
+                            impl_->get_options().log_compression_dict_ );
+        enc.compression_tried_ = true;
+        return enc.compressed_;
+    }
+
+    /**
+     * Serialize the given request for a gather write.
+     *
+     * Only the header and meta are written into the returned buffer.
+     * Log entries are encoded by `encode_log_entries`, or reused if the
+     * same log entries have been encoded recently for other peers.
+     * Both the returned buffer and `enc_out` should be alive until
+     * the write is done.
+     *
+     * @param req Request to serialize.
+     * @param req_id ID of the request, 0 if it should not be sent.
+     * @param[out] enc_out Encoded log entries.
+     * @param[out] out_spans Buffer sequence to be passed to `async_write`.
+     * @return Buffer containing header, request ID, and meta.
+     */
+    ptr<buffer> serialize_req(ptr<req_msg>& req,
+                              uint64_t req_id,
+                              ptr<encoded_log_entries>& enc_out,
+                              std::vector<asio::const_buffer>& out_spans) {
+        uint32_t flags = 0x0;
+        if (impl_->get_options().replicate_log_timestamp_) {
+            flags |= INCLUDE_LOG_TIMESTAMP;
+        }
+        if (impl_->get_options().crc_on_payload_) {
             flags |= CRC_ON_PAYLOAD;
         }
 
@@ -1548,33 +2076,47 @@ public:
             flags |= CLOSE_ON_ERROR_WIRE;
         }
 
-        for (auto& entry: req->log_entries()) {
-            ptr<log_entry>& le = entry;
-            ptr<buffer> entry_buf = buffer::alloc
-                                    ( LOG_ENTRY_SIZE + le->get_buf().size() );
-#if 0
-            auto& le_buf = le->get_buf();
-            entry_buf->put( le->get_term() );
-            entry_buf->put( (byte)le->get_val_type() );
-            entry_buf->put( (int32)le_buf.size() );
-            entry_buf->put_raw( le_buf.data_begin(), le_buf.size() );
-            entry_buf->pos( 0 );
-#else
-            buffer_serializer ss(entry_buf);
-            ss.put_u64( le->get_term() );
-            ss.put_u8( le->get_val_type() );
-            if (impl_->get_options().replicate_log_timestamp_) {
-                ss.put_u64( le->get_timestamp() );
-            }
-            if (impl_->get_options().crc_on_payload_) {
-                ss.put_u8(le->has_crc32() ? 1 : 0);
-                ss.put_u32(le->get_crc32());
-            }
-            ss.put_i32( le->get_buf().size() );
-            ss.put_raw( le->get_buf().data_begin(), le->get_buf().size() );
-#endif
-            log_entry_bufs.push_back(entry_buf);
-            log_data_size += (int32)entry_buf->size();
+        if (impl_->get_options().use_crc32c_) {
+            flags |= CRC32C_SUPPORTED;
+            if (peer_supports_crc32c_) {
+                flags |= CRC32C_IN_USE;
+            }
+        }
+
+        if (impl_->get_options().compact_header_) {
+            flags |= COMPACT_HEADER_SUPPORTED;
+        }
+        // Requests are serialized in the order they are sent,
+        // so that the switch to compact headers is seen in the same order.
+        bool compact = compact_req_;
+        if (!compact_req_ && peer_supports_compact_) {
+            flags |= COMPACT_HEADER_FOLLOWS;
+            compact_req_ = true;
+        }
+        if (compact && impl_->get_options().crc_on_entire_message_) {
+            // Flags are covered by the CRC of a compact header,
+            // should be set in advance.
+            flags |= CRC_ON_ENTIRE_MESSAGE;
+        }
+
+        enc_out = impl_->find_encoded_log_entries(req->log_entries(), compact);
+        if (!enc_out) {
+            enc_out = encode_log_entries(req, compact);
+            impl_->add_encoded_log_entries(enc_out);
+        }
+        int32 log_data_size = enc_out->size_;
+
+        // Compressed data is owned by `enc_out`.
+        ptr<buffer> compressed;
+        if ( impl_->get_options().log_compression_threshold_ &&
+             peer_supports_log_compression_ &&
+             (size_t)log_data_size >=
+                 impl_->get_options().log_compression_threshold_ ) {
+            compressed = compress_log_entries(*enc_out);
+            if (compressed) {
+                flags |= COMPRESSED_LOG_DATA;
+                log_data_size = (int32)compressed->size();
+            }
         }
 
         size_t meta_size = 0;
@@ -1589,71 +2131,93 @@ public:
             }
         }
 
-        ptr<buffer> req_buf =
-            buffer::alloc(RPC_REQ_HEADER_SIZE + meta_size + log_data_size);
-
-        // Deprecate `buffer::put` and use `buffer_serializer`.
-
-        // req_buf->pos(0);
-        // byte* req_buf_data = req_buf->data();
+        size_t id_size = 0;
+        if (req_id) {
+            flags |= REQUEST_ID_INCLUDED;
+            id_size = REQUEST_ID_LEN;
+        }
 
-        // byte marker = 0x0;
-        // req_buf->put(marker);
-        // req_buf->put((byte)req->get_type());
-        // req_buf->put(req->get_src());
-        // req_buf->put(req->get_dst());
-        // req_buf->put(req->get_term());
-        // req_buf->put(req->get_last_log_term());
-        // req_buf->put(req->get_last_log_idx());
-        // req_buf->put(req->get_commit_idx());
-        // req_buf->put((int32)meta_size + log_data_size);
+        size_t header_size = compact
+                             ? rpc_wire::compact_req_header_size(*req, flags)
+                             : RPC_REQ_HEADER_SIZE;
+        ptr<buffer> req_buf = buffer::alloc(header_size + id_size + meta_size);
 
         buffer_serializer req_buf_bs(req_buf);
-        req_buf_bs.put_u8(0x0);
-        req_buf_bs.put_u8((byte)req->get_type());
-        req_buf_bs.put_i32(req->get_src());
-        req_buf_bs.put_i32(req->get_dst());
-        req_buf_bs.put_u64(req->get_term());
-        req_buf_bs.put_u64(req->get_last_log_term());
-        req_buf_bs.put_u64(req->get_last_log_idx());
-        req_buf_bs.put_u64(req->get_commit_idx());
-        req_buf_bs.put_i32((int32)meta_size + log_data_size);
-
-        // Calculate CRC32 on header-only.
-        uint32_t crc_header = crc32_8( req_buf->data_begin(),
-                                       RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
-                                       0 );
-
-        uint64_t flags_and_crc = ((uint64_t)flags << 32) | crc_header;
-        // req_buf->put((ulong)flags_and_crc);
-        size_t crc_pos = req_buf_bs.pos();
-        req_buf_bs.put_u64(flags_and_crc);
-
-        // From now on, it will contain the payload (== meta + log entries).
-        // byte* req_buf_payload = req_buf->data();
-        size_t payload_pos = req_buf_bs.pos();
+        uint32_t crc_header = 0;
+        uint64_t flags_and_crc = 0;
+        size_t crc_pos = 0;
+        if (compact) {
+            crc_header = rpc_wire::put_compact_req_header
+                         ( req_buf_bs, *req, flags,
+                           id_size + meta_size + log_data_size );
+            crc_pos = header_size - RPC_COMPACT_CRC_LEN;
+
+        } else {
+            req_buf_bs.put_u8(0x0);
+            req_buf_bs.put_u8((byte)req->get_type());
+            req_buf_bs.put_i32(req->get_src());
+            req_buf_bs.put_i32(req->get_dst());
+            req_buf_bs.put_u64(req->get_term());
+            req_buf_bs.put_u64(req->get_last_log_term());
+            req_buf_bs.put_u64(req->get_last_log_idx());
+            req_buf_bs.put_u64(req->get_commit_idx());
+            req_buf_bs.put_i32((int32)(id_size + meta_size) + log_data_size);
+
+            // Calculate CRC32 on header-only.
+            crc_header = msg_crc( flags,
+                                  req_buf->data_begin(),
+                                  RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
+                                  0 );
+
+            flags_and_crc = ((uint64_t)flags << 32) | crc_header;
+            crc_pos = req_buf_bs.pos();
+            req_buf_bs.put_u64(flags_and_crc);
+        }
 
+        // Request ID comes first.
+        if (flags & REQUEST_ID_INCLUDED) {
+            req_buf_bs.put_u64(req_id);
+        }
         // Handling meta if the flag is set.
         if (flags & INCLUDE_META) {
-            // req_buf->put( (byte*)meta_str.data(), meta_str.size() );
             req_buf_bs.put_bytes( (byte*)meta_str.data(), meta_str.size() );
         }
 
-        for (auto& it: log_entry_bufs) {
-            // req_buf->put(*(it));
-            req_buf_bs.put_buffer(*(it));
+        out_spans.clear();
+        out_spans.reserve(enc_out->spans_.size() + 1);
+        out_spans.push_back( asio::buffer(req_buf->data_begin(), req_buf->size()) );
+        if (compressed) {
+            out_spans.push_back( asio::buffer( compressed->data_begin(),
+                                               compressed->size() ) );
+        } else {
+            out_spans.insert( out_spans.end(),
+                              enc_out->spans_.begin(),
+                              enc_out->spans_.end() );
         }
-        // req_buf->pos(0);
 
         if (impl_->get_options().crc_on_entire_message_) {
-            uint32_t crc_payload = crc32_8( req_buf->data_begin() + payload_pos,
-                                            meta_size + log_data_size,
+            // Payload (== request ID + meta + log entries) starts right
+            // after the header, calculate CRC incrementally over the same
+            // spans to be sent.
+            uint32_t crc_payload = msg_crc( flags,
+                                            req_buf->data_begin() + header_size,
+                                            id_size + meta_size,
                                             crc_header );
+            for (size_t ii = 1; ii < out_spans.size(); ++ii) {
+                crc_payload = msg_crc( flags,
+                                       out_spans[ii].data(),
+                                       out_spans[ii].size(),
+                                       crc_payload );
+            }
             // Overwrite CRC field.
-            flags |= CRC_ON_ENTIRE_MESSAGE;
-            flags_and_crc = ((uint64_t)flags << 32) | crc_payload;
             req_buf_bs.pos(crc_pos);
-            req_buf_bs.put_u64(flags_and_crc);
+            if (compact) {
+                req_buf_bs.put_u32(crc_payload);
+            } else {
+                flags |= CRC_ON_ENTIRE_MESSAGE;
+                flags_and_crc = ((uint64_t)flags << 32) | crc_payload;
+                req_buf_bs.put_u64(flags_and_crc);
+            }
         }
 
         return req_buf;
@@ -1710,7 +2274,21 @@ public:
             return;
         }
 
-        ptr<buffer> req_buf = serialize_req(req);
+        // Once the peer supports multiplexing, every request gets an ID,
+        // so that it doesn't need to wait for the previous response.
+        uint64_t req_id = 0;
+        if (multiplexing() && peer_supports_multiplexing_) {
+            req_id = ++last_req_id_;
+            // The response may arrive before the write completion handler
+            // runs, so the request should be looked up by its ID from now on.
+            if (!add_pending_read(req, when_done, send_timeout_ms, req_id)) {
+                return;
+            }
+        }
+
+        ptr<encoded_log_entries> req_enc;
+        std::vector<asio::const_buffer> req_spans;
+        ptr<buffer> req_buf = serialize_req(req, req_id, req_enc, req_spans);
 
         if (send_timeout_ms != 0)
         {
@@ -1722,17 +2300,20 @@ public:
                                                std::placeholders::_1 ) );
         }
 
-        // Note: without passing `req_buf` to callback function, it will be
-        //       unreachable before the write is done so that it is freed
-        //       and the memory corruption will occur.
+        // Note: without passing `req_buf` and `req_enc` (which owns the log
+        //       entries that `req_spans` point to) to callback function,
+        //       they will be unreachable before the write is done so that
+        //       they are freed and the memory corruption will occur.
         aa::write( ssl_enabled_, ssl_socket_, socket_,
-                   asio::buffer(req_buf->data(), req_buf->size()),
+                   req_spans,
                    std::bind( &asio_rpc_client::sent,
                               self,
                               req,
                               req_buf,
+                              req_enc,
                               when_done,
                               send_timeout_ms,
+                              req_id,
                               std::placeholders::_1,
                               std::placeholders::_2 ),
                    use_strand_ ? &ssl_strand_ : nullptr );
@@ -1811,10 +2392,10 @@ private:
         abandoned_ = true;
         close_socket(err_msg);
 
-        // In streaming mode, all `when_done` will be invoked in `close_socket()`.
-        // Otherwise, `close_socket()` will do nothing, hence `when_done`
-        // should directly be invoked here.
-        if (!impl_->get_options().streaming_mode_) {
+        // In streaming mode or multiplexing mode, all `when_done` will be
+        // invoked in `close_socket()`. Otherwise, `close_socket()` will do
+        // nothing, hence `when_done` should directly be invoked here.
+        if (!impl_->get_options().streaming_mode_ && !multiplexing()) {
             ptr<resp_msg> resp;
             ptr<rpc_exception> except(cs_new<rpc_exception>(err_msg, req));
             when_done(resp, except);
@@ -1838,12 +2419,12 @@ private:
             }
         }
 #endif
-        if (!impl_->get_options().streaming_mode_) {
+        if (!impl_->get_options().streaming_mode_ && !multiplexing()) {
             return;
         }
 
-        // In streaming mode, it should invoke all `when_done` callbacks,
-        // in chronological order.
+        // In streaming mode or multiplexing mode, it should invoke all
+        // `when_done` callbacks, in chronological order.
 
         // Clear write queue and read queue here
         // from oldest to latest, read queue first.
@@ -1973,19 +2554,22 @@ private:
 
     void sent( ptr<req_msg>& req,
                ptr<buffer>& buf,
+               ptr<encoded_log_entries>& enc,
                rpc_handler& when_done,
                uint64_t send_timeout_ms,
+               uint64_t req_id,
                std::error_code err,
                size_t bytes_transferred )
     {
-        // Now we can safely free the `req_buf`.
+        // Now we can safely free the `req_buf` and `enc`.
         (void)buf;
+        (void)enc;
         send_timer_.cancel();
         if (!err) {
             set_busy_flag(/*receive=*/ false, /*busy=*/ false);
             uint64_t receive_timeout_ms = send_timeout_ms;
-            if (impl_->get_options().streaming_mode_) {
-                post_send(req, when_done, receive_timeout_ms);
+            if (impl_->get_options().streaming_mode_ || multiplexing()) {
+                post_send(req, when_done, receive_timeout_ms, req_id);
             } else {
                 register_response_read(req, when_done, receive_timeout_ms);
             }
@@ -1999,14 +2583,39 @@ private:
         }
     }
 
-    void post_send(ptr<req_msg>& req, rpc_handler& when_done, uint64_t receive_timeout_ms) {
-        // first process read
+    void post_send(ptr<req_msg>& req,
+                   rpc_handler& when_done,
+                   uint64_t receive_timeout_ms,
+                   uint64_t req_id) {
+        // first process read.
+        // A request with ID is already in `pending_read_reqs_`,
+        // see `register_req_send()`.
+        if (!req_id &&
+            !add_pending_read(req, when_done, receive_timeout_ms, req_id)) {
+            return;
+        }
+
+        if (!impl_->get_options().streaming_mode_ && !req_id) {
+            // Multiplexing is not negotiated yet, the next request
+            // will be sent after the response is received.
+            return;
+        }
+
+        // next process write
+        send_next_req();
+    }
+
+    bool add_pending_read(ptr<req_msg>& req,
+                          rpc_handler& when_done,
+                          uint64_t receive_timeout_ms,
+                          uint64_t req_id) {
         bool immediate_action_needed = false;
         {
             auto_lock(pending_read_reqs_lock_);
             if (abandoned_)
-                return; // close_socket already drained pending_read_reqs_, don't add to it
-            pending_read_reqs_.push_back(cs_new<pending_req_pkg>(req, when_done, receive_timeout_ms));
+                return false; // close_socket already drained pending_read_reqs_, don't add to it
+            pending_read_reqs_.push_back(
+                cs_new<pending_req_pkg>(req, when_done, receive_timeout_ms, req_id));
             immediate_action_needed = (pending_read_reqs_.size() == 1);
             p_db("msg to peer %d has been write down, start_log_idx: %" PRIu64 ", "
                  "size: %" PRIu64 ", pending read reqs: %" PRIu64 "", req->get_dst(),
@@ -2017,8 +2626,10 @@ private:
         if (immediate_action_needed) {
             register_response_read(req, when_done, receive_timeout_ms);
         }
+        return true;
+    }
 
-        // next process write
+    void send_next_req() {
         ptr<pending_req_pkg> next_req_pkg{nullptr};
         {
             auto_lock(pending_write_reqs_lock_);
@@ -2059,6 +2670,21 @@ private:
                             this,
                             std::placeholders::_1 ) );
         }
+        if (compact_resp_) {
+            ptr<buffer> prefix_buf(buffer::alloc(RPC_COMPACT_PREFIX_SIZE));
+            aa::read( ssl_enabled_, ssl_socket_, socket_,
+                      asio::buffer(prefix_buf->data(), prefix_buf->size()),
+                      std::bind( &asio_rpc_client::compact_prefix_read,
+                                 self,
+                                 req,
+                                 when_done,
+                                 prefix_buf,
+                                 std::placeholders::_1,
+                                 std::placeholders::_2 ),
+                      use_strand_ ? &ssl_strand_ : nullptr );
+            return;
+        }
+
         ptr<buffer> resp_buf(buffer::alloc(RPC_RESP_HEADER_SIZE));
         aa::read( ssl_enabled_, ssl_socket_, socket_,
                   asio::buffer(resp_buf->data(), resp_buf->size()),
@@ -2078,7 +2704,6 @@ private:
                        std::error_code err,
                        size_t bytes_transferred)
     {
-        ptr<asio_rpc_client> self(this->shared_from_this());
         if (err) {
             receive_timer_.cancel();
             std::string err_msg = sstrfmt( "failed to read response to peer %d, %s:%s, "
@@ -2091,13 +2716,14 @@ private:
         }
 
         buffer_serializer bs(resp_buf);
-        uint32_t crc_local = crc32_8( resp_buf->data_begin(),
-                                      RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN,
-                                      0 );
         bs.pos(RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN);
         uint64_t flags_and_crc = bs.get_u64();
         uint32_t crc_buf = flags_and_crc & (uint32_t)0xffffffff;
         uint32_t flags = (flags_and_crc >> 32);
+        uint32_t crc_local = msg_crc( flags,
+                                      resp_buf->data_begin(),
+                                      RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN,
+                                      0 );
 
         if (crc_local != crc_buf) {
             receive_timer_.cancel();
@@ -2110,18 +2736,184 @@ private:
             return;
         }
 
+        rpc_resp_header hdr;
+        hdr.flags_ = flags;
         bs.pos(1);
-        byte msg_type_val = bs.get_u8();
-        int32 src = bs.get_i32();
-        int32 dst = bs.get_i32();
-        ulong term = bs.get_u64();
-        ulong nxt_idx = bs.get_u64();
-        byte accepted_val = bs.get_u8();
-        int32 carried_data_size = bs.get_i32();
+        hdr.type_ = (msg_type)bs.get_u8();
+        hdr.src_ = bs.get_i32();
+        hdr.dst_ = bs.get_i32();
+        hdr.term_ = bs.get_u64();
+        hdr.next_idx_ = bs.get_u64();
+        hdr.accepted_ = (bs.get_u8() == 1);
+        hdr.data_size_ = bs.get_i32();
+        resp_header_read(req, when_done, hdr, nullptr);
+    }
+
+    void compact_prefix_read(ptr<req_msg>& req,
+                             rpc_handler& when_done,
+                             ptr<buffer>& prefix_buf,
+                             std::error_code err,
+                             size_t bytes_transferred)
+    {
+        std::string err_msg;
+        size_t rest_size = 0;
+        if (err) {
+            err_msg = sstrfmt( "failed to read response to peer %d, %s:%s, "
+                               "error %d, %s" )
+                      .fmt( req->get_dst(), host_.c_str(),
+                            port_.c_str(), err.value(),
+                            err.message().c_str() );
+        } else if ( !rpc_wire::decode_compact_prefix
+                     ( *prefix_buf, 0x3, rest_size, err_msg ) ) {
+            err_msg += sstrfmt(", from peer %d, %s:%s")
+                       .fmt(req->get_dst(), host_.c_str(), port_.c_str());
+        }
+        if (!err_msg.empty()) {
+            receive_timer_.cancel();
+            handle_error(req, err_msg, when_done);
+            return;
+        }
+
+        // Read the rest of the header and the carried data at once.
+        ptr<asio_rpc_client> self(this->shared_from_this());
+        ptr<buffer> rest_buf(buffer::alloc(rest_size));
+        aa::read( ssl_enabled_, ssl_socket_, socket_,
+                  asio::buffer(rest_buf->data(), rest_size),
+                  std::bind( &asio_rpc_client::compact_rest_read,
+                             self,
+                             req,
+                             when_done,
+                             prefix_buf,
+                             rest_buf,
+                             std::placeholders::_1,
+                             std::placeholders::_2 ),
+                  use_strand_ ? &ssl_strand_ : nullptr );
+    }
+
+    void compact_rest_read(ptr<req_msg>& req,
+                           rpc_handler& when_done,
+                           ptr<buffer>& prefix_buf,
+                           ptr<buffer>& rest_buf,
+                           std::error_code err,
+                           size_t bytes_transferred)
+    {
+        std::string err_msg;
+        rpc_resp_header hdr;
+        size_t data_pos = 0;
+        if (err) {
+            err_msg = sstrfmt( "failed to read response to peer %d, %s:%s, "
+                               "error %d, %s" )
+                      .fmt( req->get_dst(), host_.c_str(),
+                            port_.c_str(), err.value(),
+                            err.message().c_str() );
+        } else if ( !rpc_wire::decode_compact_resp_header
+                     ( *prefix_buf, *rest_buf,
+                       compact_resp_src_, compact_resp_dst_,
+                       hdr, data_pos, err_msg ) ) {
+            err_msg += sstrfmt(", from peer %d, %s:%s")
+                       .fmt(req->get_dst(), host_.c_str(), port_.c_str());
+        }
+        if (!err_msg.empty()) {
+            receive_timer_.cancel();
+            handle_error(req, err_msg, when_done);
+            return;
+        }
+
+        ptr<buffer> ctx_buf;
+        if (hdr.data_size_) {
+            ctx_buf = buffer::slice(rest_buf, data_pos, hdr.data_size_);
+        }
+        resp_header_read(req, when_done, hdr, ctx_buf);
+    }
+
+    /**
+     * Handle a response header read from either format.
+     *
+     * @param req Request that the response is for.
+     * @param when_done Handler of the response.
+     * @param hdr Fields of the response header.
+     * @param ctx_buf Carried data if it has been read together with
+     *                the header, otherwise `nullptr`.
+     */
+    void resp_header_read(ptr<req_msg>& req,
+                          rpc_handler& when_done,
+                          const rpc_resp_header& hdr,
+                          ptr<buffer> ctx_buf)
+    {
+        ptr<asio_rpc_client> self(this->shared_from_this());
+        uint32_t flags = hdr.flags_;
+
+        if (flags & REQUEST_ID_INCLUDED) {
+            // `req` is just the oldest one in flight. Find out the actual
+            // request from the ID at the beginning of the carried data.
+            rpc_resp_header id_hdr = hdr;
+            if (ctx_buf) {
+                resp_id_read(req, when_done, id_hdr, ctx_buf,
+                             std::error_code(), ctx_buf->size());
+                return;
+            }
+            ctx_buf = buffer::alloc(hdr.data_size_);
+            aa::read( ssl_enabled_, ssl_socket_, socket_,
+                      asio::buffer(ctx_buf->data(), hdr.data_size_),
+                      std::bind( &asio_rpc_client::resp_id_read,
+                                 self,
+                                 req,
+                                 when_done,
+                                 id_hdr,
+                                 ctx_buf,
+                                 std::placeholders::_1,
+                                 std::placeholders::_2 ),
+                      use_strand_ ? &ssl_strand_ : nullptr );
+            return;
+        }
+
+        if ( (flags & CRC32C_SUPPORTED) &&
+             impl_->get_options().use_crc32c_ &&
+             !peer_supports_crc32c_ ) {
+            p_in( "peer %d (%s:%s) supports CRC-32C, switch to it (%s)",
+                  req->get_dst(), host_.c_str(), port_.c_str(),
+                  crc32c_impl_name() );
+            peer_supports_crc32c_ = true;
+        }
+
+        if ( (flags & LOG_COMPRESSION_SUPPORTED) &&
+             impl_->get_options().log_compression_threshold_ &&
+             !peer_supports_log_compression_ ) {
+            p_in( "peer %d (%s:%s) supports log compression, "
+                  "enable it for batches of %zu bytes or more",
+                  req->get_dst(), host_.c_str(), port_.c_str(),
+                  impl_->get_options().log_compression_threshold_ );
+            peer_supports_log_compression_ = true;
+        }
+
+        if ( (flags & COMPACT_HEADER_SUPPORTED) &&
+             impl_->get_options().compact_header_ &&
+             !peer_supports_compact_ ) {
+            p_in( "peer %d (%s:%s) supports compact headers, switch to them",
+                  req->get_dst(), host_.c_str(), port_.c_str() );
+            peer_supports_compact_ = true;
+        }
+
+        if ( (flags & MULTIPLEXING_SUPPORTED) &&
+             multiplexing() &&
+             !peer_supports_multiplexing_ ) {
+            p_in( "peer %d (%s:%s) supports multiplexing, "
+                  "send requests without waiting for responses",
+                  req->get_dst(), host_.c_str(), port_.c_str() );
+            peer_supports_multiplexing_ = true;
+        }
+
+        if (flags & COMPACT_HEADER_FOLLOWS) {
+            // Next responses will omit src and dst.
+            compact_resp_ = true;
+            compact_resp_src_ = hdr.src_;
+            compact_resp_dst_ = hdr.dst_;
+        }
+
         ptr<resp_msg> rsp
             ( cs_new<resp_msg>
-              ( term, (msg_type)msg_type_val, src, dst,
-                nxt_idx, accepted_val == 1 ) );
+              ( hdr.term_, hdr.type_, hdr.src_, hdr.dst_,
+                hdr.next_idx_, hdr.accepted_ ) );
 
         if ( !(flags & INCLUDE_META) &&
              impl_->get_options().read_resp_meta_ &&
@@ -2141,10 +2933,14 @@ private:
             rsp->set_extra_flags(rsp->get_extra_flags() | resp_msg::SELF_MARK_DOWN);
         }
 
-        if (carried_data_size) {
-            ptr<buffer> ctx_buf = buffer::alloc(carried_data_size);
+        if (ctx_buf) {
+            ctx_read(req, rsp, when_done, ctx_buf, flags,
+                     std::error_code(), ctx_buf->size());
+
+        } else if (hdr.data_size_) {
+            ctx_buf = buffer::alloc(hdr.data_size_);
             aa::read( ssl_enabled_, ssl_socket_, socket_,
-                      asio::buffer(ctx_buf->data(), carried_data_size),
+                      asio::buffer(ctx_buf->data(), hdr.data_size_),
                       std::bind( &asio_rpc_client::ctx_read,
                                  self,
                                  req,
@@ -2160,6 +2956,69 @@ private:
         }
     }
 
+    void resp_id_read(ptr<req_msg>& req,
+                      rpc_handler& when_done,
+                      rpc_resp_header& hdr,
+                      ptr<buffer>& ctx_buf,
+                      std::error_code err,
+                      size_t bytes_transferred)
+    {
+        std::string err_msg;
+        if (err) {
+            err_msg = sstrfmt( "failed to read response context "
+                               "from peer %d, %s:%s, error %d, %s" )
+                      .fmt( req->get_dst(), host_.c_str(),
+                            port_.c_str(), err.value(),
+                            err.message().c_str() );
+        } else if (ctx_buf->size() < REQUEST_ID_LEN) {
+            err_msg = sstrfmt( "wrong response context size %zu from "
+                               "peer %d, %s:%s" )
+                      .fmt( ctx_buf->size(), req->get_dst(),
+                            host_.c_str(), port_.c_str() );
+        }
+        if (!err_msg.empty()) {
+            receive_timer_.cancel();
+            handle_error(req, err_msg, when_done);
+            return;
+        }
+
+        buffer_serializer bs(ctx_buf);
+        uint64_t req_id = bs.get_u64();
+        ptr<pending_req_pkg> pkg;
+        {
+            auto_lock(pending_read_reqs_lock_);
+            for (auto& entry: pending_read_reqs_) {
+                if (entry->req_id_ == req_id) {
+                    pkg = entry;
+                    break;
+                }
+            }
+        }
+        if (!pkg) {
+            receive_timer_.cancel();
+            if (abandoned_) {
+                // `close_socket()` already invoked its callback.
+                return;
+            }
+            err_msg = sstrfmt( "unknown request ID %" PRIu64 " in response "
+                               "from peer %d, %s:%s" )
+                      .fmt( req_id, req->get_dst(),
+                            host_.c_str(), port_.c_str() );
+            handle_error(req, err_msg, when_done);
+            return;
+        }
+
+        // The rest is the same as a response without ID.
+        cur_resp_id_ = req_id;
+        hdr.flags_ &= ~REQUEST_ID_INCLUDED;
+        hdr.data_size_ -= REQUEST_ID_LEN;
+        ptr<buffer> rest_buf;
+        if (hdr.data_size_) {
+            rest_buf = bs.get_buffer_slice(hdr.data_size_);
+        }
+        resp_header_read(pkg->req_, pkg->when_done_, hdr, rest_buf);
+    }
+
     void ctx_read(ptr<req_msg>& req,
                   ptr<resp_msg>& rsp,
                   rpc_handler& when_done,
@@ -2236,8 +3095,7 @@ private:
         }
         if (ctx_len) {
             // It has context, read it.
-            ptr<buffer> actual_ctx = buffer::alloc(ctx_len);
-            bs.get_buffer(actual_ctx);
+            ptr<buffer> actual_ctx = bs.get_buffer_slice(ctx_len);
             rsp->set_ctx(actual_ctx);
             remaining_len -= ctx_len;
         }
@@ -2276,12 +3134,16 @@ private:
         receive_timer_.cancel();
         set_busy_flag(/*receive=*/ true, /*busy=*/ false);
 
-        if (!impl_->get_options().streaming_mode_) {
+        const bool streaming = impl_->get_options().streaming_mode_;
+        if (!streaming && !multiplexing()) {
             ptr<rpc_exception> except;
             when_done(rsp, except);
             return;
         }
 
+        uint64_t req_id = cur_resp_id_;
+        cur_resp_id_ = 0;
+
         // trigger next read
         ptr<pending_req_pkg> next_req_pkg{nullptr};
         bool popped = false;
@@ -2290,7 +3152,21 @@ private:
             // NOTE:
             //   The queue can be empty due to `close_socket()`
             //   when connection is suddenly closed.
-            if (pending_read_reqs_.size()) {
+            if (req_id) {
+                // Multiplexed response, can be for any request in the queue.
+                for (auto it = pending_read_reqs_.begin();
+                     it != pending_read_reqs_.end(); ++it) {
+                    if ((*it)->req_id_ == req_id) {
+                        pending_read_reqs_.erase(it);
+                        popped = true;
+                        break;
+                    }
+                }
+                if (!pending_read_reqs_.empty()) {
+                    next_req_pkg = *pending_read_reqs_.begin();
+                }
+
+            } else if (pending_read_reqs_.size()) {
                 assert(pending_read_reqs_.front()->req_ == req);
                 pending_read_reqs_.pop_front();
                 popped = true;
@@ -2317,6 +3193,11 @@ private:
             when_done(rsp, except);
         }
 
+        if (!streaming && !req_id && popped) {
+            // Multiplexing is not negotiated yet, now send the next request.
+            send_next_req();
+        }
+
         if (next_req_pkg) {
             register_response_read(next_req_pkg->req_,
                                    next_req_pkg->when_done_,
@@ -2340,8 +3221,8 @@ private:
     // asio_rpc_client consists of two "threads" of work: send side and receive side.
     // Each "thread" is a chain of boost asio calls and their callbacks,
     // executed sequentially.
-    // In streaming mode, the two chains can run in parallel, and we should
-    // be careful to avoid data races.
+    // In streaming mode or multiplexing mode, the two chains can run
+    // in parallel, and we should be careful to avoid data races.
     // Send side covers connection, SSL handshake, and sending requests.
     // Receive side covers receiving responses.
 
@@ -2364,8 +3245,45 @@ private:
     // and we should stop all activity and reject any future requests.
     std::atomic<bool> abandoned_ {false};
 
+    // True if the peer is able to verify CRC-32C,
+    // learned from the flags of its response.
+    std::atomic<bool> peer_supports_crc32c_ {false};
+
+    // True if the peer is able to decompress log entries,
+    // learned from the flags of its response.
+    std::atomic<bool> peer_supports_log_compression_ {false};
+
+    // True if the peer is able to read compact headers,
+    // learned from the flags of its response.
+    std::atomic<bool> peer_supports_compact_ {false};
+
+    // True if the following requests will have compact headers.
+    // Only the send side accesses it.
+    bool compact_req_ {false};
+
+    // True if the following responses will have compact headers,
+    // and their source and destination IDs.
+    // Only the receive side accesses them.
+    bool compact_resp_ {false};
+    int32 compact_resp_src_ {-1};
+    int32 compact_resp_dst_ {-1};
+
+    // True if the peer is able to answer requests with ID,
+    // learned from the flags of its response.
+    std::atomic<bool> peer_supports_multiplexing_ {false};
+
+    // ID of the last request sent with ID.
+    // Only the send side accesses it.
+    uint64_t last_req_id_ {0};
+
+    // ID of the request that the response being read answers,
+    // 0 if the response has no ID. Only the receive side accesses it.
+    uint64_t cur_resp_id_ {0};
+
     /**
      * Queue of request which is pending for reading.
+     * With multiplexing, responses can arrive in any order,
+     * and they are matched by `pending_req_pkg::req_id_`.
      */
     std::mutex pending_read_reqs_lock_;
     std::list<ptr<pending_req_pkg>> pending_read_reqs_;
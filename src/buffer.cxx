@@ -19,15 +19,23 @@ limitations under the License.
 **************************************************************************/
 
 #include "buffer.hxx"
+#include "buffer_pool.hxx"
 #include "stat_mgr.hxx"
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
 
 #define __init_block(ptr, len)  ( (ulong*)(ptr) )[0] = (ulong)len;    \
                                 ( (ulong*)(ptr) )[1] = 0
 
-#define __size_of_block(p)      ( *( (ulong*)(p) ))
+// Slice: the highest bit of the size field is set, and the data pointer
+//        follows the size and position fields (see `slice_block`).
+#define __SLICE_FLAG            ( (ulong)1 << 63 )
+
+#define __is_slice_block(p)     ( ( *( (ulong*)(p) ) & __SLICE_FLAG ) != 0 )
+
+#define __size_of_block(p)      ( *( (ulong*)(p) ) & ~__SLICE_FLAG )
 
 #define __pos_of_block(p)       ( (ulong*)(p) )[1]
 
@@ -35,12 +43,27 @@ limitations under the License.
 
 #define __set_block_pos(ptr, pos)  ( (ulong*)(ptr) )[1] = (pos)
 
-#define __data_of_block(p)   (byte*)( ( (byte*)( ((ulong*)(p)) + 2 ) ) + __pos_of_block(p) )
+#define __entire_data_of_block(p)                               \
+    ( __is_slice_block(p)                                       \
+      ? reinterpret_cast<const slice_block*>(p)->data_          \
+      : (byte*)( (byte*)( ((ulong*)(p)) + 2 ) ) )
 
-#define __entire_data_of_block(p)  (byte*)( (byte*)( ((ulong*)(p))   + 2 ) )
+#define __data_of_block(p)   ( __entire_data_of_block(p) + __pos_of_block(p) )
 
 namespace nuraft {
 
+struct slice_block {
+    // The first two fields should be the same as those of normal block.
+    ulong size_;
+    ulong pos_;
+
+    // Pointer to the beginning of the data in `parent_`.
+    byte* data_;
+
+    // Keep the parent allocation alive while this slice exists.
+    ptr<buffer> parent_;
+};
+
 static void free_buffer(buffer* buf) {
     static stat_elem& num_active = *stat_mgr::get_instance()->create_stat
         (stat_elem::COUNTER, "num_active_buffers");
@@ -77,6 +100,40 @@ ptr<buffer> buffer::alloc(const size_t size) {
     return buf;
 }
 
+ptr<buffer> buffer::slice(const ptr<buffer>& parent,
+                          size_t offset,
+                          size_t len)
+{
+    static stat_elem& num_slices = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "num_buffer_slices");
+
+    if (!parent) {
+        throw std::invalid_argument("slice of null buffer");
+    }
+    if (offset > parent->size() || len > parent->size() - offset) {
+        throw std::out_of_range( "slice range exceeds the size "
+                                 "of the parent buffer" );
+    }
+
+    ptr<slice_block> blk = cs_new<slice_block>();
+    blk->size_ = (ulong)len | __SLICE_FLAG;
+    blk->pos_ = 0;
+    blk->data_ = parent->data_begin() + offset;
+    // Slice of slice: refer to the original allocation directly,
+    // not to form a chain.
+    blk->parent_ = __is_slice_block(parent.get())
+                   ? reinterpret_cast<slice_block*>(parent.get())->parent_
+                   : parent;
+    num_slices++;
+
+    // Share the reference counter of `blk`.
+    return ptr<buffer>(blk, reinterpret_cast<buffer*>(blk.get()));
+}
+
+bool buffer::is_slice() const {
+    return __is_slice_block(this);
+}
+
 ptr<buffer> buffer::copy(const buffer& buf) {
     ptr<buffer> other = alloc(buf.size() - buf.pos());
     other->put(buf);
@@ -114,6 +171,9 @@ ptr<buffer> buffer::expand(const buffer& buf, uint32_t new_size) {
 }
 
 size_t buffer::container_size() const {
+    if (__is_slice_block(this)) {
+        return (size_t)( __size_of_block(this) + sizeof(slice_block) );
+    }
     return (size_t)( __size_of_block(this) + sizeof(ulong) * 2);
 }
 
@@ -347,6 +407,75 @@ void buffer::put_raw(const byte* ba, size_t len) {
     __mv_fw_block(this, len);
 }
 
+buffer_pool::buffer_pool(size_t max_buffers_per_class)
+    : max_buffers_per_class_(max_buffers_per_class)
+{
+    size_t num_classes = 1;
+    for (size_t ss = MIN_CLASS_SIZE; ss < MAX_CLASS_SIZE; ss <<= 1) {
+        num_classes++;
+    }
+    classes_.resize(num_classes);
+}
+
+ptr<buffer> buffer_pool::acquire(size_t size) {
+    static stat_elem& pool_hits = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "buffer_pool_hits");
+    static stat_elem& pool_allocs = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "buffer_pool_allocs");
+    static stat_elem& num_active = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "num_active_buffers");
+    static stat_elem& amount_active = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "amount_active_buffers");
+
+    if (size > MAX_CLASS_SIZE || !max_buffers_per_class_) {
+        return buffer::alloc(size);
+    }
+
+    size_t class_idx = 0;
+    size_t capacity = MIN_CLASS_SIZE;
+    while (capacity < size) {
+        capacity <<= 1;
+        class_idx++;
+    }
+
+    std::vector< ptr<buffer> >& entries = classes_[class_idx];
+    for (ptr<buffer>& ee: entries) {
+        // If the pool is the only owner, nobody else can get a new
+        // reference to it, so that it is safe to reuse.
+        if (ee.use_count() != 1) continue;
+
+        // Make sure that the previous owner's accesses happened before.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        any_ptr ptr = reinterpret_cast<any_ptr>( ee.get() );
+        __init_block(ptr, size);
+        pool_hits++;
+        return ee;
+    }
+
+    if (entries.size() >= max_buffers_per_class_) {
+        return buffer::alloc(size);
+    }
+
+    // Allocate the entire capacity of the class, and then set the
+    // requested size. Since the size can be changed later, the deleter
+    // keeps the original size for the accounting.
+    size_t len = capacity + sizeof(ulong) * 2;
+    ptr<buffer> buf( reinterpret_cast<buffer*>(new char[len]),
+                     [len](buffer* bb) {
+                         num_active--;
+                         amount_active -= len;
+                         delete[] reinterpret_cast<char*>(bb);
+                     } );
+    num_active++;
+    amount_active += len;
+    pool_allocs++;
+
+    any_ptr ptr = reinterpret_cast<any_ptr>( buf.get() );
+    __init_block(ptr, size);
+    entries.push_back(buf);
+    return buf;
+}
+
 }  // namespace nuraft;
 using namespace nuraft;
 
@@ -0,0 +1,75 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "buffer.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Recycles buffers of power-of-two size classes.
+ *
+ * A buffer returned by `acquire()` goes back to the pool automatically,
+ * once all the references to it (including its slices) are released.
+ * There is no explicit release API.
+ *
+ * This class is not thread-safe: `acquire()` should be called by
+ * a single thread at a time, e.g., from the read path of a session.
+ * Acquired buffers can be released by any thread.
+ */
+class buffer_pool {
+public:
+    /**
+     * @param max_buffers_per_class Maximum number of buffers to keep
+     *                              for each size class.
+     */
+    buffer_pool(size_t max_buffers_per_class);
+
+    __nocopy__(buffer_pool);
+
+public:
+    // Smallest size class.
+    static const size_t MIN_CLASS_SIZE = 1024;
+
+    // Largest size class. Bigger buffers are not pooled.
+    static const size_t MAX_CLASS_SIZE = 16 * 1024 * 1024;
+
+    /**
+     * Get a buffer whose `size()` is the given size, and
+     * position is zero. The content is not initialized.
+     *
+     * If there is no idle buffer in the corresponding size class and
+     * the class is full, a normal (non-pooled) buffer will be returned.
+     *
+     * @param size Size of buffer.
+     * @return buffer instance.
+     */
+    ptr<buffer> acquire(size_t size);
+
+private:
+    size_t max_buffers_per_class_;
+
+    // Index: size class, from `MIN_CLASS_SIZE` to `MAX_CLASS_SIZE`.
+    std::vector< std::vector< ptr<buffer> > > classes_;
+};
+
+}
@@ -118,6 +118,7 @@ buffer_serializer::buffer_serializer(buffer& src_buf,
                                      buffer_serializer::endianness endian)
     : endian_(endian)
     , buf_(src_buf)
+    , buf_ptr_(nullptr)
     , pos_(0)
 {}
 
@@ -125,6 +126,7 @@ buffer_serializer::buffer_serializer(ptr<buffer>& src_buf_ptr,
                                      buffer_serializer::endianness endian)
     : endian_(endian)
     , buf_(*src_buf_ptr)
+    , buf_ptr_(src_buf_ptr)
     , pos_(0)
 {}
 
@@ -344,6 +346,19 @@ void buffer_serializer::get_buffer(ptr<buffer>& dst) {
     ::memcpy(dst->data(), ptr, len);
 }
 
+ptr<buffer> buffer_serializer::get_buffer_slice(size_t len) {
+    if ( !is_valid(len) ) throw std::overflow_error("not enough space");
+    ptr<buffer> ret;
+    if (buf_ptr_) {
+        ret = buffer::slice(buf_ptr_, pos_, len);
+        pos( pos() + len );
+    } else {
+        ret = buffer::alloc(len);
+        get_buffer(ret);
+    }
+    return ret;
+}
+
 void* buffer_serializer::get_bytes(size_t& len) {
     len = get_u32();
     if ( !is_valid(len) ) throw std::overflow_error("not enough space");
@@ -17,7 +17,10 @@ client_req_stream::client_req_stream(raft_server& srv,
     , stream_term_(stream_term)
     , rpc_(rpc)
     , send_timeout_ms_(send_timeout_ms)
-    , supports_pipelining_(rpc_ ? rpc_->supports_pipelining() : true)
+    , supports_pipelining_( rpc_
+                            ? ( rpc_->supports_pipelining() ||
+                                rpc_->supports_multiplexing() )
+                            : true )
     , state_(cs_new<State>())
 {}
 
@@ -34,6 +34,13 @@ uint32_t crc32_1(const void* data, size_t len, uint32_t prev_value);
 uint32_t crc32_8(const void* data, size_t len, uint32_t prev_value);
 uint32_t crc32_8_last8(const void* data, size_t len, uint32_t prev_value);
 
+// CRC-32C (Castagnoli). Uses hardware instructions if available.
+uint32_t crc32c(const void* data, size_t len, uint32_t prev_value);
+// CRC-32C, software implementation only.
+uint32_t crc32c_sw(const void* data, size_t len, uint32_t prev_value);
+// Name of CRC-32C implementation chosen at runtime.
+const char* crc32c_impl_name();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,271 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "crc32.hxx"
+
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #define CRC32C_X86 (1)
+    #include <nmmintrin.h>
+    #include <wmmintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+    #define CRC32C_ARM (1)
+    #include <arm_acle.h>
+    #include <sys/auxv.h>
+    #ifndef HWCAP_CRC32
+        #define HWCAP_CRC32 (1 << 7)
+    #endif
+#endif
+
+// CRC-32C (Castagnoli), reversed representation.
+#define CRC32C_POLY (0x82F63B78)
+
+namespace {
+
+// === Software (slicing-by-8) ================================================
+
+struct crc32c_table {
+    crc32c_table() {
+        for (uint32_t ii = 0; ii < 256; ++ii) {
+            uint32_t crc = ii;
+            for (int jj = 0; jj < 8; ++jj) {
+                crc = (crc >> 1) ^ ((crc & 1) * CRC32C_POLY);
+            }
+            lookup_[0][ii] = crc;
+        }
+        for (uint32_t ii = 0; ii < 256; ++ii) {
+            for (int kk = 1; kk < 8; ++kk) {
+                uint32_t prev = lookup_[kk - 1][ii];
+                lookup_[kk][ii] = (prev >> 8) ^ lookup_[0][prev & 0xFF];
+            }
+        }
+    }
+    uint32_t lookup_[8][256];
+};
+
+const crc32c_table& get_sw_table() {
+    static crc32c_table table;
+    return table;
+}
+
+uint32_t sw_update(uint32_t crc, const uint8_t* cur, size_t len) {
+    const uint32_t (&lookup)[8][256] = get_sw_table().lookup_;
+    while (len >= 8) {
+        uint32_t one, two;
+        memcpy(&one, cur, 4);
+        memcpy(&two, cur + 4, 4);
+        one ^= crc;
+        crc = lookup[7][(one      ) & 0xFF] ^
+              lookup[6][(one >>  8) & 0xFF] ^
+              lookup[5][(one >> 16) & 0xFF] ^
+              lookup[4][(one >> 24) & 0xFF] ^
+              lookup[3][(two      ) & 0xFF] ^
+              lookup[2][(two >>  8) & 0xFF] ^
+              lookup[1][(two >> 16) & 0xFF] ^
+              lookup[0][(two >> 24) & 0xFF];
+        cur += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ lookup[0][(crc & 0xFF) ^ *cur++];
+    }
+    return crc;
+}
+
+// === x86-64: SSE4.2 + PCLMUL ================================================
+
+#ifdef CRC32C_X86
+
+// Block sizes (in bytes) for processing three streams in parallel.
+// Three independent `crc32` instructions can be in flight at once,
+// and the partial results are folded by carry-less multiplication.
+const size_t LONG_BLOCK = 8192;
+const size_t SHORT_BLOCK = 256;
+
+// Returns x^n mod P, in reversed representation.
+uint32_t xpow_mod(size_t n) {
+    uint32_t val = 0x80000000; // 1.
+    while (n--) {
+        val = (val & 1) ? ((val >> 1) ^ CRC32C_POLY) : (val >> 1);
+    }
+    return val;
+}
+
+struct crc32c_fold_consts {
+    // `crc32(0, clmul(a, K))` is `a * K * x^33 mod P`. To shift a CRC by
+    // `n` bytes (i.e., multiply by x^(8n)), K should be x^(8n - 33).
+    crc32c_fold_consts()
+        : long_1x_(xpow_mod(LONG_BLOCK * 8 - 33))
+        , long_2x_(xpow_mod(LONG_BLOCK * 2 * 8 - 33))
+        , short_1x_(xpow_mod(SHORT_BLOCK * 8 - 33))
+        , short_2x_(xpow_mod(SHORT_BLOCK * 2 * 8 - 33))
+        {}
+    uint32_t long_1x_;
+    uint32_t long_2x_;
+    uint32_t short_1x_;
+    uint32_t short_2x_;
+};
+
+const crc32c_fold_consts& get_fold_consts() {
+    static crc32c_fold_consts consts;
+    return consts;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+inline uint32_t crc32c_shift(uint32_t crc, uint32_t k) {
+    __m128i prod = _mm_clmulepi64_si128( _mm_cvtsi32_si128(crc),
+                                         _mm_cvtsi32_si128(k),
+                                         0 );
+    return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(prod));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+inline const uint8_t* crc32c_3way(uint32_t& crc,
+                                  const uint8_t* cur,
+                                  size_t& len,
+                                  size_t block,
+                                  uint32_t k1,
+                                  uint32_t k2)
+{
+    while (len >= block * 3) {
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+        const uint8_t* end = cur + block;
+        while (cur < end) {
+            uint64_t v0, v1, v2;
+            memcpy(&v0, cur, 8);
+            memcpy(&v1, cur + block, 8);
+            memcpy(&v2, cur + block * 2, 8);
+            crc0 = _mm_crc32_u64(crc0, v0);
+            crc1 = _mm_crc32_u64(crc1, v1);
+            crc2 = _mm_crc32_u64(crc2, v2);
+            cur += 8;
+        }
+        crc = crc32c_shift((uint32_t)crc0, k2) ^
+              crc32c_shift((uint32_t)crc1, k1) ^
+              (uint32_t)crc2;
+        cur += block * 2;
+        len -= block * 3;
+    }
+    return cur;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+uint32_t hw_update(uint32_t crc, const uint8_t* cur, size_t len) {
+    // Align to 8 bytes.
+    while (len && ((uintptr_t)cur & 7)) {
+        crc = _mm_crc32_u8(crc, *cur++);
+        len--;
+    }
+
+    const crc32c_fold_consts& kk = get_fold_consts();
+    cur = crc32c_3way(crc, cur, len, LONG_BLOCK, kk.long_1x_, kk.long_2x_);
+    cur = crc32c_3way(crc, cur, len, SHORT_BLOCK, kk.short_1x_, kk.short_2x_);
+
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t val;
+        memcpy(&val, cur, 8);
+        crc64 = _mm_crc32_u64(crc64, val);
+        cur += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *cur++);
+    }
+    return crc;
+}
+
+bool hw_supported() {
+    return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+}
+
+const char* HW_NAME = "sse4.2+pclmul";
+
+#endif // CRC32C_X86
+
+// === AArch64: ARMv8 CRC =====================================================
+
+#ifdef CRC32C_ARM
+
+__attribute__((target("+crc")))
+uint32_t hw_update(uint32_t crc, const uint8_t* cur, size_t len) {
+    while (len && ((uintptr_t)cur & 7)) {
+        crc = __crc32cb(crc, *cur++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t val;
+        memcpy(&val, cur, 8);
+        crc = __crc32cd(crc, val);
+        cur += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32cb(crc, *cur++);
+    }
+    return crc;
+}
+
+bool hw_supported() {
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+const char* HW_NAME = "armv8-crc";
+
+#endif // CRC32C_ARM
+
+// === Dispatch ===============================================================
+
+typedef uint32_t (*crc32c_func)(uint32_t, const uint8_t*, size_t);
+
+struct crc32c_dispatcher {
+    crc32c_dispatcher()
+        : func_(sw_update)
+        , name_("software")
+    {
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+        if (hw_supported()) {
+            func_ = hw_update;
+            name_ = HW_NAME;
+        }
+#endif
+    }
+    crc32c_func func_;
+    const char* name_;
+};
+
+const crc32c_dispatcher& get_dispatcher() {
+    static crc32c_dispatcher dispatcher;
+    return dispatcher;
+}
+
+} // namespace
+
+uint32_t crc32c(const void* data, size_t len, uint32_t prev_value) {
+    return ~get_dispatcher().func_( ~prev_value, (const uint8_t*)data, len );
+}
+
+uint32_t crc32c_sw(const void* data, size_t len, uint32_t prev_value) {
+    return ~sw_update( ~prev_value, (const uint8_t*)data, len );
+}
+
+const char* crc32c_impl_name() {
+    return get_dispatcher().name_;
+}
+
@@ -23,20 +23,25 @@ limitations under the License.
 #include "raft_params.hxx"
 #include "raft_server.hxx"
 
+#include "append_dispatcher.hxx"
 #include "cluster_config.hxx"
+#include "crc32.hxx"
 #include "error_code.hxx"
 #include "event_awaiter.hxx"
 #include "exit_handler.hxx"
 #include "handle_custom_notification.hxx"
+#include "log_entry_cache.hxx"
 #include "peer.hxx"
 #include "snapshot.hxx"
 #include "state_machine.hxx"
+#include "stat_mgr.hxx"
 #include "state_mgr.hxx"
 #include "tracer.hxx"
 
 #include <algorithm>
 #include <cassert>
 #include <sstream>
+#include <vector>
 
 namespace nuraft {
 
@@ -50,11 +55,21 @@ struct resp_appendix {
         RECEIVING_SNAPSHOT = 2,
         COMPACTED_SNAPSHOT_BOUNDARY = 3,
         NOTIFYING_SM_COMMITTED_INDEX = 4,
+        CONFLICTING_TERM = 5,
+        LOG_PACK_DECLINED = 6,
+    };
+
+    enum feature : uint32_t {
+        // Can apply a log pack in `append_entries`.
+        LOG_PACK = 0x1,
     };
 
     resp_appendix()
         : extra_order_(NONE)
         , sm_committed_idx_(0)
+        , conflict_term_(0)
+        , conflict_term_first_idx_(0)
+        , features_(0)
         {}
 
     ptr<buffer> serialize() const {
@@ -62,6 +77,15 @@ struct resp_appendix {
         size_t buf_len = sizeof(CUR_VERSION) + sizeof(extra_order_);
         if (extra_order_ == NOTIFYING_SM_COMMITTED_INDEX) {
             buf_len += sizeof(sm_committed_idx_);
+        } else if (extra_order_ == CONFLICTING_TERM) {
+            buf_len += sizeof(conflict_term_) + sizeof(conflict_term_first_idx_);
+        }
+        if (!relay_progress_.empty() || features_) {
+            buf_len += sizeof(uint32_t) +
+                       relay_progress_.size() * (sizeof(int32) + sizeof(uint64_t));
+        }
+        if (features_) {
+            buf_len += sizeof(features_);
         }
 
         //  << Format >>
@@ -73,12 +97,39 @@ struct resp_appendix {
         // Extra order          1 byte
         // SM committed index   8 bytes
 
+        //  << Format (if order == CONFLICTING_TERM) >>
+        // Format version       1 byte
+        // Extra order          1 byte
+        // Conflicting term     8 bytes
+        // First index of term  8 bytes
+
+        //  << Followed by (if relay progress or features exist) >>
+        // Number of learners   4 bytes
+        // { Learner ID         4 bytes
+        //   Matched index      8 bytes } * number of learners
+
+        //  << Followed by (if features exist) >>
+        // Features             4 bytes
+
         ptr<buffer> result = buffer::alloc(buf_len);
         buffer_serializer bs(*result);
         bs.put_u8(CUR_VERSION);
         bs.put_u8(extra_order_);
         if (extra_order_ == NOTIFYING_SM_COMMITTED_INDEX) {
             bs.put_u64(sm_committed_idx_);
+        } else if (extra_order_ == CONFLICTING_TERM) {
+            bs.put_u64(conflict_term_);
+            bs.put_u64(conflict_term_first_idx_);
+        }
+        if (!relay_progress_.empty() || features_) {
+            bs.put_u32(relay_progress_.size());
+            for (auto& entry: relay_progress_) {
+                bs.put_i32(entry.first);
+                bs.put_u64(entry.second);
+            }
+        }
+        if (features_) {
+            bs.put_u32(features_);
         }
 
         return result;
@@ -98,6 +149,24 @@ struct resp_appendix {
         if (res->extra_order_ == NOTIFYING_SM_COMMITTED_INDEX &&
             bs.pos() + sizeof(uint64_t) <= buf.size()) {
             res->sm_committed_idx_ = bs.get_u64();
+        } else if (res->extra_order_ == CONFLICTING_TERM &&
+                   bs.pos() + sizeof(uint64_t) * 2 <= buf.size()) {
+            res->conflict_term_ = bs.get_u64();
+            res->conflict_term_first_idx_ = bs.get_u64();
+        }
+
+        // Relay progress is optional, and ignored by old versions.
+        if (bs.pos() + sizeof(uint32_t) <= buf.size()) {
+            uint32_t num_learners = bs.get_u32();
+            for (uint32_t ii = 0; ii < num_learners; ++ii) {
+                if (bs.pos() + sizeof(int32) + sizeof(uint64_t) > buf.size()) break;
+                int32 learner_id = bs.get_i32();
+                uint64_t matched_idx = bs.get_u64();
+                res->relay_progress_.push_back( {learner_id, matched_idx} );
+            }
+        }
+        if (bs.pos() + sizeof(uint32_t) <= buf.size()) {
+            res->features_ = bs.get_u32();
         }
         return res;
     }
@@ -114,6 +183,10 @@ struct resp_appendix {
             return "COMPACTED_SNAPSHOT_BOUNDARY";
         case NOTIFYING_SM_COMMITTED_INDEX:
             return "NOTIFYING_SM_COMMITTED_INDEX";
+        case CONFLICTING_TERM:
+            return "CONFLICTING_TERM";
+        case LOG_PACK_DECLINED:
+            return "LOG_PACK_DECLINED";
         default:
             return "UNKNOWN";
         }
@@ -129,10 +202,128 @@ struct resp_appendix {
      * the state machine of the follower who sent this response.
      */
     uint64_t sm_committed_idx_;
+
+    /**
+     * If non-zero, it indicates the term of the follower's log
+     * at the index that the leader probed, which doesn't match
+     * the leader's one.
+     */
+    uint64_t conflict_term_;
+
+    /**
+     * The first log index of `conflict_term_` in the follower's log.
+     */
+    uint64_t conflict_term_first_idx_;
+
+    /**
+     * Pairs of {learner ID, matched log index} of the learners that
+     * the follower who sent this response relays logs to.
+     */
+    std::vector< std::pair<int32, uint64_t> > relay_progress_;
+
+    /**
+     * Bitmap of `feature` that the follower supports.
+     */
+    uint32_t features_;
 };
 
 const static int32 APPEND_ENTRIES_SAME_START_THROTTLE_THRESHOLD = 5;
 
+struct raft_server::append_entries_plan {
+    append_entries_plan()
+        : starting_idx_(0)
+        , cur_nxt_idx_(0)
+        , commit_idx_(0)
+        , term_(0)
+        , last_log_idx_(0)
+        , last_log_term_(0)
+        , end_idx_(0)
+        , peer_last_sent_idx_(0)
+        , batch_size_hint_(0)
+        , entries_valid_(false)
+        , active_async_snapshot_transfer_(false)
+        , active_snp_(nullptr)
+        , excluded_from_quorum_(false)
+        {}
+
+    /**
+     * Start log index of the leader.
+     */
+    ulong starting_idx_;
+
+    /**
+     * Next log index of the leader, based on the pre-commit index.
+     */
+    ulong cur_nxt_idx_;
+
+    ulong commit_idx_;
+    ulong term_;
+
+    /**
+     * Last log index of the peer, and its term.
+     */
+    ulong last_log_idx_;
+    ulong last_log_term_;
+
+    /**
+     * Log entries in `[last_log_idx_ + 1, end_idx_)` will be sent.
+     */
+    ulong end_idx_;
+
+    ulong peer_last_sent_idx_;
+    int64 batch_size_hint_;
+
+    /**
+     * `false` if the logs to send are not in the log store anymore.
+     */
+    bool entries_valid_;
+
+    bool active_async_snapshot_transfer_;
+    ptr<snapshot> active_snp_;
+
+    /**
+     * `true` if the request should be flagged with
+     * `EXCLUDED_FROM_THE_QUORUM` in full consensus mode.
+     */
+    bool excluded_from_quorum_;
+};
+
+/**
+ * Returns the log entry to be sent to a witness. An application log
+ * is replaced with an `app_log_meta` entry that has the CRC32 and
+ * the original size of its payload.
+ */
+static ptr<log_entry> make_witness_log_entry(const ptr<log_entry>& le) {
+    if ( le->get_val_type() != log_val_type::app_log ||
+         le->is_buf_null() ) {
+        return le;
+    }
+
+    buffer& payload = le->get_buf();
+    uint32_t crc = le->has_crc32()
+                   ? le->get_crc32()
+                   : crc32_8(payload.data_begin(), payload.size(), 0);
+
+    //  << Format >>
+    // CRC32 of payload     4 bytes
+    // Size of payload      8 bytes
+    ptr<buffer> meta = buffer::alloc(sizeof(uint32_t) + sizeof(uint64_t));
+    buffer_serializer bs(*meta);
+    bs.put_u32(crc);
+    bs.put_u64(payload.size());
+    return cs_new<log_entry>( le->get_term(), meta, log_val_type::app_log_meta,
+                              le->get_timestamp() );
+}
+
+/**
+ * Returns `true` if the given `append_entries` request carries
+ * a log pack, instead of individual log entries.
+ */
+static bool is_log_pack_req(req_msg& req) {
+    return req.log_entries().size() == 1 &&
+           req.log_entries()[0]->get_val_type() == log_val_type::log_pack;
+}
+
 void raft_server::append_entries_in_bg() {
     std::string thread_name = "nuraft_append";
 #ifdef __linux__
@@ -248,6 +439,11 @@ bool raft_server::request_append_entries(ptr<peer> p) {
         }
     }
 
+    if (is_relayed_peer(*p)) {
+        // Logs are being relayed by another member.
+        return true;
+    }
+
     bool need_to_reconnect = p->need_to_reconnect();
     int32 last_active_time_ms = p->get_active_timer_us() / 1000;
     if ( last_active_time_ms >
@@ -344,16 +540,44 @@ bool raft_server::request_append_entries(ptr<peer> p) {
             p->reset_stream();
         }
         bool streaming = last_streamed_log_idx > 0;
-
-        if (streaming || p->make_busy()) {
+        bool windowed = !streaming &&
+                        max_gap_in_stream == 0 &&
+                        is_replication_window_usable(p);
+
+        if (p->is_snapshot_busy()) {
+            // A snapshot chunk is in flight on a multiplexed connection,
+            // the next one will be sent once its response arrives.
+            // Meanwhile, keep sending heartbeats.
+            if (send_heartbeat_during_snapshot(p)) {
+                return true;
+            }
+        } else if (windowed) {
+            if (send_append_entries_in_window(p)) {
+                return true;
+            }
+        } else if (streaming || p->make_busy()) {
             p_ts("send request to %d, streaming: %d, is_busy: %d\n", (int)p->get_id(),
                  streaming, p->is_busy());
-            msg = create_append_entries_req(p, last_streamed_log_idx);
             m_handler = resp_handler_;
+            if ( !streaming &&
+                 params->append_dispatch_threads_ > 0 &&
+                 append_dispatcher_ ) {
+                // Only decide what to send here, reading logs and
+                // building the request are done by the dispatcher.
+                ptr<append_entries_plan> plan = cs_new<append_entries_plan>();
+                if (prepare_append_entries_req(p, 0, *plan, msg)) {
+                    return dispatch_append_entries_req(p, plan);
+                }
+                // Otherwise, `msg` is a special request (e.g., snapshot)
+                // built as usual.
+            } else {
+                msg = create_append_entries_req(p, last_streamed_log_idx);
+            }
 
             if (msg) {
                 streaming = streaming &&
-                            msg->get_type() == msg_type::append_entries_request;
+                            msg->get_type() == msg_type::append_entries_request &&
+                            !is_log_pack_req(*msg);
                 bool make_busy_result = p->is_busy();
                 if (streaming) {
                     // throttling
@@ -379,6 +603,11 @@ bool raft_server::request_append_entries(ptr<peer> p) {
                 }
 
                 if (streaming || make_busy_result) {
+                    if ( msg->get_type() == msg_type::install_snapshot_request &&
+                         p->move_busy_to_snapshot() ) {
+                        p_ts("snapshot chunk to peer %d doesn't block "
+                             "other requests", p->get_id());
+                    }
                     return send_request(p, msg, m_handler, streaming);
                 }
             } else {
@@ -420,10 +649,224 @@ bool raft_server::request_append_entries(ptr<peer> p) {
     return false;
 }
 
+bool raft_server::is_replication_window_usable(ptr<peer>& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->replication_window_batches_ <= 1) return false;
+
+    // Another request (e.g., snapshot) is in flight.
+    if (p->is_busy()) return false;
+    if (p->get_snapshot_sync_ctx() || p->is_snapshot_sync_needed()) return false;
+
+    // The window can be used only when the peer's position is confirmed.
+    // Otherwise, we should find it out by sending requests one by one.
+    {
+        std::lock_guard<std::mutex> guard(p->get_lock());
+        if (p->get_next_log_idx() != p->get_matched_idx() + 1) return false;
+    }
+    return p->supports_pipelining();
+}
+
+bool raft_server::send_append_entries_in_window(ptr<peer>& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    size_t window_size = p->get_window_size();
+    if ( window_size >= (size_t)params->replication_window_batches_ ||
+         ( params->replication_window_bytes_ > 0 &&
+           p->get_bytes_in_flight() >= params->replication_window_bytes_ ) ) {
+        p_ts("replication window for peer %d is full, %zu requests, "
+             "%" PRId64 " bytes in flight",
+             p->get_id(), window_size, p->get_bytes_in_flight());
+        return false;
+    }
+
+    // Continue right after the last request in the window. If there is
+    // no new log, it is still sent to deliver the latest commit index.
+    ulong window_next_idx = p->get_window_next_idx();
+    ptr<req_msg> msg =
+        create_append_entries_req(p, window_size ? window_next_idx - 1 : 0);
+    if (!msg) return true;
+
+    rpc_handler m_handler = resp_handler_;
+    if ( msg->get_type() != msg_type::append_entries_request ||
+         is_log_pack_req(*msg) ) {
+        // Snapshot or log pack, send it in the usual way.
+        if (!p->make_busy()) return false;
+        if ( msg->get_type() != msg_type::install_snapshot_request ||
+             !p->move_busy_to_snapshot() ) {
+            p->reset_window();
+        }
+        return send_request(p, msg, m_handler);
+    }
+
+    ulong msg_next_idx = msg->get_last_log_idx() + 1 + msg->log_entries().size();
+    p_ts("send request to %d in replication window, start idx: %" PRIu64
+         ", next idx: %" PRIu64 ", window size: %zu",
+         p->get_id(), msg->get_last_log_idx(), msg_next_idx, window_size + 1);
+    p->push_window(msg_next_idx);
+    return send_request(p, msg, m_handler, true);
+}
+
+bool raft_server::send_heartbeat_during_snapshot(ptr<peer>& p) {
+    ptr<snapshot_sync_ctx> sync_ctx = p->get_snapshot_sync_ctx();
+    ptr<snapshot> snp = sync_ctx ? sync_ctx->get_snapshot() : nullptr;
+    if (!snp) return true;
+
+    if (p->get_ls_timer_us() / 1000 < (uint64_t)p->get_current_hb_interval()) {
+        // Not the time yet.
+        return true;
+    }
+    if (!p->make_busy()) return false;
+
+    // Empty `append_entries` request at the position of the snapshot.
+    // The follower denies it while receiving the snapshot, and the
+    // leader doesn't move the peer's position by its response.
+    ptr<req_msg> msg =
+        cs_new<req_msg>( state_->get_term(),
+                         msg_type::append_entries_request,
+                         id_,
+                         p->get_id(),
+                         snp->get_last_log_term(),
+                         snp->get_last_log_idx(),
+                         quick_commit_index_.load() );
+    rpc_handler m_handler = resp_handler_;
+    p_ts("send heartbeat to peer %d while snapshot chunk is in flight",
+         p->get_id());
+    return send_request(p, msg, m_handler);
+}
+
 bool raft_server::send_request(ptr<peer>& p,
                                ptr<req_msg>& msg,
                                rpc_handler& m_handler,
                                bool streaming) {
+    check_peer_recovery_on_send(p);
+
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->append_dispatch_threads_ > 0 && append_dispatcher_) {
+        // Encoding and sending the request (which can be expensive for
+        // big batches) is done by the dispatcher thread of this peer,
+        // without holding `lock_`.
+        ptr<peer> pp = p;
+        ptr<req_msg> req = msg;
+        rpc_handler handler = m_handler;
+        bool dispatched = append_dispatcher_->dispatch
+                          ( p->get_id(),
+                            [this, pp, req, handler, streaming]() mutable {
+                                send_request_on_dispatcher
+                                    (pp, req, handler, streaming);
+                            },
+                            [pp, req, streaming]() {
+                                // Not sent, release the busy flag
+                                // that this request holds.
+                                pp->try_set_free(req->get_type(), streaming);
+                            } );
+        if (dispatched) {
+            p->reset_ls_timer();
+            return true;
+        }
+    }
+
+    p->send_req(p, msg, m_handler, streaming);
+    p->reset_ls_timer();
+
+    cb_func::Param param(id_, leader_, p->get_id(), msg.get());
+    ctx_->cb_func_.call(cb_func::SentAppendEntriesReq, &param);
+
+    check_srv_to_leave_on_send(p, msg->get_last_log_idx(), msg->get_commit_idx());
+
+    p_tr("sent\n");
+    return true;
+}
+
+void raft_server::send_request_on_dispatcher(ptr<peer>& p,
+                                             ptr<req_msg>& msg,
+                                             rpc_handler& m_handler,
+                                             bool streaming) {
+    // Called by the dispatcher thread, without `lock_`.
+    {   recur_lock(lock_);
+        if ( role_ != srv_role::leader ||
+             state_->get_term() != msg->get_term() ) {
+            // Became a follower, or a new term started,
+            // after this request was decided.
+            p_in("role or term changed, drop the request to peer %d, "
+                 "type %d, term %" PRIu64 ", current term %" PRIu64,
+                 p->get_id(), (int)msg->get_type(),
+                 msg->get_term(), state_->get_term());
+            p->try_set_free(msg->get_type(), streaming);
+            return;
+        }
+    }
+
+    p->send_req(p, msg, m_handler, streaming);
+
+    cb_func::Param param(id_, leader_, p->get_id(), msg.get());
+    ctx_->cb_func_.call(cb_func::SentAppendEntriesReq, &param);
+
+    {   recur_lock(lock_);
+        check_srv_to_leave_on_send(p, msg->get_last_log_idx(), msg->get_commit_idx());
+    }
+    p_tr("sent by dispatcher\n");
+}
+
+bool raft_server::dispatch_append_entries_req(ptr<peer>& p,
+                                              ptr<append_entries_plan>& plan) {
+    check_peer_recovery_on_send(p);
+
+    ptr<peer> pp = p;
+    ptr<append_entries_plan> pl = plan;
+    bool dispatched = append_dispatcher_->dispatch
+                      ( p->get_id(),
+                        [this, pp, pl]() mutable {
+                            build_and_send_append_entries_req(pp, *pl);
+                        },
+                        [pp]() {
+                            // Not sent, release the busy flag.
+                            pp->set_free();
+                        } );
+    if (!dispatched) {
+        // Dispatcher is being stopped.
+        build_and_send_append_entries_req(p, *plan);
+    }
+    p->reset_ls_timer();
+    return true;
+}
+
+void raft_server::build_and_send_append_entries_req(ptr<peer>& p,
+                                                    const append_entries_plan& plan) {
+    // Called by the dispatcher thread, without `lock_`.
+    ptr<req_msg> msg = build_append_entries_req(p, plan);
+    if (!msg) {
+        // Logs have been compacted in the meantime.
+        // Decide what to send again, in the usual way.
+        recur_lock(lock_);
+        if ( role_ == srv_role::leader &&
+             state_->get_term() == plan.term_ ) {
+            msg = create_append_entries_req(p);
+        }
+        if (!msg) {
+            p->set_free();
+            if ( ctx_->get_params()->use_bg_thread_for_snapshot_io_ &&
+                 p->get_snapshot_sync_ctx() ) {
+                snapshot_io_mgr::instance().invoke();
+            }
+            return;
+        }
+
+        if ( msg->get_type() == msg_type::install_snapshot_request &&
+             p->move_busy_to_snapshot() ) {
+            p_ts("snapshot chunk to peer %d doesn't block "
+                 "other requests", p->get_id());
+        }
+        // Queued behind this task, or sent right away
+        // if the dispatcher is being stopped.
+        rpc_handler m_handler = resp_handler_;
+        send_request(p, msg, m_handler);
+        return;
+    }
+
+    rpc_handler m_handler = resp_handler_;
+    send_request_on_dispatcher(p, msg, m_handler, false);
+}
+
+void raft_server::check_peer_recovery_on_send(ptr<peer>& p) {
     if (!p->is_manual_free()) {
         // Actual recovery.
         if ( p->get_long_puase_warnings() >=
@@ -452,16 +895,14 @@ bool raft_server::send_request(ptr<peer>& p,
         // but just temporarily freed busy flag.
         p->reset_manual_free();
     }
+}
 
-    p->send_req(p, msg, m_handler, streaming);
-    p->reset_ls_timer();
-
-    cb_func::Param param(id_, leader_, p->get_id(), msg.get());
-    ctx_->cb_func_.call(cb_func::SentAppendEntriesReq, &param);
-
+void raft_server::check_srv_to_leave_on_send(ptr<peer>& p,
+                                             ulong last_log_idx,
+                                             ulong commit_idx) {
     if ( srv_to_leave_ &&
             srv_to_leave_->get_id() == p->get_id() &&
-            msg->get_commit_idx() >= srv_to_leave_target_idx_ &&
+            commit_idx >= srv_to_leave_target_idx_ &&
             !srv_to_leave_->is_stepping_down() ) {
         // If this is the server to leave, AND
         // current request's commit index includes
@@ -471,16 +912,31 @@ bool raft_server::send_request(ptr<peer>& p,
         p_in("srv_to_leave_ %d is safe to be erased from peer list, "
                 "log idx %" PRIu64 " commit idx %" PRIu64 ", set flag",
                 srv_to_leave_->get_id(),
-                msg->get_last_log_idx(),
-                msg->get_commit_idx());
+                last_log_idx,
+                commit_idx);
     }
-
-    p_tr("sent\n");
-    return true;
 }
 
 ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
                                                     ulong custom_last_log_idx) {
+    append_entries_plan plan;
+    ptr<req_msg> req;
+    if (!prepare_append_entries_req(pp, custom_last_log_idx, plan, req)) {
+        return req;
+    }
+
+    req = build_append_entries_req(pp, plan);
+    if (!req) {
+        plan.entries_valid_ = false;
+        req = create_missing_logs_req(pp, plan);
+    }
+    return req;
+}
+
+bool raft_server::prepare_append_entries_req(ptr<peer>& pp,
+                                             ulong custom_last_log_idx,
+                                             append_entries_plan& plan,
+                                             ptr<req_msg>& req_out) {
     peer& p = *pp;
     ulong cur_nxt_idx(0L);
     ulong commit_idx(0L);
@@ -516,7 +972,8 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
               last_log_idx, cur_nxt_idx );
         ctx_->state_mgr_->system_exit(raft_err::N8_peer_last_log_idx_too_large);
         _sys_exit(-1);
-        return ptr<req_msg>();
+        req_out = nullptr;
+        return false;
         // LCOV_EXCL_STOP
     }
 
@@ -577,8 +1034,13 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
     // Read log entries. The underlying log store may have removed some log entries
     // causing some of the requested entries to be unavailable. The log store should
     // return nullptr to indicate such errors.
+    int32 max_append_size = params->max_append_size_;
+    if ( params->append_batch_target_latency_ms_ > 0 &&
+         p.get_append_batch_size() ) {
+        max_append_size = std::min(max_append_size, p.get_append_batch_size());
+    }
     ulong end_idx = std::min( cur_nxt_idx,
-                              last_log_idx + 1 + params->max_append_size_ );
+                              last_log_idx + 1 + max_append_size );
 
     // NOTE: If this is a retry, probably the follower is down.
     //       Send just one log until it comes back
@@ -612,99 +1074,92 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
              prev_end_idx, end_idx, p.get_id(), backward_probe_cnt);
     }
 
-    ptr<std::vector<ptr<log_entry>>> log_entries;
-    if ((last_log_idx + 1) >= cur_nxt_idx) {
-        log_entries = ptr<std::vector<ptr<log_entry>>>();
-    } else if (entries_valid) {
+    plan.starting_idx_ = starting_idx;
+    plan.cur_nxt_idx_ = cur_nxt_idx;
+    plan.commit_idx_ = commit_idx;
+    plan.term_ = term;
+    plan.last_log_idx_ = last_log_idx;
+    plan.end_idx_ = end_idx;
+    plan.peer_last_sent_idx_ = peer_last_sent_idx;
+    plan.entries_valid_ = entries_valid;
+    plan.active_async_snapshot_transfer_ = active_async_snapshot_transfer;
+    plan.active_snp_ = active_snp;
+
+    if ( entries_valid &&
+         custom_last_log_idx == 0 &&
+         params->use_bulk_catch_up_ ) {
+        req_out = create_log_pack_req(p, last_log_idx, term, commit_idx);
+        if (req_out) return false;
+    }
+
+    if (!entries_valid) {
+        req_out = create_missing_logs_req(pp, plan);
+        return false;
+    }
+
+    if ((last_log_idx + 1) < cur_nxt_idx) {
         int64 batch_size_hint = p.get_next_batch_size_hint_in_bytes() == 0
                                     ? params->max_append_size_bytes_
                                     : std::min(params->max_append_size_bytes_,
                                                p.get_next_batch_size_hint_in_bytes());
-        log_entries = log_store_->log_entries_ext(last_log_idx + 1, end_idx,
-                                                  batch_size_hint, p.get_id());
-        if (log_entries == nullptr) {
-            p_wn("failed to retrieve log entries: %" PRIu64 " - %" PRIu64,
-                 last_log_idx + 1, end_idx);
-            entries_valid = false;
+        if ( params->append_batch_target_latency_ms_ > 0 &&
+             p.get_append_batch_bytes() &&
+             batch_size_hint >= 0 ) {
+            // Bytes already in flight (stream mode or replication window)
+            // are counted against the adaptive limit, but at least one
+            // log entry should be sent.
+            int64 adaptive_bytes = std::max<int64>
+                                   ( 1, p.get_append_batch_bytes() -
+                                        p.get_bytes_in_flight() );
+            batch_size_hint = batch_size_hint
+                              ? std::min(batch_size_hint, adaptive_bytes)
+                              : adaptive_bytes;
         }
+        plan.batch_size_hint_ = batch_size_hint;
     }
+    plan.last_log_term_ = term_for_log(last_log_idx);
 
-    if (!entries_valid) {
-        // Required log entries are missing. First, we try to use snapshot to recover.
-        // To avoid inconsistency due to smart pointer, should have local varaible
-        // to increase its ref count.
-        ptr<snapshot> snp_local =
-            active_async_snapshot_transfer ? active_snp : get_last_snapshot();
-
-        // Modified by Jung-Sang Ahn (Oct 11 2017):
-        // As `reserved_log` has been newly added, need to check snapshot
-        // in addition to `starting_idx`.
-        if ( snp_local &&
-             ( pp->is_snapshot_sync_needed() ||
-               ( last_log_idx < starting_idx &&
-                last_log_idx < snp_local->get_last_log_idx() ) ) ) {
-            // If peer has advanced past our snapshot, it doesn't need
-            // snapshot sync anymore — clear the flag and fall through
-            // to normal log replication or out-of-log-range handling.
-            if ( last_log_idx >= snp_local->get_last_log_idx() &&
-                 !active_async_snapshot_transfer &&
-                 pp->is_snapshot_sync_needed() ) {
-                p_in( "peer %d log idx %" PRIu64 " has caught up past "
-                      "snapshot %" PRIu64 ", clearing snapshot sync flag",
-                      p.get_id(), last_log_idx,
-                      snp_local->get_last_log_idx() );
-                clear_snapshot_sync_ctx(p);
-                pp->set_snapshot_sync_is_needed(false);
-                // Fall through to log-based replication or OOL handling.
-            } else {
-                p_db( "send snapshot peer %d, peer log idx: %" PRIu64
-                      ", my starting idx: %" PRIu64 ", "
-                      "my log idx: %" PRIu64 ", last_snapshot_log_idx: %" PRIu64
-                      ", snapshot sync needed: %d",
-                      p.get_id(),
-                      last_log_idx, starting_idx, cur_nxt_idx,
-                      snp_local->get_last_log_idx(),
-                      pp->is_snapshot_sync_needed() );
-
-                bool succeeded_out = false;
-                return create_sync_snapshot_req( pp, last_log_idx, term,
-                                                 commit_idx, succeeded_out );
-            }
-        }
-
-        // Cannot recover using snapshot. Return here to protect the leader.
-        static timer_helper msg_timer(5000000);
-        int log_lv = msg_timer.timeout_and_reset() ? L_ERROR : L_TRACE;
-        p_lv(log_lv,
-             "neither snapshot nor log exists, peer %d, last log %" PRIu64 ", "
-             "leader's start log %" PRIu64,
-             p.get_id(), last_log_idx, starting_idx);
-
-        // Send out-of-log-range notification to this follower.
-        ptr<req_msg> req = cs_new<req_msg>
-                           ( term, msg_type::custom_notification_request,
-                             id_, p.get_id(), 0, last_log_idx, commit_idx );
-
-        // Out-of-log message.
-        ptr<out_of_log_msg> ool_msg = cs_new<out_of_log_msg>();
-        ool_msg->start_idx_of_leader_ = starting_idx;
-
-        // Create a notification containing OOL message.
-        ptr<custom_notification_msg> custom_noti =
-            cs_new<custom_notification_msg>
-            ( custom_notification_msg::out_of_log_range_warning );
-        custom_noti->ctx_ = ool_msg->serialize();
+    if (params->use_full_consensus_among_healthy_members_) {
+        // Full consensus mode: set flag indicating the member is excluded.
+        uint64_t last_resp_time_ms = p.get_resp_timer_us() / 1000;
+        uint64_t expiry = params->heart_beat_interval_ *
+                          raft_server::raft_limits_.full_consensus_leader_limit_;
+        uint64_t required_log_idx =
+            quick_commit_index_ > (uint64_t)params->max_append_size_
+            ? quick_commit_index_ - params->max_append_size_ : 0;
+        plan.excluded_from_quorum_ =
+            is_excluded_from_quorum(p, last_resp_time_ms, expiry, required_log_idx,
+                                    /* include_self_mark_down = */ false);
+    }
+    return true;
+}
 
-        // Wrap it using log_entry.
-        ptr<log_entry> custom_noti_le =
-            cs_new<log_entry>(0, custom_noti->serialize(), log_val_type::custom);
+ptr<req_msg> raft_server::build_append_entries_req(ptr<peer>& pp,
+                                                   const append_entries_plan& plan) {
+    peer& p = *pp;
+    ptr<raft_params> params = ctx_->get_params();
+    ulong last_log_idx = plan.last_log_idx_;
+    ulong end_idx = plan.end_idx_;
+    ulong term = plan.term_;
+    ulong commit_idx = plan.commit_idx_;
 
-        req->log_entries().push_back(custom_noti_le);
-        p.reset_cnt_backward_log_probe();
-        return req;
+    ptr<std::vector<ptr<log_entry>>> log_entries;
+    if ((last_log_idx + 1) < plan.cur_nxt_idx_) {
+        if (params->share_log_entries_among_peers_) {
+            log_entries = get_shared_log_entries(last_log_idx + 1, end_idx, term,
+                                                 plan.batch_size_hint_, p.get_id());
+        } else {
+            log_entries = read_log_entries(last_log_idx + 1, end_idx,
+                                           plan.batch_size_hint_, p.get_id());
+        }
+        if (log_entries == nullptr) {
+            p_wn("failed to retrieve log entries: %" PRIu64 " - %" PRIu64,
+                 last_log_idx + 1, end_idx);
+            return nullptr;
+        }
     }
 
-    ulong last_log_term = term_for_log(last_log_idx);
+    ulong last_log_term = plan.last_log_term_;
     ulong adjusted_end_idx = end_idx;
     if (log_entries) adjusted_end_idx = last_log_idx + 1 + log_entries->size();
     if (adjusted_end_idx != end_idx) {
@@ -717,7 +1172,7 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
           "Term=%" PRIu64 ", peer_last_sent_idx %" PRIu64,
           p.get_id(), last_log_idx, last_log_term,
           ( log_entries ? log_entries->size() : 0 ), commit_idx, term,
-          peer_last_sent_idx );
+          plan.peer_last_sent_idx_ );
     if (last_log_idx+1 == adjusted_end_idx) {
         p_ts( "EMPTY PAYLOAD" );
     } else if (last_log_idx+1 + 1 == adjusted_end_idx) {
@@ -731,29 +1186,25 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
           ( term, msg_type::append_entries_request, id_, p.get_id(),
             last_log_term, last_log_idx, commit_idx ) );
     std::vector<ptr<log_entry>>& v = req->log_entries();
-    if (log_entries) {
+    if (log_entries && p.get_config().is_witness()) {
+        // Witness gets the metadata of logs only.
+        for (auto& le: *log_entries) {
+            v.push_back( make_witness_log_entry(le) );
+        }
+    } else if (log_entries) {
         v.insert(v.end(), log_entries->begin(), log_entries->end());
     }
     p.set_last_sent_idx(last_log_idx + 1);
 
-    if (params->use_full_consensus_among_healthy_members_) {
-        // Full consensus mode: set flag indicating the member is excluded.
-        uint64_t last_resp_time_ms = p.get_resp_timer_us() / 1000;
-        uint64_t expiry = params->heart_beat_interval_ *
-                          raft_server::raft_limits_.full_consensus_leader_limit_;
-        uint64_t required_log_idx =
-            quick_commit_index_ > (uint64_t)params->max_append_size_
-            ? quick_commit_index_ - params->max_append_size_ : 0;
-        if (is_excluded_from_quorum(p, last_resp_time_ms, expiry, required_log_idx,
-                                    /* include_self_mark_down = */ false)) {
-            req->set_extra_flags(
-                req->get_extra_flags() | req_msg::EXCLUDED_FROM_THE_QUORUM);
-        }
+    if (plan.excluded_from_quorum_) {
+        req->set_extra_flags(
+            req->get_extra_flags() | req_msg::EXCLUDED_FROM_THE_QUORUM);
     }
 
-    if (params->max_log_gap_in_stream_ > 0) {
-        // Streaming mode: let the follower pipeline the next request
-        // while this one's response is still pending.
+    if ( params->max_log_gap_in_stream_ > 0 ||
+         params->replication_window_batches_ > 1 ) {
+        // Streaming mode or replication window: let the follower pipeline
+        // the next request while this one's response is still pending.
         req->set_extra_flags(
             req->get_extra_flags() | req_msg::ALLOW_ASYNC_LOG_APPENDING);
     }
@@ -761,6 +1212,211 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp ,
     return req;
 }
 
+ptr<req_msg> raft_server::create_missing_logs_req(ptr<peer>& pp,
+                                                  const append_entries_plan& plan) {
+    peer& p = *pp;
+    ulong last_log_idx = plan.last_log_idx_;
+    ulong starting_idx = plan.starting_idx_;
+    ulong cur_nxt_idx = plan.cur_nxt_idx_;
+    ulong term = plan.term_;
+    ulong commit_idx = plan.commit_idx_;
+    const bool active_async_snapshot_transfer = plan.active_async_snapshot_transfer_;
+
+    // Required log entries are missing. First, we try to use snapshot to recover.
+    // To avoid inconsistency due to smart pointer, should have local varaible
+    // to increase its ref count.
+    ptr<snapshot> snp_local =
+        active_async_snapshot_transfer ? plan.active_snp_ : get_last_snapshot();
+
+    if (p.get_config().is_witness()) {
+        // Witness doesn't need the data of the state machine.
+        ptr<req_msg> req =
+            create_witness_snapshot_req(pp, last_log_idx, term, commit_idx);
+        if (req) return req;
+    }
+
+    // Modified by Jung-Sang Ahn (Oct 11 2017):
+    // As `reserved_log` has been newly added, need to check snapshot
+    // in addition to `starting_idx`.
+    if ( snp_local &&
+         !p.get_config().is_witness() &&
+         ( pp->is_snapshot_sync_needed() ||
+           ( last_log_idx < starting_idx &&
+            last_log_idx < snp_local->get_last_log_idx() ) ) ) {
+        // If peer has advanced past our snapshot, it doesn't need
+        // snapshot sync anymore — clear the flag and fall through
+        // to normal log replication or out-of-log-range handling.
+        if ( last_log_idx >= snp_local->get_last_log_idx() &&
+             !active_async_snapshot_transfer &&
+             pp->is_snapshot_sync_needed() ) {
+            p_in( "peer %d log idx %" PRIu64 " has caught up past "
+                  "snapshot %" PRIu64 ", clearing snapshot sync flag",
+                  p.get_id(), last_log_idx,
+                  snp_local->get_last_log_idx() );
+            clear_snapshot_sync_ctx(p);
+            pp->set_snapshot_sync_is_needed(false);
+            // Fall through to log-based replication or OOL handling.
+        } else {
+            p_db( "send snapshot peer %d, peer log idx: %" PRIu64
+                  ", my starting idx: %" PRIu64 ", "
+                  "my log idx: %" PRIu64 ", last_snapshot_log_idx: %" PRIu64
+                  ", snapshot sync needed: %d",
+                  p.get_id(),
+                  last_log_idx, starting_idx, cur_nxt_idx,
+                  snp_local->get_last_log_idx(),
+                  pp->is_snapshot_sync_needed() );
+
+            bool succeeded_out = false;
+            return create_sync_snapshot_req( pp, last_log_idx, term,
+                                             commit_idx, succeeded_out );
+        }
+    }
+
+    // Cannot recover using snapshot. Return here to protect the leader.
+    static timer_helper msg_timer(5000000);
+    int log_lv = msg_timer.timeout_and_reset() ? L_ERROR : L_TRACE;
+    p_lv(log_lv,
+         "neither snapshot nor log exists, peer %d, last log %" PRIu64 ", "
+         "leader's start log %" PRIu64,
+         p.get_id(), last_log_idx, starting_idx);
+
+    // Send out-of-log-range notification to this follower.
+    ptr<req_msg> req = cs_new<req_msg>
+                       ( term, msg_type::custom_notification_request,
+                         id_, p.get_id(), 0, last_log_idx, commit_idx );
+
+    // Out-of-log message.
+    ptr<out_of_log_msg> ool_msg = cs_new<out_of_log_msg>();
+    ool_msg->start_idx_of_leader_ = starting_idx;
+
+    // Create a notification containing OOL message.
+    ptr<custom_notification_msg> custom_noti =
+        cs_new<custom_notification_msg>
+        ( custom_notification_msg::out_of_log_range_warning );
+    custom_noti->ctx_ = ool_msg->serialize();
+
+    // Wrap it using log_entry.
+    ptr<log_entry> custom_noti_le =
+        cs_new<log_entry>(0, custom_noti->serialize(), log_val_type::custom);
+
+    req->log_entries().push_back(custom_noti_le);
+    p.reset_cnt_backward_log_probe();
+    return req;
+}
+
+ptr<req_msg> raft_server::create_log_pack_req(peer& p,
+                                             ulong last_log_idx,
+                                             ulong term,
+                                             ulong commit_idx)
+{
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->log_sync_stop_gap_ <= 0) return nullptr;
+
+    const srv_config& s_conf = p.get_config();
+    if ( s_conf.is_learner() ||
+         s_conf.is_witness() ||
+         s_conf.is_new_joiner() ) {
+        return nullptr;
+    }
+
+    if (!p.is_log_pack_supported()) {
+        // The peer may be running an old version, which would store
+        // the pack as a single log entry.
+        return nullptr;
+    }
+
+    if (p.clear_log_pack_declined()) {
+        // Let the usual `append_entries` resolve the conflict first.
+        return nullptr;
+    }
+
+    {
+        // The peer's position should be confirmed, not probing.
+        std::lock_guard<std::mutex> guard(p.get_lock());
+        if (p.get_matched_idx() != last_log_idx) return nullptr;
+    }
+
+    // Only committed logs are packed.
+    ulong gap = (commit_idx > last_log_idx) ? (commit_idx - last_log_idx) : 0;
+    if (gap < (ulong)params->log_sync_stop_gap_) return nullptr;
+
+    int32 size_to_sync = std::min(gap, (ulong)params->log_sync_batch_size_);
+    ptr<buffer> log_pack = log_store_->pack(last_log_idx + 1, size_to_sync);
+    if (!log_pack) return nullptr;
+
+    p_db( "bulk catch-up for %d with LastLogIndex=%" PRIu64 ", "
+          "%d logs, log_pack size %zu, CommitIndex=%" PRIu64,
+          p.get_id(), last_log_idx, size_to_sync, log_pack->size(), commit_idx );
+
+    ptr<req_msg> req
+        ( cs_new<req_msg>
+          ( term, msg_type::append_entries_request, id_, p.get_id(),
+            term_for_log(last_log_idx), last_log_idx, commit_idx ) );
+    req->log_entries().push_back
+        ( cs_new<log_entry>(term, log_pack, log_val_type::log_pack) );
+    p.set_last_sent_idx(last_log_idx + 1);
+
+    static stat_elem& log_pack_reqs = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "bulk_catch_up_reqs");
+    log_pack_reqs++;
+    return req;
+}
+
+ptr<std::vector<ptr<log_entry>>>
+    raft_server::read_log_entries(ulong start_idx,
+                                  ulong end_idx,
+                                  int64 batch_size_hint,
+                                  int32 peer_id)
+{
+    // Negative hint means the peer doesn't want any log entry,
+    // let the log store handle it as before.
+    if (batch_size_hint >= 0) {
+        ptr<std::vector<ptr<log_entry>>> log_entries =
+            log_cache_->get(start_idx, end_idx, batch_size_hint);
+        if (log_entries) return log_entries;
+    }
+    return log_store_->log_entries_ext(start_idx, end_idx,
+                                       batch_size_hint, peer_id);
+}
+
+ptr<std::vector<ptr<log_entry>>>
+    raft_server::get_shared_log_entries(ulong start_idx,
+                                        ulong end_idx,
+                                        ulong term,
+                                        int64 batch_size_hint,
+                                        int32 peer_id)
+{
+    static stat_elem& shared_batch_hits = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "shared_log_batch_hits");
+
+    {
+        std::lock_guard<std::mutex> l(last_log_batch_lock_);
+        const shared_log_batch& bb = last_log_batch_;
+        if ( bb.entries_ &&
+             bb.start_idx_ == start_idx &&
+             bb.end_idx_ == end_idx &&
+             bb.term_ == term &&
+             bb.size_hint_ == batch_size_hint ) {
+            // Logs in the same range can't be changed while the leader
+            // is in the same term, safe to reuse them.
+            shared_batch_hits++;
+            return bb.entries_;
+        }
+    }
+
+    ptr<std::vector<ptr<log_entry>>> log_entries =
+        read_log_entries(start_idx, end_idx, batch_size_hint, peer_id);
+    if (!log_entries) return log_entries;
+
+    std::lock_guard<std::mutex> l(last_log_batch_lock_);
+    last_log_batch_.start_idx_ = start_idx;
+    last_log_batch_.end_idx_ = end_idx;
+    last_log_batch_.term_ = term;
+    last_log_batch_.size_hint_ = batch_size_hint;
+    last_log_batch_.entries_ = log_entries;
+    return log_entries;
+}
+
 ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
 {
     ptr<raft_params> params = ctx_->get_params();
@@ -947,6 +1603,25 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
             resp->set_ctx( appendix.serialize() );
             p_lv(log_lv, "appended extra order %s",
                  resp_appendix::extra_order_msg(appendix.extra_order_));
+        } else if ( req.get_term() == state_->get_term() &&
+                    !log_okay &&
+                    log_term &&
+                    req.get_last_log_idx() >= log_store_->start_index() ) {
+            // Tell the leader the term of the conflicting log and
+            // where it begins, so that the leader can skip all logs
+            // of that term at once, instead of probing them one by one.
+            resp_appendix appendix;
+            appendix.extra_order_ = resp_appendix::CONFLICTING_TERM;
+            appendix.conflict_term_ = log_term;
+            appendix.conflict_term_first_idx_ =
+                first_log_idx_after_term( log_term - 1,
+                                          log_store_->start_index(),
+                                          req.get_last_log_idx() );
+            resp->set_ctx( appendix.serialize() );
+            p_lv(log_lv, "appended extra order %s, conflicting term %" PRIu64
+                 ", first idx %" PRIu64,
+                 resp_appendix::extra_order_msg(appendix.extra_order_),
+                 appendix.conflict_term_, appendix.conflict_term_first_idx_);
         }
         resp->set_next_batch_size_hint_in_bytes(
             state_machine_->get_next_batch_size_hint_in_bytes());
@@ -1005,7 +1680,66 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         params->parallel_log_appending_ &&
         (req.get_extra_flags() & req_msg::ALLOW_ASYNC_LOG_APPENDING);
 
-    if (req.log_entries().size() > 0) {
+    // Group flush also defers the response, hence the same opt-in is needed.
+    bool group_flush =
+        params->follower_group_flush_delay_ms_ > 0 &&
+        (req.get_extra_flags() & req_msg::ALLOW_ASYNC_LOG_APPENDING);
+
+    // Last log index after appending the logs in this request.
+    ulong last_appended_idx = req.get_last_log_idx() + req.log_entries().size();
+
+    if (is_log_pack_req(req)) {
+        // Bulk catch-up: the pack contains committed logs only.
+        ulong pack_start_idx = req.get_last_log_idx() + 1;
+        if (log_store_->next_slot() != pack_start_idx) {
+            // Local logs after the given position may need to be rolled back,
+            // which should be done by the usual `append_entries`.
+            p_in( "decline log pack starting at %" PRIu64 ", my next slot %" PRIu64,
+                  pack_start_idx, log_store_->next_slot() );
+            resp_appendix appendix;
+            appendix.extra_order_ = resp_appendix::LOG_PACK_DECLINED;
+            resp->set_ctx( appendix.serialize() );
+            resp->accept(pack_start_idx);
+            restart_election_timer();
+            return resp;
+        }
+
+        flush_follower_append_group();
+        log_store_->apply_pack(pack_start_idx, req.log_entries()[0]->get_buf());
+        last_appended_idx = log_store_->next_slot() - 1;
+        p_db( "applied log pack %" PRIu64 " - %" PRIu64,
+              pack_start_idx, last_appended_idx );
+
+        // The logs are not visible before the pack is applied,
+        // do the same as the usual path for each of them now.
+        ptr<std::vector<ptr<log_entry>>> entries =
+            log_store_->log_entries(pack_start_idx, last_appended_idx + 1);
+        ulong log_idx = pack_start_idx;
+        for (size_t ii = 0; entries && ii < entries->size(); ++ii) {
+            ptr<log_entry>& entry = (*entries)[ii];
+
+            param.ctx = &entry;
+            CbReturnCode rc = ctx_->cb_func_.call(cb_func::PreAppendLogFollower, &param);
+            if (rc == CbReturnCode::ReturnNull) return resp;
+
+            if (entry->get_val_type() == log_val_type::conf) {
+                p_in("receive a config change from leader at %" PRIu64, log_idx);
+                config_changing_ = true;
+
+            } else if (entry->get_val_type() == log_val_type::app_log) {
+                ptr<buffer> buf = entry->get_buf_ptr();
+                buf->pos(0);
+                state_machine_->pre_commit_ext
+                    ( state_machine::ext_op_params( log_idx, buf ) );
+            }
+            log_idx++;
+
+            if (stopping_) return resp;
+        }
+        log_store_->end_of_append_batch( pack_start_idx,
+                                         last_appended_idx - req.get_last_log_idx() );
+
+    } else if (req.log_entries().size() > 0) {
         // Write logs to store, start from overlapped logs
 
         // Actual log number.
@@ -1054,6 +1788,11 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                   cnt );
             rollback_in_progress = true;
 
+            // Log entries to be rolled back may be in the pending group,
+            // close the group first so that `end_of_append_batch` calls
+            // are in the order of appending.
+            flush_follower_append_group();
+
             // Fail any pending async append_entries requests: any entries they refer to
             // are likely being rolled back, and leader term has changed.
             {
@@ -1174,13 +1913,33 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         }
 
         // End of batch.
-        log_store_->end_of_append_batch( req.get_last_log_idx() + 1,
-                                         req.log_entries().size() );
+        ulong required_durable =
+            req.get_last_log_idx() + req.log_entries().size();
+        if (group_flush) {
+            add_to_follower_append_group( req.get_last_log_idx() + 1,
+                                          required_durable );
+        } else {
+            flush_follower_append_group();
+            log_store_->end_of_append_batch( req.get_last_log_idx() + 1,
+                                             req.log_entries().size() );
+        }
 
-        if (params->parallel_log_appending_) {
-            ulong required_durable =
-                req.get_last_log_idx() + req.log_entries().size();
+        if (group_flush && !async_log_appending) {
+            // Defer the response until the group is flushed.
+            // `complete_pending_follower_resps` will fulfill the promise.
+            auto_lock(pending_follower_resps_lock_);
+            uint64_t last_durable_index = get_follower_durable_index();
+            if (last_durable_index < required_durable) {
+                p_ts( "durable index %" PRIu64 ", required %" PRIu64
+                      ", deferring response (group flush)",
+                      last_durable_index, required_durable );
+                auto promise = cs_new<cmd_result<ptr<buffer>>>();
+                pending_follower_resps_.push_back(
+                    {required_durable, req.log_entries().back()->get_term(), promise});
+                resp->set_async_cb([promise]() { return promise; });
+            }
 
+        } else if (params->parallel_log_appending_) {
             if (async_log_appending) {
                 // Pipelined mode (streaming + parallel log appending):
                 // defer the response until entries become durable.
@@ -1223,7 +1982,7 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                 }
             }
         }
-    } else if (async_log_appending) {
+    } else if (async_log_appending || group_flush) {
         // Previous handle_append_entries calls may have appended some
         // log entries without waiting for durability.
         // We should wait for those entries to become durable before
@@ -1231,7 +1990,7 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         // even if this request had no new entries.
         auto_lock(pending_follower_resps_lock_);
         if (!pending_follower_resps_.empty()) {
-            uint64_t last_durable_index = log_store_->last_durable_index();
+            uint64_t last_durable_index = get_follower_durable_index();
             ulong required_durable =
                 req.get_last_log_idx() + req.log_entries().size();
             if (last_durable_index < required_durable) {
@@ -1277,7 +2036,7 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
     //   on next `append_entries()` call, due to racing
     //   between BG commit thread and appending logs.
     //   Hence, we always should take smaller one.
-    ulong target_precommit_index = req.get_last_log_idx() + req.log_entries().size();
+    ulong target_precommit_index = last_appended_idx;
 
     // WARNING:
     //   Since `peer::set_free()` is called prior than response handler
@@ -1322,16 +2081,34 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
             resp->get_extra_flags() | resp_msg::SELF_MARK_DOWN
         );
     }
-    if (ctx_->get_params()->track_peers_sm_commit_idx_ && !resp->get_ctx()) {
-        // If peer track mode is enabled, we should send
-        // the current SM committed index to the leader.
+    if (params->use_learner_relay_) {
+        // Forward what we have to the learners relayed by this server.
+        relay_append_entries();
+    }
+
+    if (!resp->get_ctx()) {
         resp_appendix appendix;
-        appendix.extra_order_ = resp_appendix::NOTIFYING_SM_COMMITTED_INDEX;
-        appendix.sm_committed_idx_ = sm_commit_index_.load();
-        resp->set_ctx( appendix.serialize() );
-        p_tr("appended extra order %s, sm committed index: %" PRIu64,
-             resp_appendix::extra_order_msg(appendix.extra_order_),
-             appendix.sm_committed_idx_);
+        if (params->track_peers_sm_commit_idx_) {
+            // If peer track mode is enabled, we should send
+            // the current SM committed index to the leader.
+            appendix.extra_order_ = resp_appendix::NOTIFYING_SM_COMMITTED_INDEX;
+            appendix.sm_committed_idx_ = sm_commit_index_.load();
+            p_tr("appended extra order %s, sm committed index: %" PRIu64,
+                 resp_appendix::extra_order_msg(appendix.extra_order_),
+                 appendix.sm_committed_idx_);
+        }
+        if (params->use_learner_relay_) {
+            collect_relay_progress(appendix.relay_progress_);
+        }
+        if (params->use_bulk_catch_up_) {
+            // Let the leader know that log packs can be sent to this server.
+            appendix.features_ |= resp_appendix::LOG_PACK;
+        }
+        if ( appendix.extra_order_ != resp_appendix::NONE ||
+             !appendix.relay_progress_.empty() ||
+             appendix.features_ ) {
+            resp->set_ctx( appendix.serialize() );
+        }
     }
 
     p_ts("batch size hint: %" PRId64 " bytes, flags: %" PRIx64,
@@ -1365,6 +2142,302 @@ bool raft_server::try_update_precommit_index(ulong desired, const size_t MAX_ATT
     return false;
 }
 
+void raft_server::adjust_append_batch_size(peer& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->append_batch_target_latency_ms_ <= 0) return;
+
+    uint64_t rtt_us = 0;
+    size_t num_entries = 0;
+    size_t num_bytes = 0;
+    if (!p.pop_append_rtt_sample(rtt_us, num_entries, num_bytes)) return;
+
+    // Exponential moving average, the same weight as TCP's smoothed RTT.
+    uint64_t avg_rtt_us = p.get_avg_append_rtt_us();
+    avg_rtt_us = avg_rtt_us ? (avg_rtt_us * 7 + rtt_us) / 8 : rtt_us;
+    p.set_avg_append_rtt_us(avg_rtt_us);
+
+    // As the follower responds after appending the log entries, the RTT
+    // includes its disk latency as well as the network latency.
+    uint64_t target_us = (uint64_t)params->append_batch_target_latency_ms_ * 1000;
+    int32 max_entries = std::max(1, params->max_append_size_);
+    int64 max_bytes = params->max_append_size_bytes_;
+
+    int32 cur_entries = p.get_append_batch_size();
+    if (!cur_entries) cur_entries = max_entries;
+    int64 cur_bytes = p.get_append_batch_bytes();
+    if (!cur_bytes) cur_bytes = max_bytes;
+
+    int32 new_entries = cur_entries;
+    int64 new_bytes = cur_bytes;
+    if (avg_rtt_us > target_us && rtt_us > target_us) {
+        // Too slow: shrink proportionally to the overshoot. The latest
+        // sample should also be slow, otherwise the average is still
+        // catching up with the previous shrink.
+        new_entries = std::max<int32>
+                      ( 1, (int32)( (uint64_t)cur_entries * target_us /
+                                    avg_rtt_us ) );
+        // If there was no byte limit, start from the projected size of
+        // a full batch.
+        int64 base_bytes = cur_bytes
+                           ? cur_bytes
+                           : (int64)( num_bytes * cur_entries / num_entries );
+        new_bytes = std::max<int64>
+                    ( 1, (int64)( (uint64_t)base_bytes * target_us /
+                                  avg_rtt_us ) );
+
+    } else if ( rtt_us <= target_us &&
+                ( num_entries >= (size_t)cur_entries ||
+                  ( cur_bytes && (int64)num_bytes >= cur_bytes ) ) ) {
+        // Fast enough and the batch was full: grow by 25%.
+        new_entries = std::min( max_entries,
+                                cur_entries + std::max(1, cur_entries / 4) );
+        if (cur_bytes) {
+            new_bytes = cur_bytes + std::max<int64>(1, cur_bytes / 4);
+            if (max_bytes) new_bytes = std::min(max_bytes, new_bytes);
+        }
+    }
+
+    if (new_entries != cur_entries || new_bytes != cur_bytes) {
+        p_tr("peer %d append batch size %d -> %d entries, "
+             "%" PRId64 " -> %" PRId64 " bytes, rtt %" PRIu64 " us, "
+             "avg %" PRIu64 " us, target %" PRIu64 " us",
+             p.get_id(), cur_entries, new_entries, cur_bytes, new_bytes,
+             rtt_us, avg_rtt_us, target_us);
+    }
+    p.set_append_batch_size(new_entries);
+    p.set_append_batch_bytes(new_bytes);
+}
+
+void raft_server::fill_append_batch_info(peer& p, peer_info& info) const {
+    ptr<raft_params> params = ctx_->get_params();
+    info.append_batch_size_ = params->max_append_size_;
+    info.append_batch_bytes_ = params->max_append_size_bytes_;
+    info.avg_append_rtt_us_ = p.get_avg_append_rtt_us();
+    if (params->append_batch_target_latency_ms_ <= 0) return;
+
+    if (p.get_append_batch_size()) {
+        info.append_batch_size_ = p.get_append_batch_size();
+    }
+    if (p.get_append_batch_bytes()) {
+        info.append_batch_bytes_ = p.get_append_batch_bytes();
+    }
+}
+
+int32 raft_server::get_relay_id(const srv_config& s_conf) {
+    if (!s_conf.is_learner() || !s_conf.get_dc_id()) return 0;
+
+    // Relay candidates are the members in the same DC, except for the
+    // leader itself. A learner can be a relay only for the learners
+    // with bigger IDs, so that there is no cycle.
+    int32 voter_id = 0;
+    int32 learner_id = 0;
+    ptr<cluster_config> c_conf = get_config();
+    for (auto& entry: c_conf->get_servers()) {
+        const srv_config& cur = *entry;
+        int32 cur_id = cur.get_id();
+        if ( cur.get_dc_id() != s_conf.get_dc_id() ||
+             cur_id == s_conf.get_id() ||
+             cur_id == leader_ ||
+             cur.is_new_joiner() ||
+             cur.is_witness() ) {
+            continue;
+        }
+        if (!cur.is_learner()) {
+            if (!voter_id || cur_id < voter_id) voter_id = cur_id;
+        } else if (cur_id < s_conf.get_id()) {
+            if (!learner_id || cur_id < learner_id) learner_id = cur_id;
+        }
+    }
+    return voter_id ? voter_id : learner_id;
+}
+
+bool raft_server::is_relayed_peer(peer& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    if (!params->use_learner_relay_ || !p.get_config().is_learner()) {
+        return false;
+    }
+    if (srv_to_leave_ && srv_to_leave_->get_id() == p.get_id()) {
+        // Removal should be done by the leader directly.
+        return false;
+    }
+    // If the relay doesn't report the progress for a while,
+    // the leader should take it over.
+    return p.is_relayed_within(params->election_timeout_upper_bound_);
+}
+
+void raft_server::relay_append_entries() {
+    if (role_ != srv_role::follower || leader_ == -1) return;
+
+    for (auto& entry: peers_) {
+        ptr<peer> p = entry.second;
+        if (get_relay_id(p->get_config()) != id_) continue;
+        relay_append_entries_to(p);
+    }
+}
+
+void raft_server::relay_append_entries_to(ptr<peer>& p) {
+    if (p->need_to_reconnect()) {
+        reconnect_client(*p);
+    }
+    if (!p->make_busy()) {
+        // The previous relayed request is still in flight.
+        return;
+    }
+
+    ptr<req_msg> req = create_relay_append_entries_req(*p);
+    if (!req) {
+        p->set_free();
+        return;
+    }
+    p->send_req(p, req, relay_resp_handler_);
+}
+
+ptr<req_msg> raft_server::create_relay_append_entries_req(peer& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    // Only committed logs are relayed. Logs after that may be
+    // overwritten by the leader, and then the progress reported
+    // to the leader would point to logs that the leader doesn't have.
+    ulong cur_nxt_idx = std::min( quick_commit_index_.load(),
+                                  precommit_index_.load() ) + 1;
+    ulong starting_idx = log_store_->start_index();
+    ulong last_log_idx = 0;
+    {
+        std::lock_guard<std::mutex> guard(p.get_lock());
+        if (p.get_next_log_idx() == 0 || p.get_next_log_idx() > cur_nxt_idx) {
+            p.set_next_log_idx(cur_nxt_idx);
+        }
+        last_log_idx = p.get_next_log_idx() - 1;
+
+        if (last_log_idx + 1 < starting_idx) {
+            // Logs are compacted, the leader will take it over (by snapshot)
+            // once the progress of this peer is not reported.
+            // Start again from the end next time.
+            p_ts("peer %d log idx %" PRIu64 " is behind the start index %" PRIu64
+                 ", cannot relay", p.get_id(), last_log_idx, starting_idx);
+            p.set_next_log_idx(0);
+            return nullptr;
+        }
+    }
+
+    ulong end_idx = std::min( cur_nxt_idx,
+                              last_log_idx + 1 + params->max_append_size_ );
+    ptr<req_msg> req = cs_new<req_msg>
+                       ( state_->get_term(), msg_type::append_entries_request,
+                         // Source should be the leader, as the learner
+                         // will treat it as the current leader.
+                         leader_, p.get_id(),
+                         term_for_log(last_log_idx), last_log_idx,
+                         quick_commit_index_.load() );
+    if (last_log_idx + 1 < end_idx) {
+        // Logs appended as a follower may not be in the cache,
+        // and the cache may even have stale ones, read from the log store.
+        ptr<std::vector<ptr<log_entry>>> log_entries =
+            log_store_->log_entries_ext( last_log_idx + 1, end_idx,
+                                         params->max_append_size_bytes_,
+                                         p.get_id() );
+        if (!log_entries) {
+            p_wn("failed to retrieve log entries to relay: %" PRIu64 " - %" PRIu64,
+                 last_log_idx + 1, end_idx);
+            return nullptr;
+        }
+        std::vector<ptr<log_entry>>& v = req->log_entries();
+        v.insert(v.end(), log_entries->begin(), log_entries->end());
+    }
+
+    p_db( "relay append_entries for %d with LastLogIndex=%" PRIu64 ", "
+          "EntriesLength=%zu, CommitIndex=%" PRIu64,
+          p.get_id(), last_log_idx, req->log_entries().size(),
+          req->get_commit_idx() );
+    return req;
+}
+
+void raft_server::handle_relay_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err) {
+    static stat_elem& relayed_entries = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "relayed_log_entries");
+
+    recur_lock(lock_);
+    if (err) {
+        // The peer is freed, will retry with the next request from the leader.
+        p_db("relay response error: %s", err->what());
+        return;
+    }
+
+    peer_itor it = peers_.find(resp->get_src());
+    if (it == peers_.end()) return;
+    ptr<peer> p = it->second;
+
+    bool need_to_catchup = false;
+    {
+        std::lock_guard<std::mutex> guard(p->get_lock());
+        ulong prev_next_idx = p->get_next_log_idx();
+        if (resp->get_accepted()) {
+            if (resp->get_next_idx() > prev_next_idx) {
+                relayed_entries += resp->get_next_idx() - prev_next_idx;
+            }
+            p->set_next_log_idx(resp->get_next_idx());
+            p->set_matched_idx(resp->get_next_idx() - 1);
+            p->set_relayed_timestamp();
+        } else {
+            // Unlike the leader, the relay only probes backward.
+            // Conflict resolution is done by the log check of the learner.
+            ulong new_next_idx = prev_next_idx > 1 ? prev_next_idx - 1 : 1;
+            if (resp->get_next_idx() && resp->get_next_idx() < new_next_idx) {
+                new_next_idx = resp->get_next_idx();
+            }
+            p->set_next_log_idx(new_next_idx);
+        }
+        need_to_catchup = p->get_next_log_idx() <= quick_commit_index_ ||
+                          !resp->get_accepted();
+    }
+    p->consume_deferred_free();
+
+    if (need_to_catchup && get_relay_id(p->get_config()) == id_) {
+        relay_append_entries_to(p);
+    }
+}
+
+void raft_server::collect_relay_progress
+     ( std::vector<std::pair<int32, uint64_t>>& out )
+{
+    int32 expiry_ms = ctx_->get_params()->election_timeout_upper_bound_;
+    for (auto& entry: peers_) {
+        peer& p = *entry.second;
+        if (!p.is_relayed_within(expiry_ms)) continue;
+        if (get_relay_id(p.get_config()) != id_) continue;
+        out.push_back( {p.get_id(), p.get_matched_idx()} );
+    }
+}
+
+void raft_server::handle_relay_progress
+     ( const std::vector<std::pair<int32, uint64_t>>& progress )
+{
+    // Relays forward committed logs only, anything beyond
+    // the commit index cannot be the same as the leader's logs.
+    uint64_t max_matched_idx = quick_commit_index_;
+    for (auto& entry: progress) {
+        peer_itor it = peers_.find(entry.first);
+        if (it == peers_.end()) continue;
+        peer& p = *it->second;
+        if (!p.get_config().is_learner()) continue;
+
+        {
+            std::lock_guard<std::mutex> guard(p.get_lock());
+            uint64_t matched_idx = std::min(entry.second, max_matched_idx);
+            if (matched_idx > p.get_matched_idx()) {
+                p.set_matched_idx(matched_idx);
+                p.set_last_accepted_log_idx(matched_idx);
+            }
+            if (p.get_next_log_idx() < matched_idx + 1) {
+                p.set_next_log_idx(matched_idx + 1);
+            }
+        }
+        p.reset_resp_timer();
+        p.reset_active_timer();
+        p.set_relayed_timestamp();
+        p_tr("peer %d relayed, matched idx %" PRIu64, p.get_id(), entry.second);
+    }
+}
+
 void raft_server::handle_append_entries_resp(resp_msg& resp) {
     peer_itor it = peers_.find(resp.get_src());
     if (it == peers_.end()) {
@@ -1417,10 +2490,22 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
 
         {
             std::lock_guard<std::mutex> l(p->get_lock());
-            p->set_next_log_idx(resp.get_next_idx());
+            ulong new_next_idx = resp.get_next_idx();
+            size_t num_acked = p->ack_window(new_next_idx);
+            if ( ctx_->get_params()->replication_window_batches_ > 1 &&
+                 num_acked == 0 &&
+                 new_next_idx < p->get_next_log_idx() ) {
+                // Out-of-order response of an earlier request in the
+                // replication window, the later one was already acknowledged.
+                p_tr("peer %d, stale response in replication window, "
+                     "resp next idx: %" PRIu64 ", next idx: %" PRIu64,
+                     p->get_id(), new_next_idx, p->get_next_log_idx());
+                new_next_idx = p->get_next_log_idx();
+            }
+            p->set_next_log_idx(new_next_idx);
             p->reset_cnt_backward_log_probe();
             prev_matched_idx = p->get_matched_idx();
-            new_matched_idx = resp.get_next_idx() - 1;
+            new_matched_idx = new_next_idx - 1;
 
             if (prev_matched_idx != new_matched_idx)
                 p_tr("peer %d, prev matched idx: %" PRIu64 ", new matched idx: %" PRIu64,
@@ -1429,18 +2514,40 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
             p->set_matched_idx(new_matched_idx);
             p->set_last_accepted_log_idx(new_matched_idx);
         }
+        adjust_append_batch_size(*p);
 
         // busy flag was intentionally held by `handle_rpc_result()` until
         // the peer's log positions were updated; release it now, before
         // any follow-up send.
         p->consume_deferred_free();
 
+        // If the response contains appendix, it should be
+        // `resp_appendix` type.
+        ptr<resp_appendix> appendix;
+        if (resp.get_ctx()) {
+            appendix = resp_appendix::deserialize(*resp.get_ctx());
+        }
+        if ( appendix &&
+             !appendix->relay_progress_.empty() &&
+             ctx_->get_params()->use_learner_relay_ ) {
+            handle_relay_progress(appendix->relay_progress_);
+        }
+        if ( appendix &&
+             appendix->extra_order_ == resp_appendix::LOG_PACK_DECLINED ) {
+            p_in("peer %d declined log pack at %" PRIu64,
+                 p->get_id(), resp.get_next_idx());
+            p->set_log_pack_declined();
+        }
+        if ( appendix &&
+             (appendix->features_ & resp_appendix::LOG_PACK) &&
+             !p->is_log_pack_supported() ) {
+            p_in("peer %d supports log pack", p->get_id());
+            p->set_log_pack_supported(true);
+        }
+
         bool sm_committed_idx_updated = false;
-        if (resp.get_ctx() &&
+        if (appendix &&
             ctx_->get_params()->track_peers_sm_commit_idx_) {
-            // If the response contains appendix, it should be
-            // `resp_appendix` type.
-            ptr<resp_appendix> appendix = resp_appendix::deserialize(*resp.get_ctx());
             if (appendix->extra_order_ == resp_appendix::NOTIFYING_SM_COMMITTED_INDEX) {
                 {
                     std::lock_guard<std::mutex> l(p->get_lock());
@@ -1513,9 +2620,12 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
 
         // As commit might send requests, so refresh streamed log idx here
         last_streamed_log_idx = p->get_last_streamed_log_idx();
+        ulong window_next_idx = p->get_window_next_idx();
         ulong next_idx_to_send = last_streamed_log_idx
                                  ? last_streamed_log_idx + 1
-                                 : resp.get_next_idx();
+                                 : window_next_idx
+                                   ? window_next_idx
+                                   : resp.get_next_idx();
         need_to_catchup = p->clear_pending_commit() ||
                           next_idx_to_send < log_store_->next_slot();
         if (ctx_->get_params()->track_peers_sm_commit_idx_ &&
@@ -1541,9 +2651,16 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
     } else {
         std::lock_guard<std::mutex> guard(p->get_lock());
         ulong prev_next_log = p->get_next_log_idx();
+
+        // Discard all in-flight requests in the replication window,
+        // replication will restart from the last acknowledged log.
+        size_t window_size = p->get_window_size();
+        p->reset_window();
+
         resp_appendix::extra_order extra_order = resp_appendix::NONE;
+        ptr<resp_appendix> appendix;
         if (resp.get_ctx()) {
-            ptr<resp_appendix> appendix = resp_appendix::deserialize(*resp.get_ctx());
+            appendix = resp_appendix::deserialize(*resp.get_ctx());
             extra_order = appendix->extra_order_;
 
             static timer_helper extra_order_timer(1000 * 1000, true);
@@ -1555,21 +2672,62 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
             }
         }
 
+        bool log_probe =
+            extra_order == resp_appendix::NONE ||
+            extra_order == resp_appendix::CONFLICTING_TERM;
         bool current_term_log_probe =
-            extra_order == resp_appendix::NONE &&
+            log_probe &&
             resp.get_term() == state_->get_term();
         bool stale_term_log_probe =
-            extra_order == resp_appendix::NONE &&
+            log_probe &&
             resp.get_term() != state_->get_term();
         bool unknown_extra_order =
-            extra_order != resp_appendix::NONE &&
+            !log_probe &&
             extra_order != resp_appendix::DO_NOT_REWIND &&
             extra_order != resp_appendix::COMPACTED_SNAPSHOT_BOUNDARY &&
             extra_order != resp_appendix::RECEIVING_SNAPSHOT;
 
+        // If the follower told us the term of its conflicting log,
+        // skip all logs of that term at once (Raft thesis, 5.3):
+        //   1) If we have logs of the conflicting term, the next log
+        //      after the last one of that term.
+        //   2) Otherwise, the first log of that term on the follower.
+        ulong conflict_term_target = 0;
+        if ( extra_order == resp_appendix::CONFLICTING_TERM &&
+             current_term_log_probe &&
+             appendix->conflict_term_ &&
+             prev_next_log > 1 ) {
+            ulong conflict_term = appendix->conflict_term_;
+            ulong after_idx = first_log_idx_after_term( conflict_term,
+                                                        1,
+                                                        prev_next_log - 1 );
+            ulong target = appendix->conflict_term_first_idx_;
+            if ( after_idx > 1 &&
+                 term_for_log(after_idx - 1) == conflict_term ) {
+                target = after_idx;
+            }
+            target = std::max(target, p->get_next_log_idx_floor());
+            if (target && target < prev_next_log) {
+                conflict_term_target = target;
+            }
+        }
+
+        // If the peer's position was reset (e.g., by reconnection) during
+        // the snapshot, it is handled below, to resume the snapshot.
+        ptr<snapshot_sync_ctx> sync_ctx = p->get_snapshot_sync_ctx();
+        ptr<snapshot> sync_snp = sync_ctx ? sync_ctx->get_snapshot() : nullptr;
+        bool snapshot_in_progress =
+            extra_order == resp_appendix::RECEIVING_SNAPSHOT &&
+            sync_snp &&
+            prev_next_log <= sync_snp->get_last_log_idx();
+
         if (extra_order == resp_appendix::DO_NOT_REWIND) {
             // Application-level rejection. Keep peer progress unchanged.
             p->reset_cnt_backward_log_probe();
+        } else if (snapshot_in_progress) {
+            // Heartbeat sent while a snapshot chunk is in flight,
+            // the snapshot decides the peer's position.
+            p->reset_cnt_backward_log_probe();
         } else if (extra_order == resp_appendix::COMPACTED_SNAPSHOT_BOUNDARY) {
             p->reset_cnt_backward_log_probe();
             ulong floor = p->get_next_log_idx_floor();
@@ -1599,6 +2757,24 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
                      resp.get_next_idx(), floor, target, matched_idx,
                      last_accepted_log_idx, max_next_idx);
             }
+        } else if ( window_size &&
+                    extra_order == resp_appendix::NONE &&
+                    resp.get_next_idx() == prev_next_log ) {
+            // The peer has all logs acknowledged so far, but a later
+            // request in the window was out of order. No need to rewind
+            // further than the last acknowledged log.
+            p->reset_cnt_backward_log_probe();
+            p_in("peer %d rewind replication window (%zu requests) "
+                 "to next idx %" PRIu64,
+                 p->get_id(), window_size, prev_next_log);
+        } else if (conflict_term_target) {
+            p->set_next_log_idx(conflict_term_target);
+            p->reset_cnt_backward_log_probe();
+            p_tr("peer %d conflicting term %" PRIu64 " from idx %" PRIu64
+                 ", next idx %" PRIu64 " -> %" PRIu64,
+                 p->get_id(), appendix->conflict_term_,
+                 appendix->conflict_term_first_idx_,
+                 prev_next_log, conflict_term_target);
         } else {
             if (unknown_extra_order) {
                 p->reset_cnt_backward_log_probe();
@@ -1829,12 +3005,20 @@ ulong raft_server::get_expected_committed_log_idx() {
     matched_indexes.push_back( leader_index );
     aci_params.peer_index_map_[id_] = leader_index;
 
+    // Matched indexes of the members having the payloads of logs
+    // (i.e., all voting members except for witnesses).
+    std::vector<ulong> data_indexes;
+    data_indexes.push_back( leader_index );
+
     for (auto& entry: peers_) {
         ptr<peer>& p = entry.second;
         aci_params.peer_index_map_[p->get_id()] = p->get_matched_idx();
 
         if (!is_regular_member(p)) continue;
         matched_indexes.push_back( p->get_matched_idx() );
+        if (!p->get_config().is_witness()) {
+            data_indexes.push_back( p->get_matched_idx() );
+        }
     }
     int voting_members = get_num_voting_members();
     assert((int32)matched_indexes.size() == voting_members);
@@ -1902,8 +3086,30 @@ ulong raft_server::get_expected_committed_log_idx() {
         p_ts("quorum idx %zu, %s", quorum_idx, tmp_str.c_str());
     }
 
+    ulong expected_idx = matched_indexes[quorum_idx];
+    if ( data_indexes.size() < matched_indexes.size() &&
+         data_indexes.size() > 1 ) {
+        // Witnesses don't check if the candidate's log is up-to-date
+        // when they vote (see `handle_vote_req()`). A log should be
+        // committed only when every election quorum includes
+        // a non-witness member having it.
+        size_t num_required =
+            voting_members - (get_quorum_for_election() + 1) + 1;
+        num_required = std::min(num_required, data_indexes.size());
+        std::sort( data_indexes.begin(),
+                   data_indexes.end(),
+                   std::greater<ulong>() );
+        ulong data_idx = data_indexes[num_required - 1];
+        if (data_idx < expected_idx) {
+            p_tr( "commit index is limited by non-witness members: "
+                  "%" PRIu64 " -> %" PRIu64,
+                  expected_idx, data_idx );
+            expected_idx = data_idx;
+        }
+    }
+
     aci_params.current_commit_index_ = quick_commit_index_;
-    aci_params.expected_commit_index_ = matched_indexes[quorum_idx];
+    aci_params.expected_commit_index_ = expected_idx;
     uint64_t adjusted_commit_index = state_machine_->adjust_commit_index(aci_params);
     if (aci_params.expected_commit_index_ != adjusted_commit_index) {
         p_tr( "commit index adjusted: %" PRIu64 " -> %" PRIu64,
@@ -1955,41 +3161,7 @@ void raft_server::notify_log_append_completion(bool ok) {
         if (params->parallel_log_appending_) {
             // Send responses for pipelined append_entries requests whose
             // entries are now durable.
-            std::vector<std::pair<ptr<cmd_result<ptr<buffer>>>, cmd_result_code>> resps;
-            {
-                auto_lock(pending_follower_resps_lock_);
-                if (!pending_follower_resps_.empty()) {
-                    uint64_t durable_idx = log_store_->last_durable_index();
-                    while ( !pending_follower_resps_.empty() &&
-                            pending_follower_resps_.front().last_entry_idx <= durable_idx ) {
-                        pending_follower_resp& entry = pending_follower_resps_.front();
-
-                        // Redundant check that the entries that became durable are the ones we wrote.
-                        ulong term_in_log_store = log_store_->term_at(entry.last_entry_idx);
-                        if (entry.last_entry_term == 0 || term_in_log_store == entry.last_entry_term) {
-                            resps.emplace_back(std::move(entry.promise), cmd_result_code::OK);
-                        } else {
-                            // This should be impossible because we clear pending_follower_resps_
-                            // when doing log_store_ rollback.
-                            p_er( "term mismatch in async append_entries: "
-                                  "appended entry with idx %" PRIu64 " "
-                                  "term %" PRIu64 ", durable entry has "
-                                  "term %" PRIu64,
-                                  entry.last_entry_idx,
-                                  entry.last_entry_term,
-                                  term_in_log_store);
-                            resps.emplace_back(std::move(entry.promise), cmd_result_code::TERM_MISMATCH);
-                        }
-                        pending_follower_resps_.pop_front();
-                    }
-                }
-            }
-
-            ptr<buffer> empty_buf;
-            ptr<std::exception> no_err;
-            for (auto& p: resps) {
-                p.first->set_result(empty_buf, no_err, p.second);
-            }
+            complete_pending_follower_resps();
         }
 
         // Wake the blocking-path waiter in `handle_append_entries`.
@@ -1998,4 +3170,114 @@ void raft_server::notify_log_append_completion(bool ok) {
     }
 }
 
+void raft_server::complete_pending_follower_resps() {
+    std::vector<std::pair<ptr<cmd_result<ptr<buffer>>>, cmd_result_code>> resps;
+    {
+        auto_lock(pending_follower_resps_lock_);
+        if (!pending_follower_resps_.empty()) {
+            uint64_t durable_idx = get_follower_durable_index();
+            while ( !pending_follower_resps_.empty() &&
+                    pending_follower_resps_.front().last_entry_idx <= durable_idx ) {
+                pending_follower_resp& entry = pending_follower_resps_.front();
+
+                // Redundant check that the entries that became durable are the ones we wrote.
+                ulong term_in_log_store = log_store_->term_at(entry.last_entry_idx);
+                if (entry.last_entry_term == 0 || term_in_log_store == entry.last_entry_term) {
+                    resps.emplace_back(std::move(entry.promise), cmd_result_code::OK);
+                } else {
+                    // This should be impossible because we clear pending_follower_resps_
+                    // when doing log_store_ rollback.
+                    p_er( "term mismatch in async append_entries: "
+                          "appended entry with idx %" PRIu64 " "
+                          "term %" PRIu64 ", durable entry has "
+                          "term %" PRIu64,
+                          entry.last_entry_idx,
+                          entry.last_entry_term,
+                          term_in_log_store);
+                    resps.emplace_back(std::move(entry.promise), cmd_result_code::TERM_MISMATCH);
+                }
+                pending_follower_resps_.pop_front();
+            }
+        }
+    }
+
+    ptr<buffer> empty_buf;
+    ptr<std::exception> no_err;
+    for (auto& p: resps) {
+        p.first->set_result(empty_buf, no_err, p.second);
+    }
+}
+
+uint64_t raft_server::get_follower_durable_index() {
+    ptr<raft_params> params = ctx_->get_params();
+    if ( !params->parallel_log_appending_ && group_flush_last_idx_ ) {
+        // Log entries in the pending group are not durable yet,
+        // all the others are.
+        return group_flush_start_idx_ - 1;
+    }
+    return log_store_->last_durable_index();
+}
+
+void raft_server::add_to_follower_append_group(ulong start_idx, ulong last_idx) {
+    ptr<raft_params> params = ctx_->get_params();
+    if (!group_flush_last_idx_) {
+        // Start a new group.
+        group_flush_start_idx_ = start_idx;
+        group_flush_last_idx_ = last_idx;
+        group_flush_timer_.set_duration_ms(params->follower_group_flush_delay_ms_);
+        group_flush_timer_.reset();
+
+        if (group_flush_task_) {
+            cancel_task(group_flush_task_);
+        } else {
+            group_flush_task_ = cs_new< timer_task<void> >
+                                ( group_flush_exec_,
+                                  timer_task_type::follower_group_flush_timer );
+        }
+        schedule_task(group_flush_task_, params->follower_group_flush_delay_ms_);
+        return;
+    }
+
+    group_flush_start_idx_ = std::min(group_flush_start_idx_, start_idx);
+    group_flush_last_idx_ = std::max(group_flush_last_idx_, last_idx);
+    if (group_flush_timer_.timeout()) {
+        // Requests keep coming, do not wait for the timer.
+        flush_follower_append_group();
+    }
+}
+
+void raft_server::flush_follower_append_group() {
+    if (!group_flush_last_idx_) return;
+
+    ulong start_idx = group_flush_start_idx_;
+    ulong cnt = group_flush_last_idx_ - group_flush_start_idx_ + 1;
+    p_ts("flush follower append group %" PRIu64 " - %" PRIu64,
+         start_idx, group_flush_last_idx_);
+    log_store_->end_of_append_batch(start_idx, cnt);
+    {
+        // Should be cleared while holding the lock, so that
+        // `get_follower_durable_index()` under the same lock
+        // does not miss this flush.
+        auto_lock(pending_follower_resps_lock_);
+        group_flush_start_idx_ = 0;
+        group_flush_last_idx_ = 0;
+    }
+
+    static stat_elem& group_flushes = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "follower_group_flushes");
+    group_flushes++;
+
+    ptr<raft_params> params = ctx_->get_params();
+    if (!params->parallel_log_appending_) {
+        // Otherwise, `notify_log_append_completion` will do it.
+        complete_pending_follower_resps();
+    }
+}
+
+void raft_server::handle_group_flush_timeout() {
+    recur_lock(lock_);
+    if (stopping_) return;
+    flush_follower_append_group();
+}
+
 } // namespace nuraft;
@@ -27,10 +27,13 @@ limitations under the License.
 #include "global_mgr.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
+#include "stat_mgr.hxx"
 #include "tracer.hxx"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <limits>
 #include <sstream>
 
 namespace nuraft {
@@ -78,6 +81,9 @@ ptr<resp_msg> raft_server::handle_cli_req_prelock(req_msg& req,
 {
     ptr<resp_msg> resp = nullptr;
     ptr<raft_params> params = ctx_->get_params();
+    if (params->use_group_commit_) {
+        return handle_cli_req_grouped(req, ext_params);
+    }
     uint64_t timestamp_us = timer_helper::get_timeofday_us();
 
     switch (params->locking_method_type_) {
@@ -124,17 +130,124 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
                                           const req_ext_params& ext_params,
                                           uint64_t timestamp_us)
 {
-    ptr<resp_msg> resp = nullptr;
-    ulong last_idx = 0;
-    ptr<buffer> ret_value = nullptr;
-    ulong resp_idx = 1;
-    ulong cur_term = state_->get_term();
+    cli_req_pkg pkg(req, ext_params, timestamp_us);
+    std::vector<cli_req_pkg*> pkgs(1, &pkg);
+    handle_cli_reqs(pkgs);
+    if (pkg.exception_) {
+        std::rethrow_exception(pkg.exception_);
+    }
+    return pkg.resp_;
+}
+
+ptr<resp_msg> raft_server::handle_cli_req_grouped(req_msg& req,
+                                                  const req_ext_params& ext_params)
+{
+    cli_req_pkg pkg(req, ext_params, 0);
+
+    // Enqueue without any lock.
+    cli_req_pkg* head = cli_req_queue_head_.load();
+    do {
+        pkg.next_ = head;
+    } while (!cli_req_queue_head_.compare_exchange_weak(head, &pkg));
+
+    std::unique_lock<std::mutex> l(cli_req_group_lock_);
+    while (!pkg.done_) {
+        if (cli_req_group_draining_) {
+            // The current drainer may or may not have taken this request,
+            // either it or the next drainer will handle it.
+            cli_req_group_cv_.wait(l);
+            continue;
+        }
+
+        // Become the drainer.
+        cli_req_group_draining_ = true;
+        l.unlock();
+        drain_cli_req_queue();
+        l.lock();
+        cli_req_group_draining_ = false;
+        cli_req_group_cv_.notify_all();
+    }
+    l.unlock();
+
+    if (pkg.exception_) {
+        std::rethrow_exception(pkg.exception_);
+    }
+    return pkg.resp_;
+}
+
+void raft_server::drain_cli_req_queue() {
+    cli_req_pkg* head = cli_req_queue_head_.exchange(nullptr);
+    if (!head) return;
+
+    // Stack order -> arrival order.
+    std::vector<cli_req_pkg*> pkgs;
+    for (cli_req_pkg* cur = head; cur; cur = cur->next_) {
+        pkgs.push_back(cur);
+    }
+    std::reverse(pkgs.begin(), pkgs.end());
+
+    static stat_elem& cli_req_groups = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "cli_req_groups");
+    static stat_elem& cli_req_group_size = *stat_mgr::get_instance()->create_stat
+        (stat_elem::HISTOGRAM, "cli_req_group_size");
+    cli_req_groups++;
+    cli_req_group_size += pkgs.size();
+
+    uint64_t timestamp_us = timer_helper::get_timeofday_us();
+    for (cli_req_pkg* pkg: pkgs) {
+        pkg->timestamp_us_ = timestamp_us;
+    }
+
+    std::exception_ptr exception;
+    try {
+        ptr<raft_params> params = ctx_->get_params();
+        switch (params->locking_method_type_) {
+            case raft_params::single_mutex: {
+                recur_lock(lock_);
+                handle_cli_reqs(pkgs);
+                break;
+            }
+            case raft_params::dual_mutex:
+            default: {
+                recur_lock(cli_lock_);
+                handle_cli_reqs(pkgs);
+                break;
+            }
+        }
+    } catch (...) {
+        exception = std::current_exception();
+    }
+
+    // Urgent commit, once for all the requests in this group.
+    // If only a part of the group failed, the leading requests
+    // were appended successfully and should be replicated.
+    if (!exception && !pkgs.front()->exception_) {
+        request_append_entries_for_all();
+    }
+
+    // NOTE: `pkg` is on the caller's stack, it may disappear
+    //       right after `done_` is set.
+    for (cli_req_pkg* pkg: pkgs) {
+        if (exception && !pkg->exception_) {
+            pkg->exception_ = exception;
+        }
+        pkg->done_ = true;
+    }
+}
+
+ptr<resp_msg> raft_server::append_cli_req(cli_req_pkg& pkg,
+                                          ulong cur_term,
+                                          ulong& last_idx)
+{
+    req_msg& req = pkg.req_;
+    const req_ext_params& ext_params = pkg.ext_params_;
+    uint64_t timestamp_us = pkg.timestamp_us_;
     ptr<raft_params> params = ctx_->get_params();
 
-    resp = cs_new<resp_msg>( cur_term,
-                             msg_type::append_entries_response,
-                             id_,
-                             leader_ );
+    ptr<resp_msg> resp = cs_new<resp_msg>( cur_term,
+                                           msg_type::append_entries_response,
+                                           id_,
+                                           leader_ );
     if (role_ != srv_role::leader || write_paused_) {
         resp->set_result_code( cmd_result_code::NOT_LEADER );
         return resp;
@@ -206,11 +319,12 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         }
 
         last_idx = next_slot;
+        pkg.last_idx_ = next_slot;
 
         ptr<buffer> buf = entry->get_buf_ptr();
         buf->pos(0);
-        ret_value = state_machine_->pre_commit_ext
-                    ( state_machine::ext_op_params( last_idx, buf ) );
+        pkg.ret_value_ = state_machine_->pre_commit_ext
+                         ( state_machine::ext_op_params( last_idx, buf ) );
 
         if (ext_params.after_precommit_) {
             req_ext_cb_params cb_params;
@@ -220,17 +334,53 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
             ext_params.after_precommit_(cb_params);
         }
     }
-    if (num_entries) {
-        log_store_->end_of_append_batch(last_idx - num_entries + 1, num_entries);
+    return resp;
+}
+
+void raft_server::handle_cli_reqs(std::vector<cli_req_pkg*>& pkgs) {
+    ulong cur_term = state_->get_term();
+    ulong first_idx = log_store_->next_slot();
+    ulong last_idx = 0;
+    bool appended = false;
+
+    for (size_t ii = 0; ii < pkgs.size(); ++ii) {
+        cli_req_pkg* pkg = pkgs[ii];
+        try {
+            pkg->resp_ = append_cli_req(*pkg, cur_term, last_idx);
+        } catch (...) {
+            // Failed in the middle of this request. The requests before it
+            // are already appended and will be handled as usual, while
+            // this one and the rest of the group get the exception.
+            std::exception_ptr exception = std::current_exception();
+            for (size_t jj = ii; jj < pkgs.size(); ++jj) {
+                pkgs[jj]->resp_ = nullptr;
+                pkgs[jj]->exception_ = exception;
+            }
+            break;
+        }
+        if (pkg->resp_ && pkg->resp_->get_result_code() == cmd_result_code::OK) {
+            // Passed all the checks, logs (if any) are appended.
+            appended = true;
+        }
+    }
+
+    if (last_idx) {
+        // Including the logs partially appended by the failed request.
+        log_store_->end_of_append_batch(first_idx, last_idx - first_idx + 1);
     }
+    if (!appended) return;
+
     try_update_precommit_index(last_idx);
-    resp_idx = log_store_->next_slot();
+    ulong resp_idx = log_store_->next_slot();
 
     // Finished appending logs and pre_commit of itself.
     cb_func::Param param(id_, leader_);
     param.ctx = &last_idx;
     CbReturnCode rc = ctx_->cb_func_.call(cb_func::AppendLogs, &param);
-    if (rc == CbReturnCode::ReturnNull) return nullptr;
+    if (rc == CbReturnCode::ReturnNull) {
+        for (cli_req_pkg* pkg: pkgs) pkg->resp_ = nullptr;
+        return;
+    }
 
     size_t sleep_us = debugging_options::get_instance()
                       .handle_cli_req_sleep_us_.load(std::memory_order_relaxed);
@@ -239,56 +389,57 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         timer_helper::sleep_us(sleep_us);
     }
 
-    if (!get_config()->is_async_replication()) {
-        // Sync replication:
-        //   Set callback function for `last_idx`.
-        ptr<commit_ret_elem> elem = cs_new<commit_ret_elem>();
-        elem->idx_ = last_idx;
-        elem->result_code_ = cmd_result_code::TIMEOUT;
-
-        {   auto_lock(commit_ret_elems_lock_);
-            auto entry = commit_ret_elems_.find(last_idx);
-            if (entry != commit_ret_elems_.end()) {
-                // Commit thread was faster than this.
-                elem = entry->second;
-                p_tr("commit thread was faster than this thread: %p", elem.get());
-            } else {
-                commit_ret_elems_.insert( std::make_pair(last_idx, elem) );
-            }
-
-            switch (ctx_->get_params()->return_method_) {
-            case raft_params::blocking:
-            default:
-                // Blocking call: set callback function waiting for the result.
-                resp->set_cb( std::bind( &raft_server::handle_cli_req_callback,
-                                         this,
-                                         elem,
-                                         std::placeholders::_1 ) );
-                break;
+    for (cli_req_pkg* pkg: pkgs) {
+        ptr<resp_msg>& resp = pkg->resp_;
+        if (!resp || resp->get_result_code() != cmd_result_code::OK) continue;
+
+        if (!get_config()->is_async_replication()) {
+            // Sync replication:
+            //   Set callback function for the last log of this request.
+            {   commit_ret_ring::accessor cre(*commit_ret_elems_, pkg->last_idx_);
+                ptr<commit_ret_elem> elem = cre.find();
+                if (elem) {
+                    // Commit thread was faster than this.
+                    p_tr("commit thread was faster than this thread: %p", elem.get());
+                } else {
+                    elem = cre.insert();
+                    elem->result_code_ = cmd_result_code::TIMEOUT;
+                }
 
-            case raft_params::async_handler:
-                // Async handler: create & set async result object.
-                if (!elem->async_result_) {
-                    elem->async_result_ = cs_new< cmd_result< ptr<buffer> > >();
+                switch (ctx_->get_params()->return_method_) {
+                case raft_params::blocking:
+                default:
+                    // Blocking call: set callback function waiting for the result.
+                    resp->set_cb( std::bind( &raft_server::handle_cli_req_callback,
+                                             this,
+                                             elem,
+                                             std::placeholders::_1 ) );
+                    break;
+
+                case raft_params::async_handler:
+                    // Async handler: create & set async result object.
+                    if (!elem->async_result_) {
+                        elem->async_result_ = cs_new< cmd_result< ptr<buffer> > >();
+                    }
+                    resp->set_async_cb
+                          ( std::bind( &raft_server::handle_cli_req_callback_async,
+                                       this,
+                                       elem->async_result_ ) );
+                    break;
                 }
-                resp->set_async_cb
-                      ( std::bind( &raft_server::handle_cli_req_callback_async,
-                                   this,
-                                   elem->async_result_ ) );
-                break;
             }
+
+        } else {
+            // Async replication:
+            //   Immediately return with the result of pre-commit.
+            p_dv( "asynchronously replicated %" PRIu64 ", return value %p",
+                  pkg->last_idx_, pkg->ret_value_.get() );
+            resp->set_ctx(pkg->ret_value_);
         }
 
-    } else {
-        // Async replication:
-        //   Immediately return with the result of pre-commit.
-        p_dv( "asynchronously replicated %" PRIu64 ", return value %p",
-              last_idx, ret_value.get() );
-        resp->set_ctx(ret_value);
+        // Same as non-grouped request: the index next to its own last log.
+        resp->accept(pkg->last_idx_ ? pkg->last_idx_ + 1 : resp_idx);
     }
-
-    resp->accept(resp_idx);
-    return resp;
 }
 
 bool raft_server::should_reject_client_request_by_uncommitted_log_entries(const std::vector<ptr<log_entry>>& entries,
@@ -336,6 +487,101 @@ void raft_server::log_uncommitted_log_entry_limit_rejection(uint64_t current_ent
          max_entries);
 }
 
+raft_server::commit_ret_ring::commit_ret_ring(size_t capacity)
+    : slots_(capacity)
+    , size_(0)
+    , num_overflows_(0)
+    {}
+
+std::vector<uint64_t> raft_server::commit_ret_ring::get_indexes(uint64_t from,
+                                                                uint64_t upto) {
+    std::vector<uint64_t> indexes;
+    if (!from) from = 1;
+    if (from > upto) return indexes;
+
+    if (upto - from < slots_.size()) {
+        // Each index in the range has its own slot.
+        for (uint64_t idx = from; idx <= upto; ++idx) {
+            if (slots_[idx % slots_.size()].idx_ == idx) indexes.push_back(idx);
+        }
+    } else {
+        for (slot& ss: slots_) {
+            uint64_t idx = ss.idx_;
+            if (idx && idx >= from && idx <= upto) indexes.push_back(idx);
+        }
+    }
+
+    if (num_overflows_) {
+        std::lock_guard<std::mutex> l(overflow_lock_);
+        for ( auto entry = overflow_.lower_bound(from);
+              entry != overflow_.end() && entry->first <= upto;
+              ++entry ) {
+            indexes.push_back(entry->first);
+        }
+    }
+    std::sort(indexes.begin(), indexes.end());
+    return indexes;
+}
+
+raft_server::commit_ret_ring::accessor::accessor(commit_ret_ring& ring,
+                                                 uint64_t idx)
+    : ring_(ring)
+    , idx_(idx)
+    , slot_(ring.slots_[idx % ring.slots_.size()])
+    , guard_(slot_.lock_)
+    {}
+
+ptr<raft_server::commit_ret_elem> raft_server::commit_ret_ring::accessor::find() {
+    if (slot_.idx_ == idx_) return slot_.elem_;
+    if (!ring_.num_overflows_) return nullptr;
+
+    std::lock_guard<std::mutex> l(ring_.overflow_lock_);
+    auto entry = ring_.overflow_.find(idx_);
+    if (entry == ring_.overflow_.end()) return nullptr;
+    return entry->second;
+}
+
+ptr<raft_server::commit_ret_elem> raft_server::commit_ret_ring::accessor::insert() {
+    ring_.size_++;
+    if (!slot_.idx_) {
+        // NOTE: Only threads holding `lock_` can copy `elem_`,
+        //       so `use_count() == 1` means nobody else refers to it.
+        if (!slot_.elem_ || slot_.elem_.use_count() > 1) {
+            slot_.elem_ = cs_new<commit_ret_elem>();
+        } else {
+            // Pairs with the release of the last reference by other thread.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            slot_.elem_->reset();
+        }
+        slot_.elem_->idx_ = idx_;
+        slot_.idx_ = idx_;
+        return slot_.elem_;
+    }
+
+    // Occupied by an older one.
+    ptr<commit_ret_elem> elem = cs_new<commit_ret_elem>();
+    elem->idx_ = idx_;
+    std::lock_guard<std::mutex> l(ring_.overflow_lock_);
+    ring_.overflow_[idx_] = elem;
+    ring_.num_overflows_++;
+    return elem;
+}
+
+void raft_server::commit_ret_ring::accessor::erase() {
+    if (slot_.idx_ == idx_) {
+        slot_.idx_ = 0;
+        ring_.size_--;
+        return;
+    }
+    if (!ring_.num_overflows_) return;
+
+    std::lock_guard<std::mutex> l(ring_.overflow_lock_);
+    if (ring_.overflow_.erase(idx_)) {
+        ring_.num_overflows_--;
+        ring_.size_--;
+    }
+}
+
 ptr<resp_msg> raft_server::handle_cli_req_callback(ptr<commit_ret_elem> elem,
                                                    ptr<resp_msg> resp) {
     p_dv("commit_ret_cv %" PRIu64 " %p sleep", elem->idx_, &elem->awaiter_);
@@ -346,18 +592,18 @@ ptr<resp_msg> raft_server::handle_cli_req_callback(ptr<commit_ret_elem> elem,
     uint64_t idx = 0;
     uint64_t elapsed_us = 0;
     ptr<buffer> ret_value = nullptr;
-    {   auto_lock(commit_ret_elems_lock_);
+    {   commit_ret_ring::accessor cre(*commit_ret_elems_, elem->idx_);
         idx = elem->idx_;
         elapsed_us = elem->timer_.get_us();
         ret_value = elem->ret_value_;
         elem->callback_invoked_ = true;
         if (elem->result_code_ != cmd_result_code::TIMEOUT) {
-            commit_ret_elems_.erase(elem->idx_);
+            if (cre.find() == elem) cre.erase();
         } else {
             p_dv("Client timeout leave commit thread to remove commit_ret_elem %" PRIu64,
                  idx);
         }
-        p_dv("remaining elems in waiting queue: %zu", commit_ret_elems_.size());
+        p_dv("remaining elems in waiting queue: %zu", commit_ret_elems_->size());
     }
 
     if (elem->result_code_ == cmd_result_code::OK) {
@@ -388,33 +634,52 @@ ptr< cmd_result< ptr<buffer> > >
     return async_res;
 }
 
+size_t raft_server::get_num_commit_ret_overflows() const {
+    return commit_ret_elems_->num_overflows_;
+}
+
 void raft_server::drop_all_pending_commit_elems() {
+    // Requests of the logs committed (and notified) so far already got
+    // their results, the pending ones are after them. Every request
+    // takes the index of its last log, which is not beyond the last log.
+    uint64_t from = sm_commit_index_;
+    if (ctx_->get_params()->track_peers_sm_commit_idx_) {
+        from = std::min<uint64_t>(from, sm_commit_notifier_notified_idx_);
+    }
+    uint64_t upto = std::max<uint64_t>( precommit_index_,
+                                        log_store_->next_slot() - 1 );
+    std::vector<uint64_t> indexes = commit_ret_elems_->get_indexes(from + 1, upto);
+
     // Blocking mode:
     //   Invoke all awaiting requests to return `CANCELLED`.
     if (ctx_->get_params()->return_method_ == raft_params::blocking) {
-        auto_lock(commit_ret_elems_lock_);
         ulong min_idx = std::numeric_limits<ulong>::max();
         ulong max_idx = 0;
-        for (auto& entry: commit_ret_elems_) {
-            ptr<commit_ret_elem>& elem = entry.second;
+        size_t num_cancelled = 0;
+        for (uint64_t idx: indexes) {
+            commit_ret_ring::accessor cre(*commit_ret_elems_, idx);
+            ptr<commit_ret_elem> elem = cre.find();
+            if (!elem) continue;
+
             elem->ret_value_ = nullptr;
             elem->result_code_ = cmd_result_code::CANCELLED;
             elem->awaiter_.invoke();
+            cre.erase();
             if (min_idx > elem->idx_) {
                 min_idx = elem->idx_;
             }
             if (max_idx < elem->idx_) {
                 max_idx = elem->idx_;
             }
+            num_cancelled++;
             p_db("cancelled blocking client request %" PRIu64 ", waited %" PRIu64 " us",
                  elem->idx_, elem->timer_.get_us());
         }
-        if (!commit_ret_elems_.empty()) {
+        if (num_cancelled) {
             p_wn("cancelled %zu blocking client requests from %" PRIu64
                  " to %" PRIu64 ".",
-                 commit_ret_elems_.size(), min_idx, max_idx);
+                 num_cancelled, min_idx, max_idx);
         }
-        commit_ret_elems_.clear();
         return;
     }
 
@@ -422,12 +687,12 @@ void raft_server::drop_all_pending_commit_elems() {
     //   Set `CANCELLED` and set result & error.
     std::list< ptr<commit_ret_elem> > elems;
 
-    {   auto_lock(commit_ret_elems_lock_);
-        for (auto& entry: commit_ret_elems_) {
-            ptr<commit_ret_elem>& ee = entry.second;
-            elems.push_back(ee);
-        }
-        commit_ret_elems_.clear();
+    for (uint64_t idx: indexes) {
+        commit_ret_ring::accessor cre(*commit_ret_elems_, idx);
+        ptr<commit_ret_elem> elem = cre.find();
+        if (!elem) continue;
+        elems.push_back(elem);
+        cre.erase();
     }
 
     // Calling handler should be done outside the mutex.
@@ -471,10 +736,12 @@ void raft_server::drop_all_sm_watcher_elems() {
 ptr<cmd_result<bool>> raft_server::wait_for_state_machine_commit(uint64_t target_idx) {
     auto ret = cs_new<cmd_result<bool>>();
 
-    std::lock_guard<std::mutex> l(sm_watchers_lock_);
+    std::unique_lock<std::mutex> l(sm_watchers_lock_);
     uint64_t sm_commit_index = sm_commit_index_;
     if (target_idx <= sm_commit_index) {
         // If the target index is already committed, return immediately.
+        // Setting the result should be done outside the mutex.
+        l.unlock();
         p_tr("sm watcher for idx %" PRIu64 " already committed, return true",
              target_idx);
         bool ret_bool = true;
@@ -27,6 +27,13 @@ limitations under the License.
 #include "ptr.hxx"
 #include "raft_server.hxx"
 
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <vector>
+
 namespace nuraft {
 
 struct raft_server::commit_ret_elem {
@@ -39,6 +46,18 @@ struct raft_server::commit_ret_elem {
 
     ~commit_ret_elem() {}
 
+    /**
+     * Reset this element so as to reuse it for another log index.
+     */
+    void reset() {
+        awaiter_.reset();
+        timer_.reset();
+        ret_value_.reset();
+        result_code_ = cmd_result_code::OK;
+        async_result_.reset();
+        callback_invoked_ = false;
+    }
+
     ulong idx_;
     EventAwaiter awaiter_;
     timer_helper timer_;
@@ -48,6 +67,106 @@ struct raft_server::commit_ret_elem {
     bool callback_invoked_;
 };
 
+/**
+ * Client requests waiting for commit, addressed by their log index.
+ *
+ * As log indexes are dense and monotonic, each request takes the slot
+ * at `log_idx % capacity`, and the element in the slot is reused by the
+ * next log index taking the same slot. Only the threads handling the
+ * same log index contend on the lock of a slot. If the slot is still
+ * occupied by an older log index (e.g., its client timed out but the
+ * log is not committed yet), the request goes to the overflow map.
+ */
+struct raft_server::commit_ret_ring {
+    struct slot {
+        slot() : idx_(0) {}
+
+        /**
+         * Lock for this slot, should be acquired before `overflow_lock_`.
+         */
+        std::mutex lock_;
+
+        /**
+         * Log index using this slot, 0 if free.
+         * Can be read without `lock_`.
+         */
+        std::atomic<uint64_t> idx_;
+
+        /**
+         * Element for `idx_`. It remains after the slot is freed,
+         * to be reused unless someone else still refers to it.
+         */
+        ptr<commit_ret_elem> elem_;
+    };
+
+    /**
+     * Access to the element of a log index,
+     * holding the lock of its slot during its lifetime.
+     */
+    class accessor {
+    public:
+        accessor(commit_ret_ring& ring, uint64_t idx);
+
+        /**
+         * Return the element of the log index, or `nullptr` if not exist.
+         */
+        ptr<commit_ret_elem> find();
+
+        /**
+         * Add a new element for the log index. Should be called only
+         * when `find()` returns `nullptr`.
+         */
+        ptr<commit_ret_elem> insert();
+
+        /**
+         * Remove the element of the log index, if exists.
+         */
+        void erase();
+
+    private:
+        commit_ret_ring& ring_;
+        uint64_t idx_;
+        slot& slot_;
+        std::lock_guard<std::mutex> guard_;
+    };
+
+    explicit commit_ret_ring(size_t capacity);
+
+    /**
+     * Return the number of elements.
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * Return the log indexes of elements in `[from, upto]`,
+     * in ascending order. If the range is shorter than the number
+     * of slots, only the slots of the range are visited.
+     */
+    std::vector<uint64_t> get_indexes(uint64_t from, uint64_t upto);
+
+    std::vector<slot> slots_;
+
+    /**
+     * Number of elements, including the overflowed ones.
+     */
+    std::atomic<size_t> size_;
+
+    /**
+     * Number of elements in `overflow_`.
+     */
+    std::atomic<size_t> num_overflows_;
+
+    /**
+     * Lock for `overflow_`.
+     */
+    std::mutex overflow_lock_;
+
+    /**
+     * Elements whose slots were occupied at the time of insertion.
+     */
+    std::map<uint64_t, ptr<commit_ret_elem>> overflow_;
+};
+
 struct raft_server::sm_watcher_elem {
     sm_watcher_elem()
         : idx_(0)
@@ -61,5 +180,54 @@ struct raft_server::sm_watcher_elem {
     std::list<ptr<cmd_result<bool>>> watchers_;
 };
 
+struct raft_server::cli_req_pkg {
+    cli_req_pkg(req_msg& req,
+                const req_ext_params& ext_params,
+                uint64_t timestamp_us)
+        : req_(req)
+        , ext_params_(ext_params)
+        , timestamp_us_(timestamp_us)
+        , resp_(nullptr)
+        , last_idx_(0)
+        , ret_value_(nullptr)
+        , done_(false)
+        , next_(nullptr)
+        {}
+
+    req_msg& req_;
+    const req_ext_params& ext_params_;
+    uint64_t timestamp_us_;
+
+    /**
+     * Response to the caller, set by the drainer.
+     */
+    ptr<resp_msg> resp_;
+
+    /**
+     * Index of the last log appended by this request.
+     */
+    ulong last_idx_;
+
+    /**
+     * Return value of `pre_commit` of the last log.
+     */
+    ptr<buffer> ret_value_;
+
+    /**
+     * Set if the drainer failed while appending the group.
+     */
+    std::exception_ptr exception_;
+
+    /**
+     * `true` once the drainer finished handling this request.
+     */
+    std::atomic<bool> done_;
+
+    /**
+     * Next element in the submission queue.
+     */
+    cli_req_pkg* next_;
+};
+
 } // namespace nuraft;
 
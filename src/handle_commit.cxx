@@ -29,6 +29,7 @@ limitations under the License.
 #include "peer.hxx"
 #include "snapshot.hxx"
 #include "state_machine.hxx"
+#include "stat_mgr.hxx"
 #include "state_mgr.hxx"
 #include "tracer.hxx"
 
@@ -57,7 +58,12 @@ void raft_server::commit(ulong target_idx) {
         // if this is a leader notify peers to commit as well
         // for peers that are free, send the request, otherwise,
         // set pending commit flag for that peer
-        if (role_ == srv_role::leader) {
+        if ( role_ == srv_role::leader &&
+             ctx_->get_params()->commit_propagation_delay_ms_ > 0 ) {
+            // Let the next request carry the new commit index.
+            defer_commit_propagation();
+
+        } else if (role_ == srv_role::leader) {
             for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
                 ptr<peer> pp = it->second;
                 if (track_peers_sm_commit_idx &&
@@ -106,6 +112,58 @@ void raft_server::commit(ulong target_idx) {
     }
 }
 
+void raft_server::defer_commit_propagation() {
+    // Requests sent before this point do not have the new commit index.
+    commit_propagation_timer_.reset();
+    if (commit_propagation_pending_) {
+        // The task is already scheduled, the delay is counted from
+        // the oldest advancement.
+        return;
+    }
+
+    ptr<raft_params> params = ctx_->get_params();
+    commit_propagation_pending_ = true;
+
+    if (commit_propagation_task_) {
+        cancel_task(commit_propagation_task_);
+    } else {
+        commit_propagation_task_ = cs_new< timer_task<void> >
+                                   ( commit_propagation_exec_,
+                                     timer_task_type::commit_propagation_timer );
+    }
+    schedule_task(commit_propagation_task_, params->commit_propagation_delay_ms_);
+}
+
+void raft_server::handle_commit_propagation_timeout() {
+    recur_lock(lock_);
+    if (stopping_ || !commit_propagation_pending_) return;
+    commit_propagation_pending_ = false;
+    if (role_ != srv_role::leader) return;
+
+    static stat_elem& deferred_commit_reqs = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "deferred_commit_propagation_reqs");
+
+    bool track_peers_sm_commit_idx = ctx_->get_params()->track_peers_sm_commit_idx_;
+    uint64_t deferred_us = commit_propagation_timer_.get_us();
+    for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
+        ptr<peer> pp = it->second;
+        if (pp->get_ls_timer_us() < deferred_us) {
+            // A request has been sent after the commit index advanced,
+            // and it carried the new commit index.
+            continue;
+        }
+        if (track_peers_sm_commit_idx &&
+            pp->get_sm_committed_idx() >= quick_commit_index_) {
+            continue;
+        }
+        if (!request_append_entries(pp)) {
+            pp->set_pending_commit();
+        } else {
+            deferred_commit_reqs++;
+        }
+    }
+}
+
 void raft_server::commit_in_bg() {
     std::string thread_name = "nuraft_commit";
 #ifdef __linux__
@@ -402,7 +460,7 @@ void raft_server::commit_app_log(ulong idx_to_commit,
 
     std::list< ptr<commit_ret_elem> > async_elems;
     if (need_to_handle_commit_elem) {
-        std::unique_lock<std::mutex> cre_lock(commit_ret_elems_lock_);
+        commit_ret_ring::accessor cre(*commit_ret_elems_, sm_idx);
         /// Sometimes user can batch requests to RAFT: for example send 30
         /// append entries requests in a single batch. For such request batch
         /// user will receive a single response: all was successful or all
@@ -417,9 +475,8 @@ void raft_server::commit_app_log(ulong idx_to_commit,
         /// responses of the intermediate requests from requests batch.
         bool need_to_check_commit_ret = sm_idx == pc_idx;
 
-        auto entry = commit_ret_elems_.find(sm_idx);
-        if (entry != commit_ret_elems_.end()) {
-            ptr<commit_ret_elem> elem = entry->second;
+        ptr<commit_ret_elem> elem = cre.find();
+        if (elem) {
             if (elem->idx_ == sm_idx) {
                 elem->result_code_ = cmd_result_code::OK;
                 elem->ret_value_ = ret_value;
@@ -439,7 +496,7 @@ void raft_server::commit_app_log(ulong idx_to_commit,
                         // Blocking mode:
                         if (elem->callback_invoked_) {
                             // If elem callback invoked (== TIMEOUT), remove it
-                            commit_ret_elems_.erase(entry);
+                            cre.erase();
                         } else {
                             // or notify client that request done
                             elem->awaiter_.invoke();
@@ -449,7 +506,7 @@ void raft_server::commit_app_log(ulong idx_to_commit,
                     case raft_params::async_handler:
                         // Async handler: put into list.
                         async_elems.push_back(elem);
-                        commit_ret_elems_.erase(entry);
+                        cre.erase();
                         break;
                     }
                 }
@@ -459,8 +516,7 @@ void raft_server::commit_app_log(ulong idx_to_commit,
         if (need_to_check_commit_ret && !initial_commit_exec) {
             // If not found, commit thread is invoked earlier than user thread.
             // Create one here.
-            ptr<commit_ret_elem> elem = cs_new<commit_ret_elem>();
-            elem->idx_ = sm_idx;
+            ptr<commit_ret_elem> elem = cre.insert();
             elem->result_code_ = cmd_result_code::OK;
             elem->ret_value_ = ret_value;
             p_tr("commit thread is invoked earlier than user thread, "
@@ -484,7 +540,6 @@ void raft_server::commit_app_log(ulong idx_to_commit,
                     break;
                 }
             }
-            commit_ret_elems_.insert( std::make_pair(sm_idx, elem) );
         }
     }
 
@@ -551,37 +606,36 @@ void raft_server::scan_sm_commit_and_notify(uint64_t idx_upto) {
 
     std::list< ptr<commit_ret_elem> > async_elems;
 
-    std::unique_lock<std::mutex> cre_lock(commit_ret_elems_lock_);
-
     // NOTE: If we reach here, we assume the leader already finished its
     //       commit (i.e., `commit_app_log`), hence the corresponding
     //       `commit_ret_elem` must exist.
-    auto entry = commit_ret_elems_.begin();
-    while (entry != commit_ret_elems_.end()) {
-        if (entry->first > idx_upto) {
-            break;
-        }
-        ptr<commit_ret_elem> elem = entry->second;
-
-        p_tr("notify cb %" PRIu64 " %p", entry->first, &elem->awaiter_);
+    //       Requests up to `sm_commit_notifier_notified_idx_` are
+    //       already notified by the previous scan.
+    std::vector<uint64_t> indexes = commit_ret_elems_->get_indexes
+        ( sm_commit_notifier_notified_idx_ + 1, idx_upto );
+    for (uint64_t idx: indexes) {
+        commit_ret_ring::accessor cre(*commit_ret_elems_, idx);
+        ptr<commit_ret_elem> elem = cre.find();
+        if (!elem) continue;
+
+        p_tr("notify cb %" PRIu64 " %p", idx, &elem->awaiter_);
         switch (params->return_method_) {
         case raft_params::blocking:
         default:
             // Blocking mode:
             if (elem->callback_invoked_) {
                 // If elem callback invoked (== TIMEOUT), remove it
-                entry = commit_ret_elems_.erase(entry);
+                cre.erase();
             } else {
                 // or notify client that request done
                 elem->awaiter_.invoke();
-                entry++;
             }
             break;
 
         case raft_params::async_handler:
             // Async handler: put into list.
             async_elems.push_back(elem);
-            entry = commit_ret_elems_.erase(entry);
+            cre.erase();
             break;
         }
     }
@@ -985,6 +1039,7 @@ void raft_server::reconfigure(const ptr<cluster_config>& new_config) {
         if (id_ == (*it)->get_id()) {
             my_priority_ = (*it)->get_priority();
             im_learner_ = (*it)->is_learner();
+            im_witness_ = (*it)->is_witness();
             steps_to_down_ = 0;
             if (!(*it)->is_new_joiner() &&
                 role_ == srv_role::follower &&
@@ -1036,6 +1091,7 @@ void raft_server::reconfigure(const ptr<cluster_config>& new_config) {
         str_buf << "add peer " << srv_added->get_id()
                 << ", " << srv_added->get_endpoint()
                 << ", " << (srv_added->is_learner() ? "learner" : "voting member")
+                << (srv_added->is_witness() ? " (witness)" : "")
                 << ", " << (srv_added->is_new_joiner() ? "new joiner" : "regular")
                 << std::endl;
 
@@ -1176,6 +1232,7 @@ void raft_server::reconfigure(const ptr<cluster_config>& new_config) {
                  << ", DC ID " << s_conf->get_dc_id()
                  << ", " << s_conf->get_endpoint()
                  << ", " << (s_conf->is_learner() ? "learner" : "voting member")
+                 << (s_conf->is_witness() ? " (witness)" : "")
                  << ", " << (s_conf->is_new_joiner() ? "new joiner" : "regular member")
                  << ", " << s_conf->get_priority()
                  << std::endl;
@@ -323,7 +323,17 @@ void raft_server::sync_log_to_new_srv(ulong start_idx) {
     // Modified by Jung-Sang Ahn, 12/22, 2017.
     // When snapshot transmission is still in progress, start_idx can be 0.
     // We should tolerate this.
-    if (/* start_idx > 0 && */ start_idx < log_store_->start_index()) {
+    if (srv_to_join_->get_config().is_witness()) {
+        // Witness doesn't need the payloads of committed logs.
+        req = create_witness_snapshot_req( srv_to_join_,
+                                           start_idx ? start_idx - 1 : 0,
+                                           state_->get_term(),
+                                           quick_commit_index_ );
+    }
+
+    if (req) {
+        // Metadata snapshot has been created.
+    } else if (/* start_idx > 0 && */ start_idx < log_store_->start_index()) {
         srv_to_join_snp_retry_required_ = false;
         bool succeeded_out = false;
         req = create_sync_snapshot_req( srv_to_join_,
@@ -0,0 +1,475 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "raft_server.hxx"
+
+#include "cluster_config.hxx"
+#include "peer.hxx"
+#include "stat_mgr.hxx"
+#include "tracer.hxx"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace nuraft {
+
+ptr<cmd_result<uint64_t>> raft_server::read_index() {
+    ptr<cmd_result<uint64_t>> ret = cs_new<cmd_result<uint64_t>>();
+    uint64_t idx = 0;
+    cmd_result_code code = cmd_result_code::OK;
+    bool done = false;
+
+    {   recur_lock(lock_);
+        if (role_ != srv_role::leader || write_paused_ || stopping_) {
+            code = cmd_result_code::NOT_LEADER;
+            done = true;
+
+        } else {
+            ret->accept();
+
+            uint64_t idx_at_becoming_leader = index_at_becoming_leader_;
+            if ( timer_helper::get_timeofday_us() < get_lease_expiry_us() &&
+                 ( !idx_at_becoming_leader ||
+                   quick_commit_index_ >= idx_at_becoming_leader ) ) {
+                static stat_elem& lease_reads =
+                    *stat_mgr::get_instance()->create_stat
+                     (stat_elem::COUNTER, "lease_reads");
+                lease_reads++;
+
+                idx = quick_commit_index_;
+                done = true;
+
+            } else {
+                read_index_waiters_.push_back(ret);
+                if (!read_index_round_active_) {
+                    start_read_index_round();
+                }
+                // Otherwise, the next round will start
+                // once the current one is done.
+            }
+        }
+    }
+
+    // Results should be set outside `lock_`,
+    // as their handlers may call this function again.
+    if (done) {
+        ptr<std::exception> err = nullptr;
+        ret->set_result(idx, err, code);
+    } else {
+        notify_read_index_results();
+    }
+    return ret;
+}
+
+void raft_server::start_read_index_round() {
+    read_index_batch_.swap(read_index_waiters_);
+    read_index_round_seqs_.clear();
+    read_index_round_active_ = true;
+
+    static stat_elem& read_index_rounds = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "read_index_rounds");
+    read_index_rounds++;
+
+    std::list<ptr<peer>> voting_peers;
+    for (auto& entry: peers_) {
+        ptr<peer>& pp = entry.second;
+        {   auto_lock(pp->get_lock());
+            if (!is_regular_member(pp)) continue;
+        }
+        read_index_round_seqs_[pp->get_id()] = pp->get_last_req_seq();
+        voting_peers.push_back(pp);
+    }
+    p_tr("start read index round for %zu callers, %zu peers",
+         read_index_batch_.size(), voting_peers.size());
+
+    for (ptr<peer>& pp: voting_peers) {
+        if (!request_append_entries(pp)) {
+            // The request in flight was sent before this round,
+            // send another one right after its response.
+            pp->set_pending_commit();
+        }
+    }
+
+    // Single member cluster doesn't need to wait for anything.
+    check_read_index_round();
+}
+
+void raft_server::check_read_index_round() {
+    if (!read_index_round_active_ || role_ != srv_role::leader) return;
+
+    int32 num_acks = 0;
+    for (auto& entry: read_index_round_seqs_) {
+        auto pit = peers_.find(entry.first);
+        if (pit == peers_.end()) continue;
+        if (pit->second->get_acked_req_seq() > entry.second) num_acks++;
+    }
+
+    // Any election quorum should include at least one member that
+    // acknowledged this round (or this server itself), so that there
+    // cannot be a newer leader elected before the round started.
+    int32 num_required = get_num_voting_members() - get_quorum_for_election() - 1;
+    if (num_acks < num_required) return;
+
+    // The read index should be a log of the current term,
+    // which means the first log of this term should be committed.
+    uint64_t idx_at_becoming_leader = index_at_becoming_leader_;
+    if ( idx_at_becoming_leader &&
+         quick_commit_index_ < idx_at_becoming_leader ) {
+        p_tr("leadership confirmed, but log %" PRIu64 " is not committed yet",
+             idx_at_becoming_leader);
+        return;
+    }
+
+    uint64_t read_idx = quick_commit_index_;
+    p_tr("read index %" PRIu64 " for %zu callers, %d acks",
+         read_idx, read_index_batch_.size(), num_acks);
+
+    // Results will be set by `notify_read_index_results()`,
+    // once the caller releases `lock_`.
+    for (ptr<cmd_result<uint64_t>>& ret: read_index_batch_) {
+        read_index_results_.push_back( std::make_pair(ret, read_idx) );
+    }
+    read_index_batch_.clear();
+    read_index_round_active_ = false;
+
+    if (!read_index_waiters_.empty() && role_ == srv_role::leader) {
+        start_read_index_round();
+    }
+}
+
+void raft_server::notify_read_index_results() {
+    std::list< std::pair<ptr<cmd_result<uint64_t>>, uint64_t> > elems;
+    {   recur_lock(lock_);
+        elems.swap(read_index_results_);
+    }
+
+    // Calling handler should be done outside the mutex.
+    for (auto& entry: elems) {
+        uint64_t read_idx = entry.second;
+        ptr<std::exception> err = nullptr;
+        entry.first->set_result(read_idx, err, cmd_result_code::OK);
+    }
+}
+
+uint64_t raft_server::get_lease_expiry_us() {
+    ptr<raft_params> params = ctx_->get_params();
+    int32 lease_ms = params->leader_lease_ms_ - params->lease_clock_drift_ms_;
+    if (params->leader_lease_ms_ <= 0 || lease_ms <= 0) return 0;
+    if (role_ != srv_role::leader || write_paused_) return 0;
+
+    // Followers start their lease when they receive the request, which is
+    // always later than the time it was sent. Hence the lease measured
+    // from the send time by the leader ends earlier than any of them.
+    uint64_t since_us = leader_since_us_;
+    std::vector<uint64_t> ack_ts;
+    for (auto& entry: peers_) {
+        ptr<peer>& pp = entry.second;
+        {   auto_lock(pp->get_lock());
+            if (!is_regular_member(pp)) continue;
+        }
+        uint64_t ts = pp->get_lease_ack_ts_us();
+        ack_ts.push_back( ts >= since_us ? ts : 0 );
+    }
+
+    // Same as `check_read_index_round()`, the members holding the lease
+    // (and this server) should intersect any election quorum.
+    int32 num_required = get_num_voting_members() - get_quorum_for_election() - 1;
+    if (num_required <= 0) return std::numeric_limits<uint64_t>::max();
+    if ((size_t)num_required > ack_ts.size()) return 0;
+
+    std::sort(ack_ts.begin(), ack_ts.end(), std::greater<uint64_t>());
+    uint64_t ts = ack_ts[num_required - 1];
+    if (!ts) return 0;
+    return ts + (uint64_t)lease_ms * 1000;
+}
+
+bool raft_server::is_within_leader_lease(req_msg& req) {
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->leader_lease_ms_ <= 0) return false;
+
+    // Vote request for leadership transfer, initiated by the leader.
+    if (!req.log_entries().empty()) return false;
+
+    if (role_ == srv_role::leader) {
+        // Otherwise this server steps down by the newer term.
+        if (timer_helper::get_timeofday_us() >= get_lease_expiry_us()) {
+            return false;
+        }
+        p_in("[VOTE REQ] from peer %d, term %" PRIu64 " / mine %" PRIu64 ", "
+             "ignored as my lease is valid",
+             req.get_src(), req.get_term(), state_->get_term());
+        return true;
+    }
+
+    uint64_t elapsed_ms = last_rcvd_valid_append_entries_req_.get_ms();
+    if (elapsed_ms >= (uint64_t)params->leader_lease_ms_) return false;
+
+    p_in("[VOTE REQ] from peer %d, term %" PRIu64 " / mine %" PRIu64 ", "
+         "ignored as the leader's lease is valid "
+         "(last append_entries %" PRIu64 " ms ago)",
+         req.get_src(), req.get_term(), state_->get_term(), elapsed_ms);
+    return true;
+}
+
+ptr<resp_msg> raft_server::handle_read_index_req(req_msg& req) {
+    ptr<resp_msg> resp = cs_new<resp_msg>( state_->get_term(),
+                                           msg_type::read_index_response,
+                                           id_,
+                                           req.get_src(),
+                                           0,
+                                           true );
+    ptr<cmd_result<uint64_t>> read_ret = read_index();
+    if (read_ret->has_result()) {
+        // Not a leader, or served by the lease.
+        if (read_ret->get_result_code() != cmd_result_code::OK) {
+            resp->set_result_code(read_ret->get_result_code());
+            return resp;
+        }
+        ptr<buffer> ctx = buffer::alloc(sizeof(ulong));
+        ctx->put((ulong)read_ret->get());
+        ctx->pos(0);
+        resp->set_ctx(ctx);
+        return resp;
+    }
+
+    // Response will be sent once the round is done.
+    ptr< cmd_result< ptr<buffer> > > promise =
+        cs_new< cmd_result< ptr<buffer> > >();
+    read_ret->when_ready( [promise]( cmd_result<uint64_t>& res,
+                                     ptr<std::exception>& err ) {
+        ptr<buffer> ctx = nullptr;
+        if (res.get_result_code() == cmd_result_code::OK) {
+            ctx = buffer::alloc(sizeof(ulong));
+            ctx->put((ulong)res.get());
+            ctx->pos(0);
+        }
+        promise->set_result(ctx, err, res.get_result_code());
+    } );
+    resp->set_async_cb([promise]() { return promise; });
+    return resp;
+}
+
+ptr<cmd_result<uint64_t>> raft_server::read_index_from_leader() {
+    ptr<cmd_result<uint64_t>> ret = cs_new<cmd_result<uint64_t>>();
+    bool is_leader = false;
+    bool leader_unknown = false;
+    bool req_failed = false;
+
+    {   recur_lock(lock_);
+        if (role_ == srv_role::leader) {
+            is_leader = true;
+
+        } else if (leader_ == -1 || stopping_) {
+            leader_unknown = true;
+
+        } else {
+            ret->accept();
+            leader_read_waiters_.push_back(ret);
+            if (!leader_read_in_flight_) {
+                req_failed = !request_read_index_from_leader();
+            }
+            // Otherwise, the next request will be sent once
+            // the response of the current one arrives.
+        }
+    }
+
+    // Results should be set outside `lock_`,
+    // as their handlers may call this function again.
+    if (is_leader) {
+        ptr<cmd_result<uint64_t>> read_ret = read_index();
+        read_ret->when_ready( [this, ret]( cmd_result<uint64_t>& res,
+                                           ptr<std::exception>& err ) {
+            wait_for_read_index(ret, res, err);
+        } );
+
+    } else if (leader_unknown) {
+        uint64_t idx = 0;
+        ptr<std::exception> err =
+            cs_new<std::runtime_error>("leader is unknown.");
+        ret->set_result(idx, err, cmd_result_code::FAILED);
+
+    } else if (req_failed) {
+        ptr<resp_msg> no_resp;
+        ptr<rpc_exception> err = cs_new<rpc_exception>
+            ( "cannot send read index request to leader.", nullptr );
+        handle_leader_read_resp(no_resp, err);
+    }
+    return ret;
+}
+
+bool raft_server::request_read_index_from_leader() {
+    leader_read_batch_.swap(leader_read_waiters_);
+    leader_read_in_flight_ = true;
+
+    ptr<peer> pp;
+    auto entry = peers_.find(leader_);
+    if (entry != peers_.end()) pp = entry->second;
+
+    if (pp && pp->need_to_reconnect()) {
+        ptr<srv_config> s_conf = get_config()->get_server(leader_);
+        if (!s_conf || !pp->recreate_rpc(s_conf, *ctx_)) {
+            p_wn("reconnection to leader %d failed", leader_.load());
+            pp.reset();
+        }
+    }
+
+    if (!pp || !pp->make_busy()) {
+        // The caller should handle it as a failed response,
+        // after releasing `lock_`.
+        p_wn("cannot send read index request to leader %d: %s",
+             leader_.load(), pp ? "busy" : "not found");
+        return false;
+    }
+
+    static stat_elem& leader_read_reqs = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "leader_read_index_reqs");
+    leader_read_reqs++;
+
+    ptr<req_msg> req = cs_new<req_msg>
+                       ( state_->get_term(),
+                         msg_type::read_index_request,
+                         id_, leader_,
+                         term_for_log(log_store_->next_slot() - 1),
+                         log_store_->next_slot() - 1,
+                         quick_commit_index_.load() );
+    p_tr("send read index request to leader %d for %zu callers",
+         leader_.load(), leader_read_batch_.size());
+    rpc_handler handler = std::bind( &raft_server::handle_leader_read_resp,
+                                     this,
+                                     std::placeholders::_1,
+                                     std::placeholders::_2 );
+    pp->send_req(pp, req, handler);
+    return true;
+}
+
+void raft_server::handle_leader_read_resp(ptr<resp_msg>& resp,
+                                          ptr<rpc_exception>& err)
+{
+    std::list<ptr<cmd_result<uint64_t>>> batch;
+    cmd_result<uint64_t> read_ret;
+    uint64_t read_idx = 0;
+    ptr<std::exception> perr = nullptr;
+    cmd_result_code code = cmd_result_code::OK;
+    std::list<ptr<cmd_result<uint64_t>>> dropped;
+    bool req_failed = false;
+
+    {   recur_lock(lock_);
+        batch.swap(leader_read_batch_);
+        leader_read_in_flight_ = false;
+
+        if (err) {
+            perr = err;
+            code = cmd_result_code::FAILED;
+        } else if ( resp->get_result_code() != cmd_result_code::OK ||
+                    !resp->get_ctx() ) {
+            code = resp->get_result_code() != cmd_result_code::OK
+                   ? resp->get_result_code() : cmd_result_code::FAILED;
+        } else {
+            resp->get_ctx()->pos(0);
+            read_idx = resp->get_ctx()->get_ulong();
+        }
+        p_tr("read index %" PRIu64 " from leader, code %d, %zu callers",
+             read_idx, (int)code, batch.size());
+
+        if (!leader_read_waiters_.empty()) {
+            if (leader_ == -1 || stopping_) {
+                dropped.swap(leader_read_waiters_);
+                p_in("dropped %zu leader read waiters", dropped.size());
+            } else {
+                req_failed = !request_read_index_from_leader();
+            }
+        }
+    }
+
+    // Results should be set outside `lock_`,
+    // as their handlers may call `read_index_from_leader()` again.
+    read_ret.set_result(read_idx, perr, code);
+    for (ptr<cmd_result<uint64_t>>& ret: batch) {
+        wait_for_read_index(ret, read_ret, perr);
+    }
+    for (ptr<cmd_result<uint64_t>>& ret: dropped) {
+        uint64_t idx = 0;
+        ptr<std::exception> drop_err =
+            cs_new<std::runtime_error>("read index has been cancelled.");
+        ret->set_result(idx, drop_err, cmd_result_code::FAILED);
+    }
+
+    if (req_failed) {
+        ptr<resp_msg> no_resp;
+        ptr<rpc_exception> req_err = cs_new<rpc_exception>
+            ( "cannot send read index request to leader.", nullptr );
+        handle_leader_read_resp(no_resp, req_err);
+    }
+}
+
+void raft_server::wait_for_read_index(ptr<cmd_result<uint64_t>> ret,
+                                      cmd_result<uint64_t>& read_idx_ret,
+                                      ptr<std::exception>& err)
+{
+    uint64_t read_idx = read_idx_ret.get();
+    cmd_result_code code = read_idx_ret.get_result_code();
+    if (code != cmd_result_code::OK) {
+        ret->set_result(read_idx, err, code);
+        return;
+    }
+
+    wait_for_state_machine_commit(read_idx)->when_ready
+        ( [ret, read_idx]( bool& committed, ptr<std::exception>& err ) {
+            uint64_t idx = read_idx;
+            ret->set_result( idx, err,
+                             committed ? cmd_result_code::OK
+                                       : cmd_result_code::CANCELLED );
+        } );
+}
+
+void raft_server::drop_all_leader_read_waiters(cmd_result_code code) {
+    std::list<ptr<cmd_result<uint64_t>>> elems;
+    elems.swap(leader_read_waiters_);
+    // Callers in `leader_read_batch_` will be handled by the response.
+
+    for (ptr<cmd_result<uint64_t>>& ret: elems) {
+        uint64_t idx = 0;
+        ptr<std::exception> err =
+            cs_new<std::runtime_error>("read index has been cancelled.");
+        ret->set_result(idx, err, code);
+    }
+    if (!elems.empty()) {
+        p_in("dropped %zu leader read waiters", elems.size());
+    }
+}
+
+void raft_server::drop_all_read_index_waiters(cmd_result_code code) {
+    std::list<ptr<cmd_result<uint64_t>>> elems;
+    elems.swap(read_index_batch_);
+    elems.splice(elems.end(), read_index_waiters_);
+    read_index_round_active_ = false;
+    read_index_round_seqs_.clear();
+
+    for (ptr<cmd_result<uint64_t>>& ret: elems) {
+        uint64_t idx = 0;
+        ptr<std::exception> err =
+            cs_new<std::runtime_error>("read index has been cancelled.");
+        ret->set_result(idx, err, code);
+    }
+    if (!elems.empty()) {
+        p_in("dropped %zu read index waiters", elems.size());
+    }
+}
+
+} // namespace nuraft;
@@ -122,6 +122,54 @@ void raft_server::clear_snapshot_sync_ctx(peer& pp) {
     pp.set_snapshot_in_sync(nullptr);
 }
 
+ptr<req_msg> raft_server::create_witness_snapshot_req(ptr<peer>& pp,
+                                                      ulong last_log_idx,
+                                                      ulong term,
+                                                      ulong commit_idx) {
+    // Witness doesn't have the state machine data, so that any committed
+    // log can be the base of the snapshot, without reading anything from
+    // the state machine. Config should be read first, so that its log
+    // index is not bigger than the snapshot index.
+    ptr<cluster_config> c_conf = get_config();
+    ulong snp_idx = sm_commit_index_;
+    if (snp_idx <= last_log_idx) {
+        return nullptr;
+    }
+
+    peer& p = *pp;
+    std::lock_guard<std::mutex> guard(p.get_lock());
+    p.reset_cnt_backward_log_probe();
+    ptr<snapshot_sync_ctx> sync_ctx = p.get_snapshot_sync_ctx();
+    ptr<snapshot> snp = sync_ctx ? sync_ctx->get_snapshot() : nullptr;
+    if (!snp || sync_ctx->get_timer().timeout()) {
+        if (sync_ctx) clear_snapshot_sync_ctx(p);
+        snp = cs_new<snapshot>( snp_idx, term_for_log(snp_idx), c_conf,
+                                0, snapshot::logical_object );
+        p_in( "trying to sync metadata snapshot with last index %" PRIu64
+              " to witness %d, its last log idx %" PRIu64,
+              snp_idx, p.get_id(), last_log_idx );
+        p.set_snapshot_in_sync(snp, ulong(get_snapshot_sync_ctx_timeout()));
+    }
+
+    // Only one empty object, which is the first and the last one.
+    ptr<buffer> data = buffer::alloc(0);
+    std::unique_ptr<snapshot_sync_req> sync_req
+        ( new snapshot_sync_req(snp, 0, data, true) );
+    ptr<req_msg> req( cs_new<req_msg>
+                      ( term,
+                        msg_type::install_snapshot_request,
+                        id_,
+                        p.get_id(),
+                        snp->get_last_log_term(),
+                        snp->get_last_log_idx(),
+                        commit_idx ) );
+    req->log_entries().push_back( cs_new<log_entry>
+                                  ( term,
+                                    sync_req->serialize(),
+                                    log_val_type::snp_sync_req ) );
+    return req;
+}
+
 ptr<req_msg> raft_server::create_sync_snapshot_req(ptr<peer>& pp,
                                                    ulong last_log_idx,
                                                    ulong term,
@@ -385,8 +433,11 @@ ptr<resp_msg> raft_server::handle_install_snapshot_req(req_msg& req, std::unique
         return resp;
     }
 
+    // Snapshot data will refer to the log entry's buffer, without copy.
+    ptr<buffer> sync_req_buf = entries[0]->get_buf_ptr();
+    buffer_serializer sync_req_bs(sync_req_buf);
     ptr<snapshot_sync_req> sync_req =
-        snapshot_sync_req::deserialize(entries[0]->get_buf());
+        snapshot_sync_req::deserialize(sync_req_bs);
     if (sync_req->get_snapshot().get_last_log_idx() <= quick_commit_index_) {
         p_wn( "received a snapshot (%" PRIu64 ") that is older than "
               "current commit idx (%" PRIu64 "), last log idx %" PRIu64,
@@ -724,6 +775,12 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
     // if offset == 0, it is the first object.
     bool is_first_obj = (req.get_offset()) ? false : true;
     bool is_last_obj = req.is_done();
+    if (is_first_obj) {
+        // Log entries in the pending group may be compacted by
+        // the snapshot installation.
+        flush_follower_append_group();
+    }
+
     if (is_first_obj || is_last_obj) {
         // INFO level: log only first and last object.
         p_in("save snapshot (idx %" PRIu64 ", term %" PRIu64 ") offset 0x%" PRIx64
@@ -776,11 +833,41 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
         ulong obj_id = req.get_offset();
         buffer& buf = req.get_data();
         buf.pos(0);
-        state_machine_->save_logical_snp_obj(req.get_snapshot(),
-                                             obj_id,
-                                             buf,
-                                             is_first_obj,
-                                             is_last_obj);
+
+        ulong term_before = state_->get_term();
+        srv_role role_before = role_;
+        int32 leader_before = leader_;
+        {
+            // Saving an object may take long. Release `lock_` meanwhile,
+            // so that other requests from the leader (e.g., heartbeats
+            // on a multiplexed connection) are not blocked by it.
+            // Objects are still saved one at a time.
+            std::lock_guard<std::mutex> obj_guard(snp_obj_save_lock_);
+            guard.unlock();
+            state_machine_->save_logical_snp_obj(req.get_snapshot(),
+                                                 obj_id,
+                                                 buf,
+                                                 is_first_obj,
+                                                 is_last_obj);
+        }
+        guard.lock();
+
+        // Anything may have happened while `lock_` was released.
+        // If this server is no longer receiving the snapshot from
+        // the same leader, the leader will send it again.
+        if ( state_->get_term() != term_before ||
+             role_ != role_before ||
+             leader_ != leader_before ||
+             !state_->is_receiving_snapshot() ) {
+            p_wn("term (%" PRIu64 " -> %" PRIu64 "), role (%d -> %d), "
+                 "leader (%d -> %d) or receiving state changed while "
+                 "saving snapshot object %" PRIu64 ", drop it",
+                 term_before, state_->get_term(),
+                 (int)role_before, (int)role_.load(),
+                 leader_before, leader_.load(),
+                 req.get_offset());
+            return false;
+        }
         req.set_offset(obj_id);
     }
 
@@ -23,6 +23,7 @@ limitations under the License.
 #include "event_awaiter.hxx"
 #include "peer.hxx"
 #include "state_machine.hxx"
+#include "stat_mgr.hxx"
 #include "state_mgr.hxx"
 #include "tracer.hxx"
 
@@ -150,6 +151,25 @@ void raft_server::handle_hb_timeout(int32 srv_id) {
     p_ts("heartbeat timeout for %d", p->get_id());
     if (role_ == srv_role::leader) {
         update_target_priority();
+
+        ptr<raft_params> params = ctx_->get_params();
+        int32 last_sent_ms = p->get_ls_timer_us() / 1000;
+        int32 hb_interval_ms = p->get_current_hb_interval();
+        if ( params->suppress_busy_heartbeat_ &&
+             last_sent_ms < hb_interval_ms ) {
+            // Other request has been sent recently,
+            // heartbeat is not needed until the interval passes since then.
+            static stat_elem& suppressed_hbs = *stat_mgr::get_instance()->create_stat
+                (stat_elem::COUNTER, "suppressed_heartbeats");
+            suppressed_hbs++;
+
+            std::lock_guard<std::mutex> guard(p->get_lock());
+            if (p->is_hb_enabled()) {
+                schedule_task(p->get_hb_task(), hb_interval_ms - last_sent_ms);
+            }
+            return;
+        }
+
         request_append_entries(p);
         {
             std::lock_guard<std::mutex> guard(p->get_lock());
@@ -290,8 +310,8 @@ void raft_server::handle_election_timeout() {
         return;
     }
 
-    // Only voting member can suggest vote.
-    if (!im_learner_) {
+    // Only voting member (except for witness) can suggest vote.
+    if (!im_learner_ && !im_witness_) {
         p_wn("Election timeout, initiate leader election");
         if (!hb_alive_) {
             // Not the first election timeout, decay the target priority.
@@ -329,6 +349,13 @@ void raft_server::handle_election_timeout() {
 
     }
 
+    if (im_witness_) {
+        // Witness doesn't initiate vote, but it should grant
+        // pre-vote requests from now on.
+        p_in("election timeout, witness doesn't initiate leader election");
+        hb_alive_ = false;
+    }
+
     // restart the election timer if this is not yet a leader
     if (role_ != srv_role::leader) {
         restart_election_timer();
@@ -345,6 +372,14 @@ void raft_server::cancel_schedulers() {
         cancel_task(election_task_);
     }
 
+    if (group_flush_task_) {
+        cancel_task(group_flush_task_);
+    }
+
+    if (commit_propagation_task_) {
+        cancel_task(commit_propagation_task_);
+    }
+
     for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
         const ptr<peer>& p = it->second;
         if (p->get_hb_task()) {
@@ -197,6 +197,13 @@ void raft_server::request_prevote() {
 }
 
 void raft_server::initiate_vote(bool force_vote) {
+    if (im_witness_) {
+        // Witness doesn't have the payloads of logs,
+        // it should never become a leader.
+        p_wn("witness cannot initiate vote");
+        return;
+    }
+
     int grace_period = ctx_->get_params()->grace_period_of_lagging_state_machine_;
     ulong cur_term = state_->get_term();
     if ( !force_vote &&
@@ -335,6 +342,16 @@ ptr<resp_msg> raft_server::handle_vote_req(req_msg& req) {
         req.get_last_log_term() > log_store_->last_entry()->get_term() ||
         ( req.get_last_log_term() == log_store_->last_entry()->get_term() &&
           log_store_->next_slot() - 1 <= req.get_last_log_idx() );
+    if (im_witness_ && !log_okay) {
+        // Witness cannot be a leader, so that denying the candidate
+        // only because of the logs the witness has may block the
+        // election forever. Committed logs are protected by other
+        // members, as the leader commits a log only when enough
+        // non-witness members have it (see
+        // `get_expected_committed_log_idx()`).
+        p_in("[VOTE REQ] witness doesn't check if the log is up-to-date");
+        log_okay = true;
+    }
 
     bool grant =
         req.get_term() == state_->get_term() &&
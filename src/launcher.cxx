@@ -23,6 +23,7 @@ namespace nuraft {
 
 raft_launcher::raft_launcher()
     : asio_svc_(nullptr)
+    , uring_svc_(nullptr)
     , raft_instance_(nullptr)
     {}
 
@@ -61,6 +62,45 @@ ptr<raft_server> raft_launcher::init(ptr<state_machine> sm,
     return raft_instance_;
 }
 
+ptr<raft_server> raft_launcher::init(ptr<state_machine> sm,
+                                     ptr<state_mgr> smgr,
+                                     ptr<logger> lg,
+                                     int port_number,
+                                     const asio_service::options& asio_options,
+                                     const uring_service::options& uring_options,
+                                     const raft_params& params_given,
+                                     const raft_server::init_options& opt)
+{
+    if (!uring_service::is_supported()) return nullptr;
+
+    asio_svc_ = cs_new<asio_service>(asio_options, lg);
+    uring_svc_ = cs_new<uring_service>(uring_options, lg);
+
+    auto uring_listener = uring_svc_->create_rpc_listener(port_number, lg);
+    if (!uring_listener) return nullptr;
+
+    asio_listeners_.emplace_back(std::move(uring_listener));
+
+    ptr<delayed_task_scheduler> scheduler = asio_svc_;
+    ptr<rpc_client_factory> rpc_cli_factory = uring_svc_;
+
+    context* ctx = new context( smgr,
+                                sm,
+                                asio_listeners_,
+                                lg,
+                                rpc_cli_factory,
+                                scheduler,
+                                params_given );
+    raft_instance_ = cs_new<raft_server>(ctx, opt);
+
+    for (const auto & listener : asio_listeners_)
+    {
+        listener->listen( raft_instance_ );
+    }
+
+    return raft_instance_;
+}
+
 bool raft_launcher::shutdown(size_t time_limit_sec) {
     if (!raft_instance_) return false;
 
@@ -76,6 +116,10 @@ bool raft_launcher::shutdown(size_t time_limit_sec) {
         }
     }
 
+    if (uring_svc_) {
+        uring_svc_->stop();
+    }
+
     if (asio_svc_) {
         asio_svc_->stop();
         size_t count = 0;
@@ -0,0 +1,139 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "log_entry_cache.hxx"
+
+#include "stat_mgr.hxx"
+
+#include <algorithm>
+
+namespace nuraft {
+
+static size_t entry_size(const ptr<log_entry>& entry) {
+    ptr<buffer> buf = entry->get_buf_ptr();
+    return buf ? buf->size() : 0;
+}
+
+log_entry_cache::log_entry_cache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes)
+    , start_idx_(0)
+    , size_bytes_(0)
+    {}
+
+void log_entry_cache::put(ulong index, const ptr<log_entry>& entry) {
+    std::lock_guard<std::mutex> l(lock_);
+    if (!capacity_bytes_) return;
+
+    ulong next_idx = start_idx_ + entries_.size();
+    if ( entries_.empty() ||
+         index < start_idx_ ||
+         index > next_idx ) {
+        // Not contiguous, start over.
+        entries_.clear();
+        size_bytes_ = 0;
+        start_idx_ = index;
+    } else {
+        // Overwrite: drop the entries at `index` or later.
+        while (start_idx_ + entries_.size() > index) {
+            size_bytes_ -= entry_size(entries_.back());
+            entries_.pop_back();
+        }
+    }
+
+    entries_.push_back(entry);
+    size_bytes_ += entry_size(entry);
+    evict();
+}
+
+ptr<std::vector<ptr<log_entry>>> log_entry_cache::get(ulong start,
+                                                      ulong end,
+                                                      int64 batch_size_hint_in_bytes)
+{
+    static stat_elem& cache_hits = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "replication_cache_hits");
+    static stat_elem& cache_misses = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "replication_cache_misses");
+
+    std::lock_guard<std::mutex> l(lock_);
+    if (!capacity_bytes_) return nullptr;
+
+    ulong next_idx = start_idx_ + entries_.size();
+    if ( entries_.empty() ||
+         start < start_idx_ ||
+         start >= next_idx ||
+         start >= end ) {
+        cache_misses++;
+        return nullptr;
+    }
+
+    ptr<std::vector<ptr<log_entry>>> ret =
+        cs_new<std::vector<ptr<log_entry>>>();
+    ulong last_idx = std::min(end, next_idx);
+    ret->reserve(last_idx - start);
+
+    size_t accum_size = 0;
+    for (ulong ii = start; ii < last_idx; ++ii) {
+        const ptr<log_entry>& entry = entries_[ii - start_idx_];
+        ret->push_back(entry);
+        accum_size += entry_size(entry);
+        if ( batch_size_hint_in_bytes > 0 &&
+             accum_size >= (size_t)batch_size_hint_in_bytes ) break;
+    }
+    cache_hits++;
+    return ret;
+}
+
+void log_entry_cache::truncate(ulong index) {
+    std::lock_guard<std::mutex> l(lock_);
+    while ( !entries_.empty() &&
+            start_idx_ + entries_.size() > index ) {
+        size_bytes_ -= entry_size(entries_.back());
+        entries_.pop_back();
+    }
+}
+
+void log_entry_cache::clear() {
+    std::lock_guard<std::mutex> l(lock_);
+    entries_.clear();
+    size_bytes_ = 0;
+}
+
+void log_entry_cache::set_capacity(size_t capacity_bytes) {
+    std::lock_guard<std::mutex> l(lock_);
+    capacity_bytes_ = capacity_bytes;
+    evict();
+}
+
+size_t log_entry_cache::size_bytes() {
+    std::lock_guard<std::mutex> l(lock_);
+    return size_bytes_;
+}
+
+void log_entry_cache::evict() {
+    static stat_elem& cache_evictions = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "replication_cache_evictions");
+
+    while (!entries_.empty() && size_bytes_ > capacity_bytes_) {
+        size_bytes_ -= entry_size(entries_.front());
+        entries_.pop_front();
+        start_idx_++;
+        cache_evictions++;
+    }
+}
+
+}
+
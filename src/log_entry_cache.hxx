@@ -0,0 +1,120 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+#include "log_entry.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Size-bounded cache of the most recent log entries, in a contiguous
+ * range of log indexes. It keeps the same `log_entry` instances given
+ * to `put()`, so that reading them doesn't need deserialization.
+ *
+ * Once the total payload size exceeds the capacity, the oldest entries
+ * are evicted first.
+ *
+ * This class is thread-safe.
+ */
+class log_entry_cache {
+public:
+    /**
+     * @param capacity_bytes Maximum total payload size of cached entries.
+     */
+    log_entry_cache(size_t capacity_bytes);
+
+    __nocopy__(log_entry_cache);
+
+public:
+    /**
+     * Add a log entry. If `index` is not right after the last cached one,
+     * the cache is reset to start from `index`. If there are cached entries
+     * at `index` or later, they are dropped first.
+     *
+     * @param index Log index of the entry.
+     * @param entry Log entry.
+     */
+    void put(ulong index, const ptr<log_entry>& entry);
+
+    /**
+     * Get log entries in the range [start, end), with the same semantics
+     * as `log_store::log_entries_ext()`: the total payload size is limited
+     * by `batch_size_hint_in_bytes` (if positive), but at least one entry
+     * is returned.
+     *
+     * The returned entries may be fewer than requested, if the cache
+     * doesn't have entries up to `end - 1`.
+     *
+     * @param start Start log index (inclusive).
+     * @param end End log index (exclusive).
+     * @param batch_size_hint_in_bytes Size limit of the returned entries.
+     * @return Log entries, or `nullptr` if `start` is not cached.
+     */
+    ptr<std::vector<ptr<log_entry>>> get(ulong start,
+                                         ulong end,
+                                         int64 batch_size_hint_in_bytes);
+
+    /**
+     * Drop cached entries at `index` or later.
+     *
+     * @param index Log index.
+     */
+    void truncate(ulong index);
+
+    /**
+     * Drop all cached entries.
+     */
+    void clear();
+
+    /**
+     * Change the capacity. Zero disables the cache.
+     *
+     * @param capacity_bytes Maximum total payload size of cached entries.
+     */
+    void set_capacity(size_t capacity_bytes);
+
+    /**
+     * @return Total payload size of cached entries.
+     */
+    size_t size_bytes();
+
+private:
+    void evict();
+
+    std::mutex lock_;
+
+    size_t capacity_bytes_;
+
+    // Log index of `entries_.front()`.
+    ulong start_idx_;
+
+    std::deque< ptr<log_entry> > entries_;
+
+    // Total payload size of `entries_`.
+    size_t size_bytes_;
+};
+
+}
+
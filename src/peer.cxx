@@ -75,6 +75,8 @@ void peer::send_req( ptr<peer> myself,
                       pending,
                       streaming,
                       req_size_bytes,
+                      timer_helper::get_timeofday_us(),
+                      ++last_req_seq_,
                       std::placeholders::_1,
                       std::placeholders::_2 );
     if (rpc_local) {
@@ -100,6 +102,8 @@ void peer::handle_rpc_result( ptr<peer> myself,
                               ptr<rpc_result>& pending_result,
                               bool streaming,
                               size_t req_size_bytes,
+                              uint64_t send_ts_us,
+                              uint64_t req_seq,
                               ptr<resp_msg>& resp,
                               ptr<rpc_exception>& err )
 {
@@ -150,6 +154,30 @@ void peer::handle_rpc_result( ptr<peer> myself,
                 //   it may free the peer even though new RPC client is already created.
                 reset_stale_rpc_responses();
                 bytes_in_flight_sub(req_size_bytes);
+
+                // Consumed by `raft_server::check_read_index_round()`.
+                uint64_t acked_seq = acked_req_seq_;
+                while ( acked_seq < req_seq &&
+                        !acked_req_seq_.compare_exchange_weak(acked_seq, req_seq) );
+                if ( req->get_type() == msg_type::append_entries_request &&
+                     resp->get_accepted() &&
+                     resp->get_term() == req->get_term() ) {
+                    // Consumed by `raft_server::get_lease_expiry_us()`.
+                    uint64_t ack_ts = lease_ack_ts_us_;
+                    while ( ack_ts < send_ts_us &&
+                            !lease_ack_ts_us_.compare_exchange_weak
+                                             (ack_ts, send_ts_us) );
+                }
+                if ( req->get_type() == msg_type::append_entries_request &&
+                     !req->log_entries().empty() &&
+                     req->log_entries()[0]->get_val_type() != log_val_type::log_pack ) {
+                    // Consumed by `raft_server::adjust_append_batch_size()`.
+                    uint64_t now_us = timer_helper::get_timeofday_us();
+                    set_append_rtt_sample( now_us > send_ts_us
+                                           ? now_us - send_ts_us : 0,
+                                           req->log_entries().size(),
+                                           req_size_bytes );
+                }
                 if (req->get_type() == msg_type::append_entries_request && !streaming) {
                     // This is exactly the case where `try_set_free()` would
                     // free the peer immediately below. Instead, defer it
@@ -209,19 +237,27 @@ void peer::handle_rpc_result( ptr<peer> myself,
                 rpc_.reset();
                 uint64_t last_streamed_log_idx = get_last_streamed_log_idx();
                 reset_stream();
+                reset_window();
                 if (last_streamed_log_idx) {
                     p_in("stop stream mode for peer %d at idx: %" PRIu64 "",
                          get_id(), last_streamed_log_idx);
                 }
                 reset_stale_rpc_responses();
                 reset_bytes_in_flight();
+                bool snapshot_multiplexed = snapshot_busy_flag_.exchange(false);
                 try_set_free(req->get_type(), streaming);
+                if (snapshot_multiplexed) {
+                    // The other requests multiplexed with the snapshot
+                    // chunk on this connection will not be answered.
+                    set_free();
+                }
 
                 // On disconnection, reset `snapshot_sync_is_needed` flag.
                 // The first request on the next connection will re-check
                 // the flag.
                 set_snapshot_sync_is_needed(false);
                 reset_cnt_backward_log_probe();
+                set_log_pack_supported(false);
 
             } else {
                 // WARNING (MONSTOR-9378):
@@ -260,13 +296,18 @@ void peer::handle_rpc_result( ptr<peer> myself,
 void peer::try_set_free(msg_type type, bool streaming) {
     const static std::unordered_set<int> msg_types_to_free( {
         // msg_type::append_entries_request,
-        msg_type::install_snapshot_request,
+        // `install_snapshot_request` is handled separately below:
+        // if the chunk was multiplexed (`move_busy_to_snapshot()`), it
+        // doesn't own `busy_flag_`, which may be held by a heartbeat
+        // in flight at the same time. Freeing it here would let another
+        // request be sent before that heartbeat's response arrives.
         msg_type::request_vote_request,
         msg_type::pre_vote_request,
         msg_type::leave_cluster_request,
         msg_type::custom_notification_request,
         msg_type::reconnect_request,
-        msg_type::priority_change_request
+        msg_type::priority_change_request,
+        msg_type::read_index_request
     } );
 
     if ( msg_types_to_free.find(type) !=
@@ -274,6 +315,15 @@ void peer::try_set_free(msg_type type, bool streaming) {
         set_free();
     }
 
+    if (type == msg_type::install_snapshot_request) {
+        // A multiplexed snapshot chunk doesn't hold `busy_flag_`,
+        // which may belong to another request in flight.
+        bool exp = true;
+        if (!snapshot_busy_flag_.compare_exchange_strong(exp, false)) {
+            set_free();
+        }
+    }
+
     if (type == msg_type::append_entries_request && !streaming) {
         set_free();
     }
@@ -323,10 +373,13 @@ bool peer::recreate_rpc(ptr<srv_config>& config,
         reset_active_timer();
 
         reset_stream();
+        reset_window();
         reset_bytes_in_flight();
         set_free();
+        snapshot_busy_flag_.store(false);
         set_manual_free();
         reset_cnt_backward_log_probe();
+        set_log_pack_supported(false);
         return true;
 
     } else {
@@ -20,6 +20,7 @@ limitations under the License.
 
 #include "raft_server.hxx"
 
+#include "append_dispatcher.hxx"
 #include "cluster_config.hxx"
 #include "context.hxx"
 #include "error_code.hxx"
@@ -29,6 +30,7 @@ limitations under the License.
 #include "handle_client_request.hxx"
 #include "handle_custom_notification.hxx"
 #include "internal_timer.hxx"
+#include "log_entry_cache.hxx"
 #include "peer.hxx"
 #include "snapshot.hxx"
 #include "snapshot_sync_ctx.hxx"
@@ -46,6 +48,7 @@ limitations under the License.
 namespace nuraft {
 
 const int raft_server::default_snapshot_sync_block_size = 4 * 1024;
+const size_t raft_server::commit_ret_ring_size = 4 * 1024;
 
 raft_server::limits raft_server::raft_limits_;
 
@@ -77,6 +80,7 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     , ea_sm_commit_exec_in_progress_(new EventAwaiter())
     , next_leader_candidate_(-1)
     , im_learner_(false)
+    , im_witness_(false)
     , serving_req_(false)
     , steps_to_down_(0)
     , snp_in_progress_(false)
@@ -86,6 +90,14 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     , scheduler_(ctx->scheduler_)
     , election_exec_(std::bind(&raft_server::handle_election_timeout, this))
     , election_task_(nullptr)
+    , group_flush_exec_(std::bind(&raft_server::handle_group_flush_timeout, this))
+    , group_flush_task_(nullptr)
+    , group_flush_start_idx_(0)
+    , group_flush_last_idx_(0)
+    , commit_propagation_exec_
+      ( std::bind(&raft_server::handle_commit_propagation_timeout, this) )
+    , commit_propagation_task_(nullptr)
+    , commit_propagation_pending_(false)
     , role_(srv_role::follower)
     , state_(ctx->state_mgr_->read_state())
     , log_store_(ctx->state_mgr_->load_log_store())
@@ -101,6 +113,15 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     , srv_to_leave_(nullptr)
     , srv_to_leave_target_idx_(0)
     , conf_to_add_(nullptr)
+    , commit_ret_elems_( cs_new<commit_ret_ring>
+                         ( ctx->get_params()->commit_ret_ring_size_
+                           ? ctx->get_params()->commit_ret_ring_size_
+                           : commit_ret_ring_size ) )
+    , cli_req_queue_head_(nullptr)
+    , cli_req_group_draining_(false)
+    , read_index_round_active_(false)
+    , leader_since_us_(0)
+    , leader_read_in_flight_(false)
     , resp_handler_( (rpc_handler)std::bind( &raft_server::handle_peer_resp,
                                              this,
                                              std::placeholders::_1,
@@ -109,6 +130,10 @@ raft_server::raft_server(context* ctx, const init_options& opt)
                                                 this,
                                                 std::placeholders::_1,
                                                 std::placeholders::_2 ) )
+    , relay_resp_handler_( (rpc_handler)std::bind( &raft_server::handle_relay_resp,
+                                                   this,
+                                                   std::placeholders::_1,
+                                                   std::placeholders::_2 ) )
     , last_snapshot_(ctx->state_machine_->last_snapshot())
     , ea_follower_log_append_(new EventAwaiter())
     , test_mode_flag_(opt.test_mode_flag_)
@@ -153,6 +178,8 @@ raft_server::raft_server(context* ctx, const init_options& opt)
         p_in("First snapshot creation log distance %u", first_snapshot_distance_);
     }
 
+    log_cache_ = cs_new<log_entry_cache>(params->replication_cache_size_bytes_);
+
     apply_and_log_current_params();
     update_rand_timeout();
     precommit_index_ = log_store_->next_slot() - 1;
@@ -244,6 +271,7 @@ raft_server::raft_server(context* ctx, const init_options& opt)
         } else {
             // Myself.
             im_learner_ = cur_srv->is_learner();
+            im_witness_ = cur_srv->is_witness();
             my_priority_ = cur_srv->get_priority();
         }
 
@@ -264,12 +292,14 @@ raft_server::raft_server(context* ctx, const init_options& opt)
             << ": DC ID " << cur_srv->get_dc_id()
             << ", " << cur_srv->get_endpoint()
             << ", " << (cur_srv->is_learner() ? "learner" : "voting member")
+            << (cur_srv->is_witness() ? " (witness)" : "")
             << ", " << cur_srv->get_priority()
             << std::endl;
     }
 
     peer_info_msg << "my id: " << id_
                   << ", " << ((im_learner_) ? "learner" : "voting_member")
+                  << ((im_witness_) ? " (witness)" : "")
                   << std::endl;
     peer_info_msg << "num peers: " << peers_.size() << std::endl;
     p_in("%s", peer_info_msg.str().c_str());
@@ -421,9 +451,20 @@ void raft_server::apply_and_log_current_params() {
           "snapshot IO: %s, "
           "parallel log appending: %s, "
           "streaming mode max log gap %d, max bytes %" PRIu64 ", "
+          "replication window %d batches, %" PRId64 " bytes, "
+          "append batch target latency %d ms, "
+          "follower group flush delay %d ms, "
+          "append dispatch threads %d, "
+          "learner relay: %s, "
+          "suppress busy heartbeat: %s, "
+          "commit propagation delay %d ms, "
+          "bulk catch-up: %s, "
+          "leader lease %d ms, clock drift %d ms, "
+          "group commit: %s, "
           "full consensus mode: %s, "
           "tracking peer sm committed index: %s, "
-          "max uncommitted log entries %" PRIu64,
+          "max uncommitted log entries %" PRIu64 ", "
+          "commit result slots %zu",
           params->election_timeout_lower_bound_,
           params->election_timeout_upper_bound_,
           params->heart_beat_interval_,
@@ -448,9 +489,22 @@ void raft_server::apply_and_log_current_params() {
           params->parallel_log_appending_ ? "on" : "off",
           params->max_log_gap_in_stream_,
           params->max_bytes_in_flight_in_stream_,
+          params->replication_window_batches_,
+          params->replication_window_bytes_,
+          params->append_batch_target_latency_ms_,
+          params->follower_group_flush_delay_ms_,
+          params->append_dispatch_threads_,
+          params->use_learner_relay_ ? "ON" : "OFF",
+          params->suppress_busy_heartbeat_ ? "ON" : "OFF",
+          params->commit_propagation_delay_ms_,
+          params->use_bulk_catch_up_ ? "ON" : "OFF",
+          params->leader_lease_ms_,
+          params->lease_clock_drift_ms_,
+          params->use_group_commit_ ? "ON" : "OFF",
           params->use_full_consensus_among_healthy_members_ ? "ON" : "OFF",
           params->track_peers_sm_commit_idx_ ? "ON" : "OFF",
-          params->max_uncommitted_log_entries_
+          params->max_uncommitted_log_entries_,
+          commit_ret_elems_->slots_.size()
         );
 
     status_check_timer_.set_duration_ms(params->heart_beat_interval_);
@@ -458,6 +512,15 @@ void raft_server::apply_and_log_current_params() {
 
     leadership_transfer_timer_.set_duration_ms
         (params->leadership_transfer_min_wait_time_);
+
+    log_cache_->set_capacity(params->replication_cache_size_bytes_);
+
+    if (params->append_dispatch_threads_ > 0 && !append_dispatcher_) {
+        append_dispatcher_ = cs_new<append_dispatcher>
+                             ( params->append_dispatch_threads_, "nuraft_a_d" );
+        p_in("append dispatcher initiated, %d threads",
+             params->append_dispatch_threads_);
+    }
 }
 
 raft_params raft_server::get_current_params() const {
@@ -472,6 +535,12 @@ void raft_server::stop_server() {
 
     // Cancel all sm watchers.
     drop_all_sm_watcher_elems();
+
+    // Cancel all read index waiters.
+    {   recur_lock(lock_);
+        drop_all_read_index_waiters(cmd_result_code::CANCELLED);
+        drop_all_leader_read_waiters(cmd_result_code::CANCELLED);
+    }
 }
 
 void raft_server::cancel_global_requests() {
@@ -527,6 +596,11 @@ void raft_server::shutdown() {
 
     p_in("all state machine watchers dropped.");
 
+    {   recur_lock(lock_);
+        drop_all_read_index_waiters(cmd_result_code::CANCELLED);
+        drop_all_leader_read_waiters(cmd_result_code::CANCELLED);
+    }
+
     // Clear shared_ptrs that the current server is holding.
     {   std::lock_guard<std::mutex> l(ctx_->ctx_lock_);
         ctx_->logger_.reset();
@@ -563,6 +637,11 @@ void raft_server::shutdown() {
         bg_append_thread_.join();
     }
 
+    if (append_dispatcher_) {
+        append_dispatcher_->stop();
+        p_in("stopped append dispatcher.");
+    }
+
     {
         auto_lock(auto_fwd_reqs_lock_);
         p_in("clean up auto-forwarding queue: %zu elems", auto_fwd_reqs_.size());
@@ -799,6 +878,10 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
         return handle_leader_status_req(req);
     }
 
+    if ( req.get_type() == msg_type::read_index_request ) {
+        return handle_read_index_req(req);
+    }
+
     recur_lock(lock_);
     // recheck under lock
     if (stopping_) {
@@ -806,6 +889,16 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
         return nullptr;
     }
 
+    if ( req.get_type() == msg_type::request_vote_request &&
+         is_within_leader_lease(req) ) {
+        // Neither the term nor the vote should be changed, so that
+        // the current leader's lease remains valid.
+        return cs_new<resp_msg>( state_->get_term(),
+                                 msg_type::request_vote_response,
+                                 id_,
+                                 req.get_src() );
+    }
+
     if ( req.get_type() == msg_type::append_entries_request ||
          req.get_type() == msg_type::request_vote_request ||
          req.get_type() == msg_type::install_snapshot_request ) {
@@ -921,7 +1014,7 @@ void raft_server::reset_peer_info() {
 }
 
 void raft_server::handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err) {
-    recur_lock(lock_);
+    std::unique_lock<std::recursive_mutex> guard(lock_);
     if (err) {
         ptr<req_msg> req = err->req();
         if (!req) {
@@ -1053,6 +1146,14 @@ void raft_server::handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err)
               msg_type_to_string(resp->get_type()).c_str() );
         break;
     }
+
+    if ( read_index_round_active_ &&
+         resp->get_term() == state_->get_term() ) {
+        // The peer recognizes this server as the leader of the current term.
+        check_read_index_round();
+        guard.unlock();
+        notify_read_index_results();
+    }
 }
 
 void raft_server::send_reconnect_request() {
@@ -1150,15 +1251,22 @@ bool raft_server::reconnect_client(peer& p) {
 void raft_server::become_leader() {
     stop_election_timer();
 
-    {   auto_lock(commit_ret_elems_lock_);
-        p_in("number of pending commit elements: %zu",
-             commit_ret_elems_.size());
-    }
+    p_in("number of pending commit elements: %zu",
+         commit_ret_elems_->size());
+
+    // Entries cached in the previous leadership may have been
+    // overwritten since then.
+    log_cache_->clear();
+
+    // Log entries appended as a follower should be durable
+    // before counting this server in the quorum.
+    flush_follower_append_group();
 
     ptr<raft_params> params = ctx_->get_params();
     {   recur_lock(cli_lock_);
         role_ = srv_role::leader;
         leader_ = id_;
+        leader_since_us_ = timer_helper::get_timeofday_us();
         self_mark_down_ = excluded_from_the_quorum_ = false;
         srv_to_join_.reset();
         leadership_transfer_timer_.set_duration_ms
@@ -1184,9 +1292,13 @@ void raft_server::become_leader() {
             pp->set_next_log_idx(log_store_->next_slot());
             pp->set_next_log_idx_floor(0);
             pp->reset_stream();
+            pp->reset_window();
             enable_hb_for_peer(*pp);
             pp->set_recovered();
             pp->set_snapshot_sync_is_needed(false);
+            // Progress relayed while this server was a follower
+            // (or reported to the previous leadership) is not valid.
+            pp->reset_relayed_timestamp();
             if (params->use_full_consensus_among_healthy_members_) {
                 // We should reset response timer here
                 // so as not to disrupt full consensus.
@@ -1346,7 +1458,7 @@ void raft_server::check_leadership_transfer() {
         ptr<peer> peer_elem = entry.second;
         const srv_config& s_conf = peer_elem->get_config();
         int32 cur_priority = s_conf.get_priority();
-        if (cur_priority > max_priority) {
+        if (cur_priority > max_priority && !s_conf.is_witness()) {
             max_priority = cur_priority;
             successor_id = s_conf.get_id();
         }
@@ -1436,7 +1548,8 @@ void raft_server::yield_leadership(bool immediate_yield,
     if (successor_id >= 0) {
         // If successor is given, find that one.
         auto entry = peers_.find(successor_id);
-        if (entry != peers_.end()) {
+        if ( entry != peers_.end() &&
+             !entry->second->get_config().is_witness() ) {
             int32 srv_id = entry->first;
             ptr<peer>& pp = entry->second;
             max_priority = pp->get_config().get_priority();
@@ -1455,6 +1568,7 @@ void raft_server::yield_leadership(bool immediate_yield,
             uint64_t pp_last_resp_ms = pp->get_resp_timer_us() / 1000;
 
             if ( srv_id != id_ &&
+                 !pp->get_config().is_witness() &&
                  pp_last_resp_ms <= hb_interval_ms &&
                  pp->get_config().get_priority() > max_priority ) {
                 max_priority = pp->get_config().get_priority();
@@ -1593,6 +1707,7 @@ void raft_server::become_follower() {
         for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
             it->second->enable_hb(false);
             it->second->reset_stream();
+            it->second->reset_window();
             ptr<snapshot_sync_ctx> sync_ctx = it->second->get_snapshot_sync_ctx();
             if ( sync_ctx &&
                  sync_ctx->is_async_snapshot_transfer_started() ) {
@@ -1636,6 +1751,7 @@ void raft_server::become_follower() {
 
         // Drain all pending callback functions.
         drop_all_pending_commit_elems();
+        drop_all_read_index_waiters(cmd_result_code::NOT_LEADER);
 
         // NOTE: sm watchers are not reset here, as state machine commit can be
         //       executed regardless of the role.
@@ -1860,6 +1976,25 @@ ulong raft_server::term_for_log(ulong log_idx) {
     return last_snapshot->get_last_log_term();
 }
 
+ulong raft_server::first_log_idx_after_term(ulong term,
+                                            ulong start_idx,
+                                            ulong end_idx)
+{
+    // Terms in the log never decrease, do binary search
+    // to minimize the number of log store accesses.
+    start_idx = std::max(start_idx, log_store_->start_index());
+    ulong lo = start_idx, hi = end_idx + 1;
+    while (lo < hi) {
+        ulong mid = lo + (hi - lo) / 2;
+        if (term_for_log(mid) > term) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
 void raft_server::set_user_ctx(const std::string& ctx) {
     // Clone current cluster config.
     ptr<cluster_config> c_conf = get_config();
@@ -1998,6 +2133,7 @@ raft_server::peer_info raft_server::get_peer_info(int32 srv_id) const {
     ret.id_ = pp->get_id();
     ret.last_log_idx_ = pp->get_last_accepted_log_idx();
     ret.last_succ_resp_us_ = pp->get_resp_timer_us();
+    fill_append_batch_info(*pp, ret);
     return ret;
 }
 
@@ -2012,6 +2148,7 @@ std::vector<raft_server::peer_info> raft_server::get_peer_info_all() const {
         pi.id_ = pp->get_id();
         pi.last_log_idx_ = pp->get_last_accepted_log_idx();
         pi.last_succ_resp_us_ = pp->get_resp_timer_us();
+        fill_append_batch_info(*pp, pi);
         ret.push_back(pi);
     }
     return ret;
@@ -2048,6 +2185,12 @@ ulong raft_server::store_log_entry(ptr<log_entry>& entry, ulong index) {
         log_store_->write_at(log_index, entry);
     }
 
+    if (role_ == srv_role::leader) {
+        log_cache_->put(log_index, entry);
+    } else if (index) {
+        log_cache_->truncate(log_index);
+    }
+
     if ( entry->get_val_type() == log_val_type::conf ) {
         // Force persistence of config_change logs to guarantee the durability of
         // cluster membership change log entries.  Losing cluster membership log
@@ -0,0 +1,891 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "rpc_wire.hxx"
+
+#include "buffer_pool.hxx"
+#include "buffer_serializer.hxx"
+#include "internal_timer.hxx"
+#include "log_entry.hxx"
+#include "stat_mgr.hxx"
+#include "strfmt.hxx"
+
+#ifndef ZLIB_NOT_FOUND
+    #include <zlib.h>
+#endif
+
+#include <cstring>
+#include <stdexcept>
+
+namespace nuraft {
+
+ptr<buffer> rpc_wire::encode_req(req_msg& req, uint32_t flags) {
+    if (req.get_extra_flags() & req_msg::EXCLUDED_FROM_THE_QUORUM) {
+        flags |= MARK_DOWN;
+    }
+    if (req.get_extra_flags() & req_msg::ALLOW_ASYNC_LOG_APPENDING) {
+        flags |= ALLOW_ASYNC_LOG_APPENDING_WIRE;
+    }
+    if (req.get_extra_flags() & req_msg::CLOSE_ON_ERROR) {
+        flags |= CLOSE_ON_ERROR_WIRE;
+    }
+    const bool crc_on_entire_message = (flags & CRC_ON_ENTIRE_MESSAGE);
+    // Will be set after calculating the CRC of the header.
+    flags &= ~(uint32_t)CRC_ON_ENTIRE_MESSAGE;
+
+    size_t LOG_ENTRY_SIZE = 8 + 1 + 4;
+    if (flags & INCLUDE_LOG_TIMESTAMP) {
+        LOG_ENTRY_SIZE += 8;
+    }
+    if (flags & CRC_ON_PAYLOAD) {
+        LOG_ENTRY_SIZE += 5;
+    }
+
+    size_t log_data_size = 0;
+    for (auto& entry: req.log_entries()) {
+        log_data_size += LOG_ENTRY_SIZE + entry->get_buf().size();
+    }
+
+    ptr<buffer> buf = buffer::alloc(RPC_REQ_HEADER_SIZE + log_data_size);
+    buffer_serializer bs(buf);
+    bs.put_u8(0x0);
+    bs.put_u8((byte)req.get_type());
+    bs.put_i32(req.get_src());
+    bs.put_i32(req.get_dst());
+    bs.put_u64(req.get_term());
+    bs.put_u64(req.get_last_log_term());
+    bs.put_u64(req.get_last_log_idx());
+    bs.put_u64(req.get_commit_idx());
+    bs.put_i32((int32)log_data_size);
+
+    uint32_t crc_val = msg_crc( flags,
+                                buf->data_begin(),
+                                RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
+                                0 );
+    size_t crc_pos = bs.pos();
+    bs.put_u64( ((uint64_t)flags << 32) | crc_val );
+
+    for (auto& entry: req.log_entries()) {
+        buffer& le_buf = entry->get_buf();
+        bs.put_u64(entry->get_term());
+        bs.put_u8(entry->get_val_type());
+        if (flags & INCLUDE_LOG_TIMESTAMP) {
+            bs.put_u64(entry->get_timestamp());
+        }
+        if (flags & CRC_ON_PAYLOAD) {
+            bs.put_u8(entry->has_crc32() ? 1 : 0);
+            bs.put_u32(entry->get_crc32());
+        }
+        bs.put_i32(le_buf.size());
+        bs.put_raw(le_buf.data_begin(), le_buf.size());
+    }
+
+    if (crc_on_entire_message) {
+        crc_val = msg_crc( flags,
+                           buf->data_begin() + RPC_REQ_HEADER_SIZE,
+                           log_data_size,
+                           crc_val );
+        flags |= CRC_ON_ENTIRE_MESSAGE;
+        bs.pos(crc_pos);
+        bs.put_u64( ((uint64_t)flags << 32) | crc_val );
+    }
+    return buf;
+}
+
+bool rpc_wire::decode_req_header(buffer& hdr,
+                                 rpc_req_header& out,
+                                 std::string& err_msg)
+{
+    const byte* data = hdr.data_begin();
+    buffer_serializer h_bs(hdr);
+
+    h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
+    uint64_t flags_and_crc = h_bs.get_u64();
+    out.crc_from_msg_ = flags_and_crc & (uint32_t)0xffffffff;
+    out.flags_ = (flags_and_crc >> 32);
+    out.compact_ = false;
+    out.crc_header_ = msg_crc( out.flags_,
+                               data,
+                               RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
+                               0 );
+
+    // Verify CRC (if entire message validation is disabled).
+    if ( !(out.flags_ & CRC_ON_ENTIRE_MESSAGE) &&
+         out.crc_header_ != out.crc_from_msg_ ) {
+        err_msg = sstrfmt("CRC mismatch: local calculation %x, from header %x")
+                  .fmt(out.crc_header_, out.crc_from_msg_);
+        return false;
+    }
+
+    h_bs.pos(0);
+    byte marker = h_bs.get_u8();
+    if (marker != 0x0) {
+        err_msg = sstrfmt("wrong packet: expected REQ, got %u").fmt(marker);
+        return false;
+    }
+
+    out.type_ = (msg_type)h_bs.get_u8();
+    if (!is_valid_msg(out.type_)) {
+        err_msg = sstrfmt("wrong message type: got %u").fmt((uint8_t)out.type_);
+        return false;
+    }
+    out.src_ = h_bs.get_i32();
+    out.dst_ = h_bs.get_i32();
+    out.term_ = h_bs.get_u64();
+    out.last_log_term_ = h_bs.get_u64();
+    out.last_log_idx_ = h_bs.get_u64();
+    out.commit_idx_ = h_bs.get_u64();
+    out.data_size_ = h_bs.get_i32();
+    if (out.data_size_ < 0) {
+        err_msg = sstrfmt("bad log data size in the header %d")
+                  .fmt(out.data_size_);
+        return false;
+    }
+    return true;
+}
+
+ptr<req_msg> rpc_wire::decode_req(const rpc_req_header& hdr,
+                                  const ptr<buffer>& log_data,
+                                  bool slice_entries,
+                                  std::string& err_msg)
+{
+    if (hdr.flags_ & CRC_ON_ENTIRE_MESSAGE) {
+        uint32_t crc_payload =
+            log_data
+            ? msg_crc( hdr.flags_,
+                       log_data->data_begin(),
+                       log_data->size(),
+                       hdr.crc_header_ )
+            : hdr.crc_header_;
+        if (crc_payload != hdr.crc_from_msg_) {
+            err_msg = sstrfmt("request CRC mismatch: local calculation %x, "
+                              "from message %x")
+                      .fmt(crc_payload, hdr.crc_from_msg_);
+            return nullptr;
+        }
+    }
+
+    if (hdr.flags_ & COMPRESSED_LOG_DATA) {
+        // Not advertised by the transports using this class.
+        err_msg = "compressed log data is not supported";
+        return nullptr;
+    }
+
+    ptr<req_msg> req = cs_new<req_msg>
+                       ( hdr.term_, hdr.type_, hdr.src_, hdr.dst_,
+                         hdr.last_log_term_, hdr.last_log_idx_,
+                         hdr.commit_idx_ );
+    if (hdr.flags_ & MARK_DOWN) {
+        req->set_extra_flags(
+            req->get_extra_flags() | req_msg::EXCLUDED_FROM_THE_QUORUM );
+    }
+    if (hdr.flags_ & ALLOW_ASYNC_LOG_APPENDING_WIRE) {
+        req->set_extra_flags(
+            req->get_extra_flags() | req_msg::ALLOW_ASYNC_LOG_APPENDING );
+    }
+    if (hdr.flags_ & CLOSE_ON_ERROR_WIRE) {
+        req->set_extra_flags(
+            req->get_extra_flags() | req_msg::CLOSE_ON_ERROR );
+    }
+    if (!hdr.data_size_ || !log_data) return req;
+
+    ptr<buffer> log_ctx = log_data;
+    buffer_serializer ss(log_ctx);
+    size_t log_ctx_size = log_ctx->size();
+
+    if (hdr.flags_ & INCLUDE_META) {
+        // Not supported, skip it.
+        size_t meta_len = 0;
+        ss.get_bytes(meta_len);
+    }
+
+    size_t LOG_ENTRY_SIZE = 8 + 1 + 4;
+    if (hdr.flags_ & INCLUDE_LOG_TIMESTAMP) {
+        LOG_ENTRY_SIZE += 8;
+    }
+    if (hdr.flags_ & CRC_ON_PAYLOAD) {
+        LOG_ENTRY_SIZE += 5;
+    }
+
+    while (log_ctx_size > ss.pos()) {
+        if (log_ctx_size - ss.pos() < LOG_ENTRY_SIZE) {
+            err_msg = sstrfmt("wrong log ctx size %zu pos %zu")
+                      .fmt(log_ctx_size, ss.pos());
+            return nullptr;
+        }
+        ulong term = ss.get_u64();
+        log_val_type val_type = (log_val_type)ss.get_u8();
+        uint64_t timestamp =
+            (hdr.flags_ & INCLUDE_LOG_TIMESTAMP) ? ss.get_u64() : 0;
+        bool has_crc32 =
+            (hdr.flags_ & CRC_ON_PAYLOAD) ? (ss.get_u8() != 0) : false;
+        uint32_t crc32 = (hdr.flags_ & CRC_ON_PAYLOAD) ? ss.get_u32() : 0;
+
+        size_t val_size = ss.get_i32();
+        if (log_ctx_size - ss.pos() < val_size) {
+            err_msg = sstrfmt("wrong value size %zu log ctx %zu %zu")
+                      .fmt(val_size, log_ctx_size, ss.pos());
+            return nullptr;
+        }
+
+        ptr<buffer> buf;
+        if (slice_entries) {
+            buf = ss.get_buffer_slice(val_size);
+        } else {
+            buf = buffer::alloc(val_size);
+            ss.get_buffer(buf);
+        }
+
+        if ((hdr.flags_ & CRC_ON_PAYLOAD) && has_crc32) {
+            uint32_t crc_payload = crc32_8(buf->data_begin(), buf->size(), 0);
+            if (crc_payload != crc32) {
+                err_msg = sstrfmt("log entry CRC mismatch: local calculation "
+                                  "%x, from message %x")
+                          .fmt(crc_payload, crc32);
+                return nullptr;
+            }
+        }
+
+        req->log_entries().push_back
+            ( cs_new<log_entry>( term, buf, val_type, timestamp,
+                                 has_crc32, crc32, false ) );
+    }
+    return req;
+}
+
+ptr<buffer> rpc_wire::encode_resp(req_msg& req, resp_msg& resp, uint32_t flags) {
+    ptr<buffer> resp_ctx = resp.get_ctx();
+    int32 resp_ctx_size = (resp_ctx) ? resp_ctx->size() : 0;
+
+    size_t resp_hint_size = 0;
+    if (resp.get_next_batch_size_hint_in_bytes()) {
+        flags |= INCLUDE_HINT;
+        resp_hint_size += sizeof(uint16_t) * 2 + sizeof(int64);
+    }
+    if (resp.get_extra_flags() & resp_msg::SELF_MARK_DOWN) {
+        flags |= MARK_DOWN;
+    }
+
+    size_t carried_data_size = resp_hint_size + resp_ctx_size;
+    if (req.get_type() == msg_type::client_request ||
+        req.get_type() == msg_type::add_server_request ||
+        req.get_type() == msg_type::remove_server_request) {
+        flags |= INCLUDE_RESULT_CODE;
+        carried_data_size += sizeof(int32_t);
+    }
+
+    ptr<buffer> resp_buf =
+        buffer::alloc(RPC_RESP_HEADER_SIZE + carried_data_size);
+    buffer_serializer bs(resp_buf);
+
+    const byte RESP_MARKER = 0x1;
+    bs.put_u8(RESP_MARKER);
+    bs.put_u8(resp.get_type());
+    bs.put_i32(resp.get_src());
+    bs.put_i32(resp.get_dst());
+    bs.put_u64(resp.get_term());
+    bs.put_u64(resp.get_next_idx());
+    bs.put_u8(resp.get_accepted());
+    bs.put_i32(carried_data_size);
+
+    uint32_t crc_val = msg_crc( flags,
+                                resp_buf->data_begin(),
+                                RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN,
+                                0 );
+    bs.put_u64( ((uint64_t)flags << 32) | crc_val );
+
+    if (flags & INCLUDE_HINT) {
+        const uint16_t CUR_HINT_VERSION = 0;
+        bs.put_u16(CUR_HINT_VERSION);
+        bs.put_u16(sizeof(ulong));
+        bs.put_i64(resp.get_next_batch_size_hint_in_bytes());
+    }
+    if (resp_ctx_size) {
+        resp_ctx->pos(0);
+        bs.put_buffer(*resp_ctx);
+    }
+    if (flags & INCLUDE_RESULT_CODE) {
+        bs.put_i32(resp.get_result_code());
+    }
+    return resp_buf;
+}
+
+bool rpc_wire::decode_resp_header(buffer& hdr,
+                                  rpc_resp_header& out,
+                                  std::string& err_msg)
+{
+    const byte* data = hdr.data_begin();
+    buffer_serializer bs(hdr);
+
+    bs.pos(RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN);
+    uint64_t flags_and_crc = bs.get_u64();
+    uint32_t crc_buf = flags_and_crc & (uint32_t)0xffffffff;
+    out.flags_ = (flags_and_crc >> 32);
+    uint32_t crc_local = msg_crc( out.flags_,
+                                  data,
+                                  RPC_RESP_HEADER_SIZE - CRC_FLAGS_LEN,
+                                  0 );
+    if (crc_local != crc_buf) {
+        err_msg = sstrfmt("CRC mismatch in response: local calculation %x, "
+                          "from buffer %x")
+                  .fmt(crc_local, crc_buf);
+        return false;
+    }
+
+    bs.pos(0);
+    byte marker = bs.get_u8();
+    if (marker != 0x1) {
+        err_msg = sstrfmt("wrong packet: expected RESP, got %u").fmt(marker);
+        return false;
+    }
+    out.type_ = (msg_type)bs.get_u8();
+    out.src_ = bs.get_i32();
+    out.dst_ = bs.get_i32();
+    out.term_ = bs.get_u64();
+    out.next_idx_ = bs.get_u64();
+    out.accepted_ = (bs.get_u8() == 1);
+    out.data_size_ = bs.get_i32();
+    if (out.data_size_ < 0) {
+        err_msg = sstrfmt("bad data size in the response header %d")
+                  .fmt(out.data_size_);
+        return false;
+    }
+    return true;
+}
+
+ptr<resp_msg> rpc_wire::decode_resp(const rpc_resp_header& hdr,
+                                    const ptr<buffer>& data,
+                                    std::string& err_msg)
+{
+    ptr<resp_msg> rsp = cs_new<resp_msg>
+                        ( hdr.term_, hdr.type_, hdr.src_, hdr.dst_,
+                          hdr.next_idx_, hdr.accepted_ );
+    if (hdr.flags_ & MARK_DOWN) {
+        rsp->set_extra_flags(rsp->get_extra_flags() | resp_msg::SELF_MARK_DOWN);
+    }
+    if (!hdr.data_size_ || !data) return rsp;
+
+    ptr<buffer> ctx_buf = data;
+    if ( !(hdr.flags_ & INCLUDE_META) &&
+         !(hdr.flags_ & INCLUDE_HINT) &&
+         !(hdr.flags_ & INCLUDE_RESULT_CODE) ) {
+        ctx_buf->pos(0);
+        rsp->set_ctx(ctx_buf);
+        return rsp;
+    }
+
+    buffer_serializer bs(ctx_buf);
+    int64_t remaining_len = ctx_buf->size();
+    if (hdr.flags_ & INCLUDE_META) {
+        // Not supported, skip it.
+        size_t meta_len = 0;
+        bs.get_bytes(meta_len);
+        remaining_len -= sizeof(int32) + meta_len;
+    }
+    if (hdr.flags_ & INCLUDE_HINT) {
+        bs.get_u16(); // Version.
+        size_t hint_len = bs.get_u16();
+        if (hint_len >= sizeof(int64)) {
+            rsp->set_next_batch_size_hint_in_bytes(bs.get_i64());
+            bs.pos(bs.pos() + hint_len - sizeof(int64));
+        } else {
+            bs.pos(bs.pos() + hint_len);
+        }
+        remaining_len -= sizeof(uint16_t) * 2 + hint_len;
+    }
+
+    int64_t ctx_len = remaining_len;
+    if (hdr.flags_ & INCLUDE_RESULT_CODE) {
+        ctx_len -= sizeof(int32_t);
+    }
+    if (ctx_len < 0) {
+        err_msg = sstrfmt("wrong response data size %d").fmt(hdr.data_size_);
+        return nullptr;
+    }
+    if (ctx_len) {
+        rsp->set_ctx(bs.get_buffer_slice(ctx_len));
+    }
+    if (hdr.flags_ & INCLUDE_RESULT_CODE) {
+        rsp->set_result_code( static_cast<cmd_result_code>(bs.get_i32()) );
+    }
+    return rsp;
+}
+
+#ifndef ZLIB_NOT_FOUND
+
+bool rpc_wire::compression_available() {
+    return true;
+}
+
+ptr<buffer> rpc_wire::compress_log_data(const std::vector<wire_span>& spans,
+                                        int level,
+                                        const std::string& dict)
+{
+    static stat_elem& input_bytes = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "log_compression_input_bytes");
+    static stat_elem& output_bytes = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "log_compression_output_bytes");
+    static stat_elem& num_skipped = *stat_mgr::get_instance()->create_stat
+        (stat_elem::COUNTER, "log_compression_skipped");
+    static stat_elem& compress_us = *stat_mgr::get_instance()->create_stat
+        (stat_elem::HISTOGRAM, "log_compression_latency_us");
+
+    size_t raw_size = 0;
+    for (const wire_span& span: spans) raw_size += span.size_;
+    if (!raw_size) return nullptr;
+
+    timer_helper timer;
+    z_stream strm;
+    memset(&strm, 0x0, sizeof(strm));
+    if (deflateInit(&strm, level) != Z_OK) return nullptr;
+    if ( !dict.empty() &&
+         deflateSetDictionary( &strm, (const Bytef*)dict.data(),
+                               dict.size() ) != Z_OK ) {
+        deflateEnd(&strm);
+        return nullptr;
+    }
+
+    // Compressed data bigger than this is useless.
+    std::vector<byte> out(raw_size);
+    strm.next_out = out.data();
+    strm.avail_out = out.size();
+
+    int ret = Z_OK;
+    for (size_t ii = 0; ii < spans.size() && ret == Z_OK; ++ii) {
+        strm.next_in = (Bytef*)spans[ii].data_;
+        strm.avail_in = spans[ii].size_;
+        while (strm.avail_in && strm.avail_out && ret == Z_OK) {
+            ret = deflate(&strm, Z_NO_FLUSH);
+        }
+        if (strm.avail_in) ret = Z_BUF_ERROR;
+    }
+    if (ret == Z_OK) ret = deflate(&strm, Z_FINISH);
+    size_t out_size = strm.total_out;
+    deflateEnd(&strm);
+    compress_us += timer.get_us();
+    input_bytes += raw_size;
+
+    if (ret != Z_STREAM_END || sizeof(uint32_t) + out_size >= raw_size) {
+        // Not compressible enough.
+        num_skipped++;
+        output_bytes += raw_size;
+        return nullptr;
+    }
+    output_bytes += sizeof(uint32_t) + out_size;
+
+    ptr<buffer> buf = buffer::alloc(sizeof(uint32_t) + out_size);
+    buffer_serializer bs(buf);
+    bs.put_u32(raw_size);
+    bs.put_raw(out.data(), out_size);
+    return buf;
+}
+
+ptr<buffer> rpc_wire::decompress_log_data(buffer& log_data,
+                                          size_t offset,
+                                          const std::string& dict,
+                                          buffer_pool* pool,
+                                          std::string& err_msg)
+{
+    static stat_elem& decompress_us = *stat_mgr::get_instance()->create_stat
+        (stat_elem::HISTOGRAM, "log_decompression_latency_us");
+
+    if (log_data.size() < offset + sizeof(uint32_t)) {
+        err_msg = sstrfmt("compressed log data is too short %zu")
+                  .fmt(log_data.size() - offset);
+        return nullptr;
+    }
+    buffer_serializer bs(log_data);
+    bs.pos(offset);
+    uint32_t raw_size = bs.get_u32();
+    if (!raw_size || raw_size > (uint32_t)0x7fffffff) {
+        err_msg = sstrfmt("bad uncompressed log data size %u").fmt(raw_size);
+        return nullptr;
+    }
+
+    timer_helper timer;
+    z_stream strm;
+    memset(&strm, 0x0, sizeof(strm));
+    if (inflateInit(&strm) != Z_OK) {
+        err_msg = "inflateInit failed";
+        return nullptr;
+    }
+
+    ptr<buffer> out = pool ? pool->acquire(raw_size) : buffer::alloc(raw_size);
+    strm.next_in = log_data.data_begin() + bs.pos();
+    strm.avail_in = log_data.size() - bs.pos();
+    strm.next_out = out->data_begin();
+    strm.avail_out = raw_size;
+
+    int ret = inflate(&strm, Z_FINISH);
+    if (ret == Z_NEED_DICT) {
+        if ( dict.empty() ||
+             inflateSetDictionary( &strm, (const Bytef*)dict.data(),
+                                   dict.size() ) != Z_OK ) {
+            inflateEnd(&strm);
+            err_msg = "compression dictionary mismatch";
+            return nullptr;
+        }
+        ret = inflate(&strm, Z_FINISH);
+    }
+    size_t out_size = strm.total_out;
+    inflateEnd(&strm);
+    decompress_us += timer.get_us();
+
+    if (ret != Z_STREAM_END || out_size != raw_size) {
+        err_msg = sstrfmt("failed to decompress log data: %d, size %zu / %u")
+                  .fmt(ret, out_size, raw_size);
+        return nullptr;
+    }
+    out->pos(0);
+    return out;
+}
+
+#else // ZLIB_NOT_FOUND
+
+bool rpc_wire::compression_available() {
+    return false;
+}
+
+ptr<buffer> rpc_wire::compress_log_data(const std::vector<wire_span>& spans,
+                                        int level,
+                                        const std::string& dict)
+{
+    return nullptr;
+}
+
+ptr<buffer> rpc_wire::decompress_log_data(buffer& log_data,
+                                          size_t offset,
+                                          const std::string& dict,
+                                          buffer_pool* pool,
+                                          std::string& err_msg)
+{
+    err_msg = "compression is not supported by this build";
+    return nullptr;
+}
+
+#endif // ZLIB_NOT_FOUND
+
+static size_t varint_size(uint64_t val) {
+    size_t len = 1;
+    while (val >= 0x80) {
+        val >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static void put_varint(buffer_serializer& bs, uint64_t val) {
+    while (val >= 0x80) {
+        bs.put_u8( (uint8_t)(val | 0x80) );
+        val >>= 7;
+    }
+    bs.put_u8( (uint8_t)val );
+}
+
+// Throws `std::overflow_error` if it goes beyond the buffer.
+static bool get_varint(buffer_serializer& bs, uint64_t& val_out) {
+    val_out = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        uint8_t byte_val = bs.get_u8();
+        val_out |= (uint64_t)(byte_val & 0x7f) << shift;
+        if ( !(byte_val & 0x80) ) return true;
+    }
+    // Longer than 10 bytes.
+    return false;
+}
+
+static uint64_t zigzag(uint64_t from, uint64_t to) {
+    int64_t delta = (int64_t)(to - from);
+    return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+}
+
+static uint64_t unzigzag(uint64_t from, uint64_t val) {
+    return from + ( (val >> 1) ^ (~(val & 1) + 1) );
+}
+
+size_t rpc_wire::compact_req_header_size(req_msg& req, uint32_t flags) {
+    return RPC_COMPACT_PREFIX_SIZE +
+           varint_size(flags) +
+           1 +
+           varint_size(req.get_term()) +
+           varint_size( zigzag(req.get_term(), req.get_last_log_term()) ) +
+           varint_size(req.get_last_log_idx()) +
+           varint_size( zigzag(req.get_last_log_idx(), req.get_commit_idx()) ) +
+           RPC_COMPACT_CRC_LEN;
+}
+
+uint32_t rpc_wire::put_compact_req_header(buffer_serializer& bs,
+                                          req_msg& req,
+                                          uint32_t flags,
+                                          size_t data_size)
+{
+    size_t hdr_pos = bs.pos();
+    size_t hdr_size = compact_req_header_size(req, flags);
+    bs.put_u8(0x2);
+    bs.put_u32(hdr_size - RPC_COMPACT_PREFIX_SIZE + data_size);
+    put_varint(bs, flags);
+    bs.put_u8((byte)req.get_type());
+    put_varint(bs, req.get_term());
+    put_varint(bs, zigzag(req.get_term(), req.get_last_log_term()));
+    put_varint(bs, req.get_last_log_idx());
+    put_varint(bs, zigzag(req.get_last_log_idx(), req.get_commit_idx()));
+
+    uint32_t crc_val = msg_crc( flags,
+                                (byte*)bs.data() - (bs.pos() - hdr_pos),
+                                bs.pos() - hdr_pos,
+                                0 );
+    bs.put_u32(crc_val);
+    return crc_val;
+}
+
+size_t rpc_wire::compact_resp_header_size(resp_msg& resp, uint32_t flags) {
+    return RPC_COMPACT_PREFIX_SIZE +
+           varint_size(flags) +
+           1 +
+           varint_size(resp.get_term()) +
+           varint_size(resp.get_next_idx()) +
+           1 +
+           RPC_COMPACT_CRC_LEN;
+}
+
+void rpc_wire::put_compact_resp_header(buffer_serializer& bs,
+                                       resp_msg& resp,
+                                       uint32_t flags,
+                                       size_t data_size)
+{
+    size_t hdr_pos = bs.pos();
+    size_t hdr_size = compact_resp_header_size(resp, flags);
+    bs.put_u8(0x3);
+    bs.put_u32(hdr_size - RPC_COMPACT_PREFIX_SIZE + data_size);
+    put_varint(bs, flags);
+    bs.put_u8((byte)resp.get_type());
+    put_varint(bs, resp.get_term());
+    put_varint(bs, resp.get_next_idx());
+    bs.put_u8(resp.get_accepted() ? 1 : 0);
+
+    uint32_t crc_val = msg_crc( flags,
+                                (byte*)bs.data() - (bs.pos() - hdr_pos),
+                                bs.pos() - hdr_pos,
+                                0 );
+    bs.put_u32(crc_val);
+}
+
+bool rpc_wire::decode_compact_prefix(buffer& prefix,
+                                     byte marker,
+                                     size_t& rest_size,
+                                     std::string& err_msg)
+{
+    buffer_serializer bs(prefix);
+    byte marker_from_msg = bs.get_u8();
+    if (marker_from_msg != marker) {
+        err_msg = sstrfmt("wrong packet: expected compact marker %u, got %u")
+                  .fmt(marker, marker_from_msg);
+        return false;
+    }
+    rest_size = bs.get_u32();
+    if (!rest_size || rest_size > (size_t)0x7fffffff) {
+        err_msg = sstrfmt("bad message size in the compact header %zu")
+                  .fmt(rest_size);
+        return false;
+    }
+    return true;
+}
+
+bool rpc_wire::decode_compact_req_header(buffer& prefix,
+                                         buffer& rest,
+                                         int32 src,
+                                         int32 dst,
+                                         rpc_req_header& out,
+                                         size_t& data_pos,
+                                         std::string& err_msg)
+{
+    buffer_serializer bs(rest);
+    uint64_t flags = 0, term = 0, last_log_term = 0;
+    uint64_t last_log_idx = 0, commit_idx = 0;
+    try {
+        bool ok = get_varint(bs, flags);
+        out.type_ = (msg_type)bs.get_u8();
+        ok = ok && get_varint(bs, term);
+        ok = ok && get_varint(bs, last_log_term);
+        ok = ok && get_varint(bs, last_log_idx);
+        ok = ok && get_varint(bs, commit_idx);
+        if (!ok || flags > 0xffffffff) {
+            err_msg = "bad varint in the compact request header";
+            return false;
+        }
+        out.flags_ = (uint32_t)flags;
+        out.crc_header_ = msg_crc( out.flags_,
+                                   prefix.data_begin(),
+                                   RPC_COMPACT_PREFIX_SIZE,
+                                   0 );
+        out.crc_header_ = msg_crc( out.flags_,
+                                   rest.data_begin(),
+                                   bs.pos(),
+                                   out.crc_header_ );
+        out.crc_from_msg_ = bs.get_u32();
+    } catch (std::overflow_error&) {
+        err_msg = sstrfmt("compact request header is too short %zu")
+                  .fmt(rest.size());
+        return false;
+    }
+
+    if ( !(out.flags_ & CRC_ON_ENTIRE_MESSAGE) &&
+         out.crc_header_ != out.crc_from_msg_ ) {
+        err_msg = sstrfmt("CRC mismatch: local calculation %x, from header %x")
+                  .fmt(out.crc_header_, out.crc_from_msg_);
+        return false;
+    }
+    if (!is_valid_msg(out.type_)) {
+        err_msg = sstrfmt("wrong message type: got %u").fmt((uint8_t)out.type_);
+        return false;
+    }
+
+    out.compact_ = true;
+    out.src_ = src;
+    out.dst_ = dst;
+    out.term_ = term;
+    out.last_log_term_ = unzigzag(term, last_log_term);
+    out.last_log_idx_ = last_log_idx;
+    out.commit_idx_ = unzigzag(last_log_idx, commit_idx);
+    data_pos = bs.pos();
+    out.data_size_ = (int32)(rest.size() - data_pos);
+    return true;
+}
+
+bool rpc_wire::decode_compact_resp_header(buffer& prefix,
+                                          buffer& rest,
+                                          int32 src,
+                                          int32 dst,
+                                          rpc_resp_header& out,
+                                          size_t& data_pos,
+                                          std::string& err_msg)
+{
+    buffer_serializer bs(rest);
+    uint64_t flags = 0, term = 0, next_idx = 0;
+    uint32_t crc_local = 0, crc_buf = 0;
+    try {
+        bool ok = get_varint(bs, flags);
+        out.type_ = (msg_type)bs.get_u8();
+        ok = ok && get_varint(bs, term);
+        ok = ok && get_varint(bs, next_idx);
+        out.accepted_ = (bs.get_u8() == 1);
+        if (!ok || flags > 0xffffffff) {
+            err_msg = "bad varint in the compact response header";
+            return false;
+        }
+        out.flags_ = (uint32_t)flags;
+        crc_local = msg_crc( out.flags_,
+                             prefix.data_begin(),
+                             RPC_COMPACT_PREFIX_SIZE,
+                             0 );
+        crc_local = msg_crc( out.flags_,
+                             rest.data_begin(),
+                             bs.pos(),
+                             crc_local );
+        crc_buf = bs.get_u32();
+    } catch (std::overflow_error&) {
+        err_msg = sstrfmt("compact response header is too short %zu")
+                  .fmt(rest.size());
+        return false;
+    }
+
+    if (crc_local != crc_buf) {
+        err_msg = sstrfmt("CRC mismatch in response: local calculation %x, "
+                          "from buffer %x")
+                  .fmt(crc_local, crc_buf);
+        return false;
+    }
+
+    out.src_ = src;
+    out.dst_ = dst;
+    out.term_ = term;
+    out.next_idx_ = next_idx;
+    data_pos = bs.pos();
+    out.data_size_ = (int32)(rest.size() - data_pos);
+    return true;
+}
+
+void rpc_wire::put_compact_entry_header(buffer_serializer& bs,
+                                        log_entry& le,
+                                        uint32_t flags,
+                                        compact_entry_header& prev)
+{
+    put_varint(bs, zigzag(prev.term_, le.get_term()));
+    bs.put_u8(le.get_val_type());
+    if (flags & INCLUDE_LOG_TIMESTAMP) {
+        put_varint(bs, zigzag(prev.timestamp_, le.get_timestamp()));
+    }
+    if (flags & CRC_ON_PAYLOAD) {
+        bs.put_u8(le.has_crc32() ? 1 : 0);
+        bs.put_u32(le.get_crc32());
+    }
+    put_varint(bs, le.get_buf().size());
+
+    prev.term_ = le.get_term();
+    prev.type_ = le.get_val_type();
+    prev.timestamp_ = le.get_timestamp();
+    prev.has_crc32_ = le.has_crc32();
+    prev.crc32_ = le.get_crc32();
+    prev.size_ = le.get_buf().size();
+}
+
+bool rpc_wire::get_compact_entry_header(buffer_serializer& bs,
+                                        uint32_t flags,
+                                        compact_entry_header& hdr,
+                                        std::string& err_msg)
+{
+    size_t hdr_pos = bs.pos();
+    try {
+        uint64_t term = 0, timestamp = 0, size = 0;
+        bool ok = get_varint(bs, term);
+        hdr.type_ = (log_val_type)bs.get_u8();
+        if (ok && (flags & INCLUDE_LOG_TIMESTAMP)) {
+            ok = get_varint(bs, timestamp);
+            hdr.timestamp_ = unzigzag(hdr.timestamp_, timestamp);
+        } else {
+            hdr.timestamp_ = 0;
+        }
+        if (flags & CRC_ON_PAYLOAD) {
+            hdr.has_crc32_ = (bs.get_u8() != 0);
+            hdr.crc32_ = bs.get_u32();
+        } else {
+            hdr.has_crc32_ = false;
+            hdr.crc32_ = 0;
+        }
+        ok = ok && get_varint(bs, size);
+        if (!ok) {
+            err_msg = sstrfmt("bad varint in the log entry header at %zu")
+                      .fmt(hdr_pos);
+            return false;
+        }
+        hdr.term_ = unzigzag(hdr.term_, term);
+        hdr.size_ = size;
+    } catch (std::overflow_error&) {
+        err_msg = sstrfmt("wrong log ctx size %zu pos %zu")
+                  .fmt(bs.size(), hdr_pos);
+        return false;
+    }
+
+    if (bs.size() - bs.pos() < hdr.size_) {
+        err_msg = sstrfmt("wrong value size %zu log ctx %zu %zu")
+                  .fmt(hdr.size_, bs.size(), bs.pos());
+        return false;
+    }
+    return true;
+}
+
+}
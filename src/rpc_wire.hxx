@@ -0,0 +1,547 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "buffer.hxx"
+#include "crc32.hxx"
+#include "req_msg.hxx"
+#include "resp_msg.hxx"
+
+#include <string>
+#include <vector>
+
+// Wire format of RPC messages, shared by all the transports
+// (i.e., `asio_service` and the others) so that they can talk to each other.
+
+// Note: both req & resp header structures have been modified by Jung-Sang Ahn.
+//       They MUST NOT be combined with the original code.
+
+// request header:
+//     byte         marker (req = 0x0)  (1),
+//     msg_type     type                (1),
+//     int32        src                 (4),
+//     int32        dst                 (4),
+//     ulong        term                (8),
+//     ulong        last_log_term       (8),
+//     ulong        last_log_idx        (8),
+//     ulong        commit_idx          (8),
+//     int32        log data size       (4),
+//     ulong        flags + CRC32       (8),
+//     -------------------------------------
+//                  total               (54)
+#define RPC_REQ_HEADER_SIZE (4*3 + 8*5 + 1*2)
+
+// response header:
+//     byte         marker (resp = 0x1) (1),
+//     msg_type     type                (1),
+//     int32        src                 (4),
+//     int32        dst                 (4),
+//     ulong        term                (8),
+//     ulong        next_idx            (8),
+//     bool         accepted            (1),
+//     int32        ctx data dize       (4),
+//     ulong        flags + CRC32       (8),
+//     -------------------------------------
+//                  total               (39)
+#define RPC_RESP_HEADER_SIZE (4*3 + 8*3 + 1*3)
+
+#define DATA_SIZE_LEN (4)
+#define CRC_FLAGS_LEN (8)
+
+// Compact headers, used after `COMPACT_HEADER_FOLLOWS`.
+// `src` and `dst` are not included: they are the same as those of the
+// message that carried `COMPACT_HEADER_FOLLOWS`. Each varint is
+// a LEB128-encoded unsigned integer, and each signed one (marked as
+// "zigzag") is zigzag-encoded first.
+//
+// compact request header:
+//     byte         marker (req = 0x2)  (1),
+//     uint32       size of the rest    (4),
+//     varint       flags,
+//     msg_type     type                (1),
+//     varint       term,
+//     varint       last_log_term - term        (zigzag),
+//     varint       last_log_idx,
+//     varint       commit_idx - last_log_idx   (zigzag),
+//     uint32       CRC32               (4),
+//     -------------------------------------
+//                  total               (15 ~ 53)
+// followed by log data, whose size is the rest minus the header.
+//
+// compact response header:
+//     byte         marker (resp = 0x3) (1),
+//     uint32       size of the rest    (4),
+//     varint       flags,
+//     msg_type     type                (1),
+//     varint       term,
+//     varint       next_idx,
+//     bool         accepted            (1),
+//     uint32       CRC32               (4),
+//     -------------------------------------
+//                  total               (14 ~ 34)
+// followed by carried data.
+//
+// Unlike the legacy headers, flags are covered by the CRC.
+//
+// compact log entry header:
+//     varint       term - previous term        (zigzag),
+//     byte         type                (1),
+//     varint       timestamp - previous one    (zigzag),
+//                  if `INCLUDE_LOG_TIMESTAMP`,
+//     byte         has CRC             (1),
+//     uint32       CRC32               (4),
+//                  if `CRC_ON_PAYLOAD`,
+//     varint       payload size,
+// followed by payload. The previous term of the first entry is
+// `last_log_term` of the request, and the previous timestamp is 0.
+#define RPC_COMPACT_PREFIX_SIZE (1 + 4)
+#define RPC_COMPACT_CRC_LEN (4)
+#define MAX_COMPACT_ENTRY_HEADER_SIZE (10 + 1 + 10 + 5 + 5)
+
+// === RPC Flags =========
+
+// If set, RPC message includes custom meta given by user.
+#define INCLUDE_META (0x1)
+
+// If set, RPC message (response) includes additional hints.
+#define INCLUDE_HINT (0x2)
+
+// If set, each log entry will contain timestamp.
+#define INCLUDE_LOG_TIMESTAMP (0x4)
+
+// If set, CRC number represents the entire message.
+#define CRC_ON_ENTIRE_MESSAGE (0x8)
+
+// If set, each log entry will contain a CRC on the payload.
+#define CRC_ON_PAYLOAD (0x10)
+
+// If set, RPC message (response) includes result code
+#define INCLUDE_RESULT_CODE (0x20)
+
+// If set, and
+//   - If it is used in a request (leader -> follower),
+//     the follower has been excluded from the quorum,
+//     determined by the leader (i.e., sender).
+//   - If it is used in a response (follower -> leader),
+//     the follower is marked down by itself.
+#define MARK_DOWN (0x40)
+
+// See `req_msg::ALLOW_ASYNC_LOG_APPENDING`.
+#define ALLOW_ASYNC_LOG_APPENDING_WIRE (0x80)
+
+// See `req_msg::CLOSE_ON_ERROR`.
+#define CLOSE_ON_ERROR_WIRE (0x100)
+
+// If set, the sender is able to verify CRC-32C,
+// so that the receiver can use CRC-32C in the following messages.
+#define CRC32C_SUPPORTED (0x200)
+
+// If set, the CRC numbers of the header and the entire message
+// are CRC-32C, instead of CRC-32. Per-entry CRCs (`CRC_ON_PAYLOAD`)
+// are not affected, as they are stored in log store as they are.
+#define CRC32C_IN_USE (0x400)
+
+// If set, log entries in the request (after custom meta, if exists)
+// are compressed:
+//     uint32       uncompressed size   (4),
+//     ...          zlib stream.
+// CRC on the entire message is calculated on the compressed data.
+#define COMPRESSED_LOG_DATA (0x800)
+
+// If set, the sender (of a response) is able to decompress
+// `COMPRESSED_LOG_DATA`, so that the receiver can compress
+// log entries in the following requests.
+#define LOG_COMPRESSION_SUPPORTED (0x1000)
+
+// If set, the sender is able to read compact headers, so that
+// the receiver can switch to them.
+#define COMPACT_HEADER_SUPPORTED (0x2000)
+
+// If set, the following messages in the same direction of
+// the connection will use compact headers. It is set only once
+// on a legacy header, after `COMPACT_HEADER_SUPPORTED` is seen.
+#define COMPACT_HEADER_FOLLOWS (0x4000)
+
+// If set, the data section of the message starts with
+//     uint64       request ID          (8),
+// followed by custom meta (if exists). A response carries the ID of
+// the request it answers, so that multiple requests can be in flight
+// on the same connection and be answered out of order.
+#define REQUEST_ID_INCLUDED (0x8000)
+
+// If set, the sender (of a response) is able to answer requests
+// with `REQUEST_ID_INCLUDED`, so that the receiver can send
+// the following requests without waiting for previous responses.
+#define MULTIPLEXING_SUPPORTED (0x10000)
+
+#define REQUEST_ID_LEN (8)
+
+// =======================
+
+namespace nuraft {
+
+class buffer_pool;
+class buffer_serializer;
+
+// Calculate CRC of RPC message, using the polynomial given by `flags`.
+static inline uint32_t msg_crc(uint32_t flags,
+                               const void* data,
+                               size_t len,
+                               uint32_t prev_value) {
+    return (flags & CRC32C_IN_USE)
+           ? crc32c(data, len, prev_value)
+           : crc32_8(data, len, prev_value);
+}
+
+/**
+ * Fields of a request header, read from wire.
+ */
+struct rpc_req_header {
+    rpc_req_header()
+        : type_(msg_type::request_vote_request)
+        , src_(0), dst_(0), term_(0), last_log_term_(0)
+        , last_log_idx_(0), commit_idx_(0), data_size_(0)
+        , flags_(0), crc_header_(0), crc_from_msg_(0)
+        , compact_(false)
+        {}
+    msg_type type_;
+    int32 src_;
+    int32 dst_;
+    ulong term_;
+    ulong last_log_term_;
+    ulong last_log_idx_;
+    ulong commit_idx_;
+    int32 data_size_;
+    uint32_t flags_;
+
+    // Locally calculated CRC of the header.
+    uint32_t crc_header_;
+
+    // CRC in the header.
+    uint32_t crc_from_msg_;
+
+    // `true` if read from a compact header.
+    bool compact_;
+};
+
+/**
+ * Fields of a response header, read from wire.
+ */
+struct rpc_resp_header {
+    rpc_resp_header()
+        : type_(msg_type::request_vote_response)
+        , src_(0), dst_(0), term_(0), next_idx_(0)
+        , accepted_(false), data_size_(0), flags_(0)
+        {}
+    msg_type type_;
+    int32 src_;
+    int32 dst_;
+    ulong term_;
+    ulong next_idx_;
+    bool accepted_;
+    int32 data_size_;
+    uint32_t flags_;
+};
+
+/**
+ * Contiguous memory to be sent as a part of a message.
+ */
+struct wire_span {
+    wire_span(const void* data = nullptr, size_t size = 0)
+        : data_(data), size_(size)
+        {}
+    const void* data_;
+    size_t size_;
+};
+
+/**
+ * Fields of a compact log entry header, read from wire.
+ */
+struct compact_entry_header {
+    compact_entry_header(ulong prev_term = 0)
+        : term_(prev_term), type_(app_log), timestamp_(0)
+        , has_crc32_(false), crc32_(0), size_(0)
+        {}
+    ulong term_;
+    log_val_type type_;
+    uint64_t timestamp_;
+    bool has_crc32_;
+    uint32_t crc32_;
+    size_t size_;
+};
+
+/**
+ * Encoder and decoder of the RPC messages above, for transports
+ * that deal with a message as a contiguous memory.
+ *
+ * Custom meta (`INCLUDE_META`) is not generated by this class,
+ * but it is skipped while decoding messages from `asio_service`.
+ */
+class rpc_wire {
+public:
+    /**
+     * Encode the given request, including log entries.
+     *
+     * @param req Request.
+     * @param flags Flags for the options: `INCLUDE_LOG_TIMESTAMP`,
+     *              `CRC_ON_PAYLOAD`, `CRC_ON_ENTIRE_MESSAGE`,
+     *              `CRC32C_SUPPORTED`, and `CRC32C_IN_USE`.
+     *              Flags from `req_msg::get_extra_flags()` will be added.
+     * @return Buffer containing header and log data.
+     */
+    static ptr<buffer> encode_req(req_msg& req, uint32_t flags);
+
+    /**
+     * Read a request header, and verify its marker and CRC.
+     *
+     * @param hdr Buffer containing `RPC_REQ_HEADER_SIZE` bytes.
+     * @param[out] out Header fields.
+     * @param[out] err_msg Error message if failed.
+     * @return `true` if the header is valid.
+     */
+    static bool decode_req_header(buffer& hdr,
+                                  rpc_req_header& out,
+                                  std::string& err_msg);
+
+    /**
+     * Create a request using the given header and log data.
+     *
+     * @param hdr Header returned by `decode_req_header`.
+     * @param log_data Log data whose size is `hdr.data_size_`.
+     *                 Can be `nullptr` if the size is zero.
+     * @param slice_entries If `true`, payloads of log entries will be
+     *                      slices of `log_data`.
+     * @param[out] err_msg Error message if failed.
+     * @return Request, `nullptr` if the message is corrupted.
+     */
+    static ptr<req_msg> decode_req(const rpc_req_header& hdr,
+                                   const ptr<buffer>& log_data,
+                                   bool slice_entries,
+                                   std::string& err_msg);
+
+    /**
+     * Encode the given response.
+     *
+     * @param req Request that the response is for.
+     * @param resp Response.
+     * @param flags Flags for the options: `CRC32C_SUPPORTED`, and
+     *              `CRC32C_IN_USE`. Other flags will be added according
+     *              to the response.
+     * @return Buffer containing header and context.
+     */
+    static ptr<buffer> encode_resp(req_msg& req, resp_msg& resp, uint32_t flags);
+
+    /**
+     * Read a response header, and verify its CRC.
+     *
+     * @param hdr Buffer containing `RPC_RESP_HEADER_SIZE` bytes.
+     * @param[out] out Header fields.
+     * @param[out] err_msg Error message if failed.
+     * @return `true` if the header is valid.
+     */
+    static bool decode_resp_header(buffer& hdr,
+                                   rpc_resp_header& out,
+                                   std::string& err_msg);
+
+    /**
+     * Create a response using the given header and carried data.
+     *
+     * @param hdr Header returned by `decode_resp_header`.
+     * @param data Carried data whose size is `hdr.data_size_`.
+     *             Can be `nullptr` if the size is zero.
+     * @param[out] err_msg Error message if failed.
+     * @return Response, `nullptr` if the message is corrupted.
+     */
+    static ptr<resp_msg> decode_resp(const rpc_resp_header& hdr,
+                                     const ptr<buffer>& data,
+                                     std::string& err_msg);
+
+    /**
+     * Check if this build can compress log data.
+     *
+     * @return `true` if available.
+     */
+    static bool compression_available();
+
+    /**
+     * Compress encoded log entries, given as a sequence of spans.
+     *
+     * @param spans Encoded log entries.
+     * @param level Compression level, from 1 (fastest) to 9 (smallest).
+     * @param dict Preset dictionary. Can be empty.
+     * @return Log data to be sent with `COMPRESSED_LOG_DATA`, or
+     *         `nullptr` if it is not smaller than the original.
+     */
+    static ptr<buffer> compress_log_data(const std::vector<wire_span>& spans,
+                                         int level,
+                                         const std::string& dict);
+
+    /**
+     * Decompress log data sent with `COMPRESSED_LOG_DATA`.
+     *
+     * @param log_data Received log data.
+     * @param offset Offset where the compressed part starts
+     *               (i.e., right after custom meta).
+     * @param dict Preset dictionary, should be the same as the sender's.
+     * @param pool If given, the result will be acquired from it.
+     * @param[out] err_msg Error message if failed.
+     * @return Encoded log entries, `nullptr` if failed.
+     */
+    static ptr<buffer> decompress_log_data(buffer& log_data,
+                                           size_t offset,
+                                           const std::string& dict,
+                                           buffer_pool* pool,
+                                           std::string& err_msg);
+
+    /**
+     * Calculate the size of the compact header of the given request.
+     *
+     * @param req Request.
+     * @param flags Flags of the request.
+     * @return Size of the header, including prefix and CRC.
+     */
+    static size_t compact_req_header_size(req_msg& req, uint32_t flags);
+
+    /**
+     * Write the compact header of the given request.
+     *
+     * @param bs Serializer positioned at the beginning of the header.
+     * @param req Request.
+     * @param flags Flags of the request.
+     * @param data_size Size of meta and log data following the header.
+     * @return CRC of the header, which is also written to the header.
+     *         If `CRC_ON_ENTIRE_MESSAGE` is set, the caller should
+     *         continue it over the data and overwrite the last
+     *         `RPC_COMPACT_CRC_LEN` bytes of the header.
+     */
+    static uint32_t put_compact_req_header(buffer_serializer& bs,
+                                           req_msg& req,
+                                           uint32_t flags,
+                                           size_t data_size);
+
+    /**
+     * Calculate the size of the compact header of the given response.
+     *
+     * @param resp Response.
+     * @param flags Flags of the response.
+     * @return Size of the header, including prefix and CRC.
+     */
+    static size_t compact_resp_header_size(resp_msg& resp, uint32_t flags);
+
+    /**
+     * Write the compact header of the given response, with the CRC
+     * of the header.
+     *
+     * @param bs Serializer positioned at the beginning of the header.
+     * @param resp Response.
+     * @param flags Flags of the response.
+     * @param data_size Size of carried data following the header.
+     */
+    static void put_compact_resp_header(buffer_serializer& bs,
+                                        resp_msg& resp,
+                                        uint32_t flags,
+                                        size_t data_size);
+
+    /**
+     * Read the prefix of a compact header.
+     *
+     * @param prefix Buffer containing `RPC_COMPACT_PREFIX_SIZE` bytes.
+     * @param marker Expected marker.
+     * @param[out] rest_size Size of the rest of the message,
+     *                       to be read after the prefix.
+     * @param[out] err_msg Error message if failed.
+     * @return `true` if the prefix is valid.
+     */
+    static bool decode_compact_prefix(buffer& prefix,
+                                      byte marker,
+                                      size_t& rest_size,
+                                      std::string& err_msg);
+
+    /**
+     * Read a compact request header, and verify its CRC
+     * (if entire message validation is disabled).
+     *
+     * @param prefix Prefix given to `decode_compact_prefix`.
+     * @param rest The rest of the message.
+     * @param src Source ID of the connection.
+     * @param dst Destination ID of the connection.
+     * @param[out] out Header fields.
+     * @param[out] data_pos Position in `rest` where the data begins.
+     * @param[out] err_msg Error message if failed.
+     * @return `true` if the header is valid.
+     */
+    static bool decode_compact_req_header(buffer& prefix,
+                                          buffer& rest,
+                                          int32 src,
+                                          int32 dst,
+                                          rpc_req_header& out,
+                                          size_t& data_pos,
+                                          std::string& err_msg);
+
+    /**
+     * Read a compact response header, and verify its CRC.
+     *
+     * @param prefix Prefix given to `decode_compact_prefix`.
+     * @param rest The rest of the message.
+     * @param src Source ID of the connection.
+     * @param dst Destination ID of the connection.
+     * @param[out] out Header fields.
+     * @param[out] data_pos Position in `rest` where the data begins.
+     * @param[out] err_msg Error message if failed.
+     * @return `true` if the header is valid.
+     */
+    static bool decode_compact_resp_header(buffer& prefix,
+                                           buffer& rest,
+                                           int32 src,
+                                           int32 dst,
+                                           rpc_resp_header& out,
+                                           size_t& data_pos,
+                                           std::string& err_msg);
+
+    /**
+     * Write the compact header of a log entry, up to
+     * `MAX_COMPACT_ENTRY_HEADER_SIZE` bytes. Payload is not written.
+     *
+     * @param bs Serializer.
+     * @param le Log entry.
+     * @param flags Flags of the request.
+     * @param prev Header of the previous entry, will be updated
+     *             to that of `le`.
+     */
+    static void put_compact_entry_header(buffer_serializer& bs,
+                                         log_entry& le,
+                                         uint32_t flags,
+                                         compact_entry_header& prev);
+
+    /**
+     * Read the compact header of a log entry.
+     *
+     * @param bs Serializer positioned at the beginning of the header.
+     * @param flags Flags of the request.
+     * @param[in,out] hdr Header of the previous entry as input,
+     *                    and that of the current entry as output.
+     * @param[out] err_msg Error message if failed.
+     * @return `true` if the header is valid.
+     */
+    static bool get_compact_entry_header(buffer_serializer& bs,
+                                         uint32_t flags,
+                                         compact_entry_header& hdr,
+                                         std::string& err_msg);
+};
+
+}
@@ -0,0 +1,1577 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "shm_service.hxx"
+
+#include "buffer_pool.hxx"
+#include "callback.hxx"
+#include "logger.hxx"
+#include "raft_server.hxx"
+#include "raft_server_handler.hxx"
+#include "rpc_listener.hxx"
+#include "rpc_wire.hxx"
+#include "strfmt.hxx"
+#include "tracer.hxx"
+
+#include <stdexcept>
+
+#if defined(__linux__)
+    #include <sys/syscall.h>
+    #if defined(__NR_memfd_create)
+        #define SHM_SUPPORTED (1)
+    #endif
+#endif
+
+#ifdef SHM_SUPPORTED
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#ifndef MFD_CLOEXEC
+    #define MFD_CLOEXEC (0x0001U)
+#endif
+
+namespace nuraft {
+
+namespace {
+
+template<typename T>
+T load_acquire(const T* ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+void store_release(T* ptr, T val) {
+    __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+void full_fence() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+std::string errno_str(int err) {
+    return std::to_string(err) + ", " + strerror(err);
+}
+
+size_t round_up_pow2(size_t val) {
+    size_t ret = 1;
+    while (ret < val) ret <<= 1;
+    return ret;
+}
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+           ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void signal_efd(int fd) {
+    uint64_t one = 1;
+    ssize_t ret = ::write(fd, &one, sizeof(one));
+    (void)ret;
+}
+
+void drain_efd(int fd) {
+    uint64_t val = 0;
+    ssize_t ret = ::read(fd, &val, sizeof(val));
+    (void)ret;
+}
+
+// Listeners are abstract Unix domain sockets, named after the port.
+socklen_t make_listener_addr(ushort port, sockaddr_un& addr) {
+    memset(&addr, 0x0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::string name = "nuraft_shm_" + std::to_string(port);
+    // The first byte of `sun_path` is zero: abstract namespace.
+    memcpy(addr.sun_path + 1, name.data(), name.size());
+    return offsetof(sockaddr_un, sun_path) + 1 + name.size();
+}
+
+const uint32_t SHM_MAGIC = 0x4e525348;
+const uint32_t SHM_VERSION = 1;
+const size_t MIN_RING_SIZE = 4096;
+const size_t MAX_RING_SIZE = (size_t)1 << 30;
+
+// Maximum number of bytes to read from the ring at once,
+// so that a busy peer does not starve outgoing messages.
+const size_t MAX_READ_BATCH = 4 * 1024 * 1024;
+
+} // namespace
+
+// === Shared memory layout ===================================================
+
+/**
+ * Control block of a ring, shared by both sides. Positions are
+ * monotonically increasing byte offsets.
+ */
+struct shm_ring_ctrl {
+    // Written by the consumer.
+    alignas(64) uint64_t head_;
+    uint32_t consumer_waiting_;
+
+    // Written by the producer.
+    alignas(64) uint64_t tail_;
+    uint32_t producer_waiting_;
+};
+
+/**
+ * Beginning of the memory file, followed by the data of
+ * the two rings.
+ */
+struct shm_region_hdr {
+    uint32_t magic_;
+    uint32_t version_;
+    uint64_t ring_size_;
+    // 0: client to server, 1: server to client.
+    shm_ring_ctrl rings_[2];
+};
+
+// Sent by the client along with the file descriptors.
+struct shm_hello {
+    uint32_t magic_;
+    uint32_t version_;
+    uint64_t region_size_;
+};
+
+size_t shm_region_size(size_t ring_size) {
+    return sizeof(shm_region_hdr) + ring_size * 2;
+}
+
+/**
+ * One side's view of a ring. Either the producer or the consumer
+ * functions are used by each side, never both.
+ */
+class shm_ring {
+public:
+    shm_ring() : ctrl_(nullptr), data_(nullptr), size_(0), mask_(0) {}
+
+    void init(shm_ring_ctrl* ctrl, byte* data, size_t size) {
+        ctrl_ = ctrl;
+        data_ = data;
+        size_ = size;
+        mask_ = size - 1;
+    }
+
+    shm_ring_ctrl* ctrl() const { return ctrl_; }
+
+    // === Producer side. ===
+
+    size_t room() const {
+        return size_ - (ctrl_->tail_ - load_acquire(&ctrl_->head_));
+    }
+
+    // Returns the number of bytes written, can be smaller than `len`.
+    size_t write(const byte* src, size_t len) {
+        uint64_t tail = ctrl_->tail_;
+        size_t num = std::min(len, room());
+        size_t off = tail & mask_;
+        size_t first = std::min(num, size_ - off);
+        memcpy(data_ + off, src, first);
+        memcpy(data_, src + first, num - first);
+        store_release(&ctrl_->tail_, tail + num);
+        return num;
+    }
+
+    // === Consumer side. ===
+
+    /**
+     * Get the readable contiguous region.
+     *
+     * @return Size of the region, or -1 if the positions
+     *         written by the peer are broken.
+     */
+    int64_t peek(const byte*& ptr) const {
+        uint64_t head = ctrl_->head_;
+        uint64_t avail = load_acquire(&ctrl_->tail_) - head;
+        if (avail > size_) return -1;
+        size_t off = head & mask_;
+        ptr = data_ + off;
+        return std::min((size_t)avail, size_ - off);
+    }
+
+    bool readable() const {
+        return load_acquire(&ctrl_->tail_) != ctrl_->head_;
+    }
+
+    void advance(size_t len) {
+        store_release(&ctrl_->head_, ctrl_->head_ + len);
+    }
+
+private:
+    shm_ring_ctrl* ctrl_;
+    byte* data_;
+    size_t size_;
+    size_t mask_;
+};
+
+// === Service ================================================================
+
+class shm_conn;
+
+class shm_service_impl {
+public:
+    shm_service_impl(const shm_service::options& opt, ptr<logger> l)
+        : opt_(opt)
+        , conn_id_counter_(1)
+        , stopped_(false)
+        , l_(l)
+    {
+        opt_.ring_size_ = std::min( MAX_RING_SIZE,
+                                    round_up_pow2( std::max( MIN_RING_SIZE,
+                                                             opt_.ring_size_ ) ) );
+    }
+
+    __nocopy__(shm_service_impl);
+
+public:
+    const shm_service::options& get_options() const { return opt_; }
+
+    uint64_t new_conn_id() { return conn_id_counter_.fetch_add(1); }
+
+    // Returns `false` if the service is already stopped.
+    bool add_conn(const ptr<shm_conn>& conn) {
+        std::lock_guard<std::mutex> l(lock_);
+        if (stopped_) return false;
+        conns_.insert(conn);
+        return true;
+    }
+
+    // Called by the thread of the connection when it ends.
+    void remove_conn(shm_conn* conn) {
+        std::lock_guard<std::mutex> l(lock_);
+        for (auto it = conns_.begin(); it != conns_.end(); ++it) {
+            if (it->get() == conn) {
+                conns_.erase(it);
+                break;
+            }
+        }
+        cv_.notify_all();
+    }
+
+    void stop();
+
+private:
+    shm_service::options opt_;
+    std::atomic<uint64_t> conn_id_counter_;
+    std::mutex lock_;
+    std::condition_variable cv_;
+    bool stopped_;
+    std::set< ptr<shm_conn> > conns_;
+    ptr<logger> l_;
+};
+
+// === Connection =============================================================
+
+/**
+ * One end of a shared memory connection, served by its own thread.
+ * It assembles incoming messages (header followed by body) and
+ * sends outgoing messages in order. Subclasses decide what
+ * the messages are.
+ */
+class shm_conn : public std::enable_shared_from_this<shm_conn> {
+public:
+    shm_conn(shm_service_impl* impl, bool is_client, size_t hdr_size, ptr<logger> l)
+        : impl_(impl)
+        , id_(impl->new_conn_id())
+        , is_client_(is_client)
+        , closing_(false)
+        , close_after_sends_(false)
+        , l_(l)
+        , sock_(-1)
+        , my_efd_(-1)
+        , peer_efd_(-1)
+        , region_(nullptr)
+        , region_size_(0)
+        , peer_gone_(false)
+        , started_(false)
+        , accepting_tasks_(true)
+        , wakeup_pending_(false)
+        , hdr_(buffer::alloc(hdr_size))
+        , hdr_got_(0)
+        , body_got_(0)
+        , recv_buf_pool_(impl->get_options().recv_buffer_pool_size_)
+    {
+        my_efd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (my_efd_ < 0) {
+            throw std::runtime_error("eventfd failed: " + errno_str(errno));
+        }
+    }
+
+    virtual ~shm_conn() {
+        if (region_) munmap(region_, region_size_);
+        if (sock_ >= 0) ::close(sock_);
+        if (my_efd_ >= 0) ::close(my_efd_);
+        if (peer_efd_ >= 0) ::close(peer_efd_);
+    }
+
+    __nocopy__(shm_conn);
+
+public:
+    /**
+     * Spawn the thread of this connection, if not yet.
+     *
+     * @return `false` if it cannot be started.
+     */
+    bool start() {
+        std::lock_guard<std::mutex> l(tasks_lock_);
+        if (started_) return accepting_tasks_;
+        started_ = true;
+        if (!impl_->add_conn(shared_from_this())) {
+            accepting_tasks_ = false;
+            return false;
+        }
+        ptr<shm_conn> self = shared_from_this();
+        std::thread( [self]() { self->loop(); } ).detach();
+        return true;
+    }
+
+    /**
+     * Run the given task in the thread of this connection.
+     *
+     * @return `false` if the thread is not running.
+     */
+    bool post(std::function<void()>&& task) {
+        {
+            std::lock_guard<std::mutex> l(tasks_lock_);
+            if (!started_ || !accepting_tasks_) return false;
+            tasks_.push_back(std::move(task));
+        }
+        if (!wakeup_pending_.exchange(true)) signal_efd(my_efd_);
+        return true;
+    }
+
+    uint64_t get_id() const { return id_; }
+
+    // `eventfd` to signal for waking up this side.
+    int my_efd() const { return my_efd_; }
+
+    // === Below functions should be called in the thread. ===
+
+    void send(const ptr<buffer>& buf) {
+        if (closing_) return;
+        send_q_.push_back( send_item(buf) );
+    }
+
+    // Close the connection once all queued messages are written.
+    void close_after_sends() {
+        close_after_sends_ = true;
+    }
+
+    void close(const std::string& reason) {
+        if (closing_) return;
+        closing_ = true;
+        if (sock_ >= 0) ::shutdown(sock_, SHUT_RDWR);
+        on_close(reason);
+    }
+
+protected:
+    /**
+     * Called once the thread starts, before anything else.
+     * Returns `false` if the connection cannot be made.
+     */
+    virtual bool on_start() { return true; }
+
+    /**
+     * Called when a header is received.
+     *
+     * @return Size of the following body, or negative value
+     *         if the connection is closed.
+     */
+    virtual int64_t on_header(buffer& hdr) = 0;
+
+    // Called when a message is received. `body` can be `nullptr`.
+    virtual void on_message(const ptr<buffer>& body) = 0;
+
+    // Called when a message is completely written to the ring.
+    virtual void on_sent() {}
+
+    // Called once when the connection is closed.
+    virtual void on_close(const std::string& reason) = 0;
+
+    /**
+     * Called on every loop iteration, to handle timeouts.
+     *
+     * @return Time to wait until the next check in milliseconds,
+     *         or -1 if there is nothing to wait for.
+     */
+    virtual int on_timer() { return -1; }
+
+    /**
+     * Map the shared memory, and take the ownership of the socket
+     * and the peer's `eventfd` (if given). `mem_fd` is not closed.
+     *
+     * @return Empty string on success, otherwise error message.
+     */
+    std::string attach(int sock, int mem_fd, size_t region_size, int peer_efd) {
+        sock_ = sock;
+        peer_efd_ = peer_efd;
+        void* mem = mmap( nullptr, region_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, mem_fd, 0 );
+        if (mem == MAP_FAILED) return "mmap failed: " + errno_str(errno);
+        region_ = mem;
+        region_size_ = region_size;
+
+        shm_region_hdr* hdr = (shm_region_hdr*)region_;
+        byte* data = (byte*)region_ + sizeof(shm_region_hdr);
+        size_t ring_size = region_size - sizeof(shm_region_hdr);
+        ring_size /= 2;
+        if (is_client_) {
+            hdr->magic_ = SHM_MAGIC;
+            hdr->version_ = SHM_VERSION;
+            hdr->ring_size_ = ring_size;
+        } else if ( hdr->magic_ != SHM_MAGIC ||
+                    hdr->version_ != SHM_VERSION ||
+                    hdr->ring_size_ != ring_size ) {
+            return "invalid shared memory header";
+        }
+        shm_ring& c2s = is_client_ ? out_ : in_;
+        shm_ring& s2c = is_client_ ? in_ : out_;
+        c2s.init(&hdr->rings_[0], data, ring_size);
+        s2c.init(&hdr->rings_[1], data + ring_size, ring_size);
+        return std::string();
+    }
+
+    void set_peer_efd(int fd) { peer_efd_ = fd; }
+
+    struct send_item {
+        send_item(const ptr<buffer>& buf) : buf_(buf), offset_(0) {}
+        ptr<buffer> buf_;
+        size_t offset_;
+    };
+
+    shm_service_impl* impl_;
+    uint64_t id_;
+    bool is_client_;
+    bool closing_;
+    bool close_after_sends_;
+    std::deque<send_item> send_q_;
+    ptr<logger> l_;
+
+private:
+    void loop() {
+        std::string thread_name = "nuraft_shm_" + std::to_string(id_);
+#ifdef __linux__
+        pthread_setname_np(pthread_self(), thread_name.c_str());
+#endif
+        if (!on_start()) closing_ = true;
+
+        const size_t busy_poll_us = impl_->get_options().busy_poll_us_;
+        uint64_t idle_since_us = 0;
+        while (!closing_) {
+            bool progress = run_tasks();
+            if (closing_) break;
+            progress = flush_sends() || progress;
+            if (close_after_sends_ && send_q_.empty()) {
+                close("closed after sending responses");
+                break;
+            }
+            progress = drain_recv() || progress;
+            if (peer_gone_) {
+                // Data written before the peer closed the socket
+                // has been read above.
+                close("connection closed by peer");
+            }
+            if (closing_) break;
+            int wait_ms = on_timer();
+            if (closing_) break;
+            if (progress) {
+                idle_since_us = 0;
+                continue;
+            }
+            if (busy_poll_us) {
+                uint64_t now = now_us();
+                if (!idle_since_us) idle_since_us = now;
+                if (now - idle_since_us < busy_poll_us) continue;
+            }
+            wait(wait_ms);
+        }
+        cleanup();
+    }
+
+    // Returns `true` if any task was executed.
+    bool run_tasks() {
+        // Should be reset before taking the tasks, so that any task
+        // posted after that will wake up the loop again.
+        wakeup_pending_ = false;
+        std::vector< std::function<void()> > tasks;
+        {
+            std::lock_guard<std::mutex> l(tasks_lock_);
+            tasks.swap(tasks_);
+        }
+        for (auto& task: tasks) {
+            try {
+                task();
+            } catch (std::exception& ee) {
+                p_er("shm connection %" PRIu64 " got exception from task: %s",
+                     id_, ee.what());
+            }
+        }
+        return !tasks.empty();
+    }
+
+    // Write queued messages to the ring, as many as fit.
+    bool flush_sends() {
+        if (send_q_.empty() || !region_) return false;
+        bool written = false;
+        while (!send_q_.empty()) {
+            send_item& item = send_q_.front();
+            size_t len = item.buf_->size() - item.offset_;
+            size_t num = out_.write(item.buf_->data_begin() + item.offset_, len);
+            if (num) written = true;
+            item.offset_ += num;
+            if (num < len) break;
+            send_q_.pop_front();
+            on_sent();
+        }
+        if (written) {
+            // Pairs with the fence in `wait()` of the peer.
+            full_fence();
+            if (load_acquire(&out_.ctrl()->consumer_waiting_)) signal_efd(peer_efd_);
+        }
+        return written;
+    }
+
+    // Read incoming data from the ring.
+    bool drain_recv() {
+        if (!region_) return false;
+        size_t total = 0;
+        while (!closing_ && total < MAX_READ_BATCH) {
+            const byte* data = nullptr;
+            int64_t len = in_.peek(data);
+            if (len < 0) {
+                close("shared memory ring is broken");
+                return true;
+            }
+            if (!len) break;
+            consume(data, len);
+            in_.advance(len);
+            total += len;
+        }
+        if (total) {
+            full_fence();
+            if (load_acquire(&in_.ctrl()->producer_waiting_)) signal_efd(peer_efd_);
+        }
+        return total > 0;
+    }
+
+    void consume(const byte* data, size_t len) {
+        while (len && !closing_) {
+            if (!body_) {
+                size_t hdr_size = hdr_->size();
+                size_t to_copy = std::min(len, hdr_size - hdr_got_);
+                memcpy(hdr_->data_begin() + hdr_got_, data, to_copy);
+                hdr_got_ += to_copy;
+                data += to_copy;
+                len -= to_copy;
+                if (hdr_got_ < hdr_size) break;
+
+                hdr_->pos(0);
+                int64_t body_size = on_header(*hdr_);
+                if (body_size < 0) return;
+                if (body_size == 0) {
+                    hdr_got_ = 0;
+                    on_message(nullptr);
+                    continue;
+                }
+                body_ = recv_buf_pool_.acquire(body_size);
+                body_got_ = 0;
+
+            } else {
+                size_t to_copy = std::min(len, body_->size() - body_got_);
+                memcpy(body_->data_begin() + body_got_, data, to_copy);
+                body_got_ += to_copy;
+                data += to_copy;
+                len -= to_copy;
+                if (body_got_ < body_->size()) break;
+
+                ptr<buffer> body = std::move(body_);
+                body_.reset();
+                hdr_got_ = 0;
+                on_message(body);
+            }
+        }
+    }
+
+    void wait(int timeout_ms) {
+        // Announce that this side is going to sleep, and then check
+        // the rings again: either the peer sees the flag and wakes us up,
+        // or we see what the peer has written.
+        bool want_room = !send_q_.empty();
+        if (region_) {
+            store_release(&in_.ctrl()->consumer_waiting_, (uint32_t)1);
+            if (want_room) store_release(&out_.ctrl()->producer_waiting_, (uint32_t)1);
+            full_fence();
+        }
+        bool ready = wakeup_pending_ ||
+                     ( region_ &&
+                       ( in_.readable() || (want_room && out_.room()) ) );
+        if (!ready) {
+            pollfd fds[2];
+            fds[0].fd = my_efd_;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            fds[1].fd = sock_;
+            fds[1].events = POLLIN | POLLRDHUP;
+            fds[1].revents = 0;
+            int ret = ::poll(fds, sock_ >= 0 ? 2 : 1, timeout_ms);
+            if (ret > 0 && fds[0].revents) drain_efd(my_efd_);
+            if (ret > 0 && sock_ >= 0 && fds[1].revents) {
+                // Nothing is sent through the socket after the handshake.
+                peer_gone_ = true;
+            }
+        }
+        if (region_) {
+            store_release(&in_.ctrl()->consumer_waiting_, (uint32_t)0);
+            store_release(&out_.ctrl()->producer_waiting_, (uint32_t)0);
+        }
+    }
+
+    void cleanup() {
+        {
+            std::lock_guard<std::mutex> l(tasks_lock_);
+            accepting_tasks_ = false;
+        }
+        close("connection is closed");
+        // Remaining tasks may hold references to this connection.
+        run_tasks();
+        send_q_.clear();
+        impl_->remove_conn(this);
+    }
+
+    int sock_;
+    int my_efd_;
+    int peer_efd_;
+    void* region_;
+    size_t region_size_;
+    shm_ring in_;
+    shm_ring out_;
+    bool peer_gone_;
+
+    std::mutex tasks_lock_;
+    std::vector< std::function<void()> > tasks_;
+    bool started_;
+    bool accepting_tasks_;
+    std::atomic<bool> wakeup_pending_;
+
+    ptr<buffer> hdr_;
+    size_t hdr_got_;
+    ptr<buffer> body_;
+    size_t body_got_;
+    buffer_pool recv_buf_pool_;
+};
+
+void shm_service_impl::stop() {
+    std::set< ptr<shm_conn> > conns;
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        if (stopped_) return;
+        stopped_ = true;
+        conns = conns_;
+    }
+    for (const ptr<shm_conn>& cc: conns) {
+        ptr<shm_conn> conn = cc;
+        conn->post( [conn]() { conn->close("service stopped"); } );
+    }
+    conns.clear();
+
+    // Threads refer to this instance, wait for them.
+    std::unique_lock<std::mutex> l(lock_);
+    cv_.wait(l, [this]() { return conns_.empty(); });
+}
+
+// === Server side ============================================================
+
+class shm_rpc_listener;
+
+class shm_session
+    : public shm_conn
+    , public raft_server_handler
+{
+public:
+    shm_session(shm_service_impl* impl,
+                ushort port,
+                ptr<msg_handler> handler,
+                std::weak_ptr<shm_rpc_listener> listener,
+                ptr<logger> l)
+        : shm_conn(impl, false, RPC_REQ_HEADER_SIZE, l)
+        , port_(port)
+        , handler_(handler)
+        , listener_(listener)
+        , src_id_(-1)
+        , is_leader_(false)
+        , peer_supports_crc32c_(false)
+        {}
+
+    // Should be called before `start()`.
+    std::string accept(int sock, int mem_fd, size_t region_size, int peer_efd) {
+        std::string err_msg = attach(sock, mem_fd, region_size, peer_efd);
+        if (err_msg.empty()) {
+            p_in( "session %" PRIu64 " got shared memory connection "
+                  "on port %u", id_, port_ );
+        }
+        return err_msg;
+    }
+
+protected:
+    struct pending_resp {
+        pending_resp(ptr<req_msg> req)
+            : req_(req), ready_(false), close_after_(false)
+            {}
+        ptr<req_msg> req_;
+        ptr<resp_msg> resp_;
+        bool ready_;
+        bool close_after_;
+    };
+
+    int64_t on_header(buffer& hdr) override {
+        std::string err_msg;
+        if (!rpc_wire::decode_req_header(hdr, req_hdr_, err_msg)) {
+            p_er("session %" PRIu64 ": %s", id_, err_msg.c_str());
+            close(err_msg);
+            return -1;
+        }
+        if ( (req_hdr_.flags_ & CRC32C_SUPPORTED) &&
+             impl_->get_options().use_crc32c_ &&
+             !peer_supports_crc32c_ ) {
+            peer_supports_crc32c_ = true;
+        }
+        return req_hdr_.data_size_;
+    }
+
+    void on_message(const ptr<buffer>& body) override {
+        if (!handler_ || close_after_sends_) return;
+
+        std::string err_msg;
+        ptr<req_msg> req =
+            rpc_wire::decode_req( req_hdr_, body,
+                                  impl_->get_options().log_entry_slices_,
+                                  err_msg );
+        if (!req) {
+            p_er("session %" PRIu64 ": %s", id_, err_msg.c_str());
+            close(err_msg);
+            return;
+        }
+        update_leader_status(req->get_type());
+
+        const bool close_on_error_req = (req_hdr_.flags_ & CLOSE_ON_ERROR_WIRE);
+
+        // === RAFT server processes the request here. ===
+        ptr<resp_msg> resp = raft_server_handler::process_req(handler_.get(), *req);
+        if (!resp) {
+            p_wn("no response is returned from raft message handler");
+            close("no response");
+            return;
+        }
+
+        ptr<pending_resp> entry = cs_new<pending_resp>(req);
+        pending_resps_.push_back(entry);
+
+        if (resp->has_async_cb()) {
+            // Response will be ready later, it will be sent in order
+            // with other responses.
+            entry->resp_ = resp;
+            ptr<shm_conn> self = shared_from_this();
+            ptr< cmd_result< ptr<buffer> > > ret = resp->call_async_cb();
+            ret->when_ready(
+                [self, entry, close_on_error_req]
+                ( cmd_result<ptr<buffer>, ptr<std::exception>>& res,
+                  ptr<std::exception>& exp ) {
+                    resp_msg* resp = entry->resp_.get();
+                    resp->set_ctx(res.get());
+                    cmd_result_code code = res.get_result_code();
+                    if (code != cmd_result_code::OK) {
+                        resp->unaccept();
+                        resp->set_result_code(code);
+                    }
+                    entry->close_after_ = close_on_error_req &&
+                                          ( !resp->get_accepted() ||
+                                            resp->get_result_code() !=
+                                                cmd_result_code::OK );
+                    self->post( [self, entry]() {
+                        entry->ready_ = true;
+                        static_cast<shm_session*>(self.get())->send_resps();
+                    } );
+                    // This is needed to avoid circular reference.
+                    res.reset();
+                } );
+            return;
+        }
+
+        if (resp->has_cb()) {
+            // If callback function exists, get new response message.
+            resp = resp->call_cb(resp);
+        }
+        entry->resp_ = resp;
+        entry->close_after_ = close_on_error_req &&
+                              ( !resp->get_accepted() ||
+                                resp->get_result_code() != cmd_result_code::OK );
+        entry->ready_ = true;
+        send_resps();
+    }
+
+    void on_close(const std::string& reason) override {
+        p_in("session %" PRIu64 " is closed: %s", id_, reason.c_str());
+        if (handler_) {
+            invoke_connection_callback(false);
+            handler_.reset();
+        }
+        pending_resps_.clear();
+        remove_from_listener();
+    }
+
+private:
+    void send_resps() {
+        while ( !closing_ &&
+                !pending_resps_.empty() &&
+                pending_resps_.front()->ready_ ) {
+            ptr<pending_resp> entry = pending_resps_.front();
+            pending_resps_.pop_front();
+
+            uint32_t flags = 0x0;
+            if (impl_->get_options().use_crc32c_) {
+                flags |= CRC32C_SUPPORTED;
+                if (peer_supports_crc32c_) flags |= CRC32C_IN_USE;
+            }
+            send( rpc_wire::encode_resp(*entry->req_, *entry->resp_, flags) );
+
+            if (entry->close_after_) {
+                p_in("session %" PRIu64 " CLOSE_ON_ERROR: close after resp", id_);
+                pending_resps_.clear();
+                close_after_sends();
+            }
+        }
+    }
+
+    void update_leader_status(msg_type t) {
+        if (src_id_ == -1) {
+            // It means this is the first message on this session.
+            // Invoke callback function of new connection.
+            src_id_ = req_hdr_.src_;
+            invoke_connection_callback(true);
+
+        } else if (is_leader_ && src_id_ != handler_->get_leader()) {
+            // Leader has been changed without closing session.
+            is_leader_ = false;
+        }
+
+        if (!is_leader_) {
+            // Only leader can send below message types.
+            if ( t == msg_type::append_entries_request ||
+                 t == msg_type::sync_log_request ||
+                 t == msg_type::join_cluster_request ||
+                 t == msg_type::leave_cluster_request ||
+                 t == msg_type::install_snapshot_request ||
+                 t == msg_type::priority_change_request ||
+                 t == msg_type::custom_notification_request ) {
+                is_leader_ = true;
+                cb_func::ConnectionArgs
+                    args( id_, "localhost", port_, src_id_, is_leader_ );
+                cb_func::Param cb_param( handler_->get_id(),
+                                         handler_->get_leader(),
+                                         -1,
+                                         &args );
+                handler_->invoke_callback( cb_func::NewSessionFromLeader,
+                                           &cb_param );
+            }
+        }
+    }
+
+    void invoke_connection_callback(bool is_open) {
+        if (is_leader_ && src_id_ != handler_->get_leader()) {
+            is_leader_ = false;
+        }
+        cb_func::ConnectionArgs
+            args( id_, "localhost", port_, src_id_, is_leader_ );
+        cb_func::Param cb_param( handler_->get_id(),
+                                 handler_->get_leader(),
+                                 -1,
+                                 &args );
+        handler_->invoke_callback
+            ( is_open ? cb_func::ConnectionOpened : cb_func::ConnectionClosed,
+              &cb_param );
+    }
+
+    void remove_from_listener();
+
+    ushort port_;
+    ptr<msg_handler> handler_;
+    std::weak_ptr<shm_rpc_listener> listener_;
+    int32 src_id_;
+    bool is_leader_;
+    bool peer_supports_crc32c_;
+    rpc_req_header req_hdr_;
+    std::deque< ptr<pending_resp> > pending_resps_;
+};
+
+class shm_rpc_listener
+    : public rpc_listener
+    , public std::enable_shared_from_this<shm_rpc_listener>
+{
+public:
+    shm_rpc_listener(shm_service_impl* impl, ushort port, ptr<logger> l)
+        : impl_(impl)
+        , port_(port)
+        , fd_(-1)
+        , stop_efd_(-1)
+        , stopped_(false)
+        , l_(l)
+    {
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) {
+            throw std::runtime_error("socket failed: " + errno_str(errno));
+        }
+        sockaddr_un addr;
+        socklen_t addr_len = make_listener_addr(port, addr);
+        int ret = ::bind(fd_, (sockaddr*)&addr, addr_len);
+        if (ret == 0) ret = ::listen(fd_, SOMAXCONN);
+        if (ret < 0) {
+            int err = errno;
+            ::close(fd_);
+            fd_ = -1;
+            throw std::runtime_error( "failed to listen on port " +
+                                      std::to_string(port) + ": " +
+                                      errno_str(err) );
+        }
+        stop_efd_ = eventfd(0, EFD_CLOEXEC);
+        if (stop_efd_ < 0) {
+            int err = errno;
+            ::close(fd_);
+            fd_ = -1;
+            throw std::runtime_error("eventfd failed: " + errno_str(err));
+        }
+        p_in("Raft shared memory listener initiated on port %u", port);
+    }
+
+    ~shm_rpc_listener() {
+        stop();
+        if (fd_ >= 0) ::close(fd_);
+        if (stop_efd_ >= 0) ::close(stop_efd_);
+    }
+
+    __nocopy__(shm_rpc_listener);
+
+public:
+    virtual void listen(ptr<msg_handler>& handler) override {
+        std::lock_guard<std::mutex> l(lock_);
+        if (stopped_ || thread_.joinable()) return;
+        handler_ = handler;
+        // Holds a weak pointer, so that the listener can be destroyed
+        // without being stopped explicitly.
+        std::weak_ptr<shm_rpc_listener> weak_self = shared_from_this();
+        int fd = fd_;
+        int stop_efd = stop_efd_;
+        thread_ = std::thread( [weak_self, fd, stop_efd]() {
+            accept_loop(weak_self, fd, stop_efd);
+        } );
+    }
+
+    virtual void stop() override {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (stopped_) return;
+            stopped_ = true;
+            thread.swap(thread_);
+        }
+        signal_efd(stop_efd_);
+        if (thread.joinable()) {
+            if (thread.get_id() == std::this_thread::get_id()) {
+                thread.detach();
+            } else {
+                thread.join();
+            }
+        }
+        // Release the name, so that it can be reused right away.
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    virtual void shutdown() override {
+        std::set< ptr<shm_session> > sessions;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            sessions.swap(sessions_);
+            handler_.reset();
+        }
+        for (const ptr<shm_session>& ss: sessions) {
+            ptr<shm_session> s = ss;
+            s->post( [s]() { s->close("listener shutdown"); } );
+        }
+    }
+
+    void remove_session(shm_session* session) {
+        std::lock_guard<std::mutex> l(lock_);
+        for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+            if (it->get() == session) {
+                sessions_.erase(it);
+                break;
+            }
+        }
+    }
+
+private:
+    static void accept_loop(std::weak_ptr<shm_rpc_listener> weak_self,
+                            int fd,
+                            int stop_efd)
+    {
+#ifdef __linux__
+        pthread_setname_np(pthread_self(), "nuraft_shm_lsn");
+#endif
+        while (true) {
+            pollfd fds[2];
+            fds[0].fd = fd;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            fds[1].fd = stop_efd;
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+            int ret = ::poll(fds, 2, -1);
+            if (ret < 0 && errno == EINTR) continue;
+            if (ret < 0 || fds[1].revents) break;
+
+            int sock = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (sock < 0) continue;
+            ptr<shm_rpc_listener> self = weak_self.lock();
+            if (!self) {
+                ::close(sock);
+                break;
+            }
+            self->handle_new_conn(sock);
+        }
+    }
+
+    void handle_new_conn(int sock) {
+        // The client sends the hello message right after connecting.
+        timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        shm_hello hello;
+        memset(&hello, 0x0, sizeof(hello));
+        iovec iov;
+        iov.iov_base = &hello;
+        iov.iov_len = sizeof(hello);
+        const size_t NUM_FDS = 2;
+        union {
+            char buf[CMSG_SPACE(sizeof(int) * NUM_FDS)];
+            cmsghdr align;
+        } ctrl;
+        msghdr msg;
+        memset(&msg, 0x0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = sizeof(ctrl.buf);
+        ssize_t ret = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+
+        int fds[NUM_FDS] = {-1, -1};
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if ( ret > 0 && cmsg &&
+             cmsg->cmsg_level == SOL_SOCKET &&
+             cmsg->cmsg_type == SCM_RIGHTS ) {
+            size_t num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg), std::min(num_fds, NUM_FDS) * sizeof(int));
+        }
+        int mem_fd = fds[0];
+        int peer_efd = fds[1];
+
+        std::string err_msg;
+        struct stat st;
+        if ( ret != (ssize_t)sizeof(hello) ||
+             hello.magic_ != SHM_MAGIC ||
+             mem_fd < 0 || peer_efd < 0 ) {
+            err_msg = "invalid hello message";
+        } else if (hello.version_ != SHM_VERSION) {
+            err_msg = "unsupported version " + std::to_string(hello.version_);
+        } else if ( fstat(mem_fd, &st) != 0 ||
+                    (uint64_t)st.st_size != hello.region_size_ ||
+                    hello.region_size_ <= sizeof(shm_region_hdr) ) {
+            err_msg = "invalid shared memory size";
+        } else {
+            size_t ring_size = (hello.region_size_ - sizeof(shm_region_hdr)) / 2;
+            if ( ring_size < MIN_RING_SIZE || ring_size > MAX_RING_SIZE ||
+                 round_up_pow2(ring_size) != ring_size ||
+                 shm_region_size(ring_size) != hello.region_size_ ) {
+                err_msg = "invalid ring size " + std::to_string(ring_size);
+            }
+        }
+        if (!err_msg.empty()) {
+            p_er("failed to accept a shared memory connection: %s", err_msg.c_str());
+            if (mem_fd >= 0) ::close(mem_fd);
+            if (peer_efd >= 0) ::close(peer_efd);
+            ::close(sock);
+            return;
+        }
+
+        ptr<shm_session> session;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (!stopped_ && handler_) {
+                session = cs_new<shm_session>( impl_, port_, handler_,
+                                               shared_from_this(), l_ );
+                sessions_.insert(session);
+            }
+        }
+        if (!session) {
+            ::close(mem_fd);
+            ::close(peer_efd);
+            ::close(sock);
+            return;
+        }
+        // The session owns the socket and `eventfd` from now on.
+        err_msg = session->accept(sock, mem_fd, hello.region_size_, peer_efd);
+        ::close(mem_fd);
+        if (!err_msg.empty()) {
+            p_er("failed to accept a shared memory connection: %s", err_msg.c_str());
+            remove_session(session.get());
+            return;
+        }
+
+        // Tell the client which `eventfd` to signal.
+        int my_efd = session->my_efd();
+        iov.iov_base = &hello;
+        iov.iov_len = sizeof(hello);
+        memset(&msg, 0x0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &my_efd, sizeof(int));
+        if ( ::sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hello) ||
+             !session->start() ) {
+            p_er("failed to reply to a shared memory connection: %s",
+                 errno_str(errno).c_str());
+            remove_session(session.get());
+        }
+    }
+
+    shm_service_impl* impl_;
+    ushort port_;
+    int fd_;
+    int stop_efd_;
+
+    std::mutex lock_;
+    std::thread thread_;
+    bool stopped_;
+    ptr<msg_handler> handler_;
+    std::set< ptr<shm_session> > sessions_;
+    ptr<logger> l_;
+};
+
+void shm_session::remove_from_listener() {
+    ptr<shm_rpc_listener> listener = listener_.lock();
+    if (listener) listener->remove_session(this);
+}
+
+// === Client side ============================================================
+
+class shm_client_conn : public shm_conn {
+public:
+    shm_client_conn(shm_service_impl* impl,
+                    const std::string& endpoint,
+                    ushort port,
+                    ptr<logger> l)
+        : shm_conn(impl, true, RPC_RESP_HEADER_SIZE, l)
+        , endpoint_(endpoint)
+        , port_(port)
+        , abandoned_(false)
+        , peer_supports_crc32c_(false)
+        {}
+
+    void enqueue(ptr<req_msg>& req,
+                 rpc_handler& when_done,
+                 const ptr<buffer>& buf,
+                 uint64_t timeout_ms)
+    {
+        if (closing_) {
+            ptr<resp_msg> rsp;
+            ptr<rpc_exception> except
+                ( cs_new<rpc_exception>( "connection to peer is closed", req ) );
+            when_done(rsp, except);
+            return;
+        }
+        pending_reqs_.push_back( pending_req(req, when_done, timeout_ms) );
+        send(buf);
+    }
+
+    uint32_t get_wire_flags() const {
+        const shm_service::options& opt = impl_->get_options();
+        uint32_t flags = 0x0;
+        if (opt.replicate_log_timestamp_) flags |= INCLUDE_LOG_TIMESTAMP;
+        if (opt.crc_on_payload_) flags |= CRC_ON_PAYLOAD;
+        if (opt.crc_on_entire_message_) flags |= CRC_ON_ENTIRE_MESSAGE;
+        if (opt.use_crc32c_) {
+            flags |= CRC32C_SUPPORTED;
+            if (peer_supports_crc32c_) flags |= CRC32C_IN_USE;
+        }
+        return flags;
+    }
+
+    bool is_abandoned() const { return abandoned_; }
+
+    void abandon() { abandoned_ = true; }
+
+protected:
+    struct pending_req {
+        pending_req(ptr<req_msg>& req, rpc_handler& when_done, uint64_t timeout_ms)
+            : req_(req), when_done_(when_done)
+            , timeout_ms_(timeout_ms), deadline_us_(0)
+            {}
+        ptr<req_msg> req_;
+        rpc_handler when_done_;
+        uint64_t timeout_ms_;
+        // Set once the request is written to the ring.
+        uint64_t deadline_us_;
+    };
+
+    bool on_start() override {
+        std::string err_msg = connect();
+        if (!err_msg.empty()) {
+            close(err_msg);
+            return false;
+        }
+        return true;
+    }
+
+    int64_t on_header(buffer& hdr) override {
+        std::string err_msg;
+        if (!rpc_wire::decode_resp_header(hdr, resp_hdr_, err_msg)) {
+            close(err_msg);
+            return -1;
+        }
+        if ( (resp_hdr_.flags_ & CRC32C_SUPPORTED) &&
+             impl_->get_options().use_crc32c_ &&
+             !peer_supports_crc32c_ ) {
+            peer_supports_crc32c_ = true;
+        }
+        return resp_hdr_.data_size_;
+    }
+
+    void on_message(const ptr<buffer>& body) override {
+        std::string err_msg;
+        ptr<resp_msg> rsp = rpc_wire::decode_resp(resp_hdr_, body, err_msg);
+        if (!rsp) {
+            close(err_msg);
+            return;
+        }
+        if (pending_reqs_.empty()) {
+            close("got a response without request");
+            return;
+        }
+        pending_req entry = pending_reqs_.front();
+        pending_reqs_.pop_front();
+
+        ptr<rpc_exception> except;
+        entry.when_done_(rsp, except);
+    }
+
+    void on_sent() override {
+        // Messages are written in the same order as `pending_reqs_`,
+        // and the one just written is already out of `send_q_`.
+        if (pending_reqs_.size() < send_q_.size() + 1) return;
+        size_t idx = pending_reqs_.size() - send_q_.size() - 1;
+        pending_req& entry = pending_reqs_[idx];
+        if (entry.timeout_ms_) {
+            entry.deadline_us_ = now_us() + entry.timeout_ms_ * 1000;
+        }
+    }
+
+    int on_timer() override {
+        if (pending_reqs_.empty()) return -1;
+        uint64_t deadline = pending_reqs_.front().deadline_us_;
+        if (!deadline) return -1;
+        uint64_t now = now_us();
+        if (now >= deadline) {
+            close("timeout");
+            return -1;
+        }
+        return (int)((deadline - now + 999) / 1000);
+    }
+
+    void on_close(const std::string& reason) override {
+        abandoned_ = true;
+
+        std::deque<pending_req> reqs;
+        reqs.swap(pending_reqs_);
+        for (pending_req& entry: reqs) {
+            std::string err_msg =
+                sstrfmt( "failed to send request to peer %d, %s, %s" )
+                .fmt( entry.req_->get_dst(), endpoint_.c_str(), reason.c_str() );
+            p_er("%s", err_msg.c_str());
+            ptr<resp_msg> rsp;
+            ptr<rpc_exception> except
+                ( cs_new<rpc_exception>(err_msg, entry.req_) );
+            entry.when_done_(rsp, except);
+        }
+    }
+
+private:
+    std::string connect() {
+        int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock < 0) return "socket failed: " + errno_str(errno);
+        sockaddr_un addr;
+        socklen_t addr_len = make_listener_addr(port_, addr);
+        if (::connect(sock, (sockaddr*)&addr, addr_len) < 0) {
+            int err = errno;
+            ::close(sock);
+            return "connect failed: " + errno_str(err);
+        }
+
+        size_t region_size = shm_region_size(impl_->get_options().ring_size_);
+        int mem_fd = (int)syscall(__NR_memfd_create, "nuraft_shm", MFD_CLOEXEC);
+        if (mem_fd < 0) {
+            int err = errno;
+            ::close(sock);
+            return "memfd_create failed: " + errno_str(err);
+        }
+        if (ftruncate(mem_fd, region_size) < 0) {
+            int err = errno;
+            ::close(mem_fd);
+            ::close(sock);
+            return "ftruncate failed: " + errno_str(err);
+        }
+
+        // Map (and initialize) the memory before the server can see it.
+        std::string err_msg = attach(sock, mem_fd, region_size, -1);
+        if (!err_msg.empty()) {
+            ::close(mem_fd);
+            return err_msg;
+        }
+
+        shm_hello hello;
+        hello.magic_ = SHM_MAGIC;
+        hello.version_ = SHM_VERSION;
+        hello.region_size_ = region_size;
+        iovec iov;
+        iov.iov_base = &hello;
+        iov.iov_len = sizeof(hello);
+        int fds[2] = {mem_fd, my_efd()};
+        union {
+            char buf[CMSG_SPACE(sizeof(fds))];
+            cmsghdr align;
+        } ctrl;
+        msghdr msg;
+        memset(&msg, 0x0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = sizeof(ctrl.buf);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+        ssize_t ret = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+        int err = errno;
+        ::close(mem_fd);
+        if (ret != (ssize_t)sizeof(hello)) return "sendmsg failed: " + errno_str(err);
+
+        // Wait for the server's `eventfd`.
+        timeval tv;
+        tv.tv_sec = 3;
+        tv.tv_usec = 0;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        memset(&msg, 0x0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int));
+        ret = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if ( ret != (ssize_t)sizeof(hello) || !cmsg ||
+             cmsg->cmsg_level != SOL_SOCKET ||
+             cmsg->cmsg_type != SCM_RIGHTS ) {
+            return "handshake failed";
+        }
+        int peer_efd = -1;
+        memcpy(&peer_efd, CMSG_DATA(cmsg), sizeof(int));
+        set_peer_efd(peer_efd);
+        return std::string();
+    }
+
+    std::string endpoint_;
+    ushort port_;
+    rpc_resp_header resp_hdr_;
+    std::deque<pending_req> pending_reqs_;
+    std::atomic<bool> abandoned_;
+    std::atomic<bool> peer_supports_crc32c_;
+};
+
+class shm_rpc_client : public rpc_client {
+public:
+    shm_rpc_client(ptr<shm_client_conn> conn)
+        : conn_(conn)
+        {}
+
+    ~shm_rpc_client() {
+        ptr<shm_client_conn> conn = conn_;
+        conn->abandon();
+        conn->post( [conn]() { conn->close("client is destroyed"); } );
+    }
+
+    __nocopy__(shm_rpc_client);
+
+public:
+    void send(ptr<req_msg>& req,
+              rpc_handler& when_done,
+              uint64_t send_timeout_ms = 0) override
+    {
+        // Serialize the message in the caller's thread,
+        // the connection's thread only copies it to the ring.
+        ptr<buffer> buf;
+        if (!conn_->is_abandoned() && conn_->start()) {
+            buf = rpc_wire::encode_req(*req, conn_->get_wire_flags());
+        }
+        ptr<shm_client_conn> conn = conn_;
+        ptr<req_msg> req_to_send = req;
+        rpc_handler handler = when_done;
+        bool posted = buf &&
+            conn->post( [conn, req_to_send, handler,
+                         buf, send_timeout_ms]() mutable {
+                conn->enqueue(req_to_send, handler, buf, send_timeout_ms);
+            } );
+        if (!posted) {
+            conn_->abandon();
+            ptr<resp_msg> rsp;
+            ptr<rpc_exception> except
+                ( cs_new<rpc_exception>( "this client is already abandoned", req ) );
+            when_done(rsp, except);
+        }
+    }
+
+    uint64_t get_id() const override { return conn_->get_id(); }
+
+    bool is_abandoned() const override { return conn_->is_abandoned(); }
+
+private:
+    ptr<shm_client_conn> conn_;
+};
+
+// === Service ================================================================
+
+bool shm_service::is_supported() {
+    int mem_fd = (int)syscall(__NR_memfd_create, "nuraft_shm", MFD_CLOEXEC);
+    if (mem_fd < 0) return false;
+    ::close(mem_fd);
+    int efd = eventfd(0, EFD_CLOEXEC);
+    if (efd < 0) return false;
+    ::close(efd);
+    return true;
+}
+
+shm_service::shm_service(const options& _opt, ptr<logger> _l)
+    : impl_(nullptr)
+    , l_(_l)
+{
+    if (!is_supported()) {
+        throw std::runtime_error("shared memory transport is not supported "
+                                 "by this system");
+    }
+    impl_ = new shm_service_impl(_opt, _l);
+}
+
+shm_service::~shm_service() {
+    impl_->stop();
+    delete impl_;
+}
+
+void shm_service::stop() {
+    impl_->stop();
+}
+
+ptr<rpc_client> shm_service::create_client(const std::string& endpoint) {
+    // Same format as `asio_service`, the host is ignored.
+    size_t pos = endpoint.rfind(":");
+    int port_num = (pos == std::string::npos)
+                   ? 0
+                   : atoi( endpoint.substr(pos + 1).c_str() );
+    if (port_num <= 0 || port_num > 65535) {
+        p_er("invalid endpoint: %s", endpoint.c_str());
+        return ptr<rpc_client>();
+    }
+    ptr<shm_client_conn> conn =
+        cs_new<shm_client_conn>(impl_, endpoint, (ushort)port_num, l_);
+    return cs_new<shm_rpc_client>(conn);
+}
+
+ptr<rpc_listener> shm_service::create_rpc_listener(ushort listening_port,
+                                                   ptr<logger>& l)
+{
+    try {
+        return cs_new<shm_rpc_listener>(impl_, listening_port, l);
+    } catch (std::exception& ee) {
+        p_er("got exception: %s on port %u", ee.what(), listening_port);
+        return nullptr;
+    }
+}
+
+}
+
+#else // SHM_SUPPORTED
+
+namespace nuraft {
+
+class shm_service_impl {};
+
+bool shm_service::is_supported() {
+    return false;
+}
+
+shm_service::shm_service(const options& _opt, ptr<logger> _l)
+    : impl_(nullptr)
+    , l_(_l)
+{
+    throw std::runtime_error("shared memory transport is not supported "
+                             "by this system");
+}
+
+shm_service::~shm_service() {}
+
+void shm_service::stop() {}
+
+ptr<rpc_client> shm_service::create_client(const std::string& endpoint) {
+    return nullptr;
+}
+
+ptr<rpc_listener> shm_service::create_rpc_listener(ushort listening_port,
+                                                   ptr<logger>& l)
+{
+    return nullptr;
+}
+
+}
+
+#endif // SHM_SUPPORTED
@@ -33,12 +33,10 @@ ptr<snapshot_sync_req> snapshot_sync_req::deserialize(buffer_serializer& bs) {
     ptr<snapshot> snp(snapshot::deserialize(bs));
     ulong offset = bs.get_u64();
     bool done = bs.get_u8() == 1;
-    byte* src = (byte*)bs.data();
     ptr<buffer> b;
     if (bs.pos() < bs.size()) {
-        size_t sz = bs.size() - bs.pos();
-        b = buffer::alloc(sz);
-        ::memcpy(b->data(), src, sz);
+        // If `bs` is created with `ptr<buffer>`, it does not copy the data.
+        b = bs.get_buffer_slice(bs.size() - bs.pos());
     }
     else {
         b = buffer::alloc(0);
@@ -24,6 +24,7 @@ namespace nuraft {
 
 static const uint8_t LEARNER_FLAG = 0x1;
 static const uint8_t NEW_JOINER_FLAG = 0x2;
+static const uint8_t WITNESS_FLAG = 0x4;
 
 ptr<srv_config> srv_config::deserialize(buffer& buf) {
     buffer_serializer bs(buf);
@@ -41,12 +42,14 @@ ptr<srv_config> srv_config::deserialize(buffer_serializer& bs) {
     uint8_t srv_type = bs.get_u8();
     bool is_learner = (srv_type & LEARNER_FLAG) ? true : false;
     bool new_joiner = (srv_type & NEW_JOINER_FLAG) ? true : false;
+    bool witness = (srv_type & WITNESS_FLAG) ? true : false;
 
     int32 priority = bs.get_i32();
 
     ptr<srv_config> ret =
         cs_new<srv_config>(id, dc_id, endpoint, aux, is_learner, priority);
     ret->set_new_joiner(new_joiner);
+    ret->set_witness(witness);
     return ret;
 }
 
@@ -67,6 +70,7 @@ ptr<buffer> srv_config::serialize() const{
     uint8_t srv_type = 0x0;
     srv_type |= (learner_ ? LEARNER_FLAG : 0x0);
     srv_type |= (new_joiner_ ? NEW_JOINER_FLAG : 0x0);
+    srv_type |= (witness_ ? WITNESS_FLAG : 0x0);
     buf->put((byte)srv_type);
 
     buf->put(priority_);
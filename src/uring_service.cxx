@@ -0,0 +1,1972 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+Author/Developer(s): Jung-Sang Ahn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "uring_service.hxx"
+
+#include "buffer_pool.hxx"
+#include "callback.hxx"
+#include "logger.hxx"
+#include "raft_server.hxx"
+#include "raft_server_handler.hxx"
+#include "rpc_listener.hxx"
+#include "rpc_wire.hxx"
+#include "strfmt.hxx"
+#include "thread.hxx"
+#include "tracer.hxx"
+
+#include <stdexcept>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+    // Multishot accept (Linux 5.19) is the newest feature that we need.
+    #if defined(IORING_ACCEPT_MULTISHOT) && defined(__NR_io_uring_setup)
+        #define URING_SUPPORTED (1)
+    #endif
+    // Multishot receive (Linux 6.0) is optional.
+    #if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_register)
+        #define URING_RECV_MULTISHOT (1)
+    #endif
+#endif
+#endif
+
+#ifdef URING_SUPPORTED
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace nuraft {
+
+namespace {
+
+int sys_io_uring_setup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int sys_io_uring_enter(int fd,
+                       unsigned to_submit,
+                       unsigned min_complete,
+                       unsigned flags) {
+    return (int)syscall( __NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, nullptr, 0 );
+}
+
+#ifdef URING_RECV_MULTISHOT
+int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+#endif
+
+bool kernel_version_at_least(int req_major, int req_minor) {
+    struct utsname name;
+    if (uname(&name) != 0) return false;
+    int major = 0, minor = 0;
+    if (sscanf(name.release, "%d.%d", &major, &minor) != 2) return false;
+    return major > req_major || (major == req_major && minor >= req_minor);
+}
+
+template<typename T>
+T load_acquire(const T* ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+void store_release(T* ptr, T val) {
+    __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+std::string errno_str(int err) {
+    return std::to_string(err) + ", " + strerror(err);
+}
+
+// Maximum number of messages to be sent by a single chain of linked SQEs.
+const size_t MAX_SEND_BATCH = 32;
+
+// Maximum number of provided receive buffers of each worker.
+const unsigned MAX_RECV_BUFFER_RING_SIZE = 32768;
+
+} // namespace
+
+// === Raw ring ===============================================================
+
+/**
+ * Minimal wrapper of an io_uring instance, based on raw system calls
+ * (liburing is not required). Not thread-safe.
+ */
+class uring_ring {
+public:
+    uring_ring()
+        : fd_(-1)
+        , sq_ring_(nullptr), sq_ring_size_(0)
+        , cq_ring_(nullptr), cq_ring_size_(0)
+        , sqes_(nullptr), sqes_size_(0)
+        , sq_head_(nullptr), sq_tail_(nullptr), sq_array_(nullptr)
+        , sq_mask_(0), sq_entries_(0), sqe_tail_(0)
+        , cq_head_(nullptr), cq_tail_(nullptr), cqes_(nullptr), cq_mask_(0)
+        {}
+
+    ~uring_ring() { close(); }
+
+    __nocopy__(uring_ring);
+
+public:
+    /**
+     * @return 0 on success, or negative errno.
+     */
+    int init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0x0, sizeof(params));
+        int fd = sys_io_uring_setup(entries, &params);
+        if (fd < 0) return -errno;
+        fd_ = fd;
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes +
+                        params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+
+        sq_ring_ = mmap( nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING );
+        if (sq_ring_ == MAP_FAILED) {
+            sq_ring_ = nullptr;
+            return close_on_error();
+        }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap( nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING );
+            if (cq_ring_ == MAP_FAILED) {
+                cq_ring_ = nullptr;
+                return close_on_error();
+            }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap( nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES );
+        if (sqes == MAP_FAILED) return close_on_error();
+        sqes_ = (io_uring_sqe*)sqes;
+
+        byte* sq = (byte*)sq_ring_;
+        sq_head_ = (unsigned*)(sq + params.sq_off.head);
+        sq_tail_ = (unsigned*)(sq + params.sq_off.tail);
+        sq_array_ = (unsigned*)(sq + params.sq_off.array);
+        sq_mask_ = *(unsigned*)(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sqe_tail_ = *sq_tail_;
+
+        byte* cq = (byte*)cq_ring_;
+        cq_head_ = (unsigned*)(cq + params.cq_off.head);
+        cq_tail_ = (unsigned*)(cq + params.cq_off.tail);
+        cqes_ = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        cq_mask_ = *(unsigned*)(cq + params.cq_off.ring_mask);
+        return 0;
+    }
+
+    void close() {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+        sqes_ = nullptr;
+        cq_ring_ = sq_ring_ = nullptr;
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    int fd() const { return fd_; }
+
+    /**
+     * Get an empty SQE, `nullptr` if the submission queue is full.
+     */
+    io_uring_sqe* get_sqe() {
+        unsigned head = load_acquire(sq_head_);
+        if (sqe_tail_ - head >= sq_entries_) return nullptr;
+        unsigned idx = sqe_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        memset(sqe, 0x0, sizeof(*sqe));
+        sq_array_[idx] = idx;
+        sqe_tail_++;
+        return sqe;
+    }
+
+    /**
+     * Submit all prepared SQEs, and wait for the given number of
+     * completions.
+     *
+     * @return Number of submitted SQEs, or negative errno.
+     */
+    int submit(unsigned wait_nr) {
+        store_release(sq_tail_, sqe_tail_);
+        unsigned to_submit = sqe_tail_ - load_acquire(sq_head_);
+        if (!to_submit && !wait_nr) return 0;
+        int ret = sys_io_uring_enter( fd_, to_submit, wait_nr,
+                                      wait_nr ? IORING_ENTER_GETEVENTS : 0 );
+        return (ret < 0) ? -errno : ret;
+    }
+
+    /**
+     * Copy available CQEs to `out` and mark them consumed.
+     *
+     * @return Number of CQEs.
+     */
+    size_t reap(io_uring_cqe* out, size_t max) {
+        size_t num = 0;
+        unsigned head = *cq_head_;
+        unsigned tail = load_acquire(cq_tail_);
+        while (head != tail && num < max) {
+            out[num++] = cqes_[head & cq_mask_];
+            head++;
+        }
+        store_release(cq_head_, head);
+        return num;
+    }
+
+private:
+    int close_on_error() {
+        int err = -errno;
+        close();
+        return err;
+    }
+
+    int fd_;
+    void* sq_ring_;
+    size_t sq_ring_size_;
+    void* cq_ring_;
+    size_t cq_ring_size_;
+    io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_array_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    // Tail of the prepared (not yet published) SQEs.
+    unsigned sqe_tail_;
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    io_uring_cqe* cqes_;
+    unsigned cq_mask_;
+};
+
+// === Provided buffers =======================================================
+
+/**
+ * Ring of receive buffers provided to the kernel, shared by all
+ * connections of a worker. A multishot receive picks a buffer from it
+ * for each completion, and the buffer is given back once its data
+ * is consumed. Not thread-safe.
+ */
+class uring_buf_ring {
+public:
+    uring_buf_ring()
+        : ring_fd_(-1)
+        , ring_mem_(nullptr), ring_mem_size_(0)
+        , tail_ptr_(nullptr), tail_(0), mask_(0)
+        , buf_size_(0), bgid_(0)
+        {}
+
+    ~uring_buf_ring() { close(); }
+
+    __nocopy__(uring_buf_ring);
+
+public:
+#ifdef URING_RECV_MULTISHOT
+    /**
+     * @param entries Number of buffers, should be a power of 2.
+     * @return 0 on success, or negative errno.
+     */
+    int init(int ring_fd, unsigned entries, size_t buf_size, uint16_t bgid) {
+        ring_mem_size_ = entries * sizeof(io_uring_buf);
+        void* mem = mmap( nullptr, ring_mem_size_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if (mem == MAP_FAILED) return -errno;
+
+        io_uring_buf_reg reg;
+        memset(&reg, 0x0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)mem;
+        reg.ring_entries = entries;
+        reg.bgid = bgid;
+        if (sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            int err = -errno;
+            munmap(mem, ring_mem_size_);
+            return err;
+        }
+
+        ring_fd_ = ring_fd;
+        ring_mem_ = mem;
+        // The tail of the ring overlays `resv` of the first entry.
+        tail_ptr_ = (uint16_t*)( (byte*)mem + offsetof(io_uring_buf, resv) );
+        tail_ = 0;
+        mask_ = entries - 1;
+        buf_size_ = buf_size;
+        bgid_ = bgid;
+        bufs_.resize(entries * buf_size);
+        for (unsigned ii = 0; ii < entries; ++ii) add((uint16_t)ii);
+        store_release(tail_ptr_, tail_);
+        return 0;
+    }
+
+    void close() {
+        if (!ring_mem_) return;
+        io_uring_buf_reg reg;
+        memset(&reg, 0x0, sizeof(reg));
+        reg.bgid = bgid_;
+        sys_io_uring_register(ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(ring_mem_, ring_mem_size_);
+        ring_mem_ = nullptr;
+        bufs_.clear();
+    }
+
+    // Give the buffer back to the kernel.
+    void put(uint16_t bid) {
+        add(bid);
+        store_release(tail_ptr_, tail_);
+    }
+#else
+    int init(int, unsigned, size_t, uint16_t) { return -EOPNOTSUPP; }
+
+    void close() {}
+
+    void put(uint16_t) {}
+#endif
+
+    bool valid() const { return ring_mem_ != nullptr; }
+
+    uint16_t bgid() const { return bgid_; }
+
+    const byte* get(uint16_t bid) const { return bufs_.data() + bid * buf_size_; }
+
+private:
+#ifdef URING_RECV_MULTISHOT
+    void add(uint16_t bid) {
+        // Should not touch `resv`, which may be the tail.
+        io_uring_buf* entry = (io_uring_buf*)ring_mem_ + (tail_ & mask_);
+        entry->addr = (uint64_t)(uintptr_t)(bufs_.data() + bid * buf_size_);
+        entry->len = buf_size_;
+        entry->bid = bid;
+        tail_++;
+    }
+#endif
+
+    int ring_fd_;
+    void* ring_mem_;
+    size_t ring_mem_size_;
+    uint16_t* tail_ptr_;
+    uint16_t tail_;
+    unsigned mask_;
+    size_t buf_size_;
+    uint16_t bgid_;
+    std::vector<byte> bufs_;
+};
+
+// === Worker =================================================================
+
+using uring_op_cb = std::function<void(int32_t res, uint32_t flags)>;
+
+/**
+ * Submitted operation, its address is the `user_data` of the SQE.
+ * It is freed once its last CQE (i.e., without `IORING_CQE_F_MORE`)
+ * is handled.
+ */
+struct uring_op {
+    uring_op(uring_op_cb&& cb) : cb_(std::move(cb)) {
+        memset(&ts_, 0x0, sizeof(ts_));
+    }
+    uring_op_cb cb_;
+    __kernel_timespec ts_;
+};
+
+class uring_conn;
+class uring_service_impl;
+
+/**
+ * I/O thread and its ring. Connections belonging to a worker are
+ * touched only by its thread; other threads hand over work via `post()`.
+ */
+class uring_worker {
+public:
+    uring_worker(uring_service_impl* impl, size_t id, ptr<logger> l);
+
+    ~uring_worker();
+
+    __nocopy__(uring_worker);
+
+public:
+    void start();
+
+    void stop();
+
+    /**
+     * Run the given task in the I/O thread.
+     *
+     * @return `false` if the worker is already stopped.
+     */
+    bool post(std::function<void()>&& task);
+
+    bool in_loop() const { return std::this_thread::get_id() == thread_id_.load(); }
+
+    // === Below functions should be called in the I/O thread. ===
+
+    bool stopping() const { return stopping_; }
+
+    // Get an empty SQE, submitting the prepared ones if the queue is full.
+    io_uring_sqe* get_sqe();
+
+    // Set the callback of the given SQE.
+    uring_op* attach(io_uring_sqe* sqe, uring_op_cb&& cb);
+
+    // Cancel all operations on the given file descriptor.
+    void cancel_fd(int fd);
+
+    // Cancel the given (multishot) operation.
+    void cancel_op(uring_op* op);
+
+    // `nullptr` if multishot receive is not used.
+    uring_buf_ring* get_buf_ring() { return buf_ring_.valid() ? &buf_ring_ : nullptr; }
+
+    uring_op* add_timer(uint64_t timeout_ms, uring_op_cb&& cb);
+
+    void remove_timer(uring_op* timer);
+
+    void add_conn(const ptr<uring_conn>& conn);
+
+    void remove_conn(uring_conn* conn);
+
+    uring_service_impl* get_impl() const { return impl_; }
+
+private:
+    void init_buf_ring();
+
+    void loop();
+
+    void arm_wakeup();
+
+    void run_tasks();
+
+    void cleanup();
+
+    uring_service_impl* impl_;
+    size_t id_;
+    uring_ring ring_;
+    uring_buf_ring buf_ring_;
+
+    int wakeup_fd_;
+    uint64_t wakeup_val_;
+    std::atomic<bool> wakeup_pending_;
+
+    std::mutex tasks_lock_;
+    std::vector< std::function<void()> > tasks_;
+    bool accepting_tasks_;
+
+    bool stopping_;
+    ptr<nuraft_thread> thread_;
+    std::atomic<std::thread::id> thread_id_;
+
+    std::unordered_set<uring_op*> ops_;
+    std::unordered_map< uring_conn*, ptr<uring_conn> > conns_;
+
+    ptr<logger> l_;
+};
+
+class uring_service_impl {
+public:
+    uring_service_impl(const uring_service::options& opt, ptr<logger> l)
+        : opt_(opt)
+        , next_worker_(0)
+        , client_id_counter_(1)
+        , session_id_counter_(1)
+        , stopped_(false)
+        , l_(l)
+    {
+        size_t num_workers = std::max((size_t)1, opt_.thread_pool_size_);
+        for (size_t ii = 0; ii < num_workers; ++ii) {
+            workers_.emplace_back(new uring_worker(this, ii, l_));
+        }
+        for (auto& entry: workers_) {
+            entry->start();
+        }
+    }
+
+    ~uring_service_impl() {
+        stop();
+    }
+
+    __nocopy__(uring_service_impl);
+
+public:
+    void stop() {
+        bool exp = false;
+        if (!stopped_.compare_exchange_strong(exp, true)) return;
+        for (auto& entry: workers_) {
+            entry->stop();
+        }
+    }
+
+    const uring_service::options& get_options() const { return opt_; }
+
+    uring_worker* get_worker(size_t idx) const { return workers_[idx].get(); }
+
+    uring_worker* next_worker() {
+        return workers_[next_worker_.fetch_add(1) % workers_.size()].get();
+    }
+
+    uint64_t new_client_id() { return client_id_counter_.fetch_add(1); }
+
+    uint64_t new_session_id() { return session_id_counter_.fetch_add(1); }
+
+private:
+    uring_service::options opt_;
+    std::vector< std::unique_ptr<uring_worker> > workers_;
+    std::atomic<size_t> next_worker_;
+    std::atomic<uint64_t> client_id_counter_;
+    std::atomic<uint64_t> session_id_counter_;
+    std::atomic<bool> stopped_;
+    ptr<logger> l_;
+};
+
+// === Connection =============================================================
+
+/**
+ * Socket served by a worker. It assembles incoming messages
+ * (header followed by body) and sends outgoing messages in order.
+ * Subclasses decide what the messages are.
+ */
+class uring_conn : public std::enable_shared_from_this<uring_conn> {
+public:
+    uring_conn(uring_worker* worker, int fd, size_t hdr_size, ptr<logger> l)
+        : worker_(worker)
+        , fd_(fd)
+        , connected_(fd >= 0)
+        , closing_(false)
+        , recv_armed_(false)
+        , recv_direct_(false)
+        , recv_multishot_(false)
+        , recv_canceling_(false)
+        , recv_no_bufs_(false)
+        , recv_op_(nullptr)
+        , ops_in_flight_(0)
+        , recv_buf_size_( std::max( hdr_size,
+                                    worker->get_impl()->get_options().recv_buffer_size_ ) )
+        , hdr_(buffer::alloc(hdr_size))
+        , hdr_got_(0)
+        , body_got_(0)
+        , recv_buf_pool_(worker->get_impl()->get_options().recv_buffer_pool_size_)
+        , batch_size_(0)
+        , batch_pending_(0)
+        , batch_err_(0)
+        , close_after_sends_(false)
+        , l_(l)
+        {}
+
+    virtual ~uring_conn() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    __nocopy__(uring_conn);
+
+public:
+    uring_worker* get_worker() const { return worker_; }
+
+    // === Below functions should be called in the I/O thread. ===
+
+    void start_recv() {
+        // If the rest of the current body does not fit into the receive
+        // buffer, read it directly into the body to avoid an extra copy.
+        recv_direct_ = need_direct_recv();
+        uring_buf_ring* buf_ring = worker_->get_buf_ring();
+        recv_multishot_ = !recv_direct_ && buf_ring && !recv_no_bufs_;
+        recv_canceling_ = false;
+        recv_no_bufs_ = false;
+
+        io_uring_sqe* sqe = worker_->get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd_;
+        if (recv_direct_) {
+            sqe->addr = (uint64_t)(uintptr_t)(body_->data_begin() + body_got_);
+            sqe->len = body_->size() - body_got_;
+        } else if (recv_multishot_) {
+#ifdef URING_RECV_MULTISHOT
+            // Stays armed until canceled, or it runs out of buffers.
+            // Each completion picks a buffer of the worker.
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = buf_ring->bgid();
+#endif
+        } else {
+            // Multishot receive is not available, or all the worker's
+            // buffers are in use: use the connection's own buffer.
+            if (recv_buf_.empty()) recv_buf_.resize(recv_buf_size_);
+            sqe->addr = (uint64_t)(uintptr_t)recv_buf_.data();
+            sqe->len = recv_buf_.size();
+        }
+        ptr<uring_conn> self = shared_from_this();
+        recv_op_ = worker_->attach( sqe, [self](int32_t res, uint32_t flags) {
+            self->on_recv(res, flags);
+        } );
+        ops_in_flight_++;
+        recv_armed_ = true;
+    }
+
+    void send(const ptr<buffer>& buf) {
+        if (closing_) return;
+        buf->pos(0);
+        send_q_.push_back( send_item(buf) );
+        if (connected_ && !batch_size_) flush_sends();
+    }
+
+    // Close the connection once all queued messages are sent.
+    void close_after_sends() {
+        close_after_sends_ = true;
+        if (!batch_size_ && send_q_.empty()) close("closed after sending responses");
+    }
+
+    void close(const std::string& reason) {
+        if (closing_) return;
+        closing_ = true;
+        if (fd_ >= 0) {
+            worker_->cancel_fd(fd_);
+            ::shutdown(fd_, SHUT_RDWR);
+        }
+        on_close(reason);
+        release_if_done();
+    }
+
+    // Called by the worker when it stops, no more CQE will come.
+    void terminate() {
+        ops_in_flight_ = 0;
+        if (!closing_) {
+            closing_ = true;
+            on_close("service stopped");
+        }
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+protected:
+    /**
+     * Called when a header is received.
+     *
+     * @return Size of the following body, or negative value
+     *         if the connection is closed.
+     */
+    virtual int64_t on_header(buffer& hdr) = 0;
+
+    // Called when a message is received. `body` can be `nullptr`.
+    virtual void on_message(const ptr<buffer>& body) = 0;
+
+    // Called when a message is completely sent.
+    virtual void on_sent() {}
+
+    // Called once when the connection is closed.
+    virtual void on_close(const std::string& reason) = 0;
+
+    void set_connected(int fd) {
+        fd_ = fd;
+        connected_ = true;
+        start_recv();
+        if (!send_q_.empty()) flush_sends();
+    }
+
+    struct send_item {
+        send_item(const ptr<buffer>& buf) : buf_(buf), offset_(0) {}
+        ptr<buffer> buf_;
+        size_t offset_;
+    };
+
+    void on_recv(int32_t res, uint32_t flags) {
+        if ( !(flags & IORING_CQE_F_MORE) ) {
+            recv_armed_ = false;
+            recv_op_ = nullptr;
+            ops_in_flight_--;
+        }
+        uring_buf_ring* buf_ring = nullptr;
+        uint16_t bid = 0;
+        if (flags & IORING_CQE_F_BUFFER) {
+            buf_ring = worker_->get_buf_ring();
+            bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        }
+
+        if (res > 0 && !closing_) {
+            if (recv_direct_) {
+                body_got_ += res;
+                if (body_got_ == body_->size()) deliver_body();
+            } else if (buf_ring) {
+                consume(buf_ring->get(bid), res);
+            } else {
+                consume(recv_buf_.data(), res);
+            }
+        } else if (res == 0) {
+            close("connection closed by peer");
+        } else if (res == -ENOBUFS) {
+            recv_no_bufs_ = true;
+        } else if (res < 0 && res != -ECANCELED) {
+            close("receive failed: " + errno_str(-res));
+        }
+        // Data has been copied out, the buffer can be reused.
+        if (buf_ring) buf_ring->put(bid);
+
+        if (closing_) {
+            release_if_done();
+        } else if (!recv_armed_) {
+            start_recv();
+        } else if (recv_multishot_ && !recv_canceling_ && need_direct_recv()) {
+            // The rest of a big body will be read directly into it,
+            // once the multishot receive is finished.
+            recv_canceling_ = true;
+            worker_->cancel_op(recv_op_);
+        }
+    }
+
+    bool need_direct_recv() const {
+        return body_ && body_->size() - body_got_ >= recv_buf_size_;
+    }
+
+    void consume(const byte* data, size_t len) {
+        while (len && !closing_) {
+            if (!body_) {
+                size_t hdr_size = hdr_->size();
+                size_t to_copy = std::min(len, hdr_size - hdr_got_);
+                memcpy(hdr_->data_begin() + hdr_got_, data, to_copy);
+                hdr_got_ += to_copy;
+                data += to_copy;
+                len -= to_copy;
+                if (hdr_got_ < hdr_size) break;
+
+                hdr_->pos(0);
+                int64_t body_size = on_header(*hdr_);
+                if (body_size < 0) return;
+                if (body_size == 0) {
+                    hdr_got_ = 0;
+                    on_message(nullptr);
+                    continue;
+                }
+                body_ = recv_buf_pool_.acquire(body_size);
+                body_got_ = 0;
+
+            } else {
+                size_t to_copy = std::min(len, body_->size() - body_got_);
+                memcpy(body_->data_begin() + body_got_, data, to_copy);
+                body_got_ += to_copy;
+                data += to_copy;
+                len -= to_copy;
+                if (body_got_ < body_->size()) break;
+                deliver_body();
+            }
+        }
+    }
+
+    void deliver_body() {
+        ptr<buffer> body = std::move(body_);
+        body_.reset();
+        hdr_got_ = 0;
+        on_message(body);
+    }
+
+    // Submit queued messages as a chain of linked sends,
+    // so that they go out in order with a single system call.
+    void flush_sends() {
+        size_t num = std::min(send_q_.size(), MAX_SEND_BATCH);
+        batch_size_ = batch_pending_ = num;
+        batch_err_ = 0;
+        ptr<uring_conn> self = shared_from_this();
+        for (size_t ii = 0; ii < num; ++ii) {
+            send_item& item = send_q_[ii];
+            io_uring_sqe* sqe = worker_->get_sqe();
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = fd_;
+            sqe->addr = (uint64_t)(uintptr_t)(item.buf_->data_begin() + item.offset_);
+            sqe->len = item.buf_->size() - item.offset_;
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            if (ii + 1 < num) sqe->flags = IOSQE_IO_LINK;
+            worker_->attach( sqe, [self, ii](int32_t res, uint32_t) {
+                self->on_send(ii, res);
+            } );
+            ops_in_flight_++;
+        }
+    }
+
+    void on_send(size_t idx, int32_t res) {
+        ops_in_flight_--;
+        batch_pending_--;
+        if (res >= 0) {
+            send_q_[idx].offset_ += res;
+        } else if (res != -ECANCELED) {
+            // If a send is short or failed, the following ones in the
+            // chain are canceled. They will be submitted again.
+            batch_err_ = res;
+        }
+        if (batch_pending_) return;
+
+        size_t num_done = 0;
+        while ( num_done < batch_size_ &&
+                !send_q_.empty() &&
+                send_q_.front().offset_ == send_q_.front().buf_->size() ) {
+            send_q_.pop_front();
+            num_done++;
+            if (!closing_) on_sent();
+        }
+        batch_size_ = 0;
+
+        if (closing_) {
+            release_if_done();
+        } else if (batch_err_) {
+            close("send failed: " + errno_str(-batch_err_));
+        } else if (!send_q_.empty()) {
+            flush_sends();
+        } else if (close_after_sends_) {
+            close("closed after sending responses");
+        }
+    }
+
+    void release_if_done() {
+        if (!closing_ || ops_in_flight_) return;
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        // May destroy this instance if there is no other reference.
+        ptr<uring_conn> self = shared_from_this();
+        worker_->remove_conn(this);
+    }
+
+    uring_worker* worker_;
+    int fd_;
+    bool connected_;
+    bool closing_;
+    bool recv_armed_;
+    bool recv_direct_;
+    bool recv_multishot_;
+    bool recv_canceling_;
+    bool recv_no_bufs_;
+    uring_op* recv_op_;
+    size_t ops_in_flight_;
+
+    // Allocated only if multishot receive is not used.
+    size_t recv_buf_size_;
+    std::vector<byte> recv_buf_;
+    ptr<buffer> hdr_;
+    size_t hdr_got_;
+    ptr<buffer> body_;
+    size_t body_got_;
+    buffer_pool recv_buf_pool_;
+
+    std::deque<send_item> send_q_;
+    size_t batch_size_;
+    size_t batch_pending_;
+    int32_t batch_err_;
+    bool close_after_sends_;
+
+    ptr<logger> l_;
+};
+
+// === Worker implementation ==================================================
+
+uring_worker::uring_worker(uring_service_impl* impl, size_t id, ptr<logger> l)
+    : impl_(impl)
+    , id_(id)
+    , wakeup_fd_(-1)
+    , wakeup_val_(0)
+    , wakeup_pending_(false)
+    , accepting_tasks_(true)
+    , stopping_(false)
+    , l_(l)
+{
+    const uring_service::options& opt = impl_->get_options();
+    int ret = ring_.init(std::max((size_t)8, opt.queue_depth_));
+    if (ret < 0) {
+        throw std::runtime_error("io_uring_setup failed: " + errno_str(-ret));
+    }
+    init_buf_ring();
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+        throw std::runtime_error("eventfd failed: " + errno_str(errno));
+    }
+}
+
+void uring_worker::init_buf_ring() {
+    const uring_service::options& opt = impl_->get_options();
+    if (!opt.recv_buffer_ring_size_ || !opt.recv_buffer_size_) return;
+    // Multishot receive requires Linux 6.0.
+    if (!kernel_version_at_least(6, 0)) {
+        p_in("uring worker %zu: multishot receive is not supported", id_);
+        return;
+    }
+
+    unsigned entries = 1;
+    while ( entries < opt.recv_buffer_ring_size_ &&
+            entries < MAX_RECV_BUFFER_RING_SIZE ) {
+        entries <<= 1;
+    }
+    int ret = buf_ring_.init(ring_.fd(), entries, opt.recv_buffer_size_, 0);
+    if (ret < 0) {
+        p_wn( "uring worker %zu: failed to register receive buffers, "
+              "multishot receive is disabled: %s",
+              id_, errno_str(-ret).c_str() );
+        return;
+    }
+    p_in( "uring worker %zu: multishot receive with %u buffers",
+          id_, entries );
+}
+
+uring_worker::~uring_worker() {
+    stop();
+    if (wakeup_fd_ >= 0) ::close(wakeup_fd_);
+}
+
+void uring_worker::start() {
+    thread_ = cs_new<nuraft_thread>( std::bind(&uring_worker::loop, this) );
+}
+
+void uring_worker::stop() {
+    post( [this]() { stopping_ = true; } );
+    if (thread_ && thread_->joinable() && !in_loop()) {
+        thread_->join();
+    }
+}
+
+bool uring_worker::post(std::function<void()>&& task) {
+    {
+        std::lock_guard<std::mutex> l(tasks_lock_);
+        if (!accepting_tasks_) return false;
+        tasks_.push_back(std::move(task));
+    }
+    if (!wakeup_pending_.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t ret = ::write(wakeup_fd_, &one, sizeof(one));
+        (void)ret;
+    }
+    return true;
+}
+
+io_uring_sqe* uring_worker::get_sqe() {
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (!sqe) {
+        ring_.submit(0);
+        sqe = ring_.get_sqe();
+    }
+    if (!sqe) {
+        throw std::runtime_error("io_uring submission queue is full");
+    }
+    return sqe;
+}
+
+uring_op* uring_worker::attach(io_uring_sqe* sqe, uring_op_cb&& cb) {
+    uring_op* op = new uring_op(std::move(cb));
+    ops_.insert(op);
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    return op;
+}
+
+void uring_worker::cancel_fd(int fd) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+}
+
+void uring_worker::cancel_op(uring_op* op) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)op;
+}
+
+uring_op* uring_worker::add_timer(uint64_t timeout_ms, uring_op_cb&& cb) {
+    io_uring_sqe* sqe = get_sqe();
+    uring_op* op = attach(sqe, std::move(cb));
+    op->ts_.tv_sec = timeout_ms / 1000;
+    op->ts_.tv_nsec = (timeout_ms % 1000) * 1000000;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&op->ts_;
+    sqe->len = 1;
+    return op;
+}
+
+void uring_worker::remove_timer(uring_op* timer) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)timer;
+}
+
+void uring_worker::add_conn(const ptr<uring_conn>& conn) {
+    conns_[conn.get()] = conn;
+}
+
+void uring_worker::remove_conn(uring_conn* conn) {
+    conns_.erase(conn);
+}
+
+void uring_worker::arm_wakeup() {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup_fd_;
+    sqe->addr = (uint64_t)(uintptr_t)&wakeup_val_;
+    sqe->len = sizeof(wakeup_val_);
+    attach( sqe, [this](int32_t, uint32_t) {
+        run_tasks();
+        if (!stopping_) arm_wakeup();
+    } );
+}
+
+void uring_worker::run_tasks() {
+    // Should be reset before taking the tasks, so that any task
+    // posted after that will wake up the loop again.
+    wakeup_pending_ = false;
+    std::vector< std::function<void()> > tasks;
+    {
+        std::lock_guard<std::mutex> l(tasks_lock_);
+        tasks.swap(tasks_);
+    }
+    for (auto& task: tasks) {
+        try {
+            task();
+        } catch (std::exception& ee) {
+            p_er("uring worker %zu got exception from task: %s", id_, ee.what());
+        }
+    }
+}
+
+void uring_worker::loop() {
+    thread_id_ = std::this_thread::get_id();
+    std::string thread_name = "nuraft_u_" + std::to_string(id_);
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+#endif
+    p_in("spawned io_uring worker thread %s", thread_name.c_str());
+
+    const size_t MAX_CQES = 64;
+    io_uring_cqe cqes[MAX_CQES];
+
+    arm_wakeup();
+    while (!stopping_) {
+        int ret = ring_.submit(1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            p_er("io_uring_enter failed: %s", errno_str(-ret).c_str());
+        }
+
+        size_t num = 0;
+        while ( (num = ring_.reap(cqes, MAX_CQES)) ) {
+            for (size_t ii = 0; ii < num; ++ii) {
+                uring_op* op = (uring_op*)(uintptr_t)cqes[ii].user_data;
+                if (!op) continue;
+                try {
+                    op->cb_(cqes[ii].res, cqes[ii].flags);
+                } catch (std::exception& ee) {
+                    p_er("uring worker %zu got exception: %s", id_, ee.what());
+                }
+                if ( !(cqes[ii].flags & IORING_CQE_F_MORE) ) {
+                    ops_.erase(op);
+                    delete op;
+                }
+            }
+        }
+    }
+
+    cleanup();
+    p_in("end of io_uring worker thread %s", thread_name.c_str());
+}
+
+void uring_worker::cleanup() {
+    {
+        std::lock_guard<std::mutex> l(tasks_lock_);
+        accepting_tasks_ = false;
+    }
+    // Run the remaining tasks, e.g., closing connections.
+    run_tasks();
+
+    std::unordered_map< uring_conn*, ptr<uring_conn> > conns;
+    conns.swap(conns_);
+    for (auto& entry: conns) {
+        entry.second->terminate();
+    }
+    conns.clear();
+
+    // Operations hold references to connections, free them before the ring.
+    for (uring_op* op: ops_) delete op;
+    ops_.clear();
+    buf_ring_.close();
+    ring_.close();
+}
+
+// === Server side ============================================================
+
+class uring_rpc_listener;
+
+class uring_session
+    : public uring_conn
+    , public raft_server_handler
+{
+public:
+    uring_session(uring_worker* worker,
+                  int fd,
+                  uint64_t session_id,
+                  const std::string& address,
+                  uint32_t port,
+                  ptr<msg_handler> handler,
+                  std::weak_ptr<uring_rpc_listener> listener,
+                  ptr<logger> l)
+        : uring_conn(worker, fd, RPC_REQ_HEADER_SIZE, l)
+        , impl_(worker->get_impl())
+        , session_id_(session_id)
+        , address_(address)
+        , port_(port)
+        , handler_(handler)
+        , listener_(listener)
+        , src_id_(-1)
+        , is_leader_(false)
+        , peer_supports_crc32c_(false)
+    {
+        p_in( "session %" PRIu64 " got connection from %s:%u (io_uring)",
+              session_id_, address_.c_str(), port_ );
+    }
+
+    uint64_t get_id() const { return session_id_; }
+
+protected:
+    struct pending_resp {
+        pending_resp(ptr<req_msg> req)
+            : req_(req), ready_(false), close_after_(false)
+            {}
+        ptr<req_msg> req_;
+        ptr<resp_msg> resp_;
+        bool ready_;
+        bool close_after_;
+    };
+
+    int64_t on_header(buffer& hdr) override {
+        std::string err_msg;
+        if (!rpc_wire::decode_req_header(hdr, req_hdr_, err_msg)) {
+            p_er("session %" PRIu64 ": %s", session_id_, err_msg.c_str());
+            close(err_msg);
+            return -1;
+        }
+        if ( (req_hdr_.flags_ & CRC32C_SUPPORTED) &&
+             impl_->get_options().use_crc32c_ &&
+             !peer_supports_crc32c_ ) {
+            p_in( "session %" PRIu64 ": peer supports CRC-32C, switch to it (%s)",
+                  session_id_, crc32c_impl_name() );
+            peer_supports_crc32c_ = true;
+        }
+        return req_hdr_.data_size_;
+    }
+
+    void on_message(const ptr<buffer>& body) override {
+        if (!handler_ || close_after_sends_) return;
+
+        std::string err_msg;
+        ptr<req_msg> req =
+            rpc_wire::decode_req( req_hdr_, body,
+                                  impl_->get_options().log_entry_slices_,
+                                  err_msg );
+        if (!req) {
+            p_er("session %" PRIu64 ": %s", session_id_, err_msg.c_str());
+            close(err_msg);
+            return;
+        }
+        update_leader_status(req->get_type());
+
+        const bool close_on_error_req = (req_hdr_.flags_ & CLOSE_ON_ERROR_WIRE);
+
+        // === RAFT server processes the request here. ===
+        ptr<resp_msg> resp = raft_server_handler::process_req(handler_.get(), *req);
+        if (!resp) {
+            p_wn("no response is returned from raft message handler");
+            close("no response");
+            return;
+        }
+
+        ptr<pending_resp> entry = cs_new<pending_resp>(req);
+        pending_resps_.push_back(entry);
+
+        if (resp->has_async_cb()) {
+            // Response will be ready later, it will be sent in order
+            // with other responses.
+            entry->resp_ = resp;
+            ptr<uring_conn> self = shared_from_this();
+            ptr< cmd_result< ptr<buffer> > > ret = resp->call_async_cb();
+            ret->when_ready(
+                [self, entry, close_on_error_req]
+                ( cmd_result<ptr<buffer>, ptr<std::exception>>& res,
+                  ptr<std::exception>& exp ) {
+                    resp_msg* resp = entry->resp_.get();
+                    resp->set_ctx(res.get());
+                    cmd_result_code code = res.get_result_code();
+                    if (code != cmd_result_code::OK) {
+                        resp->unaccept();
+                        resp->set_result_code(code);
+                    }
+                    entry->close_after_ = close_on_error_req &&
+                                          ( !resp->get_accepted() ||
+                                            resp->get_result_code() !=
+                                                cmd_result_code::OK );
+                    self->get_worker()->post( [self, entry]() {
+                        entry->ready_ = true;
+                        static_cast<uring_session*>(self.get())->send_resps();
+                    } );
+                    // This is needed to avoid circular reference.
+                    res.reset();
+                } );
+            return;
+        }
+
+        if (resp->has_cb()) {
+            // If callback function exists, get new response message.
+            resp = resp->call_cb(resp);
+        }
+        entry->resp_ = resp;
+        entry->close_after_ = close_on_error_req &&
+                              ( !resp->get_accepted() ||
+                                resp->get_result_code() != cmd_result_code::OK );
+        entry->ready_ = true;
+        send_resps();
+    }
+
+    void on_close(const std::string& reason) override {
+        p_in( "session %" PRIu64 " is closed: %s",
+              session_id_, reason.c_str() );
+        if (handler_) {
+            invoke_connection_callback(false);
+            handler_.reset();
+        }
+        pending_resps_.clear();
+        remove_from_listener();
+    }
+
+private:
+    void send_resps() {
+        while ( !closing_ &&
+                !pending_resps_.empty() &&
+                pending_resps_.front()->ready_ ) {
+            ptr<pending_resp> entry = pending_resps_.front();
+            pending_resps_.pop_front();
+
+            uint32_t flags = 0x0;
+            if (impl_->get_options().use_crc32c_) {
+                flags |= CRC32C_SUPPORTED;
+                if (peer_supports_crc32c_) flags |= CRC32C_IN_USE;
+            }
+            send( rpc_wire::encode_resp(*entry->req_, *entry->resp_, flags) );
+
+            if (entry->close_after_) {
+                p_in("session %" PRIu64 " CLOSE_ON_ERROR: close after resp",
+                     session_id_);
+                pending_resps_.clear();
+                close_after_sends();
+            }
+        }
+    }
+
+    void update_leader_status(msg_type t) {
+        if (src_id_ == -1) {
+            // It means this is the first message on this session.
+            // Invoke callback function of new connection.
+            src_id_ = req_hdr_.src_;
+            invoke_connection_callback(true);
+
+        } else if (is_leader_ && src_id_ != handler_->get_leader()) {
+            // Leader has been changed without closing session.
+            is_leader_ = false;
+        }
+
+        if (!is_leader_) {
+            // Only leader can send below message types.
+            if ( t == msg_type::append_entries_request ||
+                 t == msg_type::sync_log_request ||
+                 t == msg_type::join_cluster_request ||
+                 t == msg_type::leave_cluster_request ||
+                 t == msg_type::install_snapshot_request ||
+                 t == msg_type::priority_change_request ||
+                 t == msg_type::custom_notification_request ) {
+                is_leader_ = true;
+                cb_func::ConnectionArgs
+                    args( session_id_, address_, port_, src_id_, is_leader_ );
+                cb_func::Param cb_param( handler_->get_id(),
+                                         handler_->get_leader(),
+                                         -1,
+                                         &args );
+                handler_->invoke_callback( cb_func::NewSessionFromLeader,
+                                           &cb_param );
+            }
+        }
+    }
+
+    void invoke_connection_callback(bool is_open) {
+        if (is_leader_ && src_id_ != handler_->get_leader()) {
+            is_leader_ = false;
+        }
+        cb_func::ConnectionArgs
+            args( session_id_, address_, port_, src_id_, is_leader_ );
+        cb_func::Param cb_param( handler_->get_id(),
+                                 handler_->get_leader(),
+                                 -1,
+                                 &args );
+        handler_->invoke_callback
+            ( is_open ? cb_func::ConnectionOpened : cb_func::ConnectionClosed,
+              &cb_param );
+    }
+
+    void remove_from_listener();
+
+    uring_service_impl* impl_;
+    uint64_t session_id_;
+    std::string address_;
+    uint32_t port_;
+    ptr<msg_handler> handler_;
+    std::weak_ptr<uring_rpc_listener> listener_;
+    int32 src_id_;
+    bool is_leader_;
+    bool peer_supports_crc32c_;
+    rpc_req_header req_hdr_;
+    std::deque< ptr<pending_resp> > pending_resps_;
+};
+
+class uring_rpc_listener
+    : public rpc_listener
+    , public std::enable_shared_from_this<uring_rpc_listener>
+{
+public:
+    uring_rpc_listener(uring_service_impl* impl, ushort port, ptr<logger> l)
+        : impl_(impl)
+        , worker_(impl->get_worker(0))
+        , fd_(-1)
+        , accepting_(false)
+        , stopped_(false)
+        , closed_(false)
+        , l_(l)
+    {
+        bool ipv6 = true;
+        fd_ = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) {
+            ipv6 = false;
+            fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        }
+        if (fd_ < 0) {
+            throw std::runtime_error("socket failed: " + errno_str(errno));
+        }
+        int one = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        int ret = 0;
+        if (ipv6) {
+            int zero = 0;
+            setsockopt(fd_, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+            sockaddr_in6 addr;
+            memset(&addr, 0x0, sizeof(addr));
+            addr.sin6_family = AF_INET6;
+            addr.sin6_addr = in6addr_any;
+            addr.sin6_port = htons(port);
+            ret = ::bind(fd_, (sockaddr*)&addr, sizeof(addr));
+        } else {
+            sockaddr_in addr;
+            memset(&addr, 0x0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(port);
+            ret = ::bind(fd_, (sockaddr*)&addr, sizeof(addr));
+        }
+        if (ret == 0) ret = ::listen(fd_, SOMAXCONN);
+        if (ret < 0) {
+            int err = errno;
+            ::close(fd_);
+            fd_ = -1;
+            throw std::runtime_error( "failed to listen on port " +
+                                      std::to_string(port) + ": " +
+                                      errno_str(err) );
+        }
+        p_in("Raft io_uring listener initiated on port %u", port);
+    }
+
+    ~uring_rpc_listener() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    __nocopy__(uring_rpc_listener);
+
+public:
+    virtual void listen(ptr<msg_handler>& handler) override {
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (stopped_) return;
+            handler_ = handler;
+        }
+        ptr<uring_rpc_listener> self = shared_from_this();
+        worker_->post( [self]() { self->start_accept(); } );
+    }
+
+    virtual void stop() override {
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (stopped_) return;
+            stopped_ = true;
+        }
+        ptr<uring_rpc_listener> self = shared_from_this();
+        bool posted = worker_->post( [self]() {
+            if (self->accepting_) {
+                self->worker_->cancel_fd(self->fd_);
+            } else {
+                self->close_socket();
+            }
+        } );
+        if (!posted) {
+            close_socket();
+            return;
+        }
+        if (worker_->in_loop()) return;
+
+        // Wait until the port is released, so that it can be reused
+        // right after this function returns.
+        std::unique_lock<std::mutex> l(lock_);
+        cv_.wait_for( l, std::chrono::seconds(3),
+                      [this]() { return closed_; } );
+    }
+
+    virtual void shutdown() override {
+        std::set< ptr<uring_session> > sessions;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            sessions.swap(sessions_);
+            handler_.reset();
+        }
+        for (const ptr<uring_session>& ss: sessions) {
+            ptr<uring_session> s = ss;
+            s->get_worker()->post( [s]() { s->close("listener shutdown"); } );
+        }
+    }
+
+    void remove_session(uring_session* session) {
+        std::lock_guard<std::mutex> l(lock_);
+        for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+            if (it->get() == session) {
+                sessions_.erase(it);
+                break;
+            }
+        }
+    }
+
+private:
+    void start_accept() {
+        if (accepting_ || fd_ < 0) return;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (stopped_) return;
+        }
+        io_uring_sqe* sqe = worker_->get_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd_;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        ptr<uring_rpc_listener> self = shared_from_this();
+        worker_->attach( sqe, [self](int32_t res, uint32_t flags) {
+            self->on_accept(res, flags);
+        } );
+        accepting_ = true;
+    }
+
+    void on_accept(int32_t res, uint32_t flags) {
+        if (res >= 0) {
+            handle_new_conn(res);
+        } else if (res != -ECANCELED) {
+            p_er("failed to accept a rpc connection: %s", errno_str(-res).c_str());
+        }
+        if ( !(flags & IORING_CQE_F_MORE) ) {
+            accepting_ = false;
+            bool stopped = false;
+            {
+                std::lock_guard<std::mutex> l(lock_);
+                stopped = stopped_;
+            }
+            if (stopped) {
+                close_socket();
+            } else {
+                start_accept();
+            }
+        }
+    }
+
+    void handle_new_conn(int fd) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        char addr_str[INET6_ADDRSTRLEN] = {0};
+        uint32_t port = 0;
+        if (getpeername(fd, (sockaddr*)&addr, &addr_len) == 0) {
+            if (addr.ss_family == AF_INET6) {
+                sockaddr_in6* a6 = (sockaddr_in6*)&addr;
+                inet_ntop(AF_INET6, &a6->sin6_addr, addr_str, sizeof(addr_str));
+                port = ntohs(a6->sin6_port);
+            } else {
+                sockaddr_in* a4 = (sockaddr_in*)&addr;
+                inet_ntop(AF_INET, &a4->sin_addr, addr_str, sizeof(addr_str));
+                port = ntohs(a4->sin_port);
+            }
+        }
+
+        uring_worker* worker = impl_->next_worker();
+        ptr<uring_session> session;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (stopped_ || !handler_) {
+                ::close(fd);
+                return;
+            }
+            session = cs_new<uring_session>
+                      ( worker, fd, impl_->new_session_id(), addr_str, port,
+                        handler_, shared_from_this(), l_ );
+            sessions_.insert(session);
+        }
+        bool posted = worker->post( [session, worker]() {
+            worker->add_conn(session);
+            session->start_recv();
+        } );
+        if (!posted) remove_session(session.get());
+    }
+
+    void close_socket() {
+        std::lock_guard<std::mutex> l(lock_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        closed_ = true;
+        cv_.notify_all();
+    }
+
+    uring_service_impl* impl_;
+    uring_worker* worker_;
+    int fd_;
+    // Accessed only by the I/O thread.
+    bool accepting_;
+
+    std::mutex lock_;
+    std::condition_variable cv_;
+    bool stopped_;
+    bool closed_;
+    ptr<msg_handler> handler_;
+    std::set< ptr<uring_session> > sessions_;
+    ptr<logger> l_;
+};
+
+void uring_session::remove_from_listener() {
+    ptr<uring_rpc_listener> listener = listener_.lock();
+    if (listener) listener->remove_session(this);
+}
+
+// === Client side ============================================================
+
+class uring_client_conn : public uring_conn {
+public:
+    uring_client_conn(uring_worker* worker,
+                      uint64_t client_id,
+                      const std::string& host,
+                      const std::string& port,
+                      ptr<logger> l)
+        : uring_conn(worker, -1, RPC_RESP_HEADER_SIZE, l)
+        , impl_(worker->get_impl())
+        , client_id_(client_id)
+        , host_(host)
+        , port_(port)
+        , addr_len_(0)
+        , connecting_(false)
+        , timer_op_(nullptr)
+        , timer_seq_(0)
+        , abandoned_(false)
+        , peer_supports_crc32c_(false)
+    {
+        memset(&addr_, 0x0, sizeof(addr_));
+    }
+
+    void enqueue(ptr<req_msg>& req,
+                 rpc_handler& when_done,
+                 const ptr<buffer>& buf,
+                 uint64_t timeout_ms)
+    {
+        if (closing_) {
+            ptr<resp_msg> rsp;
+            ptr<rpc_exception> except
+                ( cs_new<rpc_exception>( "connection to peer is closed", req ) );
+            when_done(rsp, except);
+            return;
+        }
+        pending_reqs_.push_back( pending_req(req, when_done, timeout_ms) );
+        if (pending_reqs_.size() == 1) arm_timer(timeout_ms);
+        if (!connected_ && !connecting_) {
+            connect();
+            if (closing_) return;
+        }
+        send(buf);
+    }
+
+    uint32_t get_wire_flags() const {
+        const uring_service::options& opt = impl_->get_options();
+        uint32_t flags = 0x0;
+        if (opt.replicate_log_timestamp_) flags |= INCLUDE_LOG_TIMESTAMP;
+        if (opt.crc_on_payload_) flags |= CRC_ON_PAYLOAD;
+        if (opt.crc_on_entire_message_) flags |= CRC_ON_ENTIRE_MESSAGE;
+        if (opt.use_crc32c_) {
+            flags |= CRC32C_SUPPORTED;
+            if (peer_supports_crc32c_) flags |= CRC32C_IN_USE;
+        }
+        return flags;
+    }
+
+    uint64_t get_id() const { return client_id_; }
+
+    bool is_abandoned() const { return abandoned_; }
+
+protected:
+    struct pending_req {
+        pending_req(ptr<req_msg>& req, rpc_handler& when_done, uint64_t timeout_ms)
+            : req_(req), when_done_(when_done), timeout_ms_(timeout_ms), sent_(false)
+            {}
+        ptr<req_msg> req_;
+        rpc_handler when_done_;
+        uint64_t timeout_ms_;
+        bool sent_;
+    };
+
+    int64_t on_header(buffer& hdr) override {
+        std::string err_msg;
+        if (!rpc_wire::decode_resp_header(hdr, resp_hdr_, err_msg)) {
+            close(err_msg);
+            return -1;
+        }
+        if ( (resp_hdr_.flags_ & CRC32C_SUPPORTED) &&
+             impl_->get_options().use_crc32c_ &&
+             !peer_supports_crc32c_ ) {
+            p_in( "peer %s:%s supports CRC-32C, switch to it (%s)",
+                  host_.c_str(), port_.c_str(), crc32c_impl_name() );
+            peer_supports_crc32c_ = true;
+        }
+        return resp_hdr_.data_size_;
+    }
+
+    void on_message(const ptr<buffer>& body) override {
+        std::string err_msg;
+        ptr<resp_msg> rsp = rpc_wire::decode_resp(resp_hdr_, body, err_msg);
+        if (!rsp) {
+            close(err_msg);
+            return;
+        }
+        if (pending_reqs_.empty()) {
+            close("got a response without request");
+            return;
+        }
+        pending_req entry = pending_reqs_.front();
+        pending_reqs_.pop_front();
+        if (pending_reqs_.empty()) {
+            disarm_timer();
+        } else {
+            arm_timer(pending_reqs_.front().timeout_ms_);
+        }
+
+        ptr<rpc_exception> except;
+        entry.when_done_(rsp, except);
+    }
+
+    void on_sent() override {
+        for (size_t ii = 0; ii < pending_reqs_.size(); ++ii) {
+            if (pending_reqs_[ii].sent_) continue;
+            pending_reqs_[ii].sent_ = true;
+            if (ii == 0) {
+                // Now waiting for the response.
+                arm_timer(pending_reqs_[0].timeout_ms_);
+            }
+            break;
+        }
+    }
+
+    void on_close(const std::string& reason) override {
+        abandoned_ = true;
+        disarm_timer();
+
+        std::deque<pending_req> reqs;
+        reqs.swap(pending_reqs_);
+        for (pending_req& entry: reqs) {
+            std::string err_msg =
+                sstrfmt( "failed to send request to peer %d, %s:%s, %s" )
+                .fmt( entry.req_->get_dst(), host_.c_str(),
+                      port_.c_str(), reason.c_str() );
+            p_er("%s", err_msg.c_str());
+            ptr<resp_msg> rsp;
+            ptr<rpc_exception> except
+                ( cs_new<rpc_exception>(err_msg, entry.req_) );
+            entry.when_done_(rsp, except);
+        }
+    }
+
+private:
+    void connect() {
+        addrinfo hints;
+        memset(&hints, 0x0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_NUMERICSERV;
+        addrinfo* result = nullptr;
+        // Endpoints are IP addresses or names in local hosts file
+        // in most cases, so resolving them will not block the loop.
+        int ret = getaddrinfo(host_.c_str(), port_.c_str(), &hints, &result);
+        if (ret != 0 || !result) {
+            close( std::string("failed to resolve host: ") + gai_strerror(ret) );
+            return;
+        }
+        memcpy(&addr_, result->ai_addr, result->ai_addrlen);
+        addr_len_ = result->ai_addrlen;
+        int fd = ::socket(result->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        freeaddrinfo(result);
+        if (fd < 0) {
+            close("socket failed: " + errno_str(errno));
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        // Keep the fd here to close it even if connect fails,
+        // but do not start any other operation until connected.
+        fd_ = fd;
+        connecting_ = true;
+        io_uring_sqe* sqe = worker_->get_sqe();
+        sqe->opcode = IORING_OP_CONNECT;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)&addr_;
+        sqe->off = addr_len_;
+        ptr<uring_conn> self = shared_from_this();
+        worker_->attach( sqe, [self, fd](int32_t res, uint32_t) {
+            uring_client_conn* cc = static_cast<uring_client_conn*>(self.get());
+            cc->ops_in_flight_--;
+            cc->connecting_ = false;
+            if (cc->closing_) {
+                cc->release_if_done();
+            } else if (res < 0) {
+                cc->close("connect failed: " + errno_str(-res));
+            } else {
+                cc->set_connected(fd);
+            }
+        } );
+        ops_in_flight_++;
+    }
+
+    void arm_timer(uint64_t timeout_ms) {
+        disarm_timer();
+        if (!timeout_ms || closing_) return;
+        uint64_t seq = ++timer_seq_;
+        ptr<uring_conn> self = shared_from_this();
+        timer_op_ = worker_->add_timer( timeout_ms, [self, seq](int32_t res, uint32_t) {
+            uring_client_conn* cc = static_cast<uring_client_conn*>(self.get());
+            if (res != -ETIME || seq != cc->timer_seq_) return;
+            cc->timer_op_ = nullptr;
+            cc->close("timeout");
+        } );
+    }
+
+    void disarm_timer() {
+        if (!timer_op_) return;
+        worker_->remove_timer(timer_op_);
+        timer_op_ = nullptr;
+        timer_seq_++;
+    }
+
+    uring_service_impl* impl_;
+    uint64_t client_id_;
+    std::string host_;
+    std::string port_;
+    sockaddr_storage addr_;
+    socklen_t addr_len_;
+    bool connecting_;
+    uring_op* timer_op_;
+    uint64_t timer_seq_;
+    rpc_resp_header resp_hdr_;
+    std::deque<pending_req> pending_reqs_;
+    std::atomic<bool> abandoned_;
+    std::atomic<bool> peer_supports_crc32c_;
+};
+
+class uring_rpc_client : public rpc_client {
+public:
+    uring_rpc_client(ptr<uring_client_conn> conn)
+        : conn_(conn)
+        {}
+
+    ~uring_rpc_client() {
+        ptr<uring_client_conn> conn = conn_;
+        conn->get_worker()->post( [conn]() {
+            conn->close("client is destroyed");
+        } );
+    }
+
+    __nocopy__(uring_rpc_client);
+
+public:
+    void send(ptr<req_msg>& req,
+              rpc_handler& when_done,
+              uint64_t send_timeout_ms = 0) override
+    {
+        // Serialize the message in the caller's thread,
+        // the I/O thread only submits it.
+        ptr<buffer> buf;
+        if (!conn_->is_abandoned()) {
+            buf = rpc_wire::encode_req(*req, conn_->get_wire_flags());
+        }
+        ptr<uring_client_conn> conn = conn_;
+        ptr<req_msg> req_to_send = req;
+        rpc_handler handler = when_done;
+        bool posted = buf &&
+            conn->get_worker()->post( [conn, req_to_send, handler,
+                                       buf, send_timeout_ms]() mutable {
+                conn->enqueue(req_to_send, handler, buf, send_timeout_ms);
+            } );
+        if (!posted) {
+            ptr<resp_msg> rsp;
+            ptr<rpc_exception> except
+                ( cs_new<rpc_exception>( "this client is already abandoned", req ) );
+            when_done(rsp, except);
+        }
+    }
+
+    uint64_t get_id() const override { return conn_->get_id(); }
+
+    bool is_abandoned() const override { return conn_->is_abandoned(); }
+
+private:
+    ptr<uring_client_conn> conn_;
+};
+
+// === Service ================================================================
+
+bool uring_service::is_supported() {
+    // Multishot accept requires Linux 5.19.
+    if (!kernel_version_at_least(5, 19)) return false;
+
+    uring_ring ring;
+    return ring.init(4) == 0;
+}
+
+uring_service::uring_service(const options& _opt, ptr<logger> _l)
+    : impl_(nullptr)
+    , l_(_l)
+{
+    if (!is_supported()) {
+        throw std::runtime_error("io_uring is not supported by this system");
+    }
+    impl_ = new uring_service_impl(_opt, _l);
+}
+
+uring_service::~uring_service() {
+    delete impl_;
+}
+
+void uring_service::stop() {
+    impl_->stop();
+}
+
+ptr<rpc_client> uring_service::create_client(const std::string& endpoint) {
+    // Same format as `asio_service`: [tcp://]host:port.
+    std::string hostname;
+    std::string port;
+    size_t pos = endpoint.rfind(":");
+    if (pos != std::string::npos) {
+        int port_num = atoi( endpoint.substr(pos + 1).c_str() );
+        if (port_num) port = std::to_string(port_num);
+        size_t pos2 = pos ? endpoint.rfind("://", pos - 1) : std::string::npos;
+        hostname = (pos2 == std::string::npos)
+                   ? endpoint.substr(0, pos)
+                   : endpoint.substr(pos2 + 3, pos - pos2 - 3);
+    }
+    if (hostname.empty() || port.empty()) {
+        p_er("invalid endpoint: %s", endpoint.c_str());
+        return ptr<rpc_client>();
+    }
+
+    ptr<uring_client_conn> conn =
+        cs_new<uring_client_conn>( impl_->next_worker(), impl_->new_client_id(),
+                                   hostname, port, l_ );
+    uring_worker* worker = conn->get_worker();
+    worker->post( [worker, conn]() { worker->add_conn(conn); } );
+    return cs_new<uring_rpc_client>(conn);
+}
+
+ptr<rpc_listener> uring_service::create_rpc_listener(ushort listening_port,
+                                                     ptr<logger>& l)
+{
+    try {
+        return cs_new<uring_rpc_listener>(impl_, listening_port, l);
+    } catch (std::exception& ee) {
+        p_er("got exception: %s on port %u", ee.what(), listening_port);
+        return nullptr;
+    }
+}
+
+}
+
+#else // URING_SUPPORTED
+
+namespace nuraft {
+
+class uring_service_impl {};
+
+bool uring_service::is_supported() {
+    return false;
+}
+
+uring_service::uring_service(const options& _opt, ptr<logger> _l)
+    : impl_(nullptr)
+    , l_(_l)
+{
+    throw std::runtime_error("io_uring is not supported by this system");
+}
+
+uring_service::~uring_service() {}
+
+void uring_service::stop() {}
+
+ptr<rpc_client> uring_service::create_client(const std::string& endpoint) {
+    return nullptr;
+}
+
+ptr<rpc_listener> uring_service::create_rpc_listener(ushort listening_port,
+                                                     ptr<logger>& l)
+{
+    return nullptr;
+}
+
+}
+
+#endif // URING_SUPPORTED
@@ -290,6 +290,585 @@ int leader_election_test(bool crc_on_entire_message) {
     return 0;
 }
 
+int large_payload_with_crc_test(bool crc_on_entire_message) {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    for (auto& pp: pkgs) {
+        pp->setCrcOnEntireMessage(crc_on_entire_message);
+    }
+    // S3 doesn't support CRC-32C, others should keep using CRC-32 for S3.
+    s1.setCrc32c(true);
+    s2.setCrc32c(true);
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    // Share log entries so that their wire encoding can be shared too.
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.share_log_entries_among_peers_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    // Mix of small (inlined) and large (sent as separate spans) payloads,
+    // in a single batch.
+    const size_t NUM = 20;
+    std::vector< ptr<buffer> > msgs;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        size_t msg_size = (ii % 2) ? 64 * 1024 + ii : 16 + ii;
+        ptr<buffer> msg = buffer::alloc(msg_size);
+        for (size_t jj=0; jj<msg_size; ++jj) {
+            msg->data_begin()[jj] = (byte)(ii + jj);
+        }
+        msgs.push_back(msg);
+    }
+    ptr< cmd_result< ptr<buffer> > > ret =
+        s1.raftServer->append_entries(msgs);
+    CHK_TRUE( ret->get_accepted() );
+    TestSuite::sleep_sec(1, "replication");
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int recv_buffer_pool_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    for (auto& pp: pkgs) {
+        pp->setCrcOnEntireMessage(true);
+        pp->setRecvBufferPool(true);
+    }
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    uint64_t prev_hits = raft_server::get_stat_counter("buffer_pool_hits");
+
+    // Multiple rounds of batches, so that message buffers can be reused.
+    const size_t NUM_ROUNDS = 10;
+    const size_t NUM = 10;
+    for (size_t rr=0; rr<NUM_ROUNDS; ++rr) {
+        std::vector< ptr<buffer> > msgs;
+        for (size_t ii=0; ii<NUM; ++ii) {
+            size_t msg_size = 100 + rr * NUM + ii;
+            ptr<buffer> msg = buffer::alloc(msg_size);
+            for (size_t jj=0; jj<msg_size; ++jj) {
+                msg->data_begin()[jj] = (byte)(rr + ii + jj);
+            }
+            msgs.push_back(msg);
+        }
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries(msgs);
+        CHK_TRUE( ret->get_accepted() );
+        TestSuite::sleep_ms(100, "replication");
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+#ifdef ENABLE_RAFT_STATS
+    CHK_GT( raft_server::get_stat_counter("buffer_pool_hits"), prev_hits );
+#else
+    (void)prev_hits;
+#endif
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int log_compression_test(bool use_dict) {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    std::string dict = use_dict ? "{\"key\": \"user_\", \"value\": \"" : "";
+    for (auto& pp: pkgs) {
+        pp->setCrcOnEntireMessage(true);
+        pp->setRecvBufferPool(true);
+    }
+    // S3 doesn't compress, but it can still decompress requests from others.
+    s1.setLogCompression(true, dict);
+    s2.setLogCompression(true, dict);
+    s3.setLogCompression(false, dict);
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    uint64_t prev_in = raft_server::get_stat_counter("log_compression_input_bytes");
+    uint64_t prev_out = raft_server::get_stat_counter("log_compression_output_bytes");
+
+    // Compressible (small batches will not be compressed) and
+    // incompressible payloads.
+    const size_t NUM_ROUNDS = 5;
+    const size_t NUM = 20;
+    for (size_t rr=0; rr<NUM_ROUNDS; ++rr) {
+        std::vector< ptr<buffer> > msgs;
+        size_t num_msgs = (rr == 0) ? 1 : NUM;
+        for (size_t ii=0; ii<num_msgs; ++ii) {
+            ptr<buffer> msg;
+            if (rr == NUM_ROUNDS - 1) {
+                msg = buffer::alloc(256);
+                for (size_t jj=0; jj<msg->size(); ++jj) {
+                    msg->data_begin()[jj] = (byte)std::rand();
+                }
+            } else {
+                std::string str = "{\"key\": \"user_" + std::to_string(ii) +
+                                  "\", \"value\": \"" +
+                                  std::string(100 + ii, 'a' + (rr % 26)) + "\"}";
+                msg = buffer::alloc(str.size());
+                memcpy(msg->data_begin(), str.data(), str.size());
+            }
+            msgs.push_back(msg);
+        }
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries(msgs);
+        CHK_TRUE( ret->get_accepted() );
+        TestSuite::sleep_ms(100, "replication");
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+#ifdef ENABLE_RAFT_STATS
+    uint64_t comp_in = raft_server::get_stat_counter("log_compression_input_bytes");
+    uint64_t comp_out = raft_server::get_stat_counter("log_compression_output_bytes");
+    CHK_GT( comp_in, prev_in );
+    CHK_GT( comp_in - prev_in, comp_out - prev_out );
+#else
+    (void)prev_in;
+    (void)prev_out;
+#endif
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int compact_header_test(bool streaming) {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    for (auto& pp: pkgs) {
+        pp->setCrcOnEntireMessage(true);
+        pp->setCrc32c(true);
+        pp->setRecvBufferPool(true);
+        pp->useLogTimestamp = true;
+    }
+    // S3 doesn't support compact headers, others should keep using
+    // the legacy ones for S3.
+    s1.setCompactHeader(true);
+    s2.setCompactHeader(true);
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers( pkgs, false, false, true,
+                           raft_server::init_options(), 1000,
+                           (streaming ? 10 : 0) ) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    // Small and large payloads, so that both inlined and separate spans
+    // follow compact entry headers.
+    const size_t NUM_ROUNDS = 5;
+    const size_t NUM = 10;
+    for (size_t rr=0; rr<NUM_ROUNDS; ++rr) {
+        std::vector< ptr<buffer> > msgs;
+        for (size_t ii=0; ii<NUM; ++ii) {
+            size_t msg_size = (ii % 4 == 0) ? 4096 + ii : 8 + ii;
+            ptr<buffer> msg = buffer::alloc(msg_size);
+            for (size_t jj=0; jj<msg_size; ++jj) {
+                msg->data_begin()[jj] = (byte)(rr + ii + jj);
+            }
+            msgs.push_back(msg);
+        }
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries(msgs);
+        CHK_TRUE( ret->get_accepted() );
+        TestSuite::sleep_ms(100, "replication");
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // Timestamps are delta-encoded, they should be replicated as they are.
+    uint64_t last_idx = s1.raftServer->get_last_log_idx();
+    ptr<log_entry> le1 = s1.getTestMgr()->load_log_store()->entry_at(last_idx);
+    ptr<log_entry> le2 = s2.getTestMgr()->load_log_store()->entry_at(last_idx);
+    CHK_NONNULL(le1.get());
+    CHK_NONNULL(le2.get());
+    CHK_EQ( le1->get_term(), le2->get_term() );
+    CHK_EQ( le1->get_timestamp(), le2->get_timestamp() );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int multiplexing_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    for (auto& pp: pkgs) {
+        pp->setCrcOnEntireMessage(true);
+        pp->setMultiplexing(true);
+    }
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    // Replication over connections with request IDs.
+    const size_t NUM = 10;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+    }
+    TestSuite::sleep_sec(1, "replication");
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // Client requests to S1 will be answered after the disk delay.
+    for (auto& pp: pkgs) {
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.parallel_log_appending_ = true;
+        pp->raftServer->update_params(param);
+        pp->getTestMgr()->set_disk_delay(pp->raftServer.get(), 500);
+    }
+
+    ptr<rpc_client> cli = s2.asioSvc->create_client(s1_addr);
+    CHK_TRUE( cli->supports_multiplexing() );
+
+    std::mutex order_lock;
+    std::vector<msg_type> order;
+    EventAwaiter ea;
+    const size_t NUM_ROUNDS = 3;
+    auto make_handler = [&]() -> rpc_handler {
+        return [&](ptr<resp_msg>& resp, ptr<rpc_exception>& err) {
+            std::lock_guard<std::mutex> l(order_lock);
+            order.push_back( (resp && !err) ? resp->get_type()
+                                            : msg_type::request_vote_request );
+            if (order.size() == NUM_ROUNDS * 2) ea.invoke();
+        };
+    };
+
+    // The first round negotiates multiplexing.
+    for (size_t rr=0; rr<NUM_ROUNDS; ++rr) {
+        ptr<req_msg> cli_req = cs_new<req_msg>
+                               ( 0, msg_type::client_request, 0, 1, 0, 0, 0 );
+        ptr<buffer> msg = buffer::alloc(sizeof(uint64_t));
+        msg->put((uint64_t)rr);
+        msg->pos(0);
+        cli_req->log_entries().push_back
+            ( cs_new<log_entry>(0, msg, log_val_type::app_log) );
+        rpc_handler h1 = make_handler();
+        cli->send(cli_req, h1, 5000);
+
+        // Should not be blocked by the previous request.
+        ptr<req_msg> vote_req = cs_new<req_msg>
+                                ( 0, msg_type::pre_vote_request, 2, 1, 0, 0, 0 );
+        rpc_handler h2 = make_handler();
+        cli->send(vote_req, h2, 5000);
+    }
+
+    ea.wait_ms(5000);
+    {
+        std::lock_guard<std::mutex> l(order_lock);
+        CHK_EQ( NUM_ROUNDS * 2, order.size() );
+        size_t num_client_resps = 0;
+        for (msg_type t: order) {
+            if (t == msg_type::append_entries_response) num_client_resps++;
+        }
+        // All responses are received.
+        CHK_EQ( NUM_ROUNDS, num_client_resps );
+        // The first client request is sent before negotiation,
+        // so that the next one waits for it.
+        CHK_EQ( msg_type::append_entries_response, order[0] );
+        CHK_EQ( msg_type::pre_vote_response, order[1] );
+        // Once multiplexed, responses to pre-vote overtake the ones
+        // to client requests sent earlier.
+        for (size_t ii = 2; ii < NUM_ROUNDS + 1; ++ii) {
+            CHK_EQ( msg_type::pre_vote_response, order[ii] );
+        }
+        for (size_t ii = NUM_ROUNDS + 1; ii < order.size(); ++ii) {
+            CHK_EQ( msg_type::append_entries_response, order[ii] );
+        }
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int uring_service_test(bool mixed) {
+    if (!uring_service::is_supported()) {
+        _msg("io_uring is not supported, skip this test\n");
+        return 0;
+    }
+    reset_log_files();
+
+    std::string s1_addr = "tcp://localhost:20010";
+    std::string s2_addr = "tcp://localhost:20020";
+    std::string s3_addr = "tcp://localhost:20030";
+
+    RaftAsioPkg* s1 = new RaftAsioPkg(1, s1_addr);
+    RaftAsioPkg* s2 = new RaftAsioPkg(2, s2_addr);
+    RaftAsioPkg* s3 = new RaftAsioPkg(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {s1, s2, s3};
+    for (auto& pp: pkgs) {
+        pp->setCrcOnEntireMessage(true);
+        pp->setCrc32c(true);
+        pp->setRecvBufferPool(true);
+        pp->setUring(true);
+    }
+    if (mixed) {
+        // S2 uses asio, to make sure that both talk the same protocol.
+        s2->setUring(false);
+    }
+
+    _msg("launching io_uring-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    CHK_TRUE( s1->raftServer->is_leader() );
+    CHK_EQ(1, s2->raftServer->get_leader());
+    CHK_EQ(1, s3->raftServer->get_leader());
+
+    auto append_msgs = [](RaftAsioPkg* leader, size_t round) -> int {
+        const size_t NUM = 10;
+        std::vector< ptr<buffer> > msgs;
+        for (size_t ii=0; ii<NUM; ++ii) {
+            // Some of them are bigger than a receive buffer.
+            size_t msg_size = (ii % 3 == 0) ? 100 * 1024 + ii : 100 + ii;
+            ptr<buffer> msg = buffer::alloc(msg_size);
+            for (size_t jj=0; jj<msg_size; ++jj) {
+                msg->data_begin()[jj] = (byte)(round + ii + jj);
+            }
+            msgs.push_back(msg);
+        }
+        ptr< cmd_result< ptr<buffer> > > ret =
+            leader->raftServer->append_entries(msgs);
+        CHK_TRUE( ret->get_accepted() );
+        return 0;
+    };
+
+    for (size_t rr=0; rr<5; ++rr) {
+        CHK_Z( append_msgs(s1, rr) );
+        TestSuite::sleep_ms(100, "replication");
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    CHK_OK( s2->getTestSm()->isSame( *s1->getTestSm() ) );
+    CHK_OK( s3->getTestSm()->isSame( *s1->getTestSm() ) );
+
+    // Kill the leader, the others should elect a new one.
+    s1->raftServer->shutdown();
+    s1->stopAsio();
+    delete s1;
+    s1 = nullptr;
+    TestSuite::sleep_sec(2, "leader election is happening");
+
+    int cur_leader = s2->raftServer->get_leader();
+    _msg("new leader id: %d\n", cur_leader);
+    CHK_TRUE( cur_leader == 2 || cur_leader == 3 );
+    CHK_EQ(cur_leader, s3->raftServer->get_leader());
+
+    RaftAsioPkg* leader = (cur_leader == 2) ? s2 : s3;
+    RaftAsioPkg* follower = (cur_leader == 2) ? s3 : s2;
+    CHK_Z( append_msgs(leader, 100) );
+    TestSuite::sleep_sec(1, "replication");
+    CHK_OK( follower->getTestSm()->isSame( *leader->getTestSm() ) );
+
+    s2->raftServer->shutdown();
+    s3->raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    s2->stopAsio();
+    s3->stopAsio();
+    delete s2;
+    delete s3;
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int shm_service_test(size_t ring_size) {
+    if (!shm_service::is_supported()) {
+        _msg("shared memory transport is not supported, skip this test\n");
+        return 0;
+    }
+    reset_log_files();
+
+    std::string s1_addr = "tcp://localhost:20010";
+    std::string s2_addr = "tcp://localhost:20020";
+    std::string s3_addr = "tcp://localhost:20030";
+
+    RaftAsioPkg* s1 = new RaftAsioPkg(1, s1_addr);
+    RaftAsioPkg* s2 = new RaftAsioPkg(2, s2_addr);
+    RaftAsioPkg* s3 = new RaftAsioPkg(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {s1, s2, s3};
+    for (auto& pp: pkgs) {
+        pp->setCrcOnEntireMessage(true);
+        pp->setCrc32c(true);
+        pp->setRecvBufferPool(true);
+        // A small ring makes big messages streamed through it.
+        pp->setShm(true, ring_size);
+    }
+
+    _msg("launching shm-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    CHK_TRUE( s1->raftServer->is_leader() );
+    CHK_EQ(1, s2->raftServer->get_leader());
+    CHK_EQ(1, s3->raftServer->get_leader());
+
+    auto append_msgs = [](RaftAsioPkg* leader, size_t round) -> int {
+        const size_t NUM = 10;
+        std::vector< ptr<buffer> > msgs;
+        for (size_t ii=0; ii<NUM; ++ii) {
+            // Some of them are bigger than the ring.
+            size_t msg_size = (ii % 3 == 0) ? 100 * 1024 + ii : 100 + ii;
+            ptr<buffer> msg = buffer::alloc(msg_size);
+            for (size_t jj=0; jj<msg_size; ++jj) {
+                msg->data_begin()[jj] = (byte)(round + ii + jj);
+            }
+            msgs.push_back(msg);
+        }
+        ptr< cmd_result< ptr<buffer> > > ret =
+            leader->raftServer->append_entries(msgs);
+        CHK_TRUE( ret->get_accepted() );
+        return 0;
+    };
+
+    for (size_t rr=0; rr<5; ++rr) {
+        CHK_Z( append_msgs(s1, rr) );
+        TestSuite::sleep_ms(100, "replication");
+    }
+    TestSuite::sleep_sec(1, "replication");
+
+    CHK_OK( s2->getTestSm()->isSame( *s1->getTestSm() ) );
+    CHK_OK( s3->getTestSm()->isSame( *s1->getTestSm() ) );
+
+    // Kill the leader, the others should elect a new one.
+    s1->raftServer->shutdown();
+    s1->stopAsio();
+    delete s1;
+    s1 = nullptr;
+    TestSuite::sleep_sec(2, "leader election is happening");
+
+    int cur_leader = s2->raftServer->get_leader();
+    _msg("new leader id: %d\n", cur_leader);
+    CHK_TRUE( cur_leader == 2 || cur_leader == 3 );
+    CHK_EQ(cur_leader, s3->raftServer->get_leader());
+
+    RaftAsioPkg* leader = (cur_leader == 2) ? s2 : s3;
+    RaftAsioPkg* follower = (cur_leader == 2) ? s3 : s2;
+    CHK_Z( append_msgs(leader, 100) );
+    TestSuite::sleep_sec(1, "replication");
+    CHK_OK( follower->getTestSm()->isSame( *leader->getTestSm() ) );
+
+    s2->raftServer->shutdown();
+    s3->raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    s2->stopAsio();
+    s3->stopAsio();
+    delete s2;
+    delete s3;
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int ssl_test() {
     reset_log_files();
 
@@ -1209,6 +1788,87 @@ int snapshot_read_failure_for_lagging_server_test(size_t num_failures) {
     return 0;
 }
 
+int multiplexed_snapshot_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+    for (auto& pp: pkgs) {
+        pp->setMultiplexing(true);
+    }
+
+    // Count the heartbeats that S3 answered while it was saving
+    // a snapshot object, which takes `SNP_DELAY_MS`.
+    const size_t SNP_DELAY_MS = RaftAsioPkg::HEARTBEAT_MS * 2;
+    std::atomic<uint64_t> last_obj_start_us(0);
+    std::atomic<size_t> num_hb_during_obj(0);
+    raft_server::init_options opt;
+    opt.raft_callback_ = [&](cb_func::Type type, cb_func::Param* param)
+        -> cb_func::ReturnCode {
+        if (param->myId != 3) return cb_func::ReturnCode::Ok;
+        if (type == cb_func::ProcessReq) {
+            req_msg* req = static_cast<req_msg*>(param->ctx);
+            if (req->get_type() == msg_type::install_snapshot_request) {
+                last_obj_start_us = timer_helper::get_timeofday_us();
+            }
+        } else if (type == cb_func::SentAppendEntriesResp) {
+            uint64_t start_us = last_obj_start_us;
+            uint64_t now_us = timer_helper::get_timeofday_us();
+            if (start_us && now_us < start_us + SNP_DELAY_MS * 1000) {
+                num_hb_during_obj++;
+            }
+        }
+        return cb_func::ReturnCode::Ok;
+    };
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false, false, false, opt) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+    TestSuite::sleep_sec(1, "wait for Raft group ready");
+
+    // Stop S3, and make logs compacted so that S3 needs a snapshot.
+    s3.raftServer->shutdown();
+    s3.stopAsio();
+    TestSuite::sleep_sec(1, "stop S3");
+
+    const size_t NUM = 20;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string msg_str = std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(sizeof(uint32_t) + msg_str.size());
+        buffer_serializer bs(msg);
+        bs.put_str(msg_str);
+        s1.raftServer->append_entries( {msg} );
+    }
+    TestSuite::sleep_sec(1, "wait for replication");
+
+    // Each snapshot object takes longer than the heartbeat interval.
+    s3.getTestSm()->setSnpDelay(SNP_DELAY_MS);
+    s3.restartServer(nullptr, false, false, opt);
+
+    // Wait until S3 completes catch-up.
+    wait_for_catch_up(s1, s3, 20);
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // Heartbeats are not blocked by the snapshot objects in flight.
+    CHK_GT( num_hb_during_obj.load(), 0 );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int snapshot_context_timeout_normal_test() {
     reset_log_files();
 
@@ -2096,6 +2756,35 @@ int main(int argc, char** argv) {
                leader_election_test,
                TestRange<bool>( {false, true} ) );
 
+    ts.doTest( "large payload with crc test",
+               large_payload_with_crc_test,
+               TestRange<bool>( {false, true} ) );
+
+    ts.doTest( "recv buffer pool test",
+               recv_buffer_pool_test );
+
+    ts.doTest( "log compression test",
+               log_compression_test,
+               TestRange<bool>( {false, true} ) );
+
+    ts.doTest( "compact header test",
+               compact_header_test,
+               TestRange<bool>( {false, true} ) );
+
+    ts.doTest( "multiplexing test",
+               multiplexing_test );
+
+    ts.doTest( "multiplexed snapshot test",
+               multiplexed_snapshot_test );
+
+    ts.doTest( "uring service test",
+               uring_service_test,
+               TestRange<bool>( {false, true} ) );
+
+    ts.doTest( "shm service test",
+               shm_service_test,
+               TestRange<size_t>( {4096, 1024 * 1024} ) );
+
 #if !SSL_LIBRARY_NOT_FOUND && (defined(__linux__) || defined(__APPLE__))
     ts.doTest( "ssl test",
                ssl_test );
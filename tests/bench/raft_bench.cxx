@@ -147,7 +147,7 @@ struct server_stuff {
     std::string addr_;
     int port_;
 
-    // Endpoint: `tcp://<addr>:<port>`.
+    // Endpoint: `tcp://<addr>:<port>` or `shm://<addr>:<port>`.
     std::string endpoint_;
 
     // Logger.
@@ -163,6 +163,9 @@ struct server_stuff {
     ptr<asio_service> asio_svc_;
     ptr<rpc_listener> asio_listener_;
 
+    // Shared memory transport, if `shm://` endpoint is given.
+    ptr<shm_service> shm_svc_;
+
     // Raft server instance.
     ptr<raft_server> raft_instance_;
 };
@@ -185,11 +188,21 @@ int init_raft(server_stuff& stuff) {
     asio_opt.thread_pool_size_ = 32;
     stuff.asio_svc_ = cs_new<asio_service>(asio_opt, stuff.raft_logger_);
 
-    stuff.asio_listener_ =
-        stuff.asio_svc_->create_rpc_listener( stuff.port_,
-                                              stuff.raft_logger_ );
     ptr<delayed_task_scheduler> scheduler = stuff.asio_svc_;
     ptr<rpc_client_factory> rpc_cli_factory = stuff.asio_svc_;
+    if (stuff.endpoint_.find("shm://") == 0) {
+        // All servers are on this host, ASIO is used only for timers.
+        stuff.shm_svc_ = cs_new<shm_service>( shm_service::options(),
+                                              stuff.raft_logger_ );
+        stuff.asio_listener_ =
+            stuff.shm_svc_->create_rpc_listener( stuff.port_,
+                                                 stuff.raft_logger_ );
+        rpc_cli_factory = stuff.shm_svc_;
+    } else {
+        stuff.asio_listener_ =
+            stuff.asio_svc_->create_rpc_listener( stuff.port_,
+                                                  stuff.raft_logger_ );
+    }
 
     // Set parameters and start Raft server.
     raft_params params;
@@ -465,7 +478,7 @@ bench_config parse_config(int argc, char** argv) {
     }
 
     std::string my_endpoint = argv[2];
-    if (my_endpoint.find("tcp://") == std::string::npos) {
+    if (my_endpoint.find("://") == std::string::npos) {
         my_endpoint = "tcp://" + my_endpoint;
     }
 
@@ -504,7 +517,7 @@ bench_config parse_config(int argc, char** argv) {
 
     for (int ii=7; ii<argc; ++ii) {
         std::string cur_endpoint = argv[ii];
-        if (cur_endpoint.find("tcp://") == std::string::npos) {
+        if (cur_endpoint.find("://") == std::string::npos) {
             cur_endpoint = "tcp://" + cur_endpoint;
         }
         ret.endpoints_.push_back(cur_endpoint);
@@ -20,6 +20,8 @@ limitations under the License.
 
 #include "nuraft.hxx"
 
+#include "buffer_pool.hxx"
+
 #include "test_common.h"
 
 #include <cstring>
@@ -258,6 +260,152 @@ int buffer_serializer_test(bool little_endian) {
     return 0;
 }
 
+int buffer_slice_test() {
+    const size_t SIZE = 1024;
+    ptr<buffer> parent = buffer::alloc(SIZE);
+    for (size_t ii = 0; ii < SIZE; ++ii) {
+        parent->data_begin()[ii] = (byte)ii;
+    }
+    CHK_FALSE( parent->is_slice() );
+
+    ptr<buffer> sl = buffer::slice(parent, 100, 200);
+    CHK_TRUE( sl->is_slice() );
+    CHK_EQ( 200, sl->size() );
+    CHK_Z( sl->pos() );
+    CHK_EQ( parent->data_begin() + 100, sl->data_begin() );
+
+    // Read through serializer.
+    buffer_serializer bs(sl);
+    CHK_EQ( (uint8_t)100, bs.get_u8() );
+    bs.pos(199);
+    CHK_EQ( (uint8_t)(299 & 0xff), bs.get_u8() );
+
+    // Position is independent of the parent.
+    sl->pos(10);
+    CHK_EQ( 10, sl->pos() );
+    CHK_Z( parent->pos() );
+    CHK_EQ( (byte)110, *sl->data() );
+
+    // Writes are visible to the parent.
+    sl->pos(0);
+    sl->put((byte)0xab);
+    CHK_EQ( (byte)0xab, parent->data_begin()[100] );
+
+    // Slice of slice refers to the same memory.
+    ptr<buffer> sl2 = buffer::slice(sl, 50, 10);
+    CHK_EQ( parent->data_begin() + 150, sl2->data_begin() );
+    CHK_EQ( 10, sl2->size() );
+
+    // Clone of slice is a normal buffer.
+    ptr<buffer> cl = buffer::clone(*sl2);
+    CHK_FALSE( cl->is_slice() );
+    CHK_Z( memcmp(cl->data_begin(), sl2->data_begin(), 10) );
+
+    // Slices should keep the memory alive.
+    parent.reset();
+    sl.reset();
+    CHK_EQ( (byte)150, sl2->data_begin()[0] );
+
+    // Out-of-range.
+    ptr<buffer> small = buffer::alloc(10);
+    bool got_exception = false;
+    try {
+        buffer::slice(small, 5, 6);
+    } catch (...) {
+        got_exception = true;
+    }
+    CHK_TRUE(got_exception);
+
+    // Empty slice at the end is allowed.
+    CHK_Z( buffer::slice(small, 10, 0)->size() );
+
+    // Serializer created with `ptr<buffer>` returns slices.
+    ptr<buffer> src = buffer::alloc(64);
+    for (size_t ii = 0; ii < 64; ++ii) src->data_begin()[ii] = (byte)ii;
+    {
+        buffer_serializer bs(src);
+        bs.get_u32();
+        ptr<buffer> s1 = bs.get_buffer_slice(16);
+        CHK_TRUE( s1->is_slice() );
+        CHK_EQ( src->data_begin() + 4, s1->data_begin() );
+        CHK_EQ( 20, bs.pos() );
+
+        // Out-of-bound.
+        got_exception = false;
+        try {
+            bs.get_buffer_slice(45);
+        } catch (...) {
+            got_exception = true;
+        }
+        CHK_TRUE(got_exception);
+    }
+    // Otherwise, it returns a copy.
+    {
+        buffer_serializer bs(*src);
+        bs.pos(4);
+        ptr<buffer> c1 = bs.get_buffer_slice(16);
+        CHK_FALSE( c1->is_slice() );
+        CHK_EQ( 16, c1->size() );
+        CHK_Z( memcmp(src->data_begin() + 4, c1->data_begin(), 16) );
+        CHK_EQ( 20, bs.pos() );
+    }
+
+    return 0;
+}
+
+int buffer_pool_test() {
+    buffer_pool pool(2);
+
+    ptr<buffer> b1 = pool.acquire(3000);
+    CHK_EQ( 3000, b1->size() );
+    b1->pos(100);
+    buffer* b1_raw = b1.get();
+
+    // In use, should get a different one.
+    ptr<buffer> b2 = pool.acquire(3500);
+    CHK_NEQ( b1_raw, b2.get() );
+    CHK_EQ( 3500, b2->size() );
+
+    // Same size class, after release: should be reused,
+    // with the new size and reset position.
+    b1.reset();
+    ptr<buffer> b3 = pool.acquire(2100);
+    CHK_EQ( b1_raw, b3.get() );
+    CHK_EQ( 2100, b3->size() );
+    CHK_Z( b3->pos() );
+
+    // Slice holds the buffer, so it should not be reused.
+    ptr<buffer> sl = buffer::slice(b3, 0, 10);
+    b3.reset();
+    ptr<buffer> b4 = pool.acquire(4000);
+    CHK_NEQ( b1_raw, b4.get() );
+
+    // Class is full (2): normal buffer.
+    ptr<buffer> b5 = pool.acquire(4000);
+    CHK_EQ( 4000, b5->size() );
+
+    // Released slice: reusable again.
+    sl.reset();
+    b4.reset();
+    ptr<buffer> b6 = pool.acquire(4096);
+    CHK_EQ( 4096, b6->size() );
+
+    // Too big: not pooled.
+    ptr<buffer> big = pool.acquire(buffer_pool::MAX_CLASS_SIZE + 1);
+    CHK_EQ( buffer_pool::MAX_CLASS_SIZE + 1, big->size() );
+
+    // Pool is destroyed before the buffer.
+    ptr<buffer> survivor;
+    {
+        buffer_pool pool2(1);
+        survivor = pool2.acquire(100);
+    }
+    survivor->put((byte)1);
+    CHK_EQ( 1, survivor->pos() );
+
+    return 0;
+}
+
 }  // namespace buffer_test;
 using namespace buffer_test;
 
@@ -274,6 +422,12 @@ int main(int argc, char** argv) {
                buffer_serializer_test,
                TestRange<bool>( {true, false} ) );
 
+    ts.doTest( "buffer slice test",
+               buffer_slice_test );
+
+    ts.doTest( "buffer pool test",
+               buffer_pool_test );
+
     return 0;
 }
 
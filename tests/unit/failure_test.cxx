@@ -186,6 +186,105 @@ int simple_conflict_test() {
     return 0;
 }
 
+int conflicting_term_backtrack_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    raft_params custom_params;
+    custom_params.election_timeout_lower_bound_ = 0;
+    custom_params.election_timeout_upper_bound_ = 1000;
+    custom_params.heart_beat_interval_ = 500;
+    custom_params.snapshot_distance_ = 100;
+    CHK_Z( launch_servers( pkgs, &custom_params ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    // Append messages to S1, without replication.
+    const size_t MORE1 = 50;
+    for (size_t ii=0; ii<MORE1; ++ii) {
+        std::string test_msg = "more" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    }
+
+    // S2 becomes the new leader with S3's vote.
+    s2.dbgLog(" --- S2 will start leader election ---");
+    s2.fTimer->invoke( timer_task_type::election_timer );
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_TRUE( s2.raftServer->is_leader() );
+    s2.fNet->makeReqFailAll( s1_addr );
+
+    // Append diverged messages to S2, and replicate them to S3.
+    const size_t MORE2 = 30;
+    for (size_t ii=0; ii<MORE2; ++ii) {
+        std::string test_msg = "diverged" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s2.raftServer->append_entries( {msg} );
+    }
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // S3 becomes the next leader with S2's vote. Now S1 has
+    // a long suffix of the old term that conflicts with S3's.
+    s3.dbgLog(" --- S3 will start leader election ---");
+    s2.raftServer->yield_leadership(true);
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    s3.fNet->execReqResp( s2_addr );
+    s3.fNet->execReqResp( s2_addr );
+    s3.fNet->execReqResp( s2_addr );
+    s3.fNet->execReqResp( s2_addr );
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_TRUE( s3.raftServer->is_leader() );
+    s3.fNet->makeReqFailAll( s1_addr );
+
+    // S3 should skip the whole conflicting term at once,
+    // instead of probing the logs one by one.
+    s3.dbgLog(" --- S3 starts to replicate to S1 ---");
+    s3.fTimer->invoke( timer_task_type::heartbeat_timer );
+    for (size_t ii = 0; ii < 5; ++ii) {
+        s3.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    CHK_EQ( s3.getTestMgr()->load_log_store()->next_slot(),
+            s1.getTestMgr()->load_log_store()->next_slot() );
+    CHK_OK( s1.getTestSm()->isSame( *s3.getTestSm() ) );
+    CHK_OK( s2.getTestSm()->isSame( *s3.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
 int rmv_not_resp_srv_wq_test(bool explicit_failure) {
     // * Remove server that is not responding.
     // * Can reach quorum.
@@ -610,6 +709,9 @@ int main(int argc, char** argv) {
     ts.doTest( "simple conflict test",
                simple_conflict_test );
 
+    ts.doTest( "conflicting term backtrack test",
+               conflicting_term_backtrack_test );
+
     ts.doTest( "remove not responding server with quorum test",
                rmv_not_resp_srv_wq_test,
                TestRange<bool>({false, true}) );
@@ -161,8 +161,11 @@ bool FakeNetwork::delieverReqTo(const std::string& endpoint,
         return makeReqFail(endpoint, random_order);
     }
 
-    auto pkg_entry = conn->pendingReqs.begin();
-    if (pkg_entry == conn->pendingReqs.end()) return false;
+    std::list<ReqPkg>::iterator pkg_entry;
+    {   std::lock_guard<std::mutex> l(conn->pendingReqsLock);
+        pkg_entry = conn->pendingReqs.begin();
+        if (pkg_entry == conn->pendingReqs.end()) return false;
+    }
 
     ReqPkg& pkg = *pkg_entry;
 
@@ -176,7 +179,9 @@ bool FakeNetwork::delieverReqTo(const std::string& endpoint,
               msg_type_to_string( pkg.req->get_type() ).c_str() );
 
     conn->pendingResps.push_back( FakeNetwork::RespPkg(resp, pkg.whenDone) );
-    conn->pendingReqs.erase(pkg_entry);
+    {   std::lock_guard<std::mutex> l(conn->pendingReqsLock);
+        conn->pendingReqs.erase(pkg_entry);
+    }
     return true;
 }
 
@@ -198,8 +203,11 @@ bool FakeNetwork::delieverStaleReqTo(const std::string& endpoint)
         _log_info(ll, "no stale connection to %s is available", endpoint.c_str());
         return false;
     }
-    auto pkg_entry = conn->pendingReqs.begin();
-    if (pkg_entry == conn->pendingReqs.end()) return false;
+    std::list<ReqPkg>::iterator pkg_entry;
+    {   std::lock_guard<std::mutex> l(conn->pendingReqsLock);
+        pkg_entry = conn->pendingReqs.begin();
+        if (pkg_entry == conn->pendingReqs.end()) return false;
+    }
 
     ReqPkg& pkg = *pkg_entry;
 
@@ -213,7 +221,9 @@ bool FakeNetwork::delieverStaleReqTo(const std::string& endpoint)
               msg_type_to_string( pkg.req->get_type() ).c_str() );
 
     // Ignore the response, just remove the request.
-    conn->pendingReqs.erase(pkg_entry);
+    {   std::lock_guard<std::mutex> l(conn->pendingReqsLock);
+        conn->pendingReqs.erase(pkg_entry);
+    }
     return true;
 }
 
@@ -228,8 +238,11 @@ bool FakeNetwork::makeReqFail(const std::string& endpoint,
     // conn->dstNet (endpoint): destination (sending response)
     ptr<FakeClient> conn = findClient(endpoint);
 
-    auto pkg_entry = conn->pendingReqs.begin();
-    if (pkg_entry == conn->pendingReqs.end()) return false;
+    std::list<ReqPkg>::iterator pkg_entry;
+    {   std::lock_guard<std::mutex> l(conn->pendingReqsLock);
+        pkg_entry = conn->pendingReqs.begin();
+        if (pkg_entry == conn->pendingReqs.end()) return false;
+    }
 
     ReqPkg& pkg = *pkg_entry;
 
@@ -250,7 +263,9 @@ bool FakeNetwork::makeReqFail(const std::string& endpoint,
               myEndpoint.c_str(), endpoint.c_str(),
               msg_type_to_string( pkg.req->get_type() ).c_str() );
 
-    conn->pendingReqs.erase(pkg_entry);
+    {   std::lock_guard<std::mutex> l(conn->pendingReqsLock);
+        conn->pendingReqs.erase(pkg_entry);
+    }
     return true;
 }
 
@@ -278,6 +293,25 @@ bool FakeNetwork::handleRespFrom(const std::string& endpoint,
         return false;
     }
 
+    if ( pkg.resp->has_async_cb() &&
+         pkg.resp->get_type() == msg_type::read_index_response ) {
+        // Same as `asio_service`, the response is sent
+        // once the async result is ready.
+        //
+        // NOTE: Deferred `append_entries` responses are still delivered
+        //       right away, as if the follower's flush was already done.
+        ptr< cmd_result< ptr<buffer> > > ret = pkg.resp->call_async_cb();
+        if (!ret->has_result()) {
+            _log_info(ll, "response from %s is not ready yet", endpoint.c_str());
+            return false;
+        }
+        pkg.resp->set_ctx(ret->get());
+        if (ret->get_result_code() != cmd_result_code::OK) {
+            pkg.resp->unaccept();
+            pkg.resp->set_result_code(ret->get_result_code());
+        }
+    }
+
     _log_info(ll, "[BEGIN] deliver response %s -> %s, %s",
               endpoint.c_str(), myEndpoint.c_str(),
               msg_type_to_string( pkg.resp->get_type() ).c_str() );
@@ -318,6 +352,7 @@ bool FakeNetwork::replaceLastPendingResp(const std::string& endpoint,
 size_t FakeNetwork::getNumPendingReqs(const std::string& endpoint) {
     ptr<FakeClient> conn = findClient(endpoint);
     if (!conn) return 0;
+    std::lock_guard<std::mutex> l(conn->pendingReqsLock);
     return conn->pendingReqs.size();
 }
 
@@ -329,7 +364,9 @@ size_t FakeNetwork::getNumPendingResps(const std::string& endpoint) {
 
 ptr<req_msg> FakeNetwork::getFirstPendingReq(const std::string& endpoint) {
     ptr<FakeClient> conn = findClient(endpoint);
-    if (!conn || conn->pendingReqs.empty()) return nullptr;
+    if (!conn) return nullptr;
+    std::lock_guard<std::mutex> l(conn->pendingReqsLock);
+    if (conn->pendingReqs.empty()) return nullptr;
     return conn->pendingReqs.begin()->req;
 }
 
@@ -370,11 +407,14 @@ void FakeClient::send(ptr<req_msg>& req,
               motherNet->getEndpoint().c_str(),
               dstNet->getEndpoint().c_str(),
               msg_type_to_string( req->get_type() ).c_str() );
+    std::lock_guard<std::mutex> l(pendingReqsLock);
     pendingReqs.push_back( FakeNetwork::ReqPkg(req, when_done) );
 }
 
 void FakeClient::dropPackets() {
-    pendingReqs.clear();
+    {   std::lock_guard<std::mutex> l(pendingReqsLock);
+        pendingReqs.clear();
+    }
     pendingResps.clear();
 }
 
@@ -391,6 +431,11 @@ bool FakeClient::is_abandoned() const {
     return false;
 }
 
+bool FakeClient::supports_pipelining() const {
+    // Requests are queued and delivered in order.
+    return true;
+}
+
 
 // === FakeTimer
 
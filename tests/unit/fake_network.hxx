@@ -23,6 +23,7 @@ limitations under the License.
 #include "raft_server_handler.hxx"
 
 #include <map>
+#include <mutex>
 #include <unordered_map>
 
 class SimpleLogger;
@@ -434,10 +435,15 @@ public:
 
     bool is_abandoned() const;
 
+    bool supports_pipelining() const;
+
 private:
     uint64_t myId;
     FakeNetwork* motherNet;
     FakeNetwork* dstNet;
+    // Requests can be sent by multiple threads
+    // (e.g., `raft_params::append_dispatch_threads_`).
+    std::mutex pendingReqsLock;
     std::list<FakeNetwork::ReqPkg> pendingReqs;
     std::list<FakeNetwork::RespPkg> pendingResps;
 };
@@ -964,6 +964,95 @@ int temporary_leader_test() {
     return 0;
 }
 
+int leader_lease_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.leader_lease_ms_ = 60 * 1000;
+        param.lease_clock_drift_ms_ = 100;
+        pp->raftServer->update_params(param);
+    }
+
+    // Acknowledged heartbeat gives the lease to S1.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    uint64_t committed_idx = s1.raftServer->get_committed_log_idx();
+    uint64_t term = s1.raftServer->get_term();
+
+    // Read index is set without any request.
+    ptr< cmd_result<uint64_t> > ret1 = s1.raftServer->read_index();
+    CHK_EQ( cmd_result_code::OK, ret1->get_result_code() );
+    CHK_EQ( committed_idx, ret1->get() );
+    CHK_Z( s1.fNet->getNumPendingReqs(s2_addr) );
+    CHK_Z( s1.fNet->getNumPendingReqs(s3_addr) );
+
+    // Let S3 pass pre-vote.
+    s2.dbgLog(" --- invoke election timer of S2 ---");
+    s2.fTimer->invoke( timer_task_type::election_timer );
+    s2.fNet->execReqResp();
+    s3.dbgLog(" --- invoke election timer of S3 ---");
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    s3.fNet->execReqResp();
+
+    // Vote requests are ignored by both S1 and S2.
+    s3.fNet->execReqResp();
+    CHK_TRUE( s1.raftServer->is_leader() );
+    CHK_FALSE( s3.raftServer->is_leader() );
+    CHK_EQ( term, s1.raftServer->get_term() );
+    CHK_EQ( term, s2.raftServer->get_term() );
+
+    // Shorten the lease and let it expire.
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.leader_lease_ms_ = 50;
+        param.lease_clock_drift_ms_ = 10;
+        pp->raftServer->update_params(param);
+    }
+    TestSuite::sleep_ms(100);
+
+    // Now a round is needed.
+    ptr< cmd_result<uint64_t> > ret2 = s1.raftServer->read_index();
+    CHK_FALSE( ret2->has_result() );
+    CHK_EQ( 1, s1.fNet->getNumPendingReqs(s2_addr) );
+
+    // S3 can be elected, and the pending read is aborted.
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    s3.fNet->execReqResp();
+    s3.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_TRUE( s3.raftServer->is_leader() );
+    CHK_FALSE( s1.raftServer->is_leader() );
+    CHK_EQ( cmd_result_code::NOT_LEADER, ret2->get_result_code() );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
 }  // namespace leader_election_test;
 using namespace leader_election_test;
 
@@ -1002,6 +1091,9 @@ int main(int argc, char** argv) {
     ts.doTest( "temporary leader test",
                temporary_leader_test );
 
+    ts.doTest( "leader lease test",
+               leader_lease_test );
+
 #ifdef ENABLE_RAFT_STATS
     _msg("raft stats: ENABLED\n");
 #else
@@ -421,6 +421,321 @@ int learner_to_normal_test() {
     return 0;
 }
 
+int learner_relay_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // All servers are in the same DC, S3 is a learner,
+    // so that S2 should be the relay of S3.
+    auto init_cb = [&](RaftPkg* pp) {
+        if (pp->myId == 3) {
+            pp->getTestMgr()->get_srv_config()->set_learner(true);
+        }
+    };
+    CHK_Z( launch_servers( pkgs, nullptr, false, cb_default, init_cb ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.use_learner_relay_ = true;
+        param.reserved_log_items_ = 1000000;
+        param.snapshot_distance_ = 1000000;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 10;
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+
+        if (ii >= 2) {
+            // S2 has reported the progress of S3,
+            // S1 should not send anything to S3.
+            CHK_Z( s1.fNet->getNumPendingReqs(s3_addr) );
+        }
+
+        // S1 -> S2, S2 should not forward it to S3 until it is committed.
+        s1.fNet->execReqResp();
+        s2.fNet->execReqResp();
+        if (ii >= 2) {
+            CHK_GT( s1.raftServer->get_last_log_idx(),
+                    s3.raftServer->get_last_log_idx() );
+        }
+        // Commit, and then S2 forwards it to S3.
+        s1.fNet->execReqResp();
+        s2.fNet->execReqResp();
+        CHK_EQ( s1.raftServer->get_last_log_idx(),
+                s3.raftServer->get_last_log_idx() );
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    uint64_t last_idx = s1.raftServer->get_last_log_idx();
+    CHK_EQ( last_idx, s3.raftServer->get_last_log_idx() );
+    CHK_EQ( s1.raftServer->get_committed_log_idx(),
+            s3.raftServer->get_committed_log_idx() );
+    CHK_EQ( 1, s3.raftServer->get_leader() );
+
+    // The leader knows the progress of S3 through S2,
+    // by the next response from S2.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    raft_server::peer_info pi = s1.raftServer->get_peer_info(3);
+    CHK_EQ( last_idx, pi.last_log_idx_ );
+
+    // S2 goes offline, the leader should take it over
+    // after the election timeout.
+    raft_params param = s1.raftServer->get_current_params();
+    param.election_timeout_upper_bound_ = 100;
+    s1.raftServer->update_params(param);
+    s2.fNet->goesOffline();
+    TestSuite::sleep_ms(150);
+
+    std::string test_msg = "test" + std::to_string(NUM);
+    ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+    msg->put(test_msg);
+    s1.raftServer->append_entries( {msg} );
+    CHK_GT( s1.fNet->getNumPendingReqs(s3_addr), 0 );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_EQ( s1.raftServer->get_last_log_idx(), s3.raftServer->get_last_log_idx() );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int witness_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Initialization callback: make S3 as a witness.
+    auto init_cb = [&](RaftPkg* pp) {
+        if (pp->myId == 3) {
+            pp->getTestMgr()->get_srv_config()->set_witness(true);
+        }
+    };
+    CHK_Z( launch_servers( pkgs, nullptr, false, cb_default, init_cb ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.snapshot_distance_ = 100;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 10;
+    uint64_t start_idx = s1.raftServer->get_last_log_idx() + 1;
+    CHK_Z( append_logs(NUM, s1, pkgs) );
+    CHK_EQ( s1.raftServer->get_last_log_idx(), s3.raftServer->get_last_log_idx() );
+
+    // S3 has the metadata of logs only.
+    ptr<inmem_log_store> s2_logs = s2.getTestMgr()->get_inmem_log_store();
+    ptr<inmem_log_store> s3_logs = s3.getTestMgr()->get_inmem_log_store();
+    for (uint64_t ii = start_idx; ii < start_idx + NUM; ++ii) {
+        ptr<log_entry> le2 = s2_logs->entry_at(ii);
+        ptr<log_entry> le3 = s3_logs->entry_at(ii);
+        CHK_EQ( le2->get_term(), le3->get_term() );
+        CHK_EQ( log_val_type::app_log_meta, le3->get_val_type() );
+        CHK_EQ( sizeof(uint32_t) + sizeof(uint64_t), le3->get_buf().size() );
+
+        buffer_serializer bs(le3->get_buf());
+        CHK_EQ( le2->get_crc32(), bs.get_u32() );
+        CHK_EQ( le2->get_buf().size(), bs.get_u64() );
+
+        // The metadata should not be passed to the state machine.
+        CHK_NONNULL( s2.getTestSm()->getData(ii).get() );
+        CHK_NULL( s3.getTestSm()->getData(ii).get() );
+    }
+
+    // Since it is a witness, it should not send vote request.
+    s3.dbgLog(" --- invoke election timer of S3 ---");
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    CHK_Z(s3.fNet->getNumPendingReqs(s1_addr));
+    CHK_Z(s3.fNet->getNumPendingReqs(s2_addr));
+
+    // Make S3 lagging behind, and create a snapshot to compact logs.
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        std::string test_msg = "more" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        CHK_TRUE( s1.raftServer->append_entries( {msg} )->get_accepted() );
+    }
+    s1.fNet->execReqResp(s2_addr);
+    s1.fNet->execReqResp(s2_addr);
+    CHK_Z( wait_for_sm_exec({&s1, &s2}, COMMIT_TIMEOUT_SEC) );
+    s1.fNet->makeReqFail(s3_addr);
+
+    uint64_t committed_index = s1.raftServer->get_committed_log_idx();
+    CHK_EQ( committed_index, s1.raftServer->create_snapshot() );
+    CHK_GT( s1.getTestMgr()->get_inmem_log_store()->start_index(),
+            s3.raftServer->get_last_log_idx() + 1 );
+
+    // S3 should get the snapshot without any state machine data.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    do {
+        s1.fNet->execReqResp();
+    } while (s3.raftServer->is_receiving_snapshot());
+    CHK_Z( s1.getTestSm()->getNumOpenedUserCtxs() );
+    CHK_EQ( committed_index, s3.raftServer->get_last_snapshot_idx() );
+    CHK_EQ( committed_index,
+            s3.getTestSm()->last_snapshot()->get_last_log_idx() );
+
+    // Continue with logs.
+    CHK_Z( append_logs(NUM, s1, pkgs) );
+    CHK_EQ( s1.raftServer->get_last_log_idx(), s3.raftServer->get_last_log_idx() );
+    CHK_EQ( s1.raftServer->get_committed_log_idx(),
+            s3.raftServer->get_committed_log_idx() );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int witness_leader_failure_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Initialization callback: make S3 as a witness.
+    auto init_cb = [&](RaftPkg* pp) {
+        if (pp->myId == 3) {
+            pp->getTestMgr()->get_srv_config()->set_witness(true);
+        }
+    };
+    raft_params custom_params;
+    custom_params.election_timeout_lower_bound_ = 0;
+    custom_params.election_timeout_upper_bound_ = 1000;
+    custom_params.heart_beat_interval_ = 500;
+    custom_params.snapshot_distance_ = 100;
+    CHK_Z( launch_servers( pkgs, &custom_params, false, cb_default, init_cb ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 10;
+    CHK_Z( append_logs(NUM, s1, pkgs) );
+    uint64_t committed_index = s1.raftServer->get_committed_log_idx();
+
+    // Append a log, and replicate it to S3 only.
+    std::string test_msg = "witness_only";
+    ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+    msg->put(test_msg);
+    CHK_TRUE( s1.raftServer->append_entries( {msg} )->get_accepted() );
+    s1.fNet->execReqResp( s3_addr );
+    s1.fNet->execReqResp( s3_addr );
+    CHK_EQ( s1.raftServer->get_last_log_idx(), s3.raftServer->get_last_log_idx() );
+    CHK_GT( s3.raftServer->get_last_log_idx(), s2.raftServer->get_last_log_idx() );
+
+    // S3 has the metadata only, S1 should not commit the log.
+    CHK_EQ( committed_index, s1.raftServer->get_committed_log_idx() );
+
+    // S1 dies. S2 becomes the new leader with S3's vote,
+    // even though S3 has a longer log.
+    s2.dbgLog(" --- S2 will start leader election ---");
+    s2.fNet->makeReqFailAll( s1_addr );
+    s3.fNet->makeReqFailAll( s1_addr );
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    s2.fTimer->invoke( timer_task_type::election_timer );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    CHK_TRUE( s2.raftServer->is_leader() );
+
+    // S2 is the only member having the data,
+    // it should not commit anything with S3 only.
+    s2.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s2.fNet->execReqResp( s3_addr );
+    s2.fNet->execReqResp( s3_addr );
+    CHK_EQ( committed_index, s2.raftServer->get_committed_log_idx() );
+
+    // S1 comes back, and gets the logs of S2.
+    s2.dbgLog(" --- S1 comes back ---");
+    for (size_t ii = 0; ii < 5; ++ii) {
+        s2.fTimer->invoke( timer_task_type::heartbeat_timer );
+        s2.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // All committed logs are still there, and the log
+    // that only the witness had is gone.
+    CHK_GT( s2.raftServer->get_committed_log_idx(), committed_index );
+    CHK_EQ( s2.raftServer->get_committed_log_idx(),
+            s1.raftServer->get_committed_log_idx() );
+    CHK_EQ( s2.raftServer->get_committed_log_idx(),
+            s3.raftServer->get_committed_log_idx() );
+    CHK_OK( s1.getTestSm()->isSame( *s2.getTestSm() ) );
+    CHK_Z( s2.getTestSm()->isCommitted(test_msg) );
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        CHK_GT( s2.getTestSm()->isCommitted("test" + std::to_string(ii)), 0 );
+    }
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
 }  // namespace learner_new_joiner_test;
 using namespace learner_new_joiner_test;
 
@@ -519,6 +834,15 @@ int main(int argc, char** argv) {
     ts.doTest( "log sync with async snapshot io test",
                log_sync_with_async_snapshot_io_test );
 
+    ts.doTest( "learner relay test",
+               learner_relay_test );
+
+    ts.doTest( "witness test",
+               witness_test );
+
+    ts.doTest( "witness leader failure test",
+               witness_leader_failure_test );
+
 #ifdef ENABLE_RAFT_STATS
     _msg("raft stats: ENABLED\n");
 #else
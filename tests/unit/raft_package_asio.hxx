@@ -49,6 +49,8 @@ public:
         , sMgr(nullptr)
         , sm(nullptr)
         , asioSvc(nullptr)
+        , uringSvc(nullptr)
+        , shmSvc(nullptr)
         , asioListener(nullptr)
         , raftServer(nullptr)
         , readReqMeta(nullptr)
@@ -57,6 +59,14 @@ public:
         , useCustomResolver(false)
         , useLogTimestamp(false)
         , useCrcOnEntireMessage(false)
+        , useCrc32c(false)
+        , useRecvBufferPool(false)
+        , useLogCompression(false)
+        , useCompactHeader(false)
+        , useMultiplexing(false)
+        , useUring(false)
+        , useShm(false)
+        , shmRingSize(0)
         , customIoContext(nullptr)
         , myLogWrapper(nullptr)
         , myLog(nullptr)
@@ -82,6 +92,36 @@ public:
         useCrcOnEntireMessage = to;
     }
 
+    void setCrc32c(bool to) {
+        useCrc32c = to;
+    }
+
+    void setRecvBufferPool(bool to) {
+        useRecvBufferPool = to;
+    }
+
+    void setLogCompression(bool to, const std::string& dict = std::string()) {
+        useLogCompression = to;
+        logCompressionDict = dict;
+    }
+
+    void setCompactHeader(bool to) {
+        useCompactHeader = to;
+    }
+
+    void setMultiplexing(bool to) {
+        useMultiplexing = to;
+    }
+
+    void setUring(bool to) {
+        useUring = to;
+    }
+
+    void setShm(bool to, size_t ring_size = 0) {
+        useShm = to;
+        shmRingSize = ring_size;
+    }
+
     static bool verifySn(const std::string& sn) {
         // Check if `CN=localhost` exists.
         size_t pos = sn.find("CN=");
@@ -142,6 +182,17 @@ public:
         }
 
         asio_opt.replicate_log_timestamp_ = useLogTimestamp;
+        asio_opt.use_crc32c_ = useCrc32c;
+        if (useRecvBufferPool) {
+            asio_opt.recv_buffer_pool_size_ = 4;
+            asio_opt.log_entry_slices_ = true;
+        }
+        if (useLogCompression) {
+            asio_opt.log_compression_threshold_ = 1024;
+        }
+        asio_opt.log_compression_dict_ = logCompressionDict;
+        asio_opt.compact_header_ = useCompactHeader;
+        asio_opt.multiplexing_ = useMultiplexing;
 
         if (readReqMeta) asio_opt.read_req_meta_ = readReqMeta;
         if (writeReqMeta) asio_opt.write_req_meta_ = writeReqMeta;
@@ -160,10 +211,42 @@ public:
                   : cs_new<asio_service>(asio_opt, myLog);
 
         int raft_port = 20000 + myId * 10;
-        ptr<rpc_listener> listener
-                          ( asioSvc->create_rpc_listener(raft_port, myLog) );
+        ptr<rpc_listener> listener;
         ptr<delayed_task_scheduler> scheduler = asioSvc;
-        ptr<rpc_client_factory> rpc_cli_factory = asioSvc;
+        ptr<rpc_client_factory> rpc_cli_factory;
+        if (useUring) {
+            // Asio is used only for timers.
+            uring_service::options uring_opt;
+            uring_opt.replicate_log_timestamp_ = useLogTimestamp;
+            uring_opt.crc_on_entire_message_ = useCrcOnEntireMessage;
+            uring_opt.crc_on_payload_ = useCrcOnEntireMessage;
+            uring_opt.use_crc32c_ = useCrc32c;
+            if (useRecvBufferPool) {
+                uring_opt.recv_buffer_pool_size_ = 4;
+                uring_opt.log_entry_slices_ = true;
+            }
+            uringSvc = cs_new<uring_service>(uring_opt, myLog);
+            listener = uringSvc->create_rpc_listener(raft_port, myLog);
+            rpc_cli_factory = uringSvc;
+        } else if (useShm) {
+            // Asio is used only for timers.
+            shm_service::options shm_opt;
+            shm_opt.replicate_log_timestamp_ = useLogTimestamp;
+            shm_opt.crc_on_entire_message_ = useCrcOnEntireMessage;
+            shm_opt.crc_on_payload_ = useCrcOnEntireMessage;
+            shm_opt.use_crc32c_ = useCrc32c;
+            if (shmRingSize) shm_opt.ring_size_ = shmRingSize;
+            if (useRecvBufferPool) {
+                shm_opt.recv_buffer_pool_size_ = 4;
+                shm_opt.log_entry_slices_ = true;
+            }
+            shmSvc = cs_new<shm_service>(shm_opt, myLog);
+            listener = shmSvc->create_rpc_listener(raft_port, myLog);
+            rpc_cli_factory = shmSvc;
+        } else {
+            listener = asioSvc->create_rpc_listener(raft_port, myLog);
+            rpc_cli_factory = asioSvc;
+        }
 
         raft_params params;
         params.with_hb_interval(HEARTBEAT_MS);
@@ -199,6 +282,7 @@ public:
             asio_opt.root_cert_file_    = "./cert.pem"; // self-signed.
             asio_opt.server_key_file_   = "./key.pem";
         }
+        asio_opt.multiplexing_ = useMultiplexing;
 
         asioSvc = use_global_asio
                   ? nuraft_global_mgr::init_asio_service(asio_opt, myLog)
@@ -235,6 +319,12 @@ public:
             asioListener->stop();
             asioListener->shutdown();
         }
+        if (uringSvc) {
+            uringSvc->stop();
+        }
+        if (shmSvc) {
+            shmSvc->stop();
+        }
         if (asioSvc) {
             asioSvc->stop();
             size_t count = 0;
@@ -265,6 +355,8 @@ public:
     ptr<state_machine> sm;
 
     ptr<asio_service> asioSvc;
+    ptr<uring_service> uringSvc;
+    ptr<shm_service> shmSvc;
     ptr<rpc_listener> asioListener;
 
     ptr<raft_server> raftServer;
@@ -289,6 +381,24 @@ public:
 
     bool useCrcOnEntireMessage;
 
+    bool useCrc32c;
+
+    bool useRecvBufferPool;
+
+    bool useLogCompression;
+
+    std::string logCompressionDict;
+
+    bool useCompactHeader;
+
+    bool useMultiplexing;
+
+    bool useUring;
+
+    bool useShm;
+
+    size_t shmRingSize;
+
 #ifdef USE_BOOST_ASIO
     boost::asio::io_context* customIoContext;
 #else
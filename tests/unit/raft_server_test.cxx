@@ -26,6 +26,7 @@ limitations under the License.
 
 #include <stdio.h>
 #include <string>
+#include <thread>
 
 using namespace nuraft;
 using namespace raft_functional_common;
@@ -2161,6 +2162,1078 @@ int extended_append_entries_api_test() {
     return 0;
 }
 
+int shared_log_entries_among_peers_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.leadership_expiry_ = -1;
+        param.share_log_entries_among_peers_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    uint64_t prev_hits = raft_server::get_stat_counter("shared_log_batch_hits");
+
+    // Both followers will request the same range,
+    // the second one should reuse the log entries read for the first one.
+    ptr<raft_result> ret = append_batch(s1, {10, 20, 30, 40, 50});
+    CHK_TRUE( ret->get_accepted() );
+    CHK_Z( drain_and_commit(s1, pkgs) );
+
+#ifdef ENABLE_RAFT_STATS
+    CHK_GT( raft_server::get_stat_counter("shared_log_batch_hits"), prev_hits );
+#else
+    (void)prev_hits;
+#endif
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int replication_cache_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.leadership_expiry_ = -1;
+        param.replication_cache_size_bytes_ = 1024 * 1024;
+        pp->raftServer->update_params(param);
+    }
+
+    uint64_t prev_hits = raft_server::get_stat_counter("replication_cache_hits");
+
+    // Newly appended logs should be served from the cache.
+    ptr<raft_result> ret = append_batch(s1, {10, 20, 30, 40, 50});
+    CHK_TRUE( ret->get_accepted() );
+    CHK_Z( drain_and_commit(s1, pkgs) );
+
+#ifdef ENABLE_RAFT_STATS
+    CHK_GT( raft_server::get_stat_counter("replication_cache_hits"), prev_hits );
+#else
+    (void)prev_hits;
+#endif
+
+    // Shrink the cache so that only a few entries fit,
+    // the rest should be read from the log store.
+    raft_params param = s1.raftServer->get_current_params();
+    param.replication_cache_size_bytes_ = 16;
+    s1.raftServer->update_params(param);
+
+    ret = append_batch(s1, {10, 20, 30, 40, 50});
+    CHK_TRUE( ret->get_accepted() );
+    CHK_Z( drain_and_commit(s1, pkgs) );
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int replication_window_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const int32 WINDOW = 3;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.leadership_expiry_ = -1;
+        param.replication_window_batches_ = WINDOW;
+        pp->raftServer->update_params(param);
+    }
+
+    // Each append should be sent right away, without waiting for
+    // the response of the previous one, up to the window size.
+    for (size_t ii = 0; ii < 10; ++ii) {
+        CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    }
+    CHK_EQ( (size_t)WINDOW, s1.fNet->getNumPendingReqs("S2") );
+    CHK_EQ( (size_t)WINDOW, s1.fNet->getNumPendingReqs("S3") );
+
+    // Smaller batches are sent first, it needs more round trips.
+    for (size_t ii = 0; ii < 10; ++ii) {
+        s1.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // Drop in-flight requests to S2, the window should be rewound.
+    for (size_t ii = 0; ii < 5; ++ii) {
+        CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    }
+    s1.fNet->makeReqFailAll("S2");
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    for (size_t ii = 0; ii < 10; ++ii) {
+        s1.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    CHK_EQ( s1.raftServer->get_last_log_idx(), s2.raftServer->get_last_log_idx() );
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+class AppendBatchInspector : public raft_server_handler {
+public:
+    static ptr<peer> getPeer(raft_server* srv, int32 peer_id) {
+        auto& peers = get_peers(srv);
+        auto entry = peers.find(peer_id);
+        if (entry == peers.end()) return nullptr;
+        return entry->second;
+    }
+
+    // Feed an RTT sample as if a response of the given batch has arrived.
+    static void feedSample(raft_server* srv,
+                           peer& pp,
+                           uint64_t rtt_us,
+                           size_t num_entries,
+                           size_t bytes)
+    {
+        pp.set_append_rtt_sample(rtt_us, num_entries, bytes);
+        adjust_append_batch_size(srv, pp);
+    }
+};
+
+int adaptive_append_batch_size_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const int32 MAX_APPEND_SIZE = 100;
+    const uint64_t TARGET_US = 20 * 1000;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.max_append_size_ = MAX_APPEND_SIZE;
+        param.append_batch_target_latency_ms_ = TARGET_US / 1000;
+        pp->raftServer->update_params(param);
+    }
+
+    // Before any sample, the static limit should be reported.
+    for (auto& entry: s1.raftServer->get_peer_info_all()) {
+        CHK_EQ( MAX_APPEND_SIZE, entry.append_batch_size_ );
+    }
+
+    raft_server* leader = s1.raftServer.get();
+    ptr<peer> s2_peer = AppendBatchInspector::getPeer(leader, 2);
+    CHK_NONNULL( s2_peer );
+
+    // Responses slower than the target latency: batch size should shrink.
+    int32 prev_size = MAX_APPEND_SIZE;
+    for (size_t ii = 0; ii < 3; ++ii) {
+        AppendBatchInspector::feedSample
+            ( leader, *s2_peer, TARGET_US * 3, prev_size, prev_size * 10 );
+        int32 cur_size = leader->get_peer_info(2).append_batch_size_;
+        CHK_GT( cur_size, 0 );
+        CHK_SM( cur_size, prev_size );
+        prev_size = cur_size;
+    }
+    CHK_GT( leader->get_peer_info(2).avg_append_rtt_us_, TARGET_US );
+
+    // Fast responses of full batches: batch size should grow back,
+    // up to the static limit.
+    size_t num_rounds = 0;
+    while (prev_size < MAX_APPEND_SIZE) {
+        CHK_SM( num_rounds++, (size_t)100 );
+        AppendBatchInspector::feedSample
+            ( leader, *s2_peer, TARGET_US / 4, prev_size, prev_size * 10 );
+        int32 cur_size = leader->get_peer_info(2).append_batch_size_;
+        CHK_GT( cur_size, prev_size );
+        prev_size = cur_size;
+    }
+    CHK_EQ( MAX_APPEND_SIZE, prev_size );
+
+    // Once it reaches the limit, it should not grow further.
+    AppendBatchInspector::feedSample
+        ( leader, *s2_peer, TARGET_US / 4, prev_size, prev_size * 10 );
+    CHK_EQ( MAX_APPEND_SIZE, leader->get_peer_info(2).append_batch_size_ );
+
+    // The other peer is not affected.
+    CHK_EQ( MAX_APPEND_SIZE, leader->get_peer_info(3).append_batch_size_ );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int follower_group_flush_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.leadership_expiry_ = -1;
+        param.replication_window_batches_ = 3;
+        // Long enough not to be flushed by the elapsed time.
+        param.follower_group_flush_delay_ms_ = 10000;
+        pp->raftServer->update_params(param);
+    }
+
+    std::vector<size_t> prev_batches;
+    for (RaftPkg* pp: {&s2, &s3}) {
+        prev_batches.push_back
+            ( pp->getTestMgr()->get_inmem_log_store()->get_num_append_batches() );
+    }
+
+    // Multiple append_entries requests, but no `end_of_append_batch` yet.
+    for (size_t ii = 0; ii < 10; ++ii) {
+        CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    }
+    for (size_t ii = 0; ii < 10; ++ii) {
+        s1.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    size_t idx = 0;
+    for (RaftPkg* pp: {&s2, &s3}) {
+        CHK_EQ( s1.raftServer->get_last_log_idx(),
+                pp->raftServer->get_last_log_idx() );
+        CHK_EQ( prev_batches[idx++],
+                pp->getTestMgr()->get_inmem_log_store()->get_num_append_batches() );
+    }
+
+    // Flush timer: all of them are done at once.
+    idx = 0;
+    for (RaftPkg* pp: {&s2, &s3}) {
+        pp->fTimer->invoke( timer_task_type::follower_group_flush_timer );
+        CHK_EQ( prev_batches[idx++] + 1,
+                pp->getTestMgr()->get_inmem_log_store()->get_num_append_batches() );
+    }
+
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int commit_propagation_delay_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.commit_propagation_delay_ms_ = 10000;
+        param.suppress_busy_heartbeat_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    // Commit happens, but no separate request to propagate it.
+    CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec({&s1}, COMMIT_TIMEOUT_SEC) );
+    uint64_t committed_idx = s1.raftServer->get_committed_log_idx();
+    CHK_EQ( s1.raftServer->get_last_log_idx(), committed_idx );
+    CHK_Z( s1.fNet->getNumPendingReqs("S2") );
+    CHK_Z( s1.fNet->getNumPendingReqs("S3") );
+    CHK_GT( committed_idx, s2.raftServer->get_committed_log_idx() );
+
+    // Recently sent, heartbeat should be suppressed.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    CHK_Z( s1.fNet->getNumPendingReqs("S2") );
+    CHK_Z( s1.fNet->getNumPendingReqs("S3") );
+
+    // The next data request carries the commit index.
+    CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    for (RaftPkg* pp: {&s2, &s3}) {
+        CHK_EQ( committed_idx, pp->raftServer->get_committed_log_idx() );
+    }
+    committed_idx = s1.raftServer->get_committed_log_idx();
+    CHK_GT( committed_idx, s2.raftServer->get_committed_log_idx() );
+
+    // Timer expires without further traffic.
+    s1.fTimer->invoke( timer_task_type::commit_propagation_timer );
+    CHK_EQ( 1, s1.fNet->getNumPendingReqs("S2") );
+    CHK_EQ( 1, s1.fNet->getNumPendingReqs("S3") );
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    for (RaftPkg* pp: {&s2, &s3}) {
+        CHK_EQ( committed_idx, pp->raftServer->get_committed_log_idx() );
+    }
+
+    // Disable the suppression, then heartbeat should be sent.
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.suppress_busy_heartbeat_ = false;
+        pp->raftServer->update_params(param);
+    }
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    CHK_EQ( 1, s1.fNet->getNumPendingReqs("S2") );
+    CHK_EQ( 1, s1.fNet->getNumPendingReqs("S3") );
+    s1.fNet->execReqResp();
+
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int bulk_catch_up_test(bool follower_supports) {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Count the log packs sent by the leader,
+    // and the logs appended by S3.
+    std::atomic<size_t> num_packs(0);
+    std::atomic<size_t> num_s3_appends(0);
+    auto count_packs = [&](cb_func::Type type, cb_func::Param* param) {
+        if (type == cb_func::SentAppendEntriesReq && param->ctx) {
+            req_msg* req = static_cast<req_msg*>(param->ctx);
+            if ( req->log_entries().size() == 1 &&
+                 req->log_entries()[0]->get_val_type() == log_val_type::log_pack ) {
+                num_packs++;
+            }
+        }
+        if (type == cb_func::PreAppendLogFollower && param->myId == 3) {
+            num_s3_appends++;
+        }
+        return cb_default(type, param);
+    };
+    CHK_Z( launch_servers( pkgs, nullptr, false, count_packs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const size_t NUM = 100;
+    const int32 PACK_SIZE = 20;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.max_append_size_ = 5;
+        param.log_sync_stop_gap_ = 10;
+        param.log_sync_batch_size_ = PACK_SIZE;
+        // If S3 does not enable it, it should be treated as an old version.
+        param.use_bulk_catch_up_ = follower_supports || pp != &s3;
+        // Keep logs, otherwise snapshot will be sent.
+        param.snapshot_distance_ = 0;
+        pp->raftServer->update_params(param);
+    }
+
+    // Replicate to S2 only, so that S3 lags behind.
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    }
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        s1.fNet->execReqResp("S2");
+    }
+    CHK_Z( wait_for_sm_exec({&s1, &s2}, COMMIT_TIMEOUT_SEC) );
+    s1.fNet->makeReqFailAll("S3");
+
+    uint64_t last_idx = s1.raftServer->get_last_log_idx();
+    CHK_EQ( last_idx, s1.raftServer->get_committed_log_idx() );
+    CHK_GT( last_idx, s3.raftServer->get_last_log_idx() + NUM - 1 );
+
+    // S3 should catch up with log packs, and then the usual requests.
+    CHK_Z( num_packs.load() );
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    size_t num_rounds = 0;
+    while ( s3.raftServer->get_last_log_idx() < last_idx &&
+            num_rounds < NUM ) {
+        s1.fNet->execReqResp("S3");
+        num_rounds++;
+    }
+    CHK_EQ( last_idx, s3.raftServer->get_last_log_idx() );
+    if (follower_supports) {
+        CHK_GT( num_packs.load(), 0 );
+        CHK_GT( (size_t)NUM / PACK_SIZE + 1, num_packs.load() );
+
+        // Far less round trips than `max_append_size_` allows.
+        CHK_GT( (size_t)NUM / 5, num_rounds );
+    } else {
+        CHK_Z( num_packs.load() );
+    }
+
+    // The logs in packs should go through the same hooks.
+    CHK_GT( num_s3_appends.load(), NUM - 1 );
+
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm(), true ) );
+
+    // No more log pack once caught up.
+    size_t prev_packs = num_packs;
+    for (size_t ii = 0; ii < 5; ++ii) {
+        CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    }
+    for (size_t ii = 0; ii < 5; ++ii) {
+        s1.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( prev_packs, num_packs.load() );
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int read_index_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    uint64_t committed_idx = s1.raftServer->get_committed_log_idx();
+
+    // Drain the commit propagation so that no request is in flight.
+    while ( s1.fNet->getNumPendingReqs("S2") ||
+            s1.fNet->getNumPendingReqs("S3") ) {
+        s1.fNet->execReqResp();
+    }
+
+    // Only the leader can serve read index.
+    ptr< cmd_result<uint64_t> > ret_s2 = s2.raftServer->read_index();
+    CHK_EQ( cmd_result_code::NOT_LEADER, ret_s2->get_result_code() );
+
+    // The first caller starts a round immediately.
+    ptr< cmd_result<uint64_t> > ret1 = s1.raftServer->read_index();
+    CHK_TRUE( ret1->get_accepted() );
+    CHK_FALSE( ret1->has_result() );
+    CHK_EQ( 1, s1.fNet->getNumPendingReqs("S2") );
+    CHK_EQ( 1, s1.fNet->getNumPendingReqs("S3") );
+
+    // Callers during the round wait for the next one, together.
+    ptr< cmd_result<uint64_t> > ret2 = s1.raftServer->read_index();
+    ptr< cmd_result<uint64_t> > ret3 = s1.raftServer->read_index();
+    CHK_FALSE( ret2->has_result() );
+    CHK_FALSE( ret3->has_result() );
+
+    // One response is enough to confirm the leadership.
+    s1.fNet->execReqResp("S2");
+    CHK_EQ( cmd_result_code::OK, ret1->get_result_code() );
+    CHK_EQ( committed_idx, ret1->get() );
+    CHK_FALSE( ret2->has_result() );
+
+    // The response from S3 was sent before the next round started,
+    // so it should not be counted.
+    s1.fNet->execReqResp("S3");
+    CHK_FALSE( ret2->has_result() );
+    CHK_FALSE( ret3->has_result() );
+
+    s1.fNet->execReqResp();
+    CHK_EQ( cmd_result_code::OK, ret2->get_result_code() );
+    CHK_EQ( cmd_result_code::OK, ret3->get_result_code() );
+    CHK_EQ( committed_idx, ret2->get() );
+    CHK_EQ( committed_idx, ret3->get() );
+
+    // Read index can be used for waiting for the state machine.
+    ptr< cmd_result<bool> > wait_ret =
+        s2.raftServer->wait_for_state_machine_commit( ret3->get() );
+    CHK_TRUE( wait_ret->get() );
+
+    // Leadership loss cancels the pending read.
+    ptr< cmd_result<uint64_t> > ret4 = s1.raftServer->read_index();
+    CHK_FALSE( ret4->has_result() );
+    s1.raftServer->shutdown();
+    CHK_EQ( cmd_result_code::CANCELLED, ret4->get_result_code() );
+
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int follower_read_index_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    // Committed on S1, but S2 doesn't know it yet.
+    CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    s1.fNet->execReqResp("S2");
+    s1.fNet->execReqResp("S3");
+    CHK_Z( wait_for_sm_exec({&s1}, COMMIT_TIMEOUT_SEC) );
+    uint64_t committed_idx = s1.raftServer->get_committed_log_idx();
+    CHK_EQ( s1.raftServer->get_last_log_idx(), committed_idx );
+    CHK_GT( committed_idx, s2.raftServer->get_committed_log_idx() );
+
+    // Callers on S2 share the same request.
+    ptr< cmd_result<uint64_t> > ret1 = s2.raftServer->read_index_from_leader();
+    CHK_TRUE( ret1->get_accepted() );
+    CHK_EQ( 1, s2.fNet->getNumPendingReqs("S1") );
+    ptr< cmd_result<uint64_t> > ret2 = s2.raftServer->read_index_from_leader();
+    ptr< cmd_result<uint64_t> > ret3 = s2.raftServer->read_index_from_leader();
+    CHK_EQ( 1, s2.fNet->getNumPendingReqs("S1") );
+
+    // S1 cannot respond until it confirms the leadership.
+    s2.fNet->execReqResp("S1");
+    CHK_FALSE( ret1->has_result() );
+    CHK_EQ( 1, s2.fNet->getNumPendingResps("S1") );
+
+    // The round also delivers the commit index to S2.
+    while ( s1.fNet->getNumPendingReqs("S2") ||
+            s1.fNet->getNumPendingReqs("S3") ) {
+        s1.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // S2 waits for its state machine, which is already done.
+    s2.fNet->handleRespFrom("S1");
+    CHK_EQ( cmd_result_code::OK, ret1->get_result_code() );
+    CHK_EQ( committed_idx, ret1->get() );
+    CHK_FALSE( ret2->has_result() );
+    CHK_FALSE( ret3->has_result() );
+
+    // The next request for the others.
+    CHK_EQ( 1, s2.fNet->getNumPendingReqs("S1") );
+    s2.fNet->execReqResp("S1");
+    while ( s1.fNet->getNumPendingReqs("S2") ||
+            s1.fNet->getNumPendingReqs("S3") ) {
+        s1.fNet->execReqResp();
+    }
+    s2.fNet->handleRespFrom("S1");
+    CHK_EQ( cmd_result_code::OK, ret2->get_result_code() );
+    CHK_EQ( cmd_result_code::OK, ret3->get_result_code() );
+    CHK_EQ( committed_idx, ret2->get() );
+    CHK_EQ( committed_idx, ret3->get() );
+
+    // The leader itself.
+    ptr< cmd_result<uint64_t> > ret4 = s1.raftServer->read_index_from_leader();
+    CHK_FALSE( ret4->has_result() );
+    s1.fNet->execReqResp();
+    CHK_EQ( cmd_result_code::OK, ret4->get_result_code() );
+    CHK_EQ( committed_idx, ret4->get() );
+
+    // Leader is not reachable.
+    ptr< cmd_result<uint64_t> > ret5 = s3.raftServer->read_index_from_leader();
+    s3.fNet->makeReqFailAll("S1");
+    CHK_EQ( cmd_result_code::FAILED, ret5->get_result_code() );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int nested_read_index_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    CHK_Z( drain_and_commit(s1, pkgs) );
+    uint64_t committed_idx = s1.raftServer->get_committed_log_idx();
+
+    // The callback of a read on the follower issues another read,
+    // which should not be blocked by any lock held by the caller.
+    ptr< cmd_result<uint64_t> > nested_ret;
+    ptr< cmd_result<uint64_t> > ret1 = s2.raftServer->read_index_from_leader();
+    ret1->when_ready( [&s2, &nested_ret]( cmd_result<uint64_t>& res,
+                                          ptr<std::exception>& err ) {
+        nested_ret = s2.raftServer->read_index_from_leader();
+    } );
+
+    s2.fNet->execReqResp("S1");
+    while ( s1.fNet->getNumPendingReqs("S2") ||
+            s1.fNet->getNumPendingReqs("S3") ) {
+        s1.fNet->execReqResp();
+    }
+    s2.fNet->handleRespFrom("S1");
+    CHK_EQ( cmd_result_code::OK, ret1->get_result_code() );
+    CHK_EQ( committed_idx, ret1->get() );
+
+    // The nested read is sent as the next request.
+    CHK_NONNULL( nested_ret.get() );
+    CHK_TRUE( nested_ret->get_accepted() );
+    CHK_EQ( 1, s2.fNet->getNumPendingReqs("S1") );
+    s2.fNet->execReqResp("S1");
+    while ( s1.fNet->getNumPendingReqs("S2") ||
+            s1.fNet->getNumPendingReqs("S3") ) {
+        s1.fNet->execReqResp();
+    }
+    s2.fNet->handleRespFrom("S1");
+    CHK_EQ( cmd_result_code::OK, nested_ret->get_result_code() );
+    CHK_EQ( committed_idx, nested_ret->get() );
+
+    // Same on the leader.
+    ptr< cmd_result<uint64_t> > nested_ret2;
+    ptr< cmd_result<uint64_t> > ret2 = s1.raftServer->read_index_from_leader();
+    ret2->when_ready( [&s1, &nested_ret2]( cmd_result<uint64_t>& res,
+                                           ptr<std::exception>& err ) {
+        nested_ret2 = s1.raftServer->read_index_from_leader();
+    } );
+    s1.fNet->execReqResp();
+    CHK_EQ( cmd_result_code::OK, ret2->get_result_code() );
+    CHK_NONNULL( nested_ret2.get() );
+    s1.fNet->execReqResp();
+    CHK_EQ( cmd_result_code::OK, nested_ret2->get_result_code() );
+    CHK_EQ( committed_idx, nested_ret2->get() );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int append_dispatch_threads_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    const size_t NUM_SERVERS = 5;
+    std::vector<ptr<RaftPkg>> pkg_holders;
+    std::vector<RaftPkg*> pkgs;
+    for (size_t ii = 0; ii < NUM_SERVERS; ++ii) {
+        pkg_holders.push_back
+            ( cs_new<RaftPkg>(f_base, ii + 1, "S" + std::to_string(ii + 1)) );
+        pkgs.push_back(pkg_holders.back().get());
+    }
+    RaftPkg& s1 = *pkgs[0];
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.append_dispatch_threads_ = 2;
+        pp->raftServer->update_params(param);
+    }
+
+    // Log entries should be read and sent by the dispatcher threads,
+    // never by the thread that triggered the replication.
+    std::thread::id test_tid = std::this_thread::get_id();
+    std::atomic<size_t> num_sent_by_caller(0);
+    std::atomic<size_t> num_sent_by_dispatcher(0);
+    s1.ctx->set_cb_func([&](cb_func::Type t, cb_func::Param* p) -> cb_func::ReturnCode {
+        if (t == cb_func::SentAppendEntriesReq && p->ctx) {
+            req_msg* req = static_cast<req_msg*>(p->ctx);
+            if (!req->log_entries().empty()) {
+                if (std::this_thread::get_id() == test_tid) {
+                    num_sent_by_caller++;
+                } else {
+                    num_sent_by_dispatcher++;
+                }
+            }
+        }
+        return cb_default(t, p);
+    });
+
+    // Requests are sent by the dispatcher threads, not by this thread.
+    CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    TestSuite::Timer timer(COMMIT_TIMEOUT_SEC * 1000);
+    bool all_sent = false;
+    while (!all_sent && !timer.timeout()) {
+        all_sent = true;
+        for (size_t ii = 1; ii < NUM_SERVERS; ++ii) {
+            if (!s1.fNet->getNumPendingReqs(pkgs[ii]->myEndpoint)) {
+                all_sent = false;
+            }
+        }
+        if (!all_sent) TestSuite::sleep_ms(1);
+    }
+    CHK_TRUE( all_sent );
+
+    for (size_t ii = 0; ii < 10; ++ii) {
+        CHK_TRUE( append_one(s1, 10)->get_accepted() );
+    }
+
+    // Keep delivering requests until all the logs are replicated.
+    uint64_t last_log_idx = s1.raftServer->get_last_log_idx();
+    bool done = false;
+    timer.reset();
+    while (!done && !timer.timeout()) {
+        s1.fNet->execReqResp();
+        done = true;
+        for (RaftPkg* pp: pkgs) {
+            if (pp->raftServer->get_committed_log_idx() < last_log_idx) {
+                done = false;
+            }
+        }
+        if (!done) TestSuite::sleep_ms(1);
+    }
+    CHK_TRUE( done );
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    for (size_t ii = 1; ii < NUM_SERVERS; ++ii) {
+        CHK_OK( pkgs[ii]->getTestSm()->isSame( *s1.getTestSm() ) );
+    }
+    CHK_Z( num_sent_by_caller.load() );
+    CHK_GT( num_sent_by_dispatcher.load(), 0 );
+
+    for (RaftPkg* pp: pkgs) {
+        pp->raftServer->shutdown();
+    }
+    f_base->destroy();
+    return 0;
+}
+
+int group_commit_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.use_group_commit_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    // Slow down the drainer, so that the other callers are queued.
+    debugging_options::get_instance().handle_cli_req_sleep_us_ = 100 * 1000;
+    TestSuite::GcFunc gcf([](){ // Auto rollback.
+        debugging_options::get_instance().handle_cli_req_sleep_us_ = 0;
+    });
+
+    const size_t NUM_THREADS = 8;
+    uint64_t prev_last_idx = s1.raftServer->get_last_log_idx();
+    size_t prev_batches =
+        s1.getTestMgr()->get_inmem_log_store()->get_num_append_batches();
+
+    std::vector<ptr<raft_result>> results(NUM_THREADS);
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < NUM_THREADS; ++ii) {
+        threads.emplace_back([&s1, &results, ii]() {
+            results[ii] = append_one(s1, 10);
+        });
+    }
+    for (std::thread& tt: threads) {
+        tt.join();
+    }
+
+    // All requests are appended, each of them got its own result.
+    for (ptr<raft_result>& result: results) {
+        CHK_NONNULL( result );
+        CHK_TRUE( result->get_accepted() );
+    }
+    CHK_EQ( prev_last_idx + NUM_THREADS, s1.raftServer->get_last_log_idx() );
+
+    // Fewer append batches than requests.
+    size_t num_batches =
+        s1.getTestMgr()->get_inmem_log_store()->get_num_append_batches()
+        - prev_batches;
+    CHK_GT( num_batches, 0 );
+    CHK_SM( num_batches, NUM_THREADS );
+
+    CHK_Z( drain_and_commit(s1, pkgs) );
+    for (ptr<raft_result>& result: results) {
+        CHK_TRUE( result->has_result() );
+        CHK_EQ( cmd_result_code::OK, result->get_result_code() );
+    }
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int group_commit_partial_failure_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Appending a log of this size fails on the leader.
+    const size_t POISON_SIZE = 13;
+    auto poison_cb = [](cb_func::Type type, cb_func::Param* param) {
+        if (type == cb_func::Type::PreAppendLogLeader) {
+            ptr<log_entry>& entry = *static_cast<ptr<log_entry>*>(param->ctx);
+            if (entry->get_buf().size() == POISON_SIZE) {
+                throw std::runtime_error("poisoned log");
+            }
+        }
+        return cb_default(type, param);
+    };
+
+    CHK_Z( launch_servers( pkgs, nullptr, false, poison_cb ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.use_group_commit_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    // Slow down the drainer, so that the requests below are queued
+    // while the first one is being handled, and form the next group.
+    debugging_options::get_instance().handle_cli_req_sleep_us_ = 200 * 1000;
+    TestSuite::GcFunc gcf([](){ // Auto rollback.
+        debugging_options::get_instance().handle_cli_req_sleep_us_ = 0;
+    });
+
+    uint64_t prev_last_idx = s1.raftServer->get_last_log_idx();
+
+    // 0: the first drainer, 1: succeeds, 2: fails, 3: follows the failure.
+    const std::vector<size_t> sizes = {10, 10, POISON_SIZE, 10};
+    std::vector<ptr<raft_result>> results(sizes.size());
+    std::vector<int> exceptions(sizes.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < sizes.size(); ++ii) {
+        threads.emplace_back([&s1, &results, &exceptions, &sizes, ii]() {
+            try {
+                results[ii] = append_one(s1, sizes[ii]);
+            } catch (...) {
+                exceptions[ii] = 1;
+            }
+        });
+        // To keep the arrival order.
+        TestSuite::sleep_ms(20);
+    }
+    for (std::thread& tt: threads) {
+        tt.join();
+    }
+
+    // Requests before the failed one are appended as usual.
+    for (size_t ii = 0; ii < 2; ++ii) {
+        CHK_FALSE( exceptions[ii] );
+        CHK_NONNULL( results[ii].get() );
+        CHK_TRUE( results[ii]->get_accepted() );
+    }
+    // The failed one and the rest of its group get the exception.
+    for (size_t ii = 2; ii < sizes.size(); ++ii) {
+        CHK_TRUE( exceptions[ii] );
+        CHK_NULL( results[ii].get() );
+    }
+    CHK_EQ( prev_last_idx + 2, s1.raftServer->get_last_log_idx() );
+
+    // Appended ones should be committed and get their results.
+    CHK_Z( drain_and_commit(s1, pkgs) );
+    for (size_t ii = 0; ii < 2; ++ii) {
+        CHK_TRUE( results[ii]->has_result() );
+        CHK_EQ( cmd_result_code::OK, results[ii]->get_result_code() );
+    }
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
+int commit_ret_ring_overflow_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    RaftPkg s1(f_base, 1, "S1");
+    RaftPkg s2(f_base, 2, "S2");
+    RaftPkg s3(f_base, 3, "S3");
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    const size_t RING_SIZE = 64;
+    raft_params custom_params;
+    custom_params.with_election_timeout_lower(0);
+    custom_params.with_election_timeout_upper(10000);
+    custom_params.with_hb_interval(5000);
+    custom_params.with_client_req_timeout(1000000);
+    custom_params.with_reserved_log_items(0);
+    custom_params.with_snapshot_enabled(5);
+    custom_params.with_log_sync_stopping_gap(1);
+    // Small ring to see overflow.
+    custom_params.commit_ret_ring_size_ = RING_SIZE;
+
+    CHK_Z( launch_servers( pkgs, &custom_params ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.leadership_expiry_ = -1;
+        pp->raftServer->update_params(param);
+    }
+    CHK_EQ( 0, s1.raftServer->get_num_commit_ret_overflows() );
+
+    // More pending requests than the slots of the ring,
+    // the later ones should go to the overflow map.
+    const size_t NUM_REQS = RING_SIZE + 100;
+    std::vector<ptr<raft_result>> results;
+    for (size_t ii = 0; ii < NUM_REQS; ++ii) {
+        results.push_back( append_one(s1, 10) );
+        CHK_TRUE( results.back()->get_accepted() );
+    }
+    for (ptr<raft_result>& result: results) {
+        CHK_FALSE( result->has_result() );
+    }
+    CHK_EQ( NUM_REQS - RING_SIZE, s1.raftServer->get_num_commit_ret_overflows() );
+
+    uint64_t last_log_idx = s1.raftServer->get_last_log_idx();
+    TestSuite::Timer timer(COMMIT_TIMEOUT_SEC * 1000);
+    while ( s1.raftServer->get_committed_log_idx() < last_log_idx &&
+            !timer.timeout() ) {
+        s1.fNet->execReqResp();
+    }
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Every request got its own result.
+    for (ptr<raft_result>& result: results) {
+        CHK_TRUE( result->has_result() );
+        CHK_EQ( cmd_result_code::OK, result->get_result_code() );
+    }
+    CHK_EQ( 0, s1.raftServer->get_num_commit_ret_overflows() );
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    f_base->destroy();
+    return 0;
+}
+
 int uncommitted_log_entry_limit_rejects_client_appends_test() {
     reset_log_files();
     ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
@@ -2370,6 +3443,49 @@ int main(int argc, char** argv) {
     ts.doTest( "extended append_entries API test",
                extended_append_entries_api_test );
 
+    ts.doTest( "shared log entries among peers test",
+               shared_log_entries_among_peers_test );
+
+    ts.doTest( "replication cache test",
+               replication_cache_test );
+
+    ts.doTest( "replication window test",
+               replication_window_test );
+
+    ts.doTest( "adaptive append batch size test",
+               adaptive_append_batch_size_test );
+
+    ts.doTest( "follower group flush test",
+               follower_group_flush_test );
+
+    ts.doTest( "commit propagation delay test",
+               commit_propagation_delay_test );
+
+    ts.doTest( "bulk catch-up test",
+               bulk_catch_up_test,
+               TestRange<bool>( {true, false} ) );
+
+    ts.doTest( "read index test",
+               read_index_test );
+
+    ts.doTest( "follower read index test",
+               follower_read_index_test );
+
+    ts.doTest( "nested read index test",
+               nested_read_index_test );
+
+    ts.doTest( "append dispatch threads test",
+               append_dispatch_threads_test );
+
+    ts.doTest( "group commit test",
+               group_commit_test );
+
+    ts.doTest( "group commit partial failure test",
+               group_commit_partial_failure_test );
+
+    ts.doTest( "commit ret ring overflow test",
+               commit_ret_ring_overflow_test );
+
     ts.doTest( "uncommitted log entry limit rejects client appends test",
                uncommitted_log_entry_limit_rejects_client_appends_test );
 
@@ -25,6 +25,7 @@ limitations under the License.
 
 #include "test_common.h"
 
+#include <cstring>
 #include <random>
 
 using namespace nuraft;
@@ -56,6 +57,15 @@ int srv_config_test() {
 
     CHK_EQ( srv_conf->get_endpoint(), srv_conf1->get_endpoint() );
     CHK_EQ( srv_conf->get_id(), srv_conf1->get_id() );
+    CHK_FALSE( srv_conf1->is_witness() );
+
+    srv_conf->set_witness(true);
+    srv_conf->set_new_joiner(true);
+    srv_conf_buf = srv_conf->serialize();
+    ptr<srv_config> srv_conf2( srv_config::deserialize(*srv_conf_buf) );
+    CHK_TRUE( srv_conf2->is_witness() );
+    CHK_TRUE( srv_conf2->is_new_joiner() );
+    CHK_FALSE( srv_conf2->is_learner() );
 
     return 0;
 }
@@ -168,6 +178,17 @@ int snapshot_sync_req_test(bool done) {
         CHK_EQ( *(d + i), *(d1 + i) );
     }
 
+    // If deserialized from `ptr<buffer>`, data should refer to it.
+    buffer_serializer bs(sync_req_buf);
+    ptr<snapshot_sync_req> sync_req2 = snapshot_sync_req::deserialize(bs);
+    buffer& buf2 = sync_req2->get_data();
+    CHK_TRUE( buf2.is_slice() );
+    CHK_Z( buf2.pos() );
+    CHK_EQ( rnd_buf->size(), buf2.size() );
+    CHK_EQ( sync_req_buf->data_begin() + sync_req_buf->size() - buf2.size(),
+            buf2.data_begin() );
+    CHK_Z( memcmp( rnd_buf->data_begin(), buf2.data_begin(), buf2.size() ) );
+
     return 0;
 }
 
@@ -222,6 +243,15 @@ int log_entry_test() {
     ptr<buffer> buf2 = entry->serialize();
     CHK_Z(compare_log_entries(entry, log_entry::deserialize(*buf2)));
 
+    // Deserialize without copying the data.
+    buf2->pos(0);
+    entry->get_buf().pos(0);
+    ptr<log_entry> entry_slice = log_entry::deserialize(buf2);
+    CHK_TRUE( entry_slice->get_buf().is_slice() );
+    CHK_EQ( buf2->data_begin() + sizeof(ulong) + sizeof(byte),
+            entry_slice->get_buf().data_begin() );
+    CHK_Z(compare_log_entries(entry, entry_slice));
+
     // Change the data buffer in log_entry and check if everything is equal
     ptr<buffer> data2 = buffer::alloc(24 + rnd() % 100);
     for (size_t i = 0; i < data2->size(); ++i) {
@@ -238,6 +268,39 @@ int log_entry_test() {
     return 0;
 }
 
+int crc32c_test() {
+    // Check value of CRC-32C.
+    const char* check_str = "123456789";
+    CHK_EQ( 0xE3069283, crc32c(check_str, 9, 0) );
+    CHK_EQ( 0xE3069283, crc32c_sw(check_str, 9, 0) );
+    TestSuite::_msg("CRC-32C implementation: %s\n", crc32c_impl_name());
+
+    // Hardware implementation should be identical to software one,
+    // for various sizes and alignments, including the ones processed
+    // by multiple streams.
+    const size_t MAX_SIZE = 3 * 8192 * 2 + 3 * 256 + 100;
+    std::vector<uint8_t> data(MAX_SIZE + 8);
+    for (size_t ii = 0; ii < data.size(); ++ii) {
+        data[ii] = static_cast<uint8_t>( rnd() % 256 );
+    }
+    std::vector<size_t> sizes = { 0, 1, 7, 8, 15, 255, 256, 767, 768, 769,
+                                  3 * 256 * 2 + 13, 3 * 8192 - 1, 3 * 8192,
+                                  3 * 8192 + 3 * 256 + 5, MAX_SIZE };
+    for (size_t size: sizes) {
+        for (size_t offset = 0; offset < 8; offset += 3) {
+            const uint8_t* ptr = data.data() + offset;
+            CHK_EQ( crc32c_sw(ptr, size, 0), crc32c(ptr, size, 0) );
+
+            // Chaining should give the same result.
+            size_t half = size / 2;
+            uint32_t chained = crc32c(ptr, half, 0);
+            chained = crc32c(ptr + half, size - half, chained);
+            CHK_EQ( crc32c(ptr, size, 0), chained );
+        }
+    }
+    return 0;
+}
+
 int custom_notification_msg_test(bool empty_context) {
     custom_notification_msg orig_msg;
     orig_msg.type_ = custom_notification_msg::out_of_log_range_warning;
@@ -297,6 +360,7 @@ int main(int argc, char** argv) {
                snapshot_sync_req_zero_buffer_test,
                TestRange<bool>( {true, false} ) );
     ts.doTest( "log_entry test", log_entry_test );
+    ts.doTest( "crc32c test", crc32c_test );
     ts.doTest( "custom_notification_msg test",
                custom_notification_msg_test,
                TestRange<bool>( {true, false} ) );